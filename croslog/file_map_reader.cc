@@ -256,7 +256,9 @@ std::unique_ptr<FileMapReader::MappedBuffer> FileMapReader::MapBuffer(
   DCHECK_LE(request_pos + request_length, file_size_);
 
   // Ensure that the previous mapped buffer has already been freed.
-  DCHECK(!instantiated_mapped_buffer_);
+  // MaybeValid() is used since the reader may be used from a prefetch thread
+  // of Multiplexer. The accesses never overlap.
+  DCHECK(!instantiated_mapped_buffer_.MaybeValid());
 
   // Reuse the previous mapped buffer if the request range is contained by the
   // previous mapped range.
@@ -296,7 +298,7 @@ FileMapReader::CreateMappedBuffer() {
   // Ensure that the previous mapped buffer has already been freed.
   // Note: The current implementation allows only one mapped buffer at the same
   // time.
-  DCHECK(!instantiated_mapped_buffer_);
+  DCHECK(!instantiated_mapped_buffer_.MaybeValid());
 
   // Doesn't use std::make_unique due to the private constructor.
   auto mapped_buffer = std::unique_ptr<MappedBuffer>(
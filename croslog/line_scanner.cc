@@ -0,0 +1,111 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/line_scanner.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace croslog {
+
+namespace {
+
+constexpr uint8_t kLf = '\n';
+
+#if defined(__AVX2__)
+constexpr size_t kVectorSize = 32;
+
+// Returns a bitmask of the LF positions in the |kVectorSize| bytes at |p|.
+inline uint32_t NewlineMask(const uint8_t* p) {
+  const __m256i chunk =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(kLf))));
+}
+#elif defined(__SSE2__)
+constexpr size_t kVectorSize = 16;
+
+inline uint32_t NewlineMask(const uint8_t* p) {
+  const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(kLf))));
+}
+#elif defined(__ARM_NEON)
+constexpr size_t kVectorSize = 16;
+
+// NEON has no movemask. Narrows each byte of the comparison to 4 bits, and
+// folds the nibbles into one bit per byte.
+inline uint32_t NewlineMask(const uint8_t* p) {
+  const uint8x16_t eq = vceqq_u8(vld1q_u8(p), vdupq_n_u8(kLf));
+  const uint64_t nibbles = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+  if (nibbles == 0)
+    return 0;
+  uint32_t mask = 0;
+  for (size_t i = 0; i < kVectorSize; i++)
+    mask |= static_cast<uint32_t>((nibbles >> (i * 4)) & 1) << i;
+  return mask;
+}
+#else
+constexpr size_t kVectorSize = 0;
+#endif
+
+}  // namespace
+
+const uint8_t* FindNewline(const uint8_t* begin, const uint8_t* end) {
+  const uint8_t* p = begin;
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+  for (; static_cast<size_t>(end - p) >= kVectorSize; p += kVectorSize) {
+    const uint32_t mask = NewlineMask(p);
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < end; p++) {
+    if (*p == kLf)
+      return p;
+  }
+  return nullptr;
+}
+
+const uint8_t* FindLastNewline(const uint8_t* begin, const uint8_t* end) {
+  const uint8_t* p = end;
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+  for (; static_cast<size_t>(p - begin) >= kVectorSize; p -= kVectorSize) {
+    const uint32_t mask = NewlineMask(p - kVectorSize);
+    if (mask != 0)
+      return p - kVectorSize + (31 - __builtin_clz(mask));
+  }
+#endif
+  while (p > begin) {
+    p--;
+    if (*p == kLf)
+      return p;
+  }
+  return nullptr;
+}
+
+size_t FindLineSpans(const uint8_t* buffer,
+                     size_t size,
+                     size_t max_lines,
+                     std::vector<LineSpan>* spans) {
+  const uint8_t* const end = buffer + size;
+  const uint8_t* line_start = buffer;
+  for (size_t i = 0; i < max_lines; i++) {
+    const uint8_t* lf = FindNewline(line_start, end);
+    if (lf == nullptr)
+      break;
+    spans->push_back({static_cast<size_t>(line_start - buffer),
+                      static_cast<size_t>(lf - line_start)});
+    line_start = lf + 1;
+  }
+  return line_start - buffer;
+}
+
+}  // namespace croslog
@@ -0,0 +1,39 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CROSLOG_LINE_SCANNER_H_
+#define CROSLOG_LINE_SCANNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace croslog {
+
+// Position and length of a line in a buffer, without the trailing LF.
+struct LineSpan {
+  size_t offset;
+  size_t length;
+};
+
+// Returns the pointer to the first LF in [begin, end), or nullptr if there is
+// no LF. The buffer is scanned with SSE2/AVX2 or NEON when available.
+const uint8_t* FindNewline(const uint8_t* begin, const uint8_t* end);
+
+// Returns the pointer to the last LF in [begin, end), or nullptr if there is
+// no LF.
+const uint8_t* FindLastNewline(const uint8_t* begin, const uint8_t* end);
+
+// Appends the spans of the complete (LF-terminated) lines in [buffer,
+// buffer + size) to |spans|, up to |max_lines| lines. Returns the number of
+// bytes consumed, which is the position just after the last LF found.
+size_t FindLineSpans(const uint8_t* buffer,
+                     size_t size,
+                     size_t max_lines,
+                     std::vector<LineSpan>* spans);
+
+}  // namespace croslog
+
+#endif  // CROSLOG_LINE_SCANNER_H_
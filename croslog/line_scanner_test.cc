@@ -0,0 +1,94 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "croslog/line_scanner.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace croslog {
+
+namespace {
+
+const uint8_t* Data(const std::string& s) {
+  return reinterpret_cast<const uint8_t*>(s.data());
+}
+
+}  // anonymous namespace
+
+TEST(LineScannerTest, FindNewline) {
+  // Longer than a vector register to exercise both the vector loop and the
+  // scalar tail.
+  for (size_t size = 0; size < 100; size++) {
+    for (size_t lf = 0; lf <= size; lf++) {
+      std::string s(size, 'a');
+      if (lf < size)
+        s[lf] = '\n';
+      const uint8_t* begin = Data(s);
+      const uint8_t* end = begin + s.size();
+
+      const uint8_t* expected = lf < size ? begin + lf : nullptr;
+      EXPECT_EQ(expected, FindNewline(begin, end));
+      EXPECT_EQ(expected, FindLastNewline(begin, end));
+    }
+  }
+}
+
+TEST(LineScannerTest, FindFirstAndLastNewline) {
+  const std::string s = std::string(40, 'a') + "\n" + std::string(40, 'b') +
+                        "\n" + std::string(40, 'c');
+  const uint8_t* begin = Data(s);
+  const uint8_t* end = begin + s.size();
+
+  EXPECT_EQ(begin + 40, FindNewline(begin, end));
+  EXPECT_EQ(begin + 81, FindLastNewline(begin, end));
+  EXPECT_EQ(begin + 81, FindNewline(begin + 41, end));
+  EXPECT_EQ(begin + 40, FindLastNewline(begin, begin + 81));
+}
+
+TEST(LineScannerTest, FindLineSpans) {
+  const std::string s = "AAA\n\nBBBB\nCC";
+  std::vector<LineSpan> spans;
+
+  EXPECT_EQ(10u, FindLineSpans(Data(s), s.size(), 100, &spans));
+  ASSERT_EQ(3u, spans.size());
+  EXPECT_EQ("AAA", s.substr(spans[0].offset, spans[0].length));
+  EXPECT_EQ("", s.substr(spans[1].offset, spans[1].length));
+  EXPECT_EQ("BBBB", s.substr(spans[2].offset, spans[2].length));
+
+  // Limited by |max_lines|.
+  spans.clear();
+  EXPECT_EQ(4u, FindLineSpans(Data(s), s.size(), 1, &spans));
+  ASSERT_EQ(1u, spans.size());
+  EXPECT_EQ("AAA", s.substr(spans[0].offset, spans[0].length));
+
+  // No complete line.
+  spans.clear();
+  EXPECT_EQ(0u, FindLineSpans(Data(s), 3, 100, &spans));
+  EXPECT_TRUE(spans.empty());
+}
+
+TEST(LineScannerTest, FindLineSpansOfLongLines) {
+  // Lines longer than a vector register, scanned in two calls which append to
+  // the same spans.
+  const std::string s = std::string(70, 'a') + "\n" + std::string(33, 'b') +
+                        "\n" + std::string(100, 'c') + "\n" + "d";
+  std::vector<LineSpan> spans;
+
+  size_t consumed = FindLineSpans(Data(s), s.size(), 2, &spans);
+  EXPECT_EQ(105u, consumed);
+  consumed += FindLineSpans(Data(s) + consumed, s.size() - consumed, 100,
+                            &spans);
+  EXPECT_EQ(s.size() - 1, consumed);
+  ASSERT_EQ(3u, spans.size());
+  EXPECT_EQ(std::string(70, 'a'), s.substr(spans[0].offset, spans[0].length));
+  EXPECT_EQ(std::string(33, 'b'), s.substr(spans[1].offset, spans[1].length));
+  // Offsets are relative to the buffer given to each call.
+  EXPECT_EQ(0u, spans[2].offset);
+  EXPECT_EQ(100u, spans[2].length);
+}
+
+}  // namespace croslog
@@ -105,6 +105,59 @@ void LogEntryReader::SetPositionLast() {
   line_reader_.SetPositionLast();
 }
 
+void LogEntryReader::SeekToTime(base::Time time) {
+  next_entry_.reset();
+
+  // Offsets in the index point into the old file after rotation.
+  if (index_rotation_count_ != line_reader_.rotation_count()) {
+    index_.clear();
+    index_rotation_count_ = line_reader_.rotation_count();
+  }
+
+  // Finds the smallest offset whose next entry is not older than |time|.
+  int64_t low = 0;
+  int64_t high = line_reader_.file_size();
+  std::optional<IndexEntry> found;
+  while (low < high) {
+    int64_t mid = low + (high - low) / 2;
+    std::optional<IndexEntry> entry = ProbeEntryAt(mid);
+    if (entry.has_value() && entry->time < time) {
+      // Every entry before |entry| is older as well.
+      low = entry->position + 1;
+    } else {
+      high = mid;
+      found = entry;
+    }
+  }
+
+  line_reader_.SetPosition(found.has_value() ? found->position
+                                             : line_reader_.file_size());
+}
+
+std::optional<LogEntryReader::IndexEntry> LogEntryReader::ProbeEntryAt(
+    int64_t pos) {
+  auto it = index_.find(pos);
+  if (it != index_.end())
+    return it->second;
+
+  line_reader_.SetPosition(pos);
+  while (true) {
+    int64_t line_start = line_reader_.position();
+    auto [line, result] = line_reader_.Forward();
+    if (result != LogLineReader::ReadResult::NO_ERROR) {
+      // Don't index the end of the file, since the file may be appended.
+      return std::nullopt;
+    }
+
+    MaybeLogEntry entry = parser_->Parse(std::move(line));
+    if (entry.has_value()) {
+      IndexEntry index_entry = {line_start, entry->time()};
+      index_.emplace(pos, index_entry);
+      return index_entry;
+    }
+  }
+}
+
 void LogEntryReader::AddObserver(LogLineReader::Observer* obs) {
   line_reader_.AddObserver(obs);
 }
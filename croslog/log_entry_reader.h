@@ -5,11 +5,14 @@
 #ifndef CROSLOG_LOG_ENTRY_READER_H_
 #define CROSLOG_LOG_ENTRY_READER_H_
 
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/time/time.h"
 
 #include "croslog/log_entry.h"
 #include "croslog/log_line_reader.h"
@@ -40,20 +43,46 @@ class LogEntryReader {
 
   // Moves the current position to the current end of the file.
   void SetPositionLast();
+  // Moves the current position to the first entry whose time is equal to or
+  // later than |time|, or to the end of the file if there is no such entry.
+  // This bisects the file by offset, assuming the entries are written in
+  // chronological order, so only a few entries are parsed. The probed
+  // positions are kept in a sparse index and reused by the later seeks.
+  void SeekToTime(base::Time time);
 
   // Returns the file path of the target.
   const base::FilePath& file_path() const { return file_path_; }
 
+  // Returns true if the file has been rotated and the next read may reopen
+  // the file.
+  bool rotated() const { return line_reader_.rotated(); }
+
   // Add a observer to retrieve file change events.
   void AddObserver(LogLineReader::Observer* obs);
   // Remove a observer to retrieve file change events.
   void RemoveObserver(LogLineReader::Observer* obs);
 
  private:
+  // The first entry which starts at or after a probed offset.
+  struct IndexEntry {
+    int64_t position;
+    base::Time time;
+  };
+
+  // Returns the first entry which starts at or after |pos|, or nullopt if
+  // there is no parsable line till the end of the file. Moves the current
+  // position.
+  std::optional<IndexEntry> ProbeEntryAt(int64_t pos);
+
   base::FilePath file_path_;
   LogLineReader line_reader_;
   MaybeLogEntry next_entry_;
   std::unique_ptr<LogParser> parser_;
+
+  // Sparse index from a probed offset to the entry found there. Built lazily
+  // by SeekToTime() and invalidated when the file is rotated.
+  std::map<int64_t, IndexEntry> index_;
+  uint64_t index_rotation_count_ = 0;
 };
 
 }  // namespace croslog
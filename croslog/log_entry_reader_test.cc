@@ -110,4 +110,47 @@ TEST_F(LogEntryReaderTest, InterleaveGetNextEntryAndGetPreviousEntry) {
   EXPECT_FALSE(reader.GetNextEntry().has_value());
 }
 
+TEST_F(LogEntryReaderTest, SeekToTime) {
+  LogEntryReader reader(base::FilePath("./testdata/TEST_MULTILINE_LOG"),
+                        std::make_unique<LogParserSyslog>(), false);
+
+  base::Time time;
+  EXPECT_TRUE(base::Time::FromString("2020-07-03T00:00:00.000000Z", &time));
+  reader.SeekToTime(time);
+  {
+    MaybeLogEntry e = reader.GetNextEntry();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(2, e->pid());
+    EXPECT_EQ("aaa\n\nccc\n", e->message());
+  }
+
+  // Exactly at the time of the entry.
+  EXPECT_TRUE(base::Time::FromString("2020-07-03T16:23:24.000000Z", &time));
+  reader.SeekToTime(time);
+  {
+    MaybeLogEntry e = reader.GetNextEntry();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(3, e->pid());
+  }
+
+  // Older than all the entries.
+  EXPECT_TRUE(base::Time::FromString("2000-01-01T00:00:00.000000Z", &time));
+  reader.SeekToTime(time);
+  {
+    MaybeLogEntry e = reader.GetNextEntry();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(1, e->pid());
+  }
+
+  // Newer than all the entries.
+  EXPECT_TRUE(base::Time::FromString("2030-01-01T00:00:00.000000Z", &time));
+  reader.SeekToTime(time);
+  EXPECT_FALSE(reader.GetNextEntry().has_value());
+  {
+    MaybeLogEntry e = reader.GetPreviousEntry();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(3, e->pid());
+  }
+}
+
 }  // namespace croslog
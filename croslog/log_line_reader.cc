@@ -19,6 +19,7 @@
 #include "base/strings/string_util.h"
 
 #include "croslog/file_map_reader.h"
+#include "croslog/line_scanner.h"
 
 #include <base/check.h>
 #include <base/check_op.h>
@@ -105,8 +106,10 @@ void LogLineReader::SetPositionLast() {
   CHECK(buffer->valid()) << "Mmap failed. Maybe the file has been truncated.";
 
   // Traverses in reverse order to find the last LF.
-  while (pos_ > pos_traversal_start && buffer->GetChar(pos_ - 1) != '\n')
-    pos_--;
+  auto raw = buffer->GetBuffer(pos_traversal_start, traversal_length);
+  const uint8_t* last_lf = FindLastNewline(raw.first, raw.first + raw.second);
+  pos_ = last_lf ? pos_traversal_start + (last_lf - raw.first) + 1
+                 : pos_traversal_start;
 
   if (pos_ != 0 && pos_ <= pos_traversal_start) {
     LOG(ERROR) << "The last line is too long to handle (more than: "
@@ -117,6 +120,45 @@ void LogLineReader::SetPositionLast() {
   }
 }
 
+void LogLineReader::SetPosition(int64_t pos) {
+  const int64_t file_size = reader_->GetFileSize();
+  if (pos <= 0 || pos >= file_size) {
+    pos_ = std::clamp(pos, INT64_C(0), file_size);
+    return;
+  }
+
+  // The line starts at |pos| if the previous character is LF. Otherwise,
+  // traverses to the next LF to find the beginning of the next line.
+  int64_t pos_traversal_start = pos - 1;
+  int64_t traversal_length =
+      std::min(g_max_line_length + 1, file_size - pos_traversal_start);
+  int64_t pos_traversal_end = pos_traversal_start + traversal_length;
+
+  auto buffer = reader_->MapBuffer(pos_traversal_start, traversal_length);
+  if (!buffer->valid()) {
+    LOG(ERROR) << "Mmap failed. Maybe the file has been truncated.";
+    pos_ = file_size;
+    return;
+  }
+
+  auto raw = buffer->GetBuffer(pos_traversal_start, traversal_length);
+  const uint8_t* lf = FindNewline(raw.first, raw.first + raw.second);
+
+  if (lf == nullptr) {
+    if (pos_traversal_end != file_size) {
+      LOG(ERROR) << "A line is too long to handle (more than "
+                 << g_max_line_length
+                 << "bytes). Lines around here may be broken.";
+    }
+    // No LF till EOF, or the line is too long. Sets the position to the end of
+    // the traversal as a sloppy solution.
+    pos_ = pos_traversal_end;
+    return;
+  }
+
+  pos_ = pos_traversal_start + (lf - raw.first) + 1;
+}
+
 // Ensure the file path is initialized.
 void LogLineReader::ReloadRotatedFile() {
   CHECK(backend_mode_ == Backend::FILE_FOLLOW);
@@ -125,6 +167,7 @@ void LogLineReader::ReloadRotatedFile() {
   DCHECK(PathExists(file_path_));
 
   rotated_ = false;
+  rotation_count_++;
 
   CHECK(file_change_watcher_);
   file_change_watcher_->RemoveWatch(file_path_);
@@ -184,12 +227,9 @@ std::tuple<std::string, LogLineReader::ReadResult> LogLineReader::Forward() {
   }
 
   // Finds the next LF (end of line).
-  int64_t pos_line_end = pos_;
-
-  while (pos_line_end < pos_traversal_end &&
-         buffer->GetChar(pos_line_end) != '\n') {
-    pos_line_end++;
-  }
+  auto raw = buffer->GetBuffer(pos_, traversal_length);
+  const uint8_t* lf = FindNewline(raw.first, raw.first + raw.second);
+  int64_t pos_line_end = lf ? pos_ + (lf - raw.first) : pos_traversal_end;
 
   if (pos_line_end == reader_->GetFileSize()) {
     // Reaches EOF without '\n'.
@@ -263,11 +303,10 @@ std::tuple<std::string, LogLineReader::ReadResult> LogLineReader::Backward() {
   }
 
   // Finds the next LF (at the beginning of the line).
-  int64_t last_start = pos_ - 1;
-  while (last_start > pos_traversal_start &&
-         buffer->GetChar(last_start - 1) != '\n') {
-    last_start--;
-  }
+  auto raw = buffer->GetBuffer(pos_traversal_start, traversal_length - 1);
+  const uint8_t* last_lf = FindLastNewline(raw.first, raw.first + raw.second);
+  int64_t last_start = last_lf ? pos_traversal_start + (last_lf - raw.first) + 1
+                               : pos_traversal_start;
 
   // Ensures the next LF is found.
   if (last_start != 0 && last_start <= pos_traversal_start) {
@@ -307,6 +346,9 @@ void LogLineReader::OnFileContentMaybeChanged() {
   CHECK(backend_mode_ == Backend::FILE_FOLLOW);
   CHECK(file_.IsValid());
 
+  for (Observer& obs : observers_)
+    obs.OnFileWillChange(this);
+
   // We didn't consider the case of content change without size change. It
   // shouldn't happen with normal log files.
 
@@ -328,6 +370,9 @@ void LogLineReader::OnFileNameMaybeChanged() {
   if (rotated_)
     return;
 
+  for (Observer& obs : observers_)
+    obs.OnFileWillChange(this);
+
   if (!PathExists(file_path_)) {
     rotated_ = true;
   } else {
@@ -31,6 +31,9 @@ class LogLineReader : public FileChangeWatcher::Observer {
  public:
   class Observer : public base::CheckedObserver {
    public:
+    // Called just before the reader applies the change of the file, so that
+    // the observer can stop using the reader from other threads.
+    virtual void OnFileWillChange(LogLineReader* reader) {}
     virtual void OnFileChanged(LogLineReader* reader) = 0;
   };
 
@@ -70,6 +73,9 @@ class LogLineReader : public FileChangeWatcher::Observer {
 
   // Set the position to read last.
   void SetPositionLast();
+  // Set the position to the beginning of the first line which starts at or
+  // after |pos|. |pos| is clamped into the range of the file.
+  void SetPosition(int64_t pos);
   // Add a observer to retrieve file change events.
   void AddObserver(Observer* obs);
   // Remove a observer to retrieve file change events.
@@ -78,9 +84,20 @@ class LogLineReader : public FileChangeWatcher::Observer {
   // Retrieve the current position in bytes.
   off_t position() const { return pos_; }
 
+  // Retrieve the size of the file in bytes at the last map.
+  int64_t file_size() const { return reader_->GetFileSize(); }
+
   // Returns the file path of the target.
   const base::FilePath& file_path() const { return file_path_; }
 
+  // Returns how many times the rotated file has been reloaded. Positions
+  // retrieved before this value changes point into the old file.
+  uint64_t rotation_count() const { return rotation_count_; }
+
+  // Returns true if the file has been rotated but the new file has not been
+  // opened yet. The new file is opened by Forward() on reaching EOF.
+  bool rotated() const { return rotated_; }
+
  private:
   void ReloadRotatedFile();
   void OnFileContentMaybeChanged() override;
@@ -103,6 +120,7 @@ class LogLineReader : public FileChangeWatcher::Observer {
   std::unique_ptr<FileMapReader> reader_;
   const Backend backend_mode_;
   bool rotated_ = false;
+  uint64_t rotation_count_ = 0;
 
   // Position of the current read.
   // - Usually be at the first character of line. But it's not when the line is
@@ -0,0 +1,108 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of line splitting over the files in the test data directory:
+// croslog::LogLineReader::Forward(), which reads the file one line at a time,
+// and croslog::FindLineSpans(), which scans the complete lines of a buffer
+// already in memory.
+//
+// Usage: log_line_reader_benchmark [testdata_dir] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "base/files/file_enumerator.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/time/time.h"
+
+#include "croslog/line_scanner.h"
+#include "croslog/log_line_reader.h"
+
+namespace {
+
+constexpr int kDefaultIterations = 10000;
+constexpr size_t kLinesPerCall = 256;
+
+// Reads all the lines of |path| |iterations| times, and returns the number of
+// lines read. Stores the elapsed time in |elapsed|.
+uint64_t ReadLines(const base::FilePath& path,
+                   int iterations,
+                   base::TimeDelta* elapsed) {
+  croslog::LogLineReader reader(croslog::LogLineReader::Backend::FILE);
+  reader.OpenFile(path);
+
+  uint64_t num_lines = 0;
+  const base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < iterations; i++) {
+    reader.SetPosition(0);
+    while (std::get<1>(reader.Forward()) ==
+           croslog::LogLineReader::ReadResult::NO_ERROR) {
+      num_lines++;
+    }
+  }
+  *elapsed += base::TimeTicks::Now() - start;
+  return num_lines;
+}
+
+// Scans the complete lines of the contents of |path| |iterations| times, and
+// returns the number of lines found. Stores the elapsed time in |elapsed|.
+uint64_t ScanLines(const base::FilePath& path,
+                   int iterations,
+                   base::TimeDelta* elapsed) {
+  std::string contents;
+  CHECK(base::ReadFileToString(path, &contents)) << path.value();
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.data());
+
+  uint64_t num_lines = 0;
+  std::vector<croslog::LineSpan> spans;
+  const base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < iterations; i++) {
+    size_t offset = 0;
+    while (true) {
+      spans.clear();
+      offset += croslog::FindLineSpans(data + offset, contents.size() - offset,
+                                       kLinesPerCall, &spans);
+      if (spans.empty())
+        break;
+      num_lines += spans.size();
+    }
+  }
+  *elapsed += base::TimeTicks::Now() - start;
+  return num_lines;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const base::FilePath testdata_dir(argc > 1 ? argv[1] : "./testdata");
+  const int iterations =
+      argc > 2 ? strtol(argv[2], nullptr, 0) : kDefaultIterations;
+
+  printf("%-32s %16s %18s\n", "file", "Forward l/s", "FindLineSpans l/s");
+  base::TimeDelta total_elapsed[2];
+  uint64_t total_lines[2] = {0, 0};
+  base::FileEnumerator files(testdata_dir, false, base::FileEnumerator::FILES);
+  for (base::FilePath path = files.Next(); !path.empty(); path = files.Next()) {
+    base::TimeDelta elapsed[2];
+    uint64_t num_lines[2] = {ReadLines(path, iterations, &elapsed[0]),
+                             ScanLines(path, iterations, &elapsed[1])};
+    for (int i = 0; i < 2; i++) {
+      total_lines[i] += num_lines[i];
+      total_elapsed[i] += elapsed[i];
+    }
+    printf("%-32s %16.0f %18.0f\n", path.BaseName().value().c_str(),
+           num_lines[0] / elapsed[0].InSecondsF(),
+           num_lines[1] / elapsed[1].InSecondsF());
+  }
+  printf("%-32s %16.0f %18.0f\n", "total",
+         total_lines[0] / total_elapsed[0].InSecondsF(),
+         total_lines[1] / total_elapsed[1].InSecondsF());
+  return 0;
+}
@@ -142,6 +142,34 @@ TEST_F(LogLineReaderTest, Forward) {
   }
 }
 
+TEST_F(LogLineReaderTest, SetPosition) {
+  LogLineReader reader(LogLineReader::Backend::MEMORY_FOR_TEST);
+  SetLogContentText(&reader, "AAA\nBBB\nCCC");
+
+  // At the beginning of a line.
+  reader.SetPosition(4);
+  EXPECT_EQ(4, reader.position());
+  EXPECT_EQ("BBB", std::get<0>(reader.Forward()));
+
+  // In the middle of a line.
+  reader.SetPosition(5);
+  EXPECT_EQ(8, reader.position());
+
+  // At the LF.
+  reader.SetPosition(3);
+  EXPECT_EQ(4, reader.position());
+
+  // In the last line without LF.
+  reader.SetPosition(9);
+  EXPECT_EQ(11, reader.position());
+
+  // Out of the range.
+  reader.SetPosition(-1);
+  EXPECT_EQ(0, reader.position());
+  reader.SetPosition(100);
+  EXPECT_EQ(11, reader.position());
+}
+
 TEST_F(LogLineReaderTest, Backward) {
   {
     LogLineReader reader(LogLineReader::Backend::FILE);
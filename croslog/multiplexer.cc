@@ -4,9 +4,11 @@
 
 #include "croslog/multiplexer.h"
 
+#include <algorithm>
 #include <optional>
 #include <utility>
 
+#include "base/bind.h"
 #include "base/strings/string_util.h"
 
 #include "croslog/log_parser_syslog.h"
@@ -15,29 +17,69 @@
 
 namespace croslog {
 
+namespace {
+
+// Number of entries parsed at once on the prefetch thread.
+constexpr size_t kPrefetchBatchSize = 256;
+// Maximum number of prefetched entries per source.
+constexpr size_t kMaxPrefetchedEntries = 4 * kPrefetchBatchSize;
+
+}  // namespace
+
 Multiplexer::LogSource::LogSource(base::FilePath log_file,
                                   std::unique_ptr<LogParser> parser_in,
-                                  bool install_change_watcher)
-    : reader(log_file, std::move(parser_in), install_change_watcher) {}
+                                  bool install_change_watcher,
+                                  size_t index,
+                                  bool pipelined)
+    : reader(log_file, std::move(parser_in), install_change_watcher),
+      index(index),
+      prefetch_done(base::WaitableEvent::ResetPolicy::MANUAL,
+                    base::WaitableEvent::InitialState::NOT_SIGNALED) {
+  if (pipelined) {
+    prefetch_thread = std::make_unique<base::Thread>("croslog_prefetch");
+    CHECK(prefetch_thread->Start());
+  }
+}
 
 Multiplexer::Multiplexer() = default;
 
+void Multiplexer::SetPipelined(bool pipelined) {
+  CHECK(sources_.empty());
+  pipelined_ = pipelined;
+}
+
 void Multiplexer::AddSource(base::FilePath log_file,
                             std::unique_ptr<LogParser> parser,
                             bool install_change_watcher) {
   auto source = std::make_unique<LogSource>(
-      std::move(log_file), std::move(parser), install_change_watcher);
+      std::move(log_file), std::move(parser), install_change_watcher,
+      sources_.size(), pipelined_);
   source->reader.AddObserver(this);
   sources_.emplace_back(std::move(source));
 }
 
+void Multiplexer::OnFileWillChange(LogLineReader* reader) {
+  for (auto&& source : sources_) {
+    if (source->reader.file_path() != reader->file_path())
+      continue;
+
+    // The reader must not be used on the prefetch thread during the change.
+    WaitForPrefetch(source.get());
+  }
+}
+
 void Multiplexer::OnFileChanged(LogLineReader* reader) {
   for (auto&& source : sources_) {
     if (source->reader.file_path() != reader->file_path())
       continue;
 
     // Invalidate caches, since the backed buffer may be invalid.
-    if (source->cache_next_backward.has_value()) {
+    WaitForPrefetch(source.get());
+    if (!source->prefetched.empty()) {
+      // Only the last read entry may be followed by the appended lines.
+      source->prefetched.pop_back();
+      source->reader.GetPreviousEntry();
+    } else if (source->cache_next_backward.has_value()) {
       CHECK(!source->cache_next_forward.has_value());
       source->cache_next_backward.reset();
       source->reader.GetNextEntry();
@@ -46,11 +88,104 @@ void Multiplexer::OnFileChanged(LogLineReader* reader) {
       source->reader.GetPreviousEntry();
     }
   }
+  RebuildForwardHeap();
 
   for (Observer& obs : observers_)
     obs.OnLogFileChanged();
 }
 
+MaybeLogEntry Multiplexer::ReadNextEntry(LogSource* source) {
+  if (!pipelined_)
+    return source->reader.GetNextEntry();
+
+  if (source->prefetching && (source->prefetched.empty() ||
+                              source->prefetch_done.IsSignaled())) {
+    WaitForPrefetch(source);
+  }
+
+  MaybeLogEntry entry;
+  if (!source->prefetched.empty()) {
+    entry.emplace(std::move(source->prefetched.front()));
+    source->prefetched.pop_front();
+  } else {
+    // Nothing has been prefetched (e.g. at the end of the file). Reads it
+    // synchronously.
+    DCHECK(!source->prefetching);
+    entry = source->reader.GetNextEntry();
+  }
+
+  if (entry.has_value() && !source->prefetching)
+    StartPrefetch(source);
+  return entry;
+}
+
+void Multiplexer::StartPrefetch(LogSource* source) {
+  DCHECK(pipelined_);
+  DCHECK(!source->prefetching);
+
+  // Reopening the rotated file re-installs the file change watcher, which
+  // must be done on this thread.
+  if (source->reader.rotated())
+    return;
+
+  if (source->prefetched.size() + kPrefetchBatchSize > kMaxPrefetchedEntries)
+    return;
+
+  source->prefetching = true;
+  source->prefetch_thread->task_runner()->PostTask(
+      FROM_HERE,
+      base::BindOnce(&Multiplexer::PrefetchOnThread, base::Unretained(source)));
+}
+
+// static
+void Multiplexer::PrefetchOnThread(LogSource* source) {
+  for (size_t i = 0; i < kPrefetchBatchSize; i++) {
+    MaybeLogEntry entry = source->reader.GetNextEntry();
+    if (!entry.has_value())
+      break;
+    source->prefetch_batch.emplace_back(std::move(*entry));
+  }
+  source->prefetch_done.Signal();
+}
+
+void Multiplexer::WaitForPrefetch(LogSource* source) {
+  if (!source->prefetching)
+    return;
+
+  source->prefetch_done.Wait();
+  source->prefetch_done.Reset();
+  source->prefetching = false;
+
+  for (LogEntry& entry : source->prefetch_batch)
+    source->prefetched.emplace_back(std::move(entry));
+  source->prefetch_batch.clear();
+}
+
+void Multiplexer::CancelPrefetch(LogSource* source) {
+  WaitForPrefetch(source);
+  while (!source->prefetched.empty()) {
+    source->prefetched.pop_back();
+    source->reader.GetPreviousEntry();
+  }
+}
+
+// static
+bool Multiplexer::IsLaterForwardSource(const LogSource* a, const LogSource* b) {
+  if (a->cache_next_forward->time() != b->cache_next_forward->time())
+    return a->cache_next_forward->time() > b->cache_next_forward->time();
+  return a->index > b->index;
+}
+
+void Multiplexer::RebuildForwardHeap() {
+  forward_heap_.clear();
+  for (auto&& source : sources_) {
+    if (source->cache_next_forward.has_value())
+      forward_heap_.push_back(source.get());
+  }
+  std::make_heap(forward_heap_.begin(), forward_heap_.end(),
+                 IsLaterForwardSource);
+}
+
 MaybeLogEntry Multiplexer::Forward() {
   for (auto&& source : sources_) {
     if (source->cache_next_backward.has_value()) {
@@ -60,33 +195,28 @@ MaybeLogEntry Multiplexer::Forward() {
     }
 
     if (!source->cache_next_forward.has_value()) {
-      MaybeLogEntry entry = source->reader.GetNextEntry();
+      MaybeLogEntry entry = ReadNextEntry(source.get());
       if (!entry.has_value()) {
         // No more entry from this source.
         continue;
       }
       // Reading an entry succeeds. Use this.
       source->cache_next_forward.emplace(std::move(*entry));
+      forward_heap_.push_back(source.get());
+      std::push_heap(forward_heap_.begin(), forward_heap_.end(),
+                     IsLaterForwardSource);
     }
   }
 
-  Multiplexer::LogSource* next_source = nullptr;
-  for (auto&& source : sources_) {
-    if (!source->cache_next_forward.has_value()) {
-      // This source doesn't have a next entry.
-      continue;
-    }
-
-    if (next_source == nullptr || next_source->cache_next_forward->time() >
-                                      source->cache_next_forward->time()) {
-      next_source = source.get();
-    }
-  }
-
-  if (next_source == nullptr) {
+  if (forward_heap_.empty()) {
     return std::nullopt;
   }
 
+  std::pop_heap(forward_heap_.begin(), forward_heap_.end(),
+                IsLaterForwardSource);
+  Multiplexer::LogSource* next_source = forward_heap_.back();
+  forward_heap_.pop_back();
+
   MaybeLogEntry entry = std::move(next_source->cache_next_forward);
   next_source->cache_next_forward.reset();
   return entry;
@@ -94,6 +224,7 @@ MaybeLogEntry Multiplexer::Forward() {
 
 MaybeLogEntry Multiplexer::Backward() {
   for (auto&& source : sources_) {
+    CancelPrefetch(source.get());
     if (source->cache_next_forward.has_value()) {
       CHECK(!source->cache_next_backward.has_value());
       source->cache_next_forward.reset();
@@ -111,6 +242,8 @@ MaybeLogEntry Multiplexer::Backward() {
     }
   }
 
+  forward_heap_.clear();
+
   Multiplexer::LogSource* next_source = nullptr;
   for (auto&& source : sources_) {
     if (!source->cache_next_backward.has_value()) {
@@ -142,7 +275,10 @@ void Multiplexer::RemoveObserver(Observer* obs) {
 }
 
 void Multiplexer::SetLinesFromLast(uint32_t pos) {
+  forward_heap_.clear();
   for (auto& source : sources_) {
+    WaitForPrefetch(source.get());
+    source->prefetched.clear();
     source->cache_next_backward.reset();
     source->cache_next_forward.reset();
     source->reader.SetPositionLast();
@@ -155,4 +291,15 @@ void Multiplexer::SetLinesFromLast(uint32_t pos) {
   }
 }
 
+void Multiplexer::SeekToTime(base::Time time) {
+  forward_heap_.clear();
+  for (auto& source : sources_) {
+    WaitForPrefetch(source.get());
+    source->prefetched.clear();
+    source->cache_next_backward.reset();
+    source->cache_next_forward.reset();
+    source->reader.SeekToTime(time);
+  }
+}
+
 }  // namespace croslog
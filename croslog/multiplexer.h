@@ -5,6 +5,7 @@
 #ifndef CROSLOG_MULTIPLEXER_H_
 #define CROSLOG_MULTIPLEXER_H_
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,6 +13,9 @@
 #include "base/files/file_path.h"
 #include "base/observer_list.h"
 #include "base/observer_list_types.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
 
 #include "croslog/log_entry.h"
 #include "croslog/log_entry_reader.h"
@@ -31,6 +35,11 @@ class Multiplexer : public LogLineReader::Observer {
   Multiplexer(const Multiplexer&) = delete;
   Multiplexer& operator=(const Multiplexer&) = delete;
 
+  // Enables the pipelined mode, where each source parses the succeeding
+  // entries ahead on its own thread while Forward() is called. This must be
+  // called before adding sources. The results are same as the normal mode.
+  void SetPipelined(bool pipelined);
+
   // Add a source log file to read.
   void AddSource(base::FilePath log_file,
                  std::unique_ptr<LogParser> parser,
@@ -45,6 +54,8 @@ class Multiplexer : public LogLineReader::Observer {
 
   // Set the position to read next.
   void SetLinesFromLast(uint32_t pos);
+  // Set the position to the first entry which is not older than |time|.
+  void SeekToTime(base::Time time);
 
   // Add a observer to retrieve file change events.
   void AddObserver(Observer* obs);
@@ -55,16 +66,52 @@ class Multiplexer : public LogLineReader::Observer {
   struct LogSource {
     LogSource(base::FilePath log_file,
               std::unique_ptr<LogParser> parser_in,
-              bool install_change_watcher);
+              bool install_change_watcher,
+              size_t index,
+              bool pipelined);
 
     LogEntryReader reader;
     MaybeLogEntry cache_next_forward;
     MaybeLogEntry cache_next_backward;
+    // Index in |sources_|, used to break ties of the time.
+    const size_t index;
+
+    // Used only in the pipelined mode. |prefetched| has the entries which
+    // follow |cache_next_forward| in the file. While |prefetching| is true,
+    // |reader| and |prefetch_batch| are owned by |prefetch_thread|.
+    std::deque<LogEntry> prefetched;
+    std::vector<LogEntry> prefetch_batch;
+    base::WaitableEvent prefetch_done;
+    bool prefetching = false;
+    // Declared last so that the thread stops before the other members are
+    // destructed.
+    std::unique_ptr<base::Thread> prefetch_thread;
   };
 
+  void OnFileWillChange(LogLineReader* reader) override;
   void OnFileChanged(LogLineReader* reader) override;
 
+  // Reads the next entry of |source|, from the prefetched ones if available.
+  MaybeLogEntry ReadNextEntry(LogSource* source);
+  // Starts parsing the succeeding entries of |source| on its thread.
+  void StartPrefetch(LogSource* source);
+  // Parses the entries on the prefetch thread.
+  static void PrefetchOnThread(LogSource* source);
+  // Waits for the running prefetch and moves its result to |prefetched|.
+  void WaitForPrefetch(LogSource* source);
+  // Drops the prefetched entries and moves the reader position back to just
+  // after |cache_next_forward|.
+  void CancelPrefetch(LogSource* source);
+  // Comparator of |forward_heap_|. Among the entries with the same time, the
+  // one from the source added first comes first.
+  static bool IsLaterForwardSource(const LogSource* a, const LogSource* b);
+  // Rebuilds |forward_heap_| from the sources having |cache_next_forward|.
+  void RebuildForwardHeap();
+
+  bool pipelined_ = false;
   std::vector<std::unique_ptr<LogSource>> sources_;
+  // Min-heap of the sources having |cache_next_forward|, keyed on its time.
+  std::vector<LogSource*> forward_heap_;
   base::ObserverList<Observer> observers_;
 };
 
@@ -152,4 +152,122 @@ TEST_F(MultiplexerTest, InterleaveForwardAndBackward2) {
   }
 }
 
+TEST_F(MultiplexerTest, SeekToTime) {
+  Multiplexer Multiplexer;
+  Multiplexer.AddSource(base::FilePath("./testdata/TEST_NORMAL_LOG1"),
+                        std::make_unique<LogParserSyslog>(), false);
+  Multiplexer.AddSource(base::FilePath("./testdata/TEST_NORMAL_LOG2"),
+                        std::make_unique<LogParserSyslog>(), false);
+
+  base::Time time;
+  EXPECT_TRUE(base::Time::FromString("2020-05-25T05:15:22.402259Z", &time));
+  Multiplexer.SeekToTime(time);
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5965, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5966, e->pid());
+  }
+
+  EXPECT_FALSE(Multiplexer.Forward().has_value());
+
+  // Seeking again moves the position backward.
+  EXPECT_TRUE(base::Time::FromString("2020-05-25T05:15:22.402260Z", &time));
+  Multiplexer.SeekToTime(time);
+
+  {
+    MaybeLogEntry e = Multiplexer.Backward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+}
+
+TEST_F(MultiplexerTest, PipelinedForward) {
+  const char* kSources[] = {"./testdata/TEST_SEQUENTIAL_LOG1",
+                            "./testdata/TEST_SEQUENTIAL_LOG2",
+                            "./testdata/TEST_SEQUENTIAL_LOG3",
+                            "./testdata/TEST_NORMAL_LOG1",
+                            "./testdata/TEST_NORMAL_LOG2"};
+
+  Multiplexer serial;
+  Multiplexer pipelined;
+  pipelined.SetPipelined(true);
+  for (const char* source : kSources) {
+    serial.AddSource(base::FilePath(source),
+                     std::make_unique<LogParserSyslog>(), false);
+    pipelined.AddSource(base::FilePath(source),
+                        std::make_unique<LogParserSyslog>(), false);
+  }
+
+  while (true) {
+    MaybeLogEntry expected = serial.Forward();
+    MaybeLogEntry e = pipelined.Forward();
+    ASSERT_EQ(expected.has_value(), e.has_value());
+    if (!expected.has_value())
+      break;
+    EXPECT_EQ(expected->time(), e->time());
+    EXPECT_EQ(expected->message(), e->message());
+  }
+}
+
+TEST_F(MultiplexerTest, PipelinedInterleaveForwardAndBackward) {
+  Multiplexer Multiplexer;
+  Multiplexer.SetPipelined(true);
+  Multiplexer.AddSource(base::FilePath("./testdata/TEST_NORMAL_LOG1"),
+                        std::make_unique<LogParserSyslog>(), false);
+  Multiplexer.AddSource(base::FilePath("./testdata/TEST_NORMAL_LOG2"),
+                        std::make_unique<LogParserSyslog>(), false);
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5963, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  // The entries parsed ahead are dropped.
+  {
+    MaybeLogEntry e = Multiplexer.Backward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5964, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5965, e->pid());
+  }
+
+  {
+    MaybeLogEntry e = Multiplexer.Forward();
+    EXPECT_TRUE(e.has_value());
+    EXPECT_EQ(5966, e->pid());
+  }
+
+  EXPECT_FALSE(Multiplexer.Forward().has_value());
+}
+
 }  // namespace croslog
@@ -76,6 +76,8 @@ void ViewerPlaintext::Initialize() {
 
 bool ViewerPlaintext::Run() {
   bool install_change_watcher = config_.follow;
+  // Parses each source ahead on its own thread.
+  multiplexer_.SetPipelined(true);
   for (const auto& log_path_str : croslog::kLogSources) {
     base::FilePath path(log_path_str.data());
     if (!base::PathExists(path))
@@ -98,6 +100,9 @@ bool ViewerPlaintext::Run() {
     multiplexer_.SetLinesFromLast(config_.lines);
   } else if (config_.follow) {
     multiplexer_.SetLinesFromLast(10);
+  } else if (!config_.since.is_null()) {
+    // Skips the older entries without parsing all of them.
+    multiplexer_.SeekToTime(config_.since);
   }
 
   ReadRemainingLogs();
@@ -168,6 +173,12 @@ void ViewerPlaintext::ReadRemainingLogs() {
     if (config_show_cursor_)
       last_shown_log_time = e->time();
 
+    // The entries come in chronological order, so the rest are newer as well.
+    if (!config_.until.is_null() && e->time() > config_.until &&
+        !config_.follow && !config_show_cursor_) {
+      break;
+    }
+
     if (ShouldFilterOutEntry(*e))
       continue;
 
@@ -0,0 +1,291 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dns-proxy/dns_cache.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+#include <base/big_endian.h>
+#include <base/strings/string_util.h>
+#include <chromeos/patchpanel/dns/dns_protocol.h>
+#include <chromeos/patchpanel/dns/dns_response.h>
+
+namespace dns_proxy {
+namespace {
+namespace dns_protocol = patchpanel::dns_protocol;
+
+constexpr size_t kHeaderSize = sizeof(dns_protocol::Header);
+// Offsets of the header fields used by the cache.
+constexpr size_t kFlagsOffset = 2;
+constexpr size_t kQdcountOffset = 4;
+constexpr size_t kAncountOffset = 6;
+constexpr size_t kNscountOffset = 8;
+constexpr size_t kArcountOffset = 10;
+// The TTL of a record is followed by the 2-bytes RDLENGTH field.
+constexpr size_t kTtlOffsetFromRdata = 6;
+// The RDATA of a SOA record ends with the 4-bytes MINIMUM field.
+constexpr size_t kSoaMinimumOffsetFromEnd = 4;
+
+constexpr uint16_t kFlagsOpcodeMask = 0x7800;
+constexpr uint16_t kFlagsRcodeMask = 0x000f;
+
+// Upper bounds of the lifetime of positive and negative entries. RFC 2308
+// recommends not keeping negative answers for more than a few hours.
+constexpr base::TimeDelta kMaxTtl = base::Days(1);
+constexpr base::TimeDelta kMaxNegativeTtl = base::Hours(3);
+
+uint16_t ReadU16(const uint8_t* p) {
+  uint16_t value;
+  base::ReadBigEndian<uint16_t>(p, &value);
+  return value;
+}
+
+uint32_t ReadU32(const uint8_t* p) {
+  uint32_t value;
+  base::ReadBigEndian<uint32_t>(p, &value);
+  return value;
+}
+
+// Parses the header and the question of the DNS message |msg| of length |len|
+// and stores in |key| the question with its name in lower case. Returns the
+// offset of the end of the question, or 0 if |msg| does not hold exactly one
+// question.
+size_t ParseQuestion(const uint8_t* msg, size_t len, std::string* key) {
+  if (!msg || len < kHeaderSize || ReadU16(msg + kQdcountOffset) != 1)
+    return 0;
+
+  // The question is the first name of the message and cannot be compressed.
+  size_t offset = kHeaderSize;
+  for (;;) {
+    if (offset >= len)
+      return 0;
+    const uint8_t label_len = msg[offset];
+    if ((label_len & dns_protocol::kLabelMask) != dns_protocol::kLabelDirect)
+      return 0;
+    offset += label_len + 1;
+    if (offset - kHeaderSize >
+        static_cast<size_t>(dns_protocol::kMaxNameLength)) {
+      return 0;
+    }
+    if (label_len == 0)
+      break;
+  }
+  const size_t name_len = offset - kHeaderSize;
+
+  // QTYPE and QCLASS.
+  offset += 2 * sizeof(uint16_t);
+  if (offset > len)
+    return 0;
+
+  key->assign(reinterpret_cast<const char*>(msg) + kHeaderSize,
+              offset - kHeaderSize);
+  std::transform(key->begin(), key->begin() + name_len, key->begin(),
+                 [](char c) { return base::ToLowerASCII(c); });
+  return offset;
+}
+
+// Returns whether the DNS message |msg| of length |len|, whose question ends
+// at |question_end|, has an EDNS OPT pseudo-record.
+bool HasOptRecord(const uint8_t* msg, size_t len, size_t question_end) {
+  const unsigned record_count = ReadU16(msg + kAncountOffset) +
+                                ReadU16(msg + kNscountOffset) +
+                                ReadU16(msg + kArcountOffset);
+  patchpanel::DnsRecordParser parser(msg, len, question_end);
+  for (unsigned i = 0; i < record_count; i++) {
+    patchpanel::DnsResourceRecord record;
+    if (!parser.ReadRecord(&record))
+      return false;
+    if (record.type == dns_protocol::kTypeOPT)
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+DnsCache::DnsCache(size_t max_size) : max_size_(max_size) {}
+
+DnsCache::~DnsCache() = default;
+
+Metrics::CacheResult DnsCache::Get(const char* msg,
+                                   size_t len,
+                                   std::string* response) {
+  const uint8_t* query = reinterpret_cast<const uint8_t*>(msg);
+  std::string key;
+  const size_t question_end = ParseQuestion(query, len, &key);
+  if (!question_end)
+    return Metrics::CacheResult::kMiss;
+
+  const auto it = entries_.find(key);
+  if (it == entries_.end())
+    return Metrics::CacheResult::kMiss;
+
+  const EntryList::iterator entry = it->second;
+  const base::TimeTicks now = base::TimeTicks::Now();
+  if (now >= entry->expiry) {
+    Erase(entry);
+    return Metrics::CacheResult::kMiss;
+  }
+  lru_.splice(lru_.begin(), lru_, entry);
+
+  *response = entry->response;
+  uint8_t* out = reinterpret_cast<uint8_t*>(&(*response)[0]);
+  // Answer with the ID and the RD flag of the query.
+  constexpr uint8_t kFlagRD = dns_protocol::kFlagRD >> 8;
+  memcpy(out, msg, sizeof(uint16_t));
+  out[kFlagsOffset] =
+      (out[kFlagsOffset] & ~kFlagRD) | (msg[kFlagsOffset] & kFlagRD);
+  // Echo the question of the query, whose name may differ in case from the
+  // cached one (e.g. DNS 0x20 randomization).
+  memcpy(out + kHeaderSize, msg + kHeaderSize, question_end - kHeaderSize);
+  // Only answer with an OPT record to queries that have one (RFC 6891
+  // section 7).
+  if (entry->opt_offset && !HasOptRecord(query, len, question_end)) {
+    response->resize(entry->opt_offset);
+    out = reinterpret_cast<uint8_t*>(&(*response)[0]);
+    base::WriteBigEndian(reinterpret_cast<char*>(out + kArcountOffset),
+                         static_cast<uint16_t>(
+                             ReadU16(out + kArcountOffset) - 1));
+  }
+
+  const int64_t elapsed = (now - entry->stored).InSeconds();
+  for (size_t offset : entry->ttl_offsets) {
+    const uint32_t ttl = ReadU32(out + offset);
+    base::WriteBigEndian(reinterpret_cast<char*>(out + offset),
+                         static_cast<uint32_t>(std::max<int64_t>(
+                             static_cast<int64_t>(ttl) - elapsed, 0)));
+  }
+
+  return entry->negative ? Metrics::CacheResult::kNegativeHit
+                         : Metrics::CacheResult::kHit;
+}
+
+void DnsCache::Put(const char* msg,
+                   size_t len,
+                   const unsigned char* response,
+                   size_t response_len) {
+  std::string key;
+  const size_t question_end = ParseQuestion(response, response_len, &key);
+  if (!question_end)
+    return;
+
+  std::string query_key;
+  if (!ParseQuestion(reinterpret_cast<const uint8_t*>(msg), len, &query_key) ||
+      query_key != key) {
+    return;
+  }
+
+  const uint16_t flags = ReadU16(response + kFlagsOffset);
+  if (!(flags & dns_protocol::kFlagResponse) ||
+      (flags & dns_protocol::kFlagTC) || (flags & kFlagsOpcodeMask)) {
+    return;
+  }
+  const uint8_t rcode = flags & kFlagsRcodeMask;
+  if (rcode != dns_protocol::kRcodeNOERROR &&
+      rcode != dns_protocol::kRcodeNXDOMAIN) {
+    return;
+  }
+
+  const unsigned answer_count = ReadU16(response + kAncountOffset);
+  const unsigned authority_count = ReadU16(response + kNscountOffset);
+  const unsigned additional_count = ReadU16(response + kArcountOffset);
+  const unsigned record_count =
+      answer_count + authority_count + additional_count;
+
+  Entry entry;
+  entry.negative = rcode == dns_protocol::kRcodeNXDOMAIN || answer_count == 0;
+  entry.opt_offset = 0;
+  uint32_t ttl = std::numeric_limits<uint32_t>::max();
+  bool has_soa = false;
+  patchpanel::DnsRecordParser parser(response, response_len, question_end);
+  for (unsigned i = 0; i < record_count; i++) {
+    const size_t record_offset = parser.GetOffset();
+    patchpanel::DnsResourceRecord record;
+    if (!parser.ReadRecord(&record))
+      return;
+    // The TTL field of the EDNS pseudo-record holds flags. It is removed
+    // from the answers to queries without EDNS, which is only simple when it
+    // is the last record, as it is in practice.
+    if (record.type == dns_protocol::kTypeOPT) {
+      if (i != record_count - 1)
+        return;
+      entry.opt_offset = record_offset;
+      continue;
+    }
+    entry.ttl_offsets.push_back(record.rdata.data() -
+                                reinterpret_cast<const char*>(response) -
+                                kTtlOffsetFromRdata);
+
+    if (i < answer_count) {
+      ttl = std::min(ttl, record.ttl);
+    } else if (i < answer_count + authority_count) {
+      if (!entry.negative) {
+        ttl = std::min(ttl, record.ttl);
+      } else if (record.type == dns_protocol::kTypeSOA) {
+        // The negative TTL is the smallest of the TTL of the SOA record and
+        // of its MINIMUM field (RFC 2308 section 5).
+        if (record.rdata.size() < kSoaMinimumOffsetFromEnd)
+          return;
+        const uint32_t minimum = ReadU32(
+            reinterpret_cast<const uint8_t*>(record.rdata.data()) +
+            record.rdata.size() - kSoaMinimumOffsetFromEnd);
+        ttl = std::min({ttl, record.ttl, minimum});
+        has_soa = true;
+      }
+    }
+  }
+  // Negative answers without SOA record must not be cached (RFC 2308 section
+  // 5).
+  if (entry.negative && !has_soa)
+    return;
+
+  const base::TimeDelta lifetime = std::min(
+      base::Seconds(ttl), entry.negative ? kMaxNegativeTtl : kMaxTtl);
+  if (lifetime.is_zero())
+    return;
+
+  entry.key = std::move(key);
+  entry.response.assign(reinterpret_cast<const char*>(response), response_len);
+  entry.stored = base::TimeTicks::Now();
+  entry.expiry = entry.stored + lifetime;
+  const size_t entry_size = EntrySize(entry);
+  if (entry_size > max_size_)
+    return;
+
+  const auto it = entries_.find(entry.key);
+  if (it != entries_.end())
+    Erase(it->second);
+  size_ += entry_size;
+  lru_.push_front(std::move(entry));
+  entries_.emplace(lru_.front().key, lru_.begin());
+  while (size_ > max_size_)
+    Erase(std::prev(lru_.end()));
+}
+
+void DnsCache::Clear() {
+  entries_.clear();
+  lru_.clear();
+  size_ = 0;
+}
+
+// static
+size_t DnsCache::EntrySize(const Entry& entry) {
+  // The key is stored both in the entry and in the index.
+  return sizeof(Entry) + 2 * entry.key.size() + entry.response.size() +
+         entry.ttl_offsets.size() * sizeof(size_t);
+}
+
+void DnsCache::Erase(EntryList::iterator it) {
+  size_ -= EntrySize(*it);
+  entries_.erase(it->key);
+  lru_.erase(it);
+}
+
+}  // namespace dns_proxy
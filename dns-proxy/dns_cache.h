@@ -0,0 +1,89 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DNS_PROXY_DNS_CACHE_H_
+#define DNS_PROXY_DNS_CACHE_H_
+
+#include <stddef.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/time/time.h>
+
+#include "dns-proxy/metrics.h"
+
+namespace dns_proxy {
+
+// Default memory budget of the cache in bytes.
+constexpr size_t kDefaultDnsCacheSize = 1 << 20;
+
+// DnsCache stores wire-format DNS responses keyed by the question of the
+// query: (qname, qtype, qclass), with qname compared case-insensitively.
+//
+// Positive responses are kept for the smallest TTL of their answer and
+// authority records. NXDOMAIN and NODATA responses are kept for the negative
+// TTL given by the SOA record of their authority section (RFC 2308). Other
+// responses are not cached. Entries are evicted in least recently used order
+// once the memory used by the cache exceeds its budget.
+class DnsCache {
+ public:
+  explicit DnsCache(size_t max_size = kDefaultDnsCacheSize);
+  DnsCache(const DnsCache&) = delete;
+  DnsCache& operator=(const DnsCache&) = delete;
+  ~DnsCache();
+
+  // Looks up the response to the query |msg| of length |len|. On a hit, the
+  // cached response is copied into |response| with the ID, RD flag and
+  // question of the query, without OPT record if the query has none, and
+  // with its TTLs decreased by the time spent in the cache.
+  Metrics::CacheResult Get(const char* msg, size_t len, std::string* response);
+
+  // Stores |response| of length |response_len| as the answer to the query
+  // |msg| of length |len| if the response can be cached.
+  void Put(const char* msg,
+           size_t len,
+           const unsigned char* response,
+           size_t response_len);
+
+  // Removes all the entries.
+  void Clear();
+
+  // Number of entries and memory used by the cache in bytes.
+  size_t entry_count() const { return entries_.size(); }
+  size_t size() const { return size_; }
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string response;
+    // Offsets in |response| of the TTL of every record.
+    std::vector<size_t> ttl_offsets;
+    // Offset in |response| of its EDNS OPT record, which is then its last
+    // record, or 0 if it has none.
+    size_t opt_offset;
+    base::TimeTicks stored;
+    base::TimeTicks expiry;
+    bool negative;
+  };
+  using EntryList = std::list<Entry>;
+
+  // Memory accounted for |entry|.
+  static size_t EntrySize(const Entry& entry);
+
+  void Erase(EntryList::iterator it);
+
+  size_t max_size_;
+  size_t size_ = 0;
+
+  // Entries ordered from the most to the least recently used.
+  EntryList lru_;
+  std::map<std::string, EntryList::iterator> entries_;
+};
+
+}  // namespace dns_proxy
+
+#endif  // DNS_PROXY_DNS_CACHE_H_
@@ -0,0 +1,309 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dns-proxy/dns_cache.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/strings/string_split.h>
+#include <base/test/task_environment.h>
+#include <base/time/time.h>
+#include <chromeos/patchpanel/dns/dns_protocol.h>
+#include <gtest/gtest.h>
+
+namespace dns_proxy {
+namespace {
+namespace dns_protocol = patchpanel::dns_protocol;
+
+constexpr char kName[] = "www.example.com";
+
+struct Record {
+  std::string name;
+  uint16_t type;
+  uint32_t ttl;
+  std::string rdata;
+};
+
+void AppendU16(std::string* msg, uint16_t value) {
+  msg->push_back(value >> 8);
+  msg->push_back(value & 0xff);
+}
+
+void AppendU32(std::string* msg, uint32_t value) {
+  AppendU16(msg, value >> 16);
+  AppendU16(msg, value & 0xffff);
+}
+
+void AppendName(std::string* msg, const std::string& name) {
+  for (const auto& label : base::SplitString(
+           name, ".", base::KEEP_WHITESPACE, base::SPLIT_WANT_NONEMPTY)) {
+    msg->push_back(label.size());
+    msg->append(label);
+  }
+  msg->push_back('\0');
+}
+
+std::string Message(uint16_t id,
+                    uint16_t flags,
+                    const std::string& name,
+                    uint16_t type,
+                    const std::vector<Record>& answers = {},
+                    const std::vector<Record>& authority = {}) {
+  std::string msg;
+  AppendU16(&msg, id);
+  AppendU16(&msg, flags);
+  AppendU16(&msg, 1);
+  AppendU16(&msg, answers.size());
+  AppendU16(&msg, authority.size());
+  AppendU16(&msg, 0);
+  AppendName(&msg, name);
+  AppendU16(&msg, type);
+  AppendU16(&msg, dns_protocol::kClassIN);
+  for (const auto* section : {&answers, &authority}) {
+    for (const auto& record : *section) {
+      AppendName(&msg, record.name);
+      AppendU16(&msg, record.type);
+      AppendU16(&msg, dns_protocol::kClassIN);
+      AppendU32(&msg, record.ttl);
+      AppendU16(&msg, record.rdata.size());
+      msg.append(record.rdata);
+    }
+  }
+  return msg;
+}
+
+std::string Query(uint16_t id,
+                  const std::string& name = kName,
+                  uint16_t type = dns_protocol::kTypeA) {
+  return Message(id, dns_protocol::kFlagRD, name, type);
+}
+
+std::string Response(uint16_t id,
+                     uint8_t rcode,
+                     const std::vector<Record>& answers,
+                     const std::vector<Record>& authority = {},
+                     const std::string& name = kName,
+                     uint16_t type = dns_protocol::kTypeA) {
+  return Message(id,
+                 dns_protocol::kFlagResponse | dns_protocol::kFlagRD | rcode,
+                 name, type, answers, authority);
+}
+
+Record ARecord(uint32_t ttl, const std::string& name = kName) {
+  return {name, dns_protocol::kTypeA, ttl, std::string("\x01\x02\x03\x04", 4)};
+}
+
+Record SoaRecord(uint32_t ttl, uint32_t minimum) {
+  std::string rdata;
+  AppendName(&rdata, "ns.example.com");
+  AppendName(&rdata, "hostmaster.example.com");
+  for (uint32_t field : {1u, 7200u, 3600u, 1209600u})
+    AppendU32(&rdata, field);
+  AppendU32(&rdata, minimum);
+  return {"example.com", dns_protocol::kTypeSOA, ttl, rdata};
+}
+
+// Returns |msg| with an EDNS OPT record appended to its additional section.
+std::string WithOpt(std::string msg) {
+  msg[11]++;
+  AppendName(&msg, "");
+  AppendU16(&msg, dns_protocol::kTypeOPT);
+  // UDP payload size, extended RCODE and flags, and empty RDATA.
+  AppendU16(&msg, 1232);
+  AppendU32(&msg, 0);
+  AppendU16(&msg, 0);
+  return msg;
+}
+
+// Returns the TTL of the first answer of |response|, with the question for
+// |kName|.
+uint32_t FirstTtl(const std::string& response) {
+  // Header, question, then the answer name, type and class.
+  const size_t offset = 12 + (sizeof(kName) + 1) + 4 + (sizeof(kName) + 1) + 4;
+  const auto* p = reinterpret_cast<const uint8_t*>(response.data() + offset);
+  return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+class DnsCacheTest : public testing::Test {
+ protected:
+  Metrics::CacheResult Get(const std::string& query, std::string* response) {
+    return cache_.Get(query.data(), query.size(), response);
+  }
+
+  void Put(const std::string& query, const std::string& response) {
+    cache_.Put(query.data(), query.size(),
+               reinterpret_cast<const unsigned char*>(response.data()),
+               response.size());
+  }
+
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::TimeSource::MOCK_TIME};
+  DnsCache cache_;
+};
+
+TEST_F(DnsCacheTest, PositiveResponse) {
+  Put(Query(1), Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}));
+
+  std::string response;
+  EXPECT_EQ(Metrics::CacheResult::kHit, Get(Query(2), &response));
+  EXPECT_EQ(Response(2, dns_protocol::kRcodeNOERROR, {ARecord(300)}),
+            response);
+
+  task_environment_.FastForwardBy(base::Seconds(100));
+  EXPECT_EQ(Metrics::CacheResult::kHit, Get(Query(3), &response));
+  EXPECT_EQ(200u, FirstTtl(response));
+
+  task_environment_.FastForwardBy(base::Seconds(200));
+  EXPECT_EQ(Metrics::CacheResult::kMiss, Get(Query(4), &response));
+  EXPECT_EQ(0u, cache_.entry_count());
+  EXPECT_EQ(0u, cache_.size());
+}
+
+TEST_F(DnsCacheTest, SmallestTtl) {
+  Put(Query(1), Response(1, dns_protocol::kRcodeNOERROR,
+                         {ARecord(300), ARecord(30)}));
+
+  std::string response;
+  task_environment_.FastForwardBy(base::Seconds(29));
+  EXPECT_EQ(Metrics::CacheResult::kHit, Get(Query(2), &response));
+  task_environment_.FastForwardBy(base::Seconds(1));
+  EXPECT_EQ(Metrics::CacheResult::kMiss, Get(Query(3), &response));
+}
+
+TEST_F(DnsCacheTest, KeyedByQuestion) {
+  Put(Query(1), Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}));
+
+  std::string response;
+  EXPECT_EQ(Metrics::CacheResult::kHit,
+            Get(Query(2, "WWW.Example.COM"), &response));
+  EXPECT_EQ(Metrics::CacheResult::kMiss,
+            Get(Query(3, kName, dns_protocol::kTypeAAAA), &response));
+  EXPECT_EQ(Metrics::CacheResult::kMiss,
+            Get(Query(4, "example.com"), &response));
+}
+
+TEST_F(DnsCacheTest, EchoesQuestion) {
+  Put(Query(1), Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}));
+
+  std::string response;
+  EXPECT_EQ(Metrics::CacheResult::kHit,
+            Get(Query(2, "wWw.ExAmple.cOm"), &response));
+  EXPECT_EQ(Response(2, dns_protocol::kRcodeNOERROR, {ARecord(300)}, {},
+                     "wWw.ExAmple.cOm")
+                .substr(0, 12 + sizeof(kName) + 1 + 4),
+            response.substr(0, 12 + sizeof(kName) + 1 + 4));
+}
+
+TEST_F(DnsCacheTest, OptRecordOnlyForEdnsQueries) {
+  const std::string response_with_opt =
+      WithOpt(Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}));
+  Put(WithOpt(Query(1)), response_with_opt);
+
+  std::string response;
+  EXPECT_EQ(Metrics::CacheResult::kHit, Get(WithOpt(Query(1)), &response));
+  EXPECT_EQ(response_with_opt, response);
+  EXPECT_EQ(Metrics::CacheResult::kHit, Get(Query(1), &response));
+  EXPECT_EQ(Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}),
+            response);
+}
+
+TEST_F(DnsCacheTest, NegativeResponse) {
+  Put(Query(1),
+      Response(1, dns_protocol::kRcodeNXDOMAIN, {}, {SoaRecord(3600, 60)}));
+  Put(Query(1, kName, dns_protocol::kTypeAAAA),
+      Response(1, dns_protocol::kRcodeNOERROR, {}, {SoaRecord(30, 60)}, kName,
+               dns_protocol::kTypeAAAA));
+
+  std::string response;
+  EXPECT_EQ(Metrics::CacheResult::kNegativeHit, Get(Query(2), &response));
+  EXPECT_EQ(Metrics::CacheResult::kNegativeHit,
+            Get(Query(2, kName, dns_protocol::kTypeAAAA), &response));
+
+  task_environment_.FastForwardBy(base::Seconds(30));
+  EXPECT_EQ(Metrics::CacheResult::kNegativeHit, Get(Query(3), &response));
+  EXPECT_EQ(Metrics::CacheResult::kMiss,
+            Get(Query(3, kName, dns_protocol::kTypeAAAA), &response));
+
+  task_environment_.FastForwardBy(base::Seconds(30));
+  EXPECT_EQ(Metrics::CacheResult::kMiss, Get(Query(4), &response));
+}
+
+TEST_F(DnsCacheTest, ResponsesNotCached) {
+  const std::vector<std::string> responses = {
+      // Negative response without SOA.
+      Response(1, dns_protocol::kRcodeNXDOMAIN, {}),
+      Response(1, dns_protocol::kRcodeSERVFAIL, {}, {SoaRecord(3600, 60)}),
+      Response(1, dns_protocol::kRcodeNOERROR, {ARecord(0)}),
+      // Answer to another question.
+      Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}, {},
+               "example.com"),
+      // Truncated response.
+      Message(1, dns_protocol::kFlagResponse | dns_protocol::kFlagTC, kName,
+              dns_protocol::kTypeA, {ARecord(300)}),
+      // Malformed response.
+      Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}).substr(0, 40),
+      "",
+  };
+  for (const auto& r : responses) {
+    Put(Query(1), r);
+  }
+  EXPECT_EQ(0u, cache_.entry_count());
+}
+
+TEST_F(DnsCacheTest, LeastRecentlyUsedEviction) {
+  const std::vector<std::string> names = {"a.example.com", "b.example.com",
+                                          "c.example.com"};
+  // Measure the size of one entry.
+  Put(Query(1, names[0]), Response(1, dns_protocol::kRcodeNOERROR,
+                                   {ARecord(300, names[0])}, {}, names[0]));
+  const size_t entry_size = cache_.size();
+  ASSERT_GT(entry_size, 0u);
+
+  DnsCache cache(2 * entry_size);
+  for (const auto& name : {names[0], names[1]}) {
+    const std::string query = Query(1, name);
+    const std::string response = Response(
+        1, dns_protocol::kRcodeNOERROR, {ARecord(300, name)}, {}, name);
+    cache.Put(query.data(), query.size(),
+              reinterpret_cast<const unsigned char*>(response.data()),
+              response.size());
+  }
+  std::string response;
+  std::string query = Query(2, names[0]);
+  EXPECT_EQ(Metrics::CacheResult::kHit,
+            cache.Get(query.data(), query.size(), &response));
+
+  query = Query(1, names[2]);
+  const std::string r = Response(1, dns_protocol::kRcodeNOERROR,
+                                 {ARecord(300, names[2])}, {}, names[2]);
+  cache.Put(query.data(), query.size(),
+            reinterpret_cast<const unsigned char*>(r.data()), r.size());
+  EXPECT_EQ(2u, cache.entry_count());
+  EXPECT_LE(cache.size(), 2 * entry_size);
+
+  for (const auto& [name, result] :
+       std::vector<std::pair<std::string, Metrics::CacheResult>>{
+           {names[0], Metrics::CacheResult::kHit},
+           {names[1], Metrics::CacheResult::kMiss},
+           {names[2], Metrics::CacheResult::kHit}}) {
+    query = Query(3, name);
+    EXPECT_EQ(result, cache.Get(query.data(), query.size(), &response))
+        << name;
+  }
+}
+
+TEST_F(DnsCacheTest, Clear) {
+  Put(Query(1), Response(1, dns_protocol::kRcodeNOERROR, {ARecord(300)}));
+  EXPECT_EQ(1u, cache_.entry_count());
+
+  cache_.Clear();
+  std::string response;
+  EXPECT_EQ(Metrics::CacheResult::kMiss, Get(Query(2), &response));
+  EXPECT_EQ(0u, cache_.size());
+}
+
+}  // namespace
+}  // namespace dns_proxy
@@ -4,6 +4,7 @@
 
 #include "dns-proxy/doh_curl_client.h"
 
+#include <algorithm>
 #include <utility>
 
 #include <base/bind.h>
@@ -20,6 +21,16 @@ constexpr char kLinuxUserAgent[] =
 constexpr std::array<const char*, 2> kDoHHeaderList{
     {"Accept: application/dns-message",
      "Content-Type: application/dns-message"}};
+
+// Idle connections are reused for queries made within this duration.
+constexpr base::TimeDelta kMaxConnectionAge = base::Minutes(5);
+// TCP keep-alive probes are sent on connections idle for |kKeepAliveIdle|,
+// every |kKeepAliveInterval|, to keep them open through NATs and firewalls.
+constexpr base::TimeDelta kKeepAliveIdle = base::Seconds(45);
+constexpr base::TimeDelta kKeepAliveInterval = base::Seconds(15);
+// Maximum number of connections kept in the pool per DoH provider queried.
+// With HTTP/2, a single connection per provider is normally used.
+constexpr long kMaxConnectionsPerProvider = 2;
 }  // namespace
 
 DoHCurlClient::CurlResult::CurlResult(CURLcode curl_code,
@@ -29,11 +40,40 @@ DoHCurlClient::CurlResult::CurlResult(CURLcode curl_code,
       http_code(http_code),
       retry_delay_ms(retry_delay_ms) {}
 
+DoHCurlClient::Multi::Multi(DoHCurlClient* client, long max_connections)
+    : client(client), handle(curl_multi_init()) {
+  // Set socket callback to `SocketCallback(...)`. This function will be called
+  // whenever a CURL socket state is changed. This Multi will be passed as a
+  // parameter of the callback.
+  curl_multi_setopt(handle, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(handle, CURLMOPT_SOCKETFUNCTION,
+                    &DoHCurlClient::SocketCallback);
+
+  // Set timer callback to `TimerCallback(...)`. This function will be called
+  // whenever a timeout change happened. This Multi will be passed as a
+  // parameter of the callback.
+  curl_multi_setopt(handle, CURLMOPT_TIMERDATA, this);
+  curl_multi_setopt(handle, CURLMOPT_TIMERFUNCTION,
+                    &DoHCurlClient::TimerCallback);
+
+  // Multiplex concurrent queries to the same DoH provider over a single
+  // HTTP/2 connection, and keep the connections in the pool of the multi
+  // handle between queries.
+  curl_multi_setopt(handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(handle, CURLMOPT_MAXCONNECTS, max_connections);
+}
+
+DoHCurlClient::Multi::~Multi() {
+  curl_multi_cleanup(handle);
+}
+
 DoHCurlClient::State::State(CURL* curl,
+                            CURLM* multi,
                             const QueryCallback& callback,
                             void* ctx,
                             int request_id)
     : curl(curl),
+      multi(multi),
       callback(callback),
       ctx(ctx),
       header_list(nullptr),
@@ -61,24 +101,18 @@ void DoHCurlClient::State::SetResponse(char* msg, size_t len) {
 DoHCurlClient::DoHCurlClient(base::TimeDelta timeout,
                              int max_concurrent_queries)
     : timeout_seconds_(timeout.InSeconds()),
-      max_concurrent_queries_(max_concurrent_queries) {
+      max_concurrent_queries_(max_concurrent_queries),
+      next_request_id_(0),
+      connection_pooling_(true) {
   // Initialize CURL.
   curl_global_init(CURL_GLOBAL_DEFAULT);
-  curlm_ = curl_multi_init();
 
-  // Set socket callback to `SocketCallback(...)`. This function will be called
-  // whenever a CURL socket state is changed. DoHCurlClient class |this| will
-  // passed as a parameter of the callback.
-  curl_multi_setopt(curlm_, CURLMOPT_SOCKETDATA, this);
-  curl_multi_setopt(curlm_, CURLMOPT_SOCKETFUNCTION,
-                    &DoHCurlClient::SocketCallback);
+  // Share TLS sessions between queries, including the ones done on different
+  // connections.
+  curlsh_ = curl_share_init();
+  curl_share_setopt(curlsh_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 
-  // Set timer callback to `TimerCallback(...)`. This function will be called
-  // whenever a timeout change happened. DoHCurlClient class |this| will be
-  // passed as a parameter of the callback.
-  curl_multi_setopt(curlm_, CURLMOPT_TIMERDATA, this);
-  curl_multi_setopt(curlm_, CURLMOPT_TIMERFUNCTION,
-                    &DoHCurlClient::TimerCallback);
+  multi_ = std::make_unique<Multi>(this, MaxConnections());
 }
 
 DoHCurlClient::~DoHCurlClient() {
@@ -86,11 +120,46 @@ DoHCurlClient::~DoHCurlClient() {
   for (const auto& requests : requests_) {
     CancelRequest(requests.second);
   }
-  curl_multi_cleanup(curlm_);
-  curlm_ = nullptr;
+  // Closing the multi handles may still call `SocketCallback(...)`.
+  stale_multis_.clear();
+  multi_.reset();
+  curl_share_cleanup(curlsh_);
+  curlsh_ = nullptr;
   curl_global_cleanup();
 }
 
+long DoHCurlClient::MaxConnections() const {
+  // Only the first |max_concurrent_queries_| providers are queried.
+  const size_t providers = std::min(
+      doh_providers_.size(), static_cast<size_t>(max_concurrent_queries_));
+  return kMaxConnectionsPerProvider * std::max<long>(providers, 1);
+}
+
+DoHCurlClient::Multi* DoHCurlClient::FindMulti(CURLM* handle) {
+  if (multi_ && multi_->handle == handle)
+    return multi_.get();
+  for (const auto& multi : stale_multis_) {
+    if (multi->handle == handle)
+      return multi.get();
+  }
+  return nullptr;
+}
+
+void DoHCurlClient::CloseIdleStaleMultis() {
+  for (auto it = stale_multis_.begin(); it != stale_multis_.end();) {
+    CURLM* handle = (*it)->handle;
+    if (std::any_of(states_.begin(), states_.end(), [handle](const auto& s) {
+          return s.second->multi == handle;
+        })) {
+      ++it;
+      continue;
+    }
+    for (curl_socket_t socket_fd : (*it)->sockets)
+      RemoveWatcher(socket_fd);
+    it = stale_multis_.erase(it);
+  }
+}
+
 void DoHCurlClient::HandleResult(CURLMsg* curl_msg) {
   // `HandleResult(...)` may be called even after `CancelRequest(...)` is
   // called. This happens if a query is completed while queries are being
@@ -116,58 +185,70 @@ void DoHCurlClient::HandleResult(CURLMsg* curl_msg) {
   // TODO(jasongustaman): Get and save curl metrics.
 }
 
-void DoHCurlClient::CheckMultiInfo() {
+void DoHCurlClient::CheckMultiInfo(CURLM* multi) {
   CURLMsg* curl_msg = nullptr;
   int msgs_left = 0;
-  while ((curl_msg = curl_multi_info_read(curlm_, &msgs_left))) {
+  while ((curl_msg = curl_multi_info_read(multi, &msgs_left))) {
     if (curl_msg->msg != CURLMSG_DONE) {
       continue;
     }
     HandleResult(curl_msg);
   }
+
+  // CURL may still be running |multi| further up the stack, so stale multi
+  // handles are closed from a separate task.
+  if (!stale_multis_.empty()) {
+    base::ThreadTaskRunnerHandle::Get()->PostTask(
+        FROM_HERE, base::BindOnce(&DoHCurlClient::CloseIdleStaleMultis,
+                                  weak_factory_.GetWeakPtr()));
+  }
 }
 
-void DoHCurlClient::OnFileCanReadWithoutBlocking(curl_socket_t socket_fd) {
+void DoHCurlClient::OnFileCanReadWithoutBlocking(CURLM* multi,
+                                                 curl_socket_t socket_fd) {
   int still_running;
-  CURLMcode rc = curl_multi_socket_action(curlm_, socket_fd, CURL_CSELECT_IN,
+  CURLMcode rc = curl_multi_socket_action(multi, socket_fd, CURL_CSELECT_IN,
                                           &still_running);
   if (rc != CURLM_OK) {
     LOG(INFO) << "Failed to read from socket: " << curl_multi_strerror(rc);
     return;
   }
-  CheckMultiInfo();
+  CheckMultiInfo(multi);
 }
 
-void DoHCurlClient::OnFileCanWriteWithoutBlocking(curl_socket_t socket_fd) {
+void DoHCurlClient::OnFileCanWriteWithoutBlocking(CURLM* multi,
+                                                  curl_socket_t socket_fd) {
   int still_running;
-  CURLMcode rc = curl_multi_socket_action(curlm_, socket_fd, CURL_CSELECT_OUT,
+  CURLMcode rc = curl_multi_socket_action(multi, socket_fd, CURL_CSELECT_OUT,
                                           &still_running);
   if (rc != CURLM_OK) {
     LOG(INFO) << "Failed to write to socket: " << curl_multi_strerror(rc);
     return;
   }
-  CheckMultiInfo();
+  CheckMultiInfo(multi);
 }
 
-void DoHCurlClient::AddReadWatcher(curl_socket_t socket_fd) {
+void DoHCurlClient::AddReadWatcher(CURLM* multi, curl_socket_t socket_fd) {
   if (!base::Contains(read_watchers_, socket_fd)) {
     read_watchers_.emplace(
         socket_fd,
         base::FileDescriptorWatcher::WatchReadable(
             socket_fd,
             base::BindRepeating(&DoHCurlClient::OnFileCanReadWithoutBlocking,
-                                weak_factory_.GetWeakPtr(), socket_fd)));
+                                weak_factory_.GetWeakPtr(), multi,
+                                socket_fd)));
   }
 }
 
-void DoHCurlClient::AddWriteWatcher(curl_socket_t socket_fd) {
+void DoHCurlClient::AddWriteWatcher(CURLM* multi, curl_socket_t socket_fd) {
   if (!base::Contains(write_watchers_, socket_fd)) {
     write_watchers_.emplace(
         socket_fd,
-        base::FileDescriptorWatcher::WatchReadable(
+        base::FileDescriptorWatcher::WatchWritable(
             socket_fd,
             base::BindRepeating(&DoHCurlClient::OnFileCanWriteWithoutBlocking,
-                                weak_factory_.GetWeakPtr(), socket_fd)));
+                                weak_factory_.GetWeakPtr(), multi,
+                                socket_fd)));
   }
 }
 
@@ -178,19 +259,24 @@ void DoHCurlClient::RemoveWatcher(curl_socket_t socket_fd) {
 
 int DoHCurlClient::SocketCallback(
     CURL* easy, curl_socket_t socket_fd, int what, void* userp, void* socketp) {
-  DoHCurlClient* client = static_cast<DoHCurlClient*>(userp);
+  Multi* multi = static_cast<Multi*>(userp);
+  DoHCurlClient* client = multi->client;
   switch (what) {
     case CURL_POLL_IN:
-      client->AddReadWatcher(socket_fd);
+      multi->sockets.insert(socket_fd);
+      client->AddReadWatcher(multi->handle, socket_fd);
       return 0;
     case CURL_POLL_OUT:
-      client->AddWriteWatcher(socket_fd);
+      multi->sockets.insert(socket_fd);
+      client->AddWriteWatcher(multi->handle, socket_fd);
       return 0;
     case CURL_POLL_INOUT:
-      client->AddReadWatcher(socket_fd);
-      client->AddWriteWatcher(socket_fd);
+      multi->sockets.insert(socket_fd);
+      client->AddReadWatcher(multi->handle, socket_fd);
+      client->AddWriteWatcher(multi->handle, socket_fd);
       return 0;
     case CURL_POLL_REMOVE:
+      multi->sockets.erase(socket_fd);
       client->RemoveWatcher(socket_fd);
       return 0;
     default:
@@ -198,25 +284,26 @@ int DoHCurlClient::SocketCallback(
   }
 }
 
-void DoHCurlClient::TimeoutCallback() {
-  if (!curlm_) {
+void DoHCurlClient::TimeoutCallback(CURLM* multi) {
+  // The multi handle may have been closed since the timeout was set.
+  if (!FindMulti(multi)) {
     return;
   }
   int still_running;
-  curl_multi_socket_action(curlm_, CURL_SOCKET_TIMEOUT, 0, &still_running);
-  CheckMultiInfo();
+  curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
+  CheckMultiInfo(multi);
 }
 
 int DoHCurlClient::TimerCallback(CURLM* multi, long timeout_ms, void* userp) {
-  DoHCurlClient* client = static_cast<DoHCurlClient*>(userp);
-  if (timeout_ms > 0) {
+  DoHCurlClient* client = static_cast<Multi*>(userp)->client;
+  // CURL rejects calls to `curl_multi_socket_action(...)` made from within
+  // its callbacks, so an immediate timeout is also run from a task.
+  if (timeout_ms >= 0) {
     base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(
         FROM_HERE,
         base::BindRepeating(&DoHCurlClient::TimeoutCallback,
-                            client->GetWeakPtr()),
+                            client->GetWeakPtr(), multi),
         base::Milliseconds(timeout_ms));
-  } else if (timeout_ms == 0) {
-    client->TimeoutCallback();
   }
   return 0;
 }
@@ -244,17 +331,27 @@ size_t DoHCurlClient::HeaderCallback(char* data,
 
 void DoHCurlClient::SetNameServers(
     const std::vector<std::string>& name_servers) {
-  name_servers_ = base::JoinString(name_servers, ",");
+  const std::string joined = base::JoinString(name_servers, ",");
+  // The pooled connections were opened through the previous network. New
+  // queries get a new pool while the in-flight ones complete on the previous
+  // one.
+  if (!name_servers_.empty() && joined != name_servers_) {
+    stale_multis_.push_back(std::move(multi_));
+    multi_ = std::make_unique<Multi>(this, MaxConnections());
+    CloseIdleStaleMultis();
+  }
+  name_servers_ = joined;
 }
 
 void DoHCurlClient::SetDoHProviders(
     const std::vector<std::string>& doh_providers) {
   doh_providers_ = doh_providers;
+  curl_multi_setopt(multi_->handle, CURLMOPT_MAXCONNECTS, MaxConnections());
 }
 
 void DoHCurlClient::CancelRequest(const std::set<State*>& states) {
   for (const auto& state : states) {
-    curl_multi_remove_handle(curlm_, state->curl);
+    curl_multi_remove_handle(state->multi, state->curl);
     states_.erase(state->curl);
   }
 }
@@ -283,8 +380,8 @@ std::unique_ptr<DoHCurlClient::State> DoHCurlClient::InitCurl(
   }
 
   // Allocate a state for the request.
-  std::unique_ptr<State> state =
-      std::make_unique<State>(curl, callback, ctx, next_request_id_);
+  std::unique_ptr<State> state = std::make_unique<State>(
+      curl, multi_->handle, callback, ctx, next_request_id_);
 
   // Set the target URL which is the DoH provider to query to.
   curl_easy_setopt(curl, CURLOPT_URL, doh_provider.c_str());
@@ -324,6 +421,31 @@ std::unique_ptr<DoHCurlClient::State> DoHCurlClient::InitCurl(
   curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS, 1L);
   curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
 
+  // Use HTTP/2 when the DoH provider supports it.
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+
+  // Resume TLS sessions of previous connections.
+  curl_easy_setopt(curl, CURLOPT_SHARE, curlsh_);
+
+  if (!connection_pooling_) {
+    curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+    return state;
+  }
+
+  // Wait for a connection being established to the DoH provider instead of
+  // opening a parallel one, so that the query can be multiplexed on it.
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+  // Keep idle connections alive to be reused by the next queries.
+  curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN,
+                   static_cast<long>(kMaxConnectionAge.InSeconds()));
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE,
+                   static_cast<long>(kKeepAliveIdle.InSeconds()));
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL,
+                   static_cast<long>(kKeepAliveInterval.InSeconds()));
+
   return state;
 }
 
@@ -351,7 +473,7 @@ bool DoHCurlClient::Resolve(const char* msg,
     requests.emplace(state_ptr);
 
     // Runs the query asynchronously.
-    curl_multi_add_handle(curlm_, state_ptr->curl);
+    curl_multi_add_handle(multi_->handle, state_ptr->curl);
 
     // Queries at most |max_concurrent_queries_| times concurrently.
     num_concurrent_queries++;
@@ -70,6 +70,14 @@ class DoHCurlClientInterface {
 // response done through CURL. Given multiple DoH servers, DoHCurlClient will
 // query each servers concurrently. It will return only the first successful
 // response OR the last failing response.
+//
+// Connections to the DoH providers are pooled: they are kept open between
+// queries and concurrent queries to a provider are multiplexed as HTTP/2
+// streams over a single connection. TLS sessions are shared between
+// connections so that new connections can resume them. When the name servers
+// change, new queries get a new pool and the previous pool is closed as soon
+// as its in-flight queries are done, as its connections are likely bound to
+// the previous network.
 class DoHCurlClient : public DoHCurlClientInterface {
  public:
   DoHCurlClient(base::TimeDelta timeout, int max_concurrent_queries);
@@ -93,6 +101,10 @@ class DoHCurlClient : public DoHCurlClientInterface {
   void SetNameServers(const std::vector<std::string>& name_servers) override;
   void SetDoHProviders(const std::vector<std::string>& doh_providers) override;
 
+  // Enable or disable the reuse of connections between queries. Enabled by
+  // default, provided for benchmarks.
+  void set_connection_pooling(bool enabled) { connection_pooling_ = enabled; }
+
   // Returns a weak pointer to ensure that callbacks don't run after this class
   // is destroyed.
   base::WeakPtr<DoHCurlClient> GetWeakPtr() {
@@ -100,9 +112,26 @@ class DoHCurlClient : public DoHCurlClientInterface {
   }
 
  private:
+  // CURL multi handle, which runs queries and owns a pool of connections to
+  // the DoH providers. Its socket and timer callbacks get a pointer to it.
+  struct Multi {
+    Multi(DoHCurlClient* client, long max_connections);
+    ~Multi();
+
+    DoHCurlClient* client;
+    CURLM* handle;
+
+    // Sockets of |handle| being watched.
+    std::set<curl_socket_t> sockets;
+  };
+
   // State of an individual query.
   struct State {
-    State(CURL* curl, const QueryCallback& callback, void* ctx, int request_id);
+    State(CURL* curl,
+          CURLM* multi,
+          const QueryCallback& callback,
+          void* ctx,
+          int request_id);
     ~State();
 
     // Fetch the necessary response and run |callback|.
@@ -114,6 +143,9 @@ class DoHCurlClient : public DoHCurlClientInterface {
     // Stores the CURL handle for the query.
     CURL* curl;
 
+    // Multi handle running the query.
+    CURLM* multi;
+
     // Stores the response of a query.
     std::vector<uint8_t> response;
 
@@ -185,8 +217,8 @@ class DoHCurlClient : public DoHCurlClientInterface {
                                size_t nitems,
                                void* userp);
 
-  // Callback informed when a query timed out.
-  void TimeoutCallback();
+  // Callback informed when a query of |multi| timed out.
+  void TimeoutCallback(CURLM* multi);
 
   // Callback informed to start the query and to handle timeout, method
   // signature matches CURL `timer_callback(...)`. This callback is registered
@@ -201,22 +233,23 @@ class DoHCurlClient : public DoHCurlClientInterface {
   // query completion.
   static int TimerCallback(CURLM* multi, long timeout_ms, void* userp);
 
-  // Methods to update CURL socket watchers for asynchronous CURL events.
-  // When an action is observed, `CheckMultiInfo()` will be called.
-  void AddReadWatcher(curl_socket_t socket_fd);
-  void AddWriteWatcher(curl_socket_t socket_fd);
+  // Methods to update CURL socket watchers for asynchronous CURL events of
+  // |multi|. When an action is observed, `CheckMultiInfo()` will be called.
+  void AddReadWatcher(CURLM* multi, curl_socket_t socket_fd);
+  void AddWriteWatcher(CURLM* multi, curl_socket_t socket_fd);
   void RemoveWatcher(curl_socket_t socket_fd);
 
   // Callback called whenever an event is ready to be handled by CURL on
-  // |socket_fd|. This callback is registered through the core event loop.
-  void OnFileCanReadWithoutBlocking(curl_socket_t socket_fd);
-  void OnFileCanWriteWithoutBlocking(curl_socket_t socket_fd);
+  // |socket_fd| of |multi|. This callback is registered through the core
+  // event loop.
+  void OnFileCanReadWithoutBlocking(CURLM* multi, curl_socket_t socket_fd);
+  void OnFileCanWriteWithoutBlocking(CURLM* multi, curl_socket_t socket_fd);
 
   // Checks for a querycompletion and handles its result.
   // These functions are called when CURL just finished processing an event.
   // |curl_msg| is owned by CURL, DoHCurlClient should not care about its
   // lifecycle.
-  void CheckMultiInfo();
+  void CheckMultiInfo(CURLM* multi);
   void HandleResult(CURLMsg* curl_msg);
 
   // Cancel an in-flight request denoted by a set of states |states|.
@@ -225,6 +258,18 @@ class DoHCurlClient : public DoHCurlClientInterface {
   // Cancel in-flight request of identifier |request_id|.
   void CancelRequest(int request_id);
 
+  // Returns the live multi handle |handle| belongs to, or nullptr if it was
+  // closed.
+  Multi* FindMulti(CURLM* handle);
+
+  // Closes the stale multi handles that have no in-flight query anymore,
+  // along with their connections.
+  void CloseIdleStaleMultis();
+
+  // Maximum number of connections kept in a pool for the DoH providers
+  // queried.
+  long MaxConnections() const;
+
   // Timeout for a CURL query in seconds.
   int64_t timeout_seconds_;
 
@@ -257,8 +302,19 @@ class DoHCurlClient : public DoHCurlClientInterface {
   // resolve call to keep the unique value.
   int next_request_id_;
 
-  // CURL multi handle to do asynchronous requests.
-  CURLM* curlm_;
+  // CURL multi handle running new queries. It owns the pool of connections
+  // to the DoH providers.
+  std::unique_ptr<Multi> multi_;
+
+  // Multi handles used before the name servers changed. They are closed once
+  // their in-flight queries are done.
+  std::vector<std::unique_ptr<Multi>> stale_multis_;
+
+  // CURL share handle to share TLS sessions between queries.
+  CURLSH* curlsh_;
+
+  // Reuse connections between queries if true.
+  bool connection_pooling_;
 
   base::WeakPtrFactory<DoHCurlClient> weak_factory_{this};
 };
@@ -0,0 +1,108 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dns-proxy/doh_curl_client.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/run_loop.h>
+#include <base/test/task_environment.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "dns-proxy/fake_doh_server.h"
+
+namespace dns_proxy {
+namespace {
+
+constexpr base::TimeDelta kTimeout = base::Seconds(5);
+
+// Query for google.com A.
+const char kQuery[] = {'\x12', '\x34', '\x01', '\x00', '\x00', '\x01', '\x00',
+                       '\x00', '\x00', '\x00', '\x00', '\x00', '\x06', 'g',
+                       'o',    'o',    'g',    'l',    'e',    '\x03', 'c',
+                       'o',    'm',    '\x00', '\x00', '\x01', '\x00', '\x01'};
+
+class DoHCurlClientTest : public testing::Test {
+ protected:
+  DoHCurlClientTest() : client_(kTimeout, 1) {
+    client_.SetNameServers({"127.0.0.1"});
+    client_.SetDoHProviders({server_.url()});
+  }
+
+  void Send() {
+    ASSERT_TRUE(client_.Resolve(
+        kQuery, sizeof(kQuery),
+        base::BindRepeating(&DoHCurlClientTest::OnResponse,
+                            base::Unretained(this)),
+        nullptr));
+    num_pending_++;
+  }
+
+  // Runs until all the queries sent are answered.
+  void WaitForResponses() {
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+  }
+
+  void OnResponse(void* ctx,
+                  const DoHCurlClientInterface::CurlResult& res,
+                  unsigned char* msg,
+                  size_t len) {
+    EXPECT_EQ(res.curl_code, CURLE_OK);
+    EXPECT_EQ(res.http_code, kHTTPOk);
+    if (--num_pending_ == 0)
+      std::move(quit_closure_).Run();
+  }
+
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::MainThreadType::IO};
+  FakeDoHServer server_;
+  DoHCurlClient client_;
+  int num_pending_ = 0;
+  base::OnceClosure quit_closure_;
+};
+
+TEST_F(DoHCurlClientTest, ReusesConnection) {
+  for (int i = 0; i < 3; i++) {
+    Send();
+    WaitForResponses();
+  }
+
+  EXPECT_EQ(server_.num_connections(), 1);
+  EXPECT_EQ(server_.request_connections(), std::vector<int>({0, 0, 0}));
+}
+
+TEST_F(DoHCurlClientTest, NameServersChangeClosesConnectionsWhenIdle) {
+  Send();
+  WaitForResponses();
+
+  // A query in flight when the name servers change completes on the previous
+  // connection while new queries get a new one.
+  Send();
+  client_.SetNameServers({"127.0.0.2"});
+  Send();
+  WaitForResponses();
+  Send();
+  WaitForResponses();
+  // Let the client close the previous connection and the server notice it.
+  base::RunLoop().RunUntilIdle();
+
+  EXPECT_EQ(server_.num_connections(), 2);
+  EXPECT_EQ(server_.num_closed_connections(), 1);
+  std::vector<int> connections = server_.request_connections();
+  ASSERT_EQ(connections.size(), 4);
+  EXPECT_EQ(connections[0], 0);
+  std::sort(connections.begin() + 1, connections.begin() + 3);
+  EXPECT_EQ(connections[1], 0);
+  EXPECT_EQ(connections[2], 1);
+  EXPECT_EQ(connections[3], 1);
+}
+
+}  // namespace
+}  // namespace dns_proxy
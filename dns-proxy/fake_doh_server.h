@@ -0,0 +1,158 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DNS_PROXY_FAKE_DOH_SERVER_H_
+#define DNS_PROXY_FAKE_DOH_SERVER_H_
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/check.h>
+#include <base/files/file_descriptor_watcher_posix.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+
+namespace dns_proxy {
+
+// Minimal HTTP/1.1 server answering every DoH POST request with the query
+// echoed back as a response. Connections are kept alive. It stands in for a
+// DoH provider in tests and benchmarks of DoHCurlClient.
+class FakeDoHServer {
+ public:
+  FakeDoHServer() {
+    fd_.reset(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    PCHECK(fd_.is_valid());
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    PCHECK(bind(fd_.get(), reinterpret_cast<struct sockaddr*>(&addr), len) ==
+           0);
+    PCHECK(listen(fd_.get(), SOMAXCONN) == 0);
+    PCHECK(getsockname(fd_.get(), reinterpret_cast<struct sockaddr*>(&addr),
+                       &len) == 0);
+    url_ = base::StringPrintf("http://127.0.0.1:%d/dns-query",
+                              ntohs(addr.sin_port));
+    watcher_ = base::FileDescriptorWatcher::WatchReadable(
+        fd_.get(), base::BindRepeating(&FakeDoHServer::OnConnection,
+                                       base::Unretained(this)));
+  }
+  FakeDoHServer(const FakeDoHServer&) = delete;
+  FakeDoHServer& operator=(const FakeDoHServer&) = delete;
+
+  const std::string& url() const { return url_; }
+  // Number of connections accepted so far.
+  int num_connections() const { return num_connections_; }
+  // Number of connections closed by the client so far.
+  int num_closed_connections() const { return num_closed_connections_; }
+  // Index in accepting order, starting at 0, of the connection each request
+  // was received on.
+  const std::vector<int>& request_connections() const {
+    return request_connections_;
+  }
+
+ private:
+  struct Connection {
+    int index;
+    base::ScopedFD fd;
+    std::string data;
+    std::unique_ptr<base::FileDescriptorWatcher::Controller> watcher;
+  };
+
+  void OnConnection() {
+    base::ScopedFD fd(HANDLE_EINTR(
+        accept4(fd_.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)));
+    if (!fd.is_valid())
+      return;
+    auto conn = std::make_unique<Connection>();
+    conn->index = num_connections_++;
+    conn->watcher = base::FileDescriptorWatcher::WatchReadable(
+        fd.get(), base::BindRepeating(&FakeDoHServer::OnReadable,
+                                      base::Unretained(this), fd.get()));
+    conn->fd = std::move(fd);
+    connections_[conn->fd.get()] = std::move(conn);
+  }
+
+  void OnReadable(int fd) {
+    Connection* conn = connections_[fd].get();
+    char buf[4096];
+    const ssize_t len = HANDLE_EINTR(read(fd, buf, sizeof(buf)));
+    if (len < 0 && errno == EAGAIN)
+      return;
+    if (len <= 0) {
+      num_closed_connections_++;
+      connections_.erase(fd);
+      return;
+    }
+    conn->data.append(buf, len);
+
+    // Answer all the complete requests received.
+    for (;;) {
+      const size_t headers_end = conn->data.find("\r\n\r\n");
+      if (headers_end == std::string::npos)
+        return;
+      const size_t body_start = headers_end + 4;
+      const size_t body_len =
+          ContentLength(base::ToLowerASCII(conn->data.substr(0, headers_end)));
+      if (conn->data.size() < body_start + body_len)
+        return;
+
+      // Echo the query with the QR bit set.
+      std::string response = conn->data.substr(body_start, body_len);
+      conn->data.erase(0, body_start + body_len);
+      request_connections_.push_back(conn->index);
+      if (response.size() > 2)
+        response[2] |= 0x80;
+      const std::string reply = base::StringPrintf(
+          "HTTP/1.1 200 OK\r\n"
+          "Content-Type: application/dns-message\r\n"
+          "Content-Length: %zu\r\n\r\n",
+          response.size());
+      if (!base::WriteFileDescriptor(fd, reply + response)) {
+        connections_.erase(fd);
+        return;
+      }
+    }
+  }
+
+  static size_t ContentLength(const std::string& headers) {
+    static constexpr char kContentLength[] = "content-length:";
+    const size_t pos = headers.find(kContentLength);
+    if (pos == std::string::npos)
+      return 0;
+    const size_t start = pos + sizeof(kContentLength) - 1;
+    const size_t end = headers.find("\r\n", start);
+    size_t len = 0;
+    base::StringToSizeT(base::TrimWhitespaceASCII(
+                            headers.substr(start, end - start), base::TRIM_ALL),
+                        &len);
+    return len;
+  }
+
+  base::ScopedFD fd_;
+  std::unique_ptr<base::FileDescriptorWatcher::Controller> watcher_;
+  std::string url_;
+  int num_connections_ = 0;
+  int num_closed_connections_ = 0;
+  std::vector<int> request_connections_;
+  std::map<int, std::unique_ptr<Connection>> connections_;
+};
+
+}  // namespace dns_proxy
+
+#endif  // DNS_PROXY_FAKE_DOH_SERVER_H_
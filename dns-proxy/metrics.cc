@@ -29,6 +29,8 @@ constexpr char kQueryResultsTemplate[] = "Network.DnsProxy.$1Query.Results";
 constexpr char kQueryErrorsTemplate[] = "Network.DnsProxy.$1Query.Errors";
 constexpr char kHttpErrors[] = "Network.DnsProxy.DnsOverHttpsQuery.HttpErrors";
 
+constexpr char kCacheResults[] = "Network.DnsProxy.Cache.Results";
+
 constexpr char kQueryDurationTemplate[] = "Network.DnsProxy.Query.$1$2Duration";
 constexpr char kQueryDurationResolveTemplate[] =
     "Network.DnsProxy.$1Query.$2ResolveDuration";
@@ -184,6 +186,10 @@ void Metrics::RecordQueryResolveDuration(QueryType type,
                      kQueryDurationMillisecondsBuckets);
 }
 
+void Metrics::RecordCacheResult(Metrics::CacheResult result) {
+  metrics_.SendEnumToUMA(kCacheResults, result);
+}
+
 Metrics::QueryTimer::~QueryTimer() {
   Stop();
   Record(metrics_);
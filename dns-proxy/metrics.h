@@ -131,6 +131,16 @@ class Metrics {
     kMaxValue = kOtherServerError,
   };
 
+  // These values are persisted to logs. Entries should not be renumbered and
+  // numeric values should never be reused.
+  enum class CacheResult {
+    kMiss = 0,
+    kHit = 1,
+    kNegativeHit = 2,
+
+    kMaxValue = kNegativeHit,
+  };
+
   // Helper class for measuring time elapsed during different stages of the
   // name resolution process. Accumulates stage timings for later use so that
   // logging metrics do not impact the time spans with i/o overhead.
@@ -190,6 +200,7 @@ class Metrics {
   void RecordQueryResolveDuration(QueryType type,
                                   int64_t ms,
                                   bool success = true);
+  void RecordCacheResult(CacheResult result);
 
  private:
   MetricsLibrary metrics_;
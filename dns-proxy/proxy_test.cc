@@ -6,12 +6,19 @@
 
 #include <fcntl.h>
 #include <linux/rtnetlink.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 
 #include <memory>
+#include <set>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include <base/files/scoped_file.h>
+#include <base/test/task_environment.h>
+#include <base/time/time.h>
 #include <chromeos/patchpanel/net_util.h>
 #include <chromeos/patchpanel/dbus/fake_client.h>
 #include <dbus/mock_bus.h>
@@ -235,6 +242,52 @@ class MockResolver : public Resolver {
               (override));
 };
 
+// Records the queries sent upstream and answers them on demand.
+class CountingAresClient : public AresClient {
+ public:
+  CountingAresClient()
+      : AresClient(kRequestTimeout,
+                   kRequestMaxRetry,
+                   kDefaultMaxConcurrentQueries) {}
+  ~CountingAresClient() = default;
+
+  bool Resolve(const unsigned char* msg,
+               size_t len,
+               const QueryCallback& callback,
+               void* ctx) override {
+    queries_.push_back(
+        {std::string(reinterpret_cast<const char*>(msg), len), callback, ctx});
+    num_queries_++;
+    return true;
+  }
+
+  void SetNameServers(const std::vector<std::string>& name_servers) override {}
+
+  // Answers all the pending queries with the query echoed back as response.
+  void AnswerAll() {
+    std::vector<Query> queries = std::move(queries_);
+    queries_.clear();
+    for (auto& query : queries) {
+      query.msg[2] |= 0x80;
+      query.callback.Run(query.ctx, ARES_SUCCESS,
+                         reinterpret_cast<unsigned char*>(&query.msg[0]),
+                         query.msg.size());
+    }
+  }
+
+  int num_queries() const { return num_queries_; }
+
+ private:
+  struct Query {
+    std::string msg;
+    QueryCallback callback;
+    void* ctx;
+  };
+
+  std::vector<Query> queries_;
+  int num_queries_ = 0;
+};
+
 class TestProxy : public Proxy {
  public:
   TestProxy(const Options& opts,
@@ -1981,4 +2034,76 @@ TEST_F(ProxyTest, UpdateNameServers) {
   EXPECT_THAT(proxy.doh_config_.ipv6_nameservers(),
               ElementsAreArray(expected_ipv6_dns_addresses));
 }
+
+// |kBurstClients| clients each send |kBurstQueriesPerClient| queries for
+// |kBurstNames| different names before any response is received from
+// upstream. Only one query per name must be sent upstream, and every client
+// query must be answered with its own ID.
+TEST(ProxyBurstTest, IdenticalQueriesSentUpstreamOnce) {
+  constexpr int kBurstClients = 8;
+  constexpr int kBurstQueriesPerClient = 64;
+  constexpr int kBurstNames = 4;
+
+  base::test::TaskEnvironment task_environment;
+  auto scoped_ares_client = std::make_unique<CountingAresClient>();
+  CountingAresClient* ares_client = scoped_ares_client.get();
+  Resolver resolver(std::move(scoped_ares_client),
+                    std::make_unique<DoHCurlClient>(
+                        kRequestTimeout, kDefaultMaxConcurrentQueries));
+  resolver.SetNameServers({"8.8.8.8"});
+
+  std::vector<base::ScopedFD> clients;
+  std::vector<base::ScopedFD> servers;
+  for (int i = 0; i < kBurstClients; i++) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    clients.emplace_back(fds[0]);
+    servers.emplace_back(fds[1]);
+  }
+
+  uint16_t id = 0;
+  for (int i = 0; i < kBurstQueriesPerClient; i++) {
+    for (const auto& server : servers) {
+      // Query for host<n>.example.com A, with the RD flag set.
+      std::string query(12, '\0');
+      query[0] = id >> 8;
+      query[1] = id & 0xff;
+      query[2] = 0x01;
+      query[5] = 1;
+      query += std::string("\x05" "host") +
+               static_cast<char>('0' + id % kBurstNames) +
+               "\x07" "example" "\x03" "com";
+      query.append("\x00\x00\x01\x00\x01", 5);
+
+      auto* sock_fd = new Resolver::SocketFd(SOCK_STREAM, server.get());
+      memcpy(sock_fd->msg, query.data(), query.size());
+      sock_fd->len = query.size();
+      resolver.Resolve(sock_fd);
+      id++;
+    }
+  }
+  EXPECT_EQ(kBurstNames, ares_client->num_queries());
+  ares_client->AnswerAll();
+
+  // Every client receives one reply per query, with the ID of the query.
+  for (int c = 0; c < kBurstClients; c++) {
+    std::set<uint16_t> expected_ids;
+    for (int i = 0; i < kBurstQueriesPerClient; i++)
+      expected_ids.insert(i * kBurstClients + c);
+
+    std::set<uint16_t> ids;
+    unsigned char buf[4096];
+    ssize_t len;
+    std::string data;
+    while ((len = recv(clients[c].get(), buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+      data.append(reinterpret_cast<char*>(buf), len);
+    // Replies over TCP are prefixed by their 2-bytes length.
+    for (size_t offset = 0; offset + 4 <= data.size();) {
+      const auto* p = reinterpret_cast<const uint8_t*>(data.data() + offset);
+      ids.insert((p[2] << 8) | p[3]);
+      offset += 2 + ((p[0] << 8) | p[1]);
+    }
+    EXPECT_EQ(expected_ids, ids) << "client " << c;
+  }
+}
 }  // namespace dns_proxy
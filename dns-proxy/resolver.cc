@@ -100,7 +100,12 @@ Metrics::QueryError CurlCodeMetric(int code) {
 }  // namespace
 
 Resolver::SocketFd::SocketFd(int type, int fd)
-    : type(type), fd(fd), num_retries(0) {
+    : type(type),
+      fd(fd),
+      msg(buf),
+      len(0),
+      num_retries(0),
+      cache_generation(0) {
   if (type == SOCK_STREAM) {
     socklen = 0;
     return;
@@ -123,6 +128,7 @@ Resolver::Resolver(base::TimeDelta timeout,
                    int max_concurrent_queries)
     : always_on_doh_(false),
       doh_enabled_(false),
+      cache_generation_(0),
       retry_delay_(retry_delay),
       max_num_retries_(max_num_retries),
       ares_client_(
@@ -135,6 +141,7 @@ Resolver::Resolver(std::unique_ptr<AresClient> ares_client,
                    std::unique_ptr<Metrics> metrics)
     : always_on_doh_(false),
       doh_enabled_(false),
+      cache_generation_(0),
       ares_client_(std::move(ares_client)),
       curl_client_(std::move(curl_client)),
       metrics_(std::move(metrics)) {}
@@ -214,9 +221,12 @@ void Resolver::HandleAresResult(void* ctx,
 
   if (status != ARES_SUCCESS) {
     LOG(ERROR) << "Failed to do ares lookup: " << ares_strerror(status);
+    ReplyAttachedQueries(sock_fd.get(), nullptr, 0);
     return;
   }
   ReplyDNS(sock_fd.get(), msg, len);
+  ReplyAttachedQueries(sock_fd.get(), msg, len);
+  CacheResponse(sock_fd.get(), msg, len);
 }
 
 void Resolver::HandleCurlResult(void* ctx,
@@ -234,6 +244,7 @@ void Resolver::HandleCurlResult(void* ctx,
                << curl_easy_strerror(res.curl_code);
     if (always_on_doh_) {
       // TODO(jasongustaman): Send failure reply with RCODE.
+      ReplyAttachedQueries(sock_fd, nullptr, 0);
       delete sock_fd;
       return;
     }
@@ -247,6 +258,8 @@ void Resolver::HandleCurlResult(void* ctx,
   switch (res.http_code) {
     case kHTTPOk: {
       ReplyDNS(sock_fd, msg, len);
+      ReplyAttachedQueries(sock_fd, msg, len);
+      CacheResponse(sock_fd, msg, len);
       delete sock_fd;
       return;
     }
@@ -254,6 +267,7 @@ void Resolver::HandleCurlResult(void* ctx,
       if (sock_fd->num_retries >= max_num_retries_) {
         LOG(ERROR) << "Failed to resolve hostname, retried " << max_num_retries_
                    << " tries";
+        ReplyAttachedQueries(sock_fd, nullptr, 0);
         delete sock_fd;
         return;
       }
@@ -277,6 +291,7 @@ void Resolver::HandleCurlResult(void* ctx,
                  << res.http_code;
       if (always_on_doh_) {
         // TODO(jasongustaman): Send failure reply with RCODE.
+        ReplyAttachedQueries(sock_fd, nullptr, 0);
         delete sock_fd;
       } else {
         base::ThreadTaskRunnerHandle::Get()->PostTask(
@@ -323,13 +338,96 @@ void Resolver::ReplyDNS(SocketFd* sock_fd, unsigned char* msg, size_t len) {
   }
 }
 
+bool Resolver::ReplyFromCache(SocketFd* sock_fd) {
+  std::string response;
+  const Metrics::CacheResult result =
+      cache_.Get(sock_fd->msg, sock_fd->len, &response);
+  if (metrics_)
+    metrics_->RecordCacheResult(result);
+  if (result == Metrics::CacheResult::kMiss)
+    return false;
+
+  ReplyDNS(sock_fd, reinterpret_cast<unsigned char*>(&response[0]),
+           response.size());
+  return true;
+}
+
+void Resolver::CacheResponse(SocketFd* sock_fd,
+                             unsigned char* msg,
+                             size_t len) {
+  if (sock_fd->cache_generation != cache_generation_)
+    return;
+  cache_.Put(sock_fd->msg, sock_fd->len, msg, len);
+}
+
+bool Resolver::AttachToPendingQuery(SocketFd* sock_fd) {
+  if (sock_fd->len <
+      static_cast<ssize_t>(sizeof(patchpanel::dns_protocol::Header))) {
+    return false;
+  }
+
+  // The response to a query is only reused for queries that are identical
+  // but for their ID, and received over the same transport: the header flags
+  // (e.g. RD, CD), the case of the question and the EDNS options of a query
+  // change its response, and responses over UDP may be truncated.
+  std::string key(1, static_cast<char>(sock_fd->type));
+  key.append(sock_fd->msg + sizeof(uint16_t),
+             sock_fd->len - sizeof(uint16_t));
+
+  const auto it = pending_queries_.find(key);
+  if (it != pending_queries_.end()) {
+    it->second.emplace_back(sock_fd);
+    return true;
+  }
+  pending_queries_.emplace(key, std::vector<std::unique_ptr<SocketFd>>());
+  sock_fd->pending_key = std::move(key);
+  return false;
+}
+
+void Resolver::ReplyAttachedQueries(SocketFd* sock_fd,
+                                    unsigned char* msg,
+                                    size_t len) {
+  if (sock_fd->pending_key.empty())
+    return;
+  const auto it = pending_queries_.find(sock_fd->pending_key);
+  sock_fd->pending_key.clear();
+  if (it == pending_queries_.end())
+    return;
+  std::vector<std::unique_ptr<SocketFd>> attached = std::move(it->second);
+  pending_queries_.erase(it);
+
+  // Without response, the attached queries are dropped like |sock_fd|.
+  if (!msg || len < sizeof(uint16_t))
+    return;
+  std::string response(reinterpret_cast<char*>(msg), len);
+  for (const auto& attached_sock_fd : attached) {
+    // Reply with the transaction ID of the attached query.
+    memcpy(&response[0], attached_sock_fd->msg, sizeof(uint16_t));
+    ReplyDNS(attached_sock_fd.get(),
+             reinterpret_cast<unsigned char*>(&response[0]), response.size());
+  }
+}
+
+void Resolver::FlushCache() {
+  cache_.Clear();
+  cache_generation_++;
+}
+
 void Resolver::SetNameServers(const std::vector<std::string>& name_servers) {
+  if (name_servers != name_servers_) {
+    name_servers_ = name_servers;
+    FlushCache();
+  }
   ares_client_->SetNameServers(name_servers);
   curl_client_->SetNameServers(name_servers);
 }
 
 void Resolver::SetDoHProviders(const std::vector<std::string>& doh_providers,
                                bool always_on_doh) {
+  if (doh_providers != doh_providers_ || always_on_doh != always_on_doh_) {
+    doh_providers_ = doh_providers;
+    FlushCache();
+  }
   always_on_doh_ = always_on_doh;
   doh_enabled_ = !doh_providers.empty();
   curl_client_->SetDoHProviders(doh_providers);
@@ -391,6 +489,18 @@ void Resolver::OnDNSQuery(int fd, int type) {
 }
 
 void Resolver::Resolve(SocketFd* sock_fd, bool fallback) {
+  // Only look up the cache on the first attempt of a query.
+  if (!fallback && sock_fd->num_retries == 0) {
+    sock_fd->cache_generation = cache_generation_;
+    if (ReplyFromCache(sock_fd)) {
+      delete sock_fd;
+      return;
+    }
+    if (AttachToPendingQuery(sock_fd)) {
+      return;
+    }
+  }
+
   if (doh_enabled_ && !fallback) {
     sock_fd->timer.StartResolve(true);
     if (curl_client_->Resolve(sock_fd->msg, sock_fd->len,
@@ -419,6 +529,9 @@ void Resolver::Resolve(SocketFd* sock_fd, bool fallback) {
   ReplyDNS(sock_fd,
            reinterpret_cast<unsigned char*>(response.io_buffer()->data()),
            response.io_buffer_size());
+  ReplyAttachedQueries(
+      sock_fd, reinterpret_cast<unsigned char*>(response.io_buffer()->data()),
+      response.io_buffer_size());
   // |sock_fd| pointer must be deleted when the request associated with the
   // pointer is done. Normally, the pointer is deleted after c-ares or CURL
   // finish handling the request, `HandleAresResult(...)` or
@@ -17,6 +17,7 @@
 #include <chromeos/patchpanel/socket.h>
 
 #include "dns-proxy/ares_client.h"
+#include "dns-proxy/dns_cache.h"
 #include "dns-proxy/doh_curl_client.h"
 #include "dns-proxy/metrics.h"
 
@@ -76,6 +77,15 @@ class Resolver {
     // a certain threshold.
     int num_retries;
 
+    // Value of the resolver's cache generation when the query was first
+    // resolved.
+    // Responses are not cached if the cache was flushed in between.
+    uint64_t cache_generation;
+
+    // Key of the query in |pending_queries_| if identical queries received
+    // while it is in flight are attached to it, empty otherwise.
+    std::string pending_key;
+
     // Records timings for metrics.
     Metrics::QueryTimer timer;
   };
@@ -131,6 +141,7 @@ class Resolver {
 
   // Resolve a domain using CURL or Ares using data from |sock_fd|.
   // If |fallback| is true, force to use standard plain-text DNS.
+  // Queries answered by the cache are replied to without being forwarded.
   void Resolve(SocketFd* sock_fd, bool fallback = false);
 
   // Create a SERVFAIL response from a DNS query |msg| of length |len|.
@@ -156,12 +167,48 @@ class Resolver {
   // Send back data taken from CURL or Ares to the client.
   void ReplyDNS(SocketFd* sock_fd, unsigned char* msg, size_t len);
 
+  // Reply to the query of |sock_fd| from |cache_|. Returns false if the
+  // response is not cached.
+  bool ReplyFromCache(SocketFd* sock_fd);
+
+  // Store the response |msg| of length |len| to the query of |sock_fd| in
+  // |cache_|.
+  void CacheResponse(SocketFd* sock_fd, unsigned char* msg, size_t len);
+
+  // Attach the query of |sock_fd| to an identical query in flight. Returns
+  // false if there is none, in which case the following identical queries
+  // will be attached to |sock_fd| until `ReplyAttachedQueries(...)` is called.
+  bool AttachToPendingQuery(SocketFd* sock_fd);
+
+  // Reply to the queries attached to |sock_fd| with the response |msg| of
+  // length |len| and their own transaction ID. If |msg| is null, the attached
+  // queries are dropped.
+  void ReplyAttachedQueries(SocketFd* sock_fd, unsigned char* msg, size_t len);
+
+  // Remove all the responses from |cache_|. Responses to queries in flight
+  // will not be cached.
+  void FlushCache();
+
   // Disallow DoH fallback to standard plain-text DNS.
   bool always_on_doh_;
 
   // Resolve using DoH if true.
   bool doh_enabled_;
 
+  // Servers currently in use, used to flush |cache_| when they change.
+  std::vector<std::string> name_servers_;
+  std::vector<std::string> doh_providers_;
+
+  // Responses to previous queries.
+  DnsCache cache_;
+  // Incremented every time |cache_| is flushed.
+  uint64_t cache_generation_;
+
+  // Queries waiting for the response of an identical query in flight, keyed
+  // by their transport and their content but for their ID.
+  std::map<std::string, std::vector<std::unique_ptr<SocketFd>>>
+      pending_queries_;
+
   // Watch |tcp_src_| for incoming TCP connections.
   std::unique_ptr<patchpanel::Socket> tcp_src_;
   std::unique_ptr<base::FileDescriptorWatcher::Controller> tcp_src_watcher_;
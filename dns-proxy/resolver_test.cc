@@ -4,9 +4,14 @@
 
 #include "dns-proxy/resolver.h"
 
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
 #include <utility>
 #include <vector>
 
+#include <base/files/scoped_file.h>
 #include <base/test/task_environment.h>
 #include <base/time/time.h>
 #include <gmock/gmock.h>
@@ -27,6 +32,18 @@ const std::vector<std::string> kTestDoHProviders{
 constexpr base::TimeDelta kTimeout = base::Seconds(3);
 constexpr int32_t kMaxNumRetries = 1;
 
+// Query for google.com A and its response with one record valid for 300s.
+const char kCachedQuery[] = {'\x12', '\x34', '\x01', '\x00', '\x00', '\x01',
+                             '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+                             '\x06', 'g',    'o',    'o',    'g',    'l',
+                             'e',    '\x03', 'c',    'o',    'm',    '\x00',
+                             '\x00', '\x01', '\x00', '\x01'};
+const unsigned char kCachedResponse[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00,
+    0x00, 0x06, 'g',  'o',  'o',  'g',  'l',  'e',  0x03, 'c',  'o',
+    'm',  0x00, 0x00, 0x01, 0x00, 0x01, 0xc0, 0x0c, 0x00, 0x01, 0x00,
+    0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x04, 0x08, 0x08, 0x08, 0x08};
+
 class MockDoHCurlClient : public DoHCurlClient {
  public:
   MockDoHCurlClient() : DoHCurlClient(kTimeout, kDefaultMaxConcurrentQueries) {}
@@ -72,6 +89,26 @@ class ResolverTest : public testing::Test {
                                            std::move(scoped_curl_client));
   }
 
+  // Returns the query |kCachedQuery| received from a TCP client on |fd|, with
+  // the ID |id|.
+  Resolver::SocketFd* NewQuery(int fd, uint16_t id) {
+    auto* sock_fd = new Resolver::SocketFd(SOCK_STREAM, fd);
+    memcpy(sock_fd->msg, kCachedQuery, sizeof(kCachedQuery));
+    sock_fd->msg[0] = id >> 8;
+    sock_fd->msg[1] = id & 0xff;
+    sock_fd->len = sizeof(kCachedQuery);
+    return sock_fd;
+  }
+
+  // Reads a reply sent over TCP on |fd| and returns its ID.
+  uint16_t ReadReplyId(int fd) {
+    std::vector<unsigned char> buf(2 + sizeof(kCachedResponse));
+    EXPECT_EQ(static_cast<ssize_t>(buf.size()),
+              recv(fd, buf.data(), buf.size(), MSG_DONTWAIT));
+    EXPECT_TRUE(std::equal(buf.begin() + 4, buf.end(), kCachedResponse + 2));
+    return (buf[2] << 8) | buf[3];
+  }
+
   base::test::TaskEnvironment task_environment_;
 
   MockAresClient* ares_client_;
@@ -217,6 +254,127 @@ TEST_F(ResolverTest, HandleAresResult_Fail) {
                               nullptr, 0);
 }
 
+TEST_F(ResolverTest, Resolve_CachedResponse) {
+  EXPECT_CALL(*ares_client_, Resolve(_, _, _, _)).WillOnce(Return(true));
+  EXPECT_CALL(*curl_client_, Resolve(_, _, _, _)).Times(0);
+
+  resolver_->SetNameServers(kTestNameServers);
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  base::ScopedFD client(fds[0]);
+  base::ScopedFD server(fds[1]);
+
+  Resolver::SocketFd* sock_fd = NewQuery(server.get(), 0x1234);
+  resolver_->Resolve(sock_fd);
+  resolver_->HandleAresResult(
+      sock_fd, ARES_SUCCESS, const_cast<unsigned char*>(kCachedResponse),
+      sizeof(kCachedResponse));
+  EXPECT_EQ(0x1234, ReadReplyId(client.get()));
+
+  // Setting the same name servers again keeps the cache.
+  resolver_->SetNameServers(kTestNameServers);
+  resolver_->Resolve(NewQuery(server.get(), 0x5678));
+  EXPECT_EQ(0x5678, ReadReplyId(client.get()));
+}
+
+TEST_F(ResolverTest, Resolve_CacheFlushedOnNameServersChange) {
+  EXPECT_CALL(*ares_client_, Resolve(_, _, _, _))
+      .Times(2)
+      .WillRepeatedly(Return(true));
+
+  resolver_->SetNameServers(kTestNameServers);
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  base::ScopedFD client(fds[0]);
+  base::ScopedFD server(fds[1]);
+
+  Resolver::SocketFd* sock_fd = NewQuery(server.get(), 0x1234);
+  resolver_->Resolve(sock_fd);
+  resolver_->HandleAresResult(
+      sock_fd, ARES_SUCCESS, const_cast<unsigned char*>(kCachedResponse),
+      sizeof(kCachedResponse));
+  EXPECT_EQ(0x1234, ReadReplyId(client.get()));
+
+  resolver_->SetNameServers({"1.1.1.1"});
+  std::unique_ptr<Resolver::SocketFd> pending(
+      NewQuery(server.get(), 0x5678));
+  resolver_->Resolve(pending.get());
+}
+
+TEST_F(ResolverTest, Resolve_CoalescesPendingQueries) {
+  EXPECT_CALL(*ares_client_, Resolve(_, _, _, _)).WillOnce(Return(true));
+
+  resolver_->SetNameServers(kTestNameServers);
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  base::ScopedFD client(fds[0]);
+  base::ScopedFD server(fds[1]);
+
+  Resolver::SocketFd* sock_fd = NewQuery(server.get(), 0x1234);
+  resolver_->Resolve(sock_fd);
+  // Identical query received while the first one is in flight.
+  resolver_->Resolve(NewQuery(server.get(), 0x5678));
+
+  resolver_->HandleAresResult(
+      sock_fd, ARES_SUCCESS, const_cast<unsigned char*>(kCachedResponse),
+      sizeof(kCachedResponse));
+  EXPECT_EQ(0x1234, ReadReplyId(client.get()));
+  EXPECT_EQ(0x5678, ReadReplyId(client.get()));
+}
+
+TEST_F(ResolverTest, Resolve_DoesNotCoalesceDifferentQueries) {
+  EXPECT_CALL(*ares_client_, Resolve(_, _, _, _))
+      .Times(3)
+      .WillRepeatedly(Return(true));
+
+  resolver_->SetNameServers(kTestNameServers);
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  base::ScopedFD client(fds[0]);
+  base::ScopedFD server(fds[1]);
+
+  std::unique_ptr<Resolver::SocketFd> tcp(NewQuery(server.get(), 0x1234));
+  resolver_->Resolve(tcp.get());
+
+  // Same query over UDP.
+  auto udp = std::make_unique<Resolver::SocketFd>(SOCK_DGRAM, server.get());
+  memcpy(udp->msg, kCachedQuery, sizeof(kCachedQuery));
+  udp->len = sizeof(kCachedQuery);
+  resolver_->Resolve(udp.get());
+
+  // Same query with the CD flag set.
+  std::unique_ptr<Resolver::SocketFd> cd(NewQuery(server.get(), 0x5678));
+  cd->msg[3] |= 0x10;
+  resolver_->Resolve(cd.get());
+}
+
+TEST_F(ResolverTest, Resolve_PendingQueriesDroppedOnFailure) {
+  EXPECT_CALL(*ares_client_, Resolve(_, _, _, _))
+      .Times(2)
+      .WillRepeatedly(Return(true));
+
+  resolver_->SetNameServers(kTestNameServers);
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  base::ScopedFD client(fds[0]);
+  base::ScopedFD server(fds[1]);
+
+  Resolver::SocketFd* sock_fd = NewQuery(server.get(), 0x1234);
+  resolver_->Resolve(sock_fd);
+  resolver_->Resolve(NewQuery(server.get(), 0x5678));
+  resolver_->HandleAresResult(sock_fd, ARES_ETIMEOUT, nullptr, 0);
+
+  // The next identical query is sent upstream.
+  std::unique_ptr<Resolver::SocketFd> pending(
+      NewQuery(server.get(), 0x9abc));
+  resolver_->Resolve(pending.get());
+}
+
 TEST_F(ResolverTest, ConstructServFailResponse_ValidQuery) {
   const char kDnsQuery[] = {'J',    'G',    '\x01', ' ',    '\x00', '\x01',
                             '\x00', '\x00', '\x00', '\x00', '\x00', '\x01',
@@ -6,6 +6,7 @@
 #include <base/command_line.h>
 #include <base/logging.h>
 #include <base/strings/string_util.h>
+#include <base/time/time.h>
 #include <brillo/flag_helper.h>
 #include <brillo/syslog_logging.h>
 #include <rootdev/rootdev.h>
@@ -21,6 +22,11 @@ const char kScalingMaxFreqPath[] =
 const char kCpuinfoMaxFreqPath[] =
     "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq";
 
+// The daemon sends its statistics in bursts of samples, which are buffered and
+// written to the events file together.
+constexpr base::TimeDelta kMetricsFlushInterval = base::Seconds(10);
+constexpr size_t kMaxBufferedSamples = 100;
+
 // Returns the path to the disk stats in the sysfs.  Returns the null string if
 // it cannot find the disk stats file.
 const std::string MetricsMainDiskStatsPath() {
@@ -80,6 +86,7 @@ int main(int argc, char** argv) {
 
   base::FilePath backing_dir_path(kPersistentIntegerBackingDir);
   MetricsLibrary metrics_lib;
+  metrics_lib.EnableBufferedMode(kMetricsFlushInterval, kMaxBufferedSamples);
   chromeos_metrics::MetricsDaemon daemon;
   daemon.Init(FLAGS_uploader_test, FLAGS_uploader | FLAGS_uploader_test,
               &metrics_lib, MetricsMainDiskStatsPath(), "/proc/vmstat",
@@ -93,4 +100,7 @@ int main(int argc, char** argv) {
   }
 
   daemon.Run();
+  // Flush while the message loop of the daemon, which runs the flush timer,
+  // still exists.
+  metrics_lib.FlushBufferedSamples();
 }
@@ -4,6 +4,7 @@
 
 #include "metrics/metrics_library.h"
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_util.h>
@@ -12,6 +13,8 @@
 #include <base/logging.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
+#include <base/threading/sequenced_task_runner_handle.h>
+#include <base/timer/timer.h>
 #include <brillo/files/safe_fd.h>
 #include <errno.h>
 #include <session_manager/dbus-proxies.h>
@@ -109,7 +112,9 @@ MetricsLibrary::MetricsLibrary()
       daemon_store_dir_(kDaemonStoreConsentDir),
       per_user_consent_file_(kUsePerUserConsentFile) {}
 
-MetricsLibrary::~MetricsLibrary() {}
+MetricsLibrary::~MetricsLibrary() {
+  FlushBufferedSamples();
+}
 
 bool MetricsLibrary::IsGuestMode() {
   // Shortcut check whether there is any logged-in user.
@@ -302,6 +307,8 @@ void MetricsLibrary::Init() {
 }
 
 void MetricsLibrary::SetOutputFile(const std::string& output_file) {
+  // The buffered samples belong to the previous file.
+  FlushBufferedSamples();
   uma_events_file_ = base::FilePath(output_file);
 }
 
@@ -316,12 +323,59 @@ bool MetricsLibrary::Replay(const std::string& input_file) {
       samples, uma_events_file_.value());
 }
 
+void MetricsLibrary::EnableBufferedMode(base::TimeDelta flush_interval,
+                                        size_t max_buffered_samples) {
+  buffered_mode_ = true;
+  flush_interval_ = flush_interval;
+  max_buffered_samples_ = max_buffered_samples;
+}
+
+bool MetricsLibrary::FlushBufferedSamples() {
+  if (flush_timer_)
+    flush_timer_->Stop();
+  if (buffered_output_.empty())
+    return true;
+
+  std::string output;
+  output.swap(buffered_output_);
+  buffered_samples_ = 0;
+  return metrics::SerializationUtils::WriteSerializedMetricsToFile(
+      output, uma_events_file_.value());
+}
+
+bool MetricsLibrary::SendSample(const metrics::MetricSample& sample) {
+  if (!buffered_mode_) {
+    return metrics::SerializationUtils::WriteMetricsToFile(
+        {sample}, uma_events_file_.value());
+  }
+
+  if (!metrics::SerializationUtils::SerializeSample(sample,
+                                                    &buffered_output_)) {
+    return false;
+  }
+  buffered_samples_++;
+
+  if (buffered_samples_ >= max_buffered_samples_)
+    return FlushBufferedSamples();
+
+  if (!flush_interval_.is_zero() && base::SequencedTaskRunnerHandle::IsSet()) {
+    if (!flush_timer_)
+      flush_timer_ = std::make_unique<base::OneShotTimer>();
+    if (!flush_timer_->IsRunning()) {
+      flush_timer_->Start(
+          FROM_HERE, flush_interval_,
+          base::BindOnce(
+              base::IgnoreResult(&MetricsLibrary::FlushBufferedSamples),
+              base::Unretained(this)));
+    }
+  }
+  return true;
+}
+
 bool MetricsLibrary::SendToUMA(
     const std::string& name, int sample, int min, int max, int nbuckets) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::HistogramSample(name, sample, min, max,
-                                              nbuckets)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::HistogramSample(name, sample, min,
+                                                          max, nbuckets));
 }
 
 #if USE_METRICS_UPLOADER
@@ -331,10 +385,8 @@ bool MetricsLibrary::SendRepeatedToUMA(const std::string& name,
                                        int max,
                                        int nbuckets,
                                        int num_samples) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::HistogramSample(name, sample, min, max, nbuckets,
-                                              num_samples)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::HistogramSample(
+      name, sample, min, max, nbuckets, num_samples));
 }
 #endif
 
@@ -345,33 +397,25 @@ void MetricsLibrary::SetConsentFileForTest(const base::FilePath& consent_file) {
 bool MetricsLibrary::SendEnumToUMA(const std::string& name,
                                    int sample,
                                    int max) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::LinearHistogramSample(name, sample, max)},
-      uma_events_file_.value());
+  return SendSample(
+      metrics::MetricSample::LinearHistogramSample(name, sample, max));
 }
 
 bool MetricsLibrary::SendBoolToUMA(const std::string& name, bool sample) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::LinearHistogramSample(name, sample ? 1 : 0, 2)},
-      uma_events_file_.value());
+  return SendSample(
+      metrics::MetricSample::LinearHistogramSample(name, sample ? 1 : 0, 2));
 }
 
 bool MetricsLibrary::SendSparseToUMA(const std::string& name, int sample) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::SparseHistogramSample(name, sample)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::SparseHistogramSample(name, sample));
 }
 
 bool MetricsLibrary::SendUserActionToUMA(const std::string& action) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::UserActionSample(action)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::UserActionSample(action));
 }
 
 bool MetricsLibrary::SendCrashToUMA(const char* crash_kind) {
-  return metrics::SerializationUtils::WriteMetricsToFile(
-      {metrics::MetricSample::CrashSample(crash_kind)},
-      uma_events_file_.value());
+  return SendSample(metrics::MetricSample::CrashSample(crash_kind));
 }
 
 void MetricsLibrary::SetPolicyProvider(policy::PolicyProvider* provider) {
@@ -14,10 +14,19 @@
 
 #include <base/compiler_specific.h>
 #include <base/files/file_path.h>
+#include <base/time/time.h>
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST
 
 #include "policy/libpolicy.h"
 
+namespace base {
+class OneShotTimer;
+}  // namespace base
+
+namespace metrics {
+class MetricSample;
+}  // namespace metrics
+
 class MetricsLibraryInterface {
  public:
   virtual void Init() = 0;  // TODO(chromium:940343): Remove this function.
@@ -108,6 +117,22 @@ class MetricsLibrary : public MetricsLibraryInterface {
   // where being generated via the SendXYZ functions.
   bool Replay(const std::string& input_file);
 
+  // Enables the buffered mode, for clients which send many samples. Instead of
+  // opening, locking and appending to the events file for every sample, the
+  // SendXYZ functions keep the serialized samples in memory, and they are
+  // written to the file together with a single locked write. The buffer is
+  // flushed when |max_buffered_samples| samples are buffered, |flush_interval|
+  // after the first buffered sample (only if the calling sequence has a task
+  // runner), and when this object is destroyed. The SendXYZ functions still
+  // return false for invalid samples, but errors on writing the file are only
+  // reported by FlushBufferedSamples().
+  void EnableBufferedMode(base::TimeDelta flush_interval,
+                          size_t max_buffered_samples);
+
+  // Writes the samples buffered in the buffered mode to the events file.
+  // Returns true on success, or if nothing is buffered.
+  bool FlushBufferedSamples();
+
   // Sends histogram data to Chrome for transport to UMA and returns
   // true on success. This method results in the equivalent of an
   // asynchronous non-blocking RPC to UMA_HISTOGRAM_CUSTOM_COUNTS
@@ -246,6 +271,9 @@ class MetricsLibrary : public MetricsLibraryInterface {
   // multiple users are signed in simultaneously.
   std::optional<bool> ArePerUserMetricsEnabled();
 
+  // Writes |sample| to the events file, or buffers it in the buffered mode.
+  bool SendSample(const metrics::MetricSample& sample);
+
   // Time at which we last checked if metrics were enabled.
   static time_t cached_enabled_time_;
 
@@ -258,6 +286,14 @@ class MetricsLibrary : public MetricsLibraryInterface {
   base::FilePath per_user_consent_file_;
 
   std::unique_ptr<policy::PolicyProvider> policy_provider_;
+
+  // State of the buffered mode. See EnableBufferedMode().
+  bool buffered_mode_ = false;
+  base::TimeDelta flush_interval_;
+  size_t max_buffered_samples_ = 0;
+  size_t buffered_samples_ = 0;
+  std::string buffered_output_;
+  std::unique_ptr<base::OneShotTimer> flush_timer_;
 };
 
 #endif  // METRICS_METRICS_LIBRARY_H_
@@ -0,0 +1,88 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the samples/sec a MetricsLibrary client can send to the events
+// file, with and without the buffered mode, and of the samples/sec the daemon
+// can read back.
+//
+// Usage: metrics_library_benchmark [num_samples]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include <base/check.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/time/time.h>
+
+#include "metrics/metrics_library.h"
+#include "metrics/serialization/metric_sample.h"
+#include "metrics/serialization/serialization_utils.h"
+
+namespace {
+
+constexpr int kDefaultNumSamples = 100000;
+constexpr size_t kBatchSizes[] = {16, 64, 256};
+
+// Sends |num_samples| samples to |path| and returns the samples/sec. The
+// buffered mode is used if |batch_size| is not zero.
+double SendSamples(const base::FilePath& path,
+                   int num_samples,
+                   size_t batch_size) {
+  CHECK(base::WriteFile(path, "", 0) == 0);
+  base::TimeTicks start;
+  {
+    MetricsLibrary lib;
+    lib.SetOutputFile(path.value());
+    if (batch_size)
+      lib.EnableBufferedMode(base::TimeDelta(), batch_size);
+
+    start = base::TimeTicks::Now();
+    for (int i = 0; i < num_samples; i++)
+      CHECK(lib.SendToUMA("Benchmark.Histogram", i % 100, 1, 100, 50));
+    // The remaining samples are flushed on destruction.
+  }
+  return num_samples / (base::TimeTicks::Now() - start).InSecondsF();
+}
+
+// Reads all the samples in |path| and returns the samples/sec.
+double ReadSamples(const base::FilePath& path, int num_samples) {
+  std::vector<metrics::MetricSample> samples;
+  base::TimeTicks start = base::TimeTicks::Now();
+  while (!metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
+      path.value(), &samples,
+      metrics::SerializationUtils::kSampleBatchMaxLength)) {
+  }
+  double samples_per_sec =
+      num_samples / (base::TimeTicks::Now() - start).InSecondsF();
+  CHECK_EQ(samples.size(), static_cast<size_t>(num_samples));
+  return samples_per_sec;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int num_samples =
+      argc > 1 ? strtol(argv[1], nullptr, 0) : kDefaultNumSamples;
+
+  base::ScopedTempDir temp_dir;
+  CHECK(temp_dir.CreateUniqueTempDir());
+  const base::FilePath path = temp_dir.GetPath().Append("uma-events");
+
+  printf("%-16s %16s %16s\n", "mode", "send samples/s", "read samples/s");
+  double send = SendSamples(path, num_samples, 0);
+  printf("%-16s %16.0f %16.0f\n", "unbuffered", send,
+         ReadSamples(path, num_samples));
+  for (size_t batch_size : kBatchSizes) {
+    send = SendSamples(path, num_samples, batch_size);
+    std::string mode = "buffered/" + std::to_string(batch_size);
+    printf("%-16s %16.0f %16.0f\n", mode.c_str(), send,
+           ReadSamples(path, num_samples));
+  }
+  return 0;
+}
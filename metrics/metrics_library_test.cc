@@ -6,6 +6,7 @@
 
 #include <cstring>
 #include <utility>
+#include <vector>
 
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
@@ -17,6 +18,8 @@
 #include "metrics/c_metrics_library.h"
 #include "metrics/metrics_library.h"
 #include "metrics/metrics_library_mock.h"
+#include "metrics/serialization/metric_sample.h"
+#include "metrics/serialization/serialization_utils.h"
 
 using base::FilePath;
 using ::testing::_;
@@ -282,6 +285,41 @@ TEST_F(MetricsLibraryTest, SendEnumToUMAMax) {
   metrics_library->SendEnumToUMA("My.Enumeration", MyEnum::kSecondValue);
 }
 
+TEST_F(MetricsLibraryTest, BufferedMode) {
+  lib_.EnableBufferedMode(base::TimeDelta(), 3);
+  EXPECT_TRUE(lib_.SendToUMA("My.Histogram", 1, 1, 10, 5));
+  EXPECT_TRUE(lib_.SendSparseToUMA("My.Sparse", 2));
+
+  // Nothing is written until the buffer is full.
+  int64_t size = -1;
+  ASSERT_TRUE(base::GetFileSize(kTestUMAEventsFile, &size));
+  EXPECT_EQ(0, size);
+
+  EXPECT_TRUE(lib_.SendUserActionToUMA("MyAction"));
+  std::vector<metrics::MetricSample> samples;
+  metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
+      kTestUMAEventsFile.value(), &samples,
+      metrics::SerializationUtils::kSampleBatchMaxLength);
+  ASSERT_EQ(3u, samples.size());
+  EXPECT_TRUE(samples[0].IsEqual(
+      metrics::MetricSample::HistogramSample("My.Histogram", 1, 1, 10, 5)));
+  EXPECT_TRUE(samples[1].IsEqual(
+      metrics::MetricSample::SparseHistogramSample("My.Sparse", 2)));
+  EXPECT_TRUE(
+      samples[2].IsEqual(metrics::MetricSample::UserActionSample("MyAction")));
+
+  // The remaining samples are written by an explicit flush.
+  EXPECT_TRUE(lib_.SendCrashToUMA("mycrash"));
+  EXPECT_TRUE(lib_.FlushBufferedSamples());
+  samples.clear();
+  metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
+      kTestUMAEventsFile.value(), &samples,
+      metrics::SerializationUtils::kSampleBatchMaxLength);
+  ASSERT_EQ(1u, samples.size());
+  EXPECT_TRUE(
+      samples[0].IsEqual(metrics::MetricSample::CrashSample("mycrash")));
+}
+
 void MetricsLibraryTest::VerifyEnabledCacheHit(bool to_value) {
   // We might step from one second to the next one time, but not 100
   // times in a row.
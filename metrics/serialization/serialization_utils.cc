@@ -6,11 +6,13 @@
 
 #include <sys/file.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "base/bind.h"
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_file.h"
@@ -27,6 +29,10 @@
 namespace metrics {
 namespace {
 
+// Number of samples handed to the callback at once by
+// ReadAndTruncateMetricsFromFile().
+constexpr size_t kSampleChunkLength = 1024;
+
 // Magic string that gets written at the beginning of the message file
 // when the file has been partially uploaded.
 constexpr char kMagicString[] = {'S', 'K', 'I', 'P'};
@@ -91,14 +97,83 @@ void SeekToSamples(int fd) {
   }
 }
 
-// Reads the next message from |file_descriptor| into |message|.
+// Reads a file from the current offset of |fd| in large blocks, so that
+// reading many small messages doesn't cost a few syscalls per message.
+class BufferedFileReader {
+ public:
+  explicit BufferedFileReader(int fd)
+      : fd_(fd), buffer_(kBufferSize), buffer_offset_(lseek(fd, 0, SEEK_CUR)) {}
+  BufferedFileReader(const BufferedFileReader&) = delete;
+  BufferedFileReader& operator=(const BufferedFileReader&) = delete;
+
+  // Reads up to |size| bytes into |out|. Returns the number of bytes read,
+  // which is less than |size| only at EOF, or -1 on errors.
+  ssize_t Read(void* out, size_t size) {
+    char* dest = static_cast<char*>(out);
+    size_t copied = 0;
+    while (copied < size) {
+      if (begin_ == end_) {
+        ssize_t result = Fill();
+        if (result < 0)
+          return -1;
+        if (result == 0)
+          break;
+      }
+      size_t length = std::min(size - copied, end_ - begin_);
+      memcpy(dest + copied, buffer_.data() + begin_, length);
+      begin_ += length;
+      copied += length;
+    }
+    return copied;
+  }
+
+  // Skips |size| bytes. Returns false on errors.
+  bool Skip(size_t size) {
+    if (size <= end_ - begin_) {
+      begin_ += size;
+      return true;
+    }
+    off_t target = offset() + size;
+    if (lseek(fd_, target, SEEK_SET) < 0)
+      return false;
+    buffer_offset_ = target;
+    begin_ = end_ = 0;
+    return true;
+  }
+
+  // Returns the offset in the file of the next byte to read.
+  off_t offset() const { return buffer_offset_ + begin_; }
+
+ private:
+  static constexpr size_t kBufferSize = 64 * 1024;
+
+  ssize_t Fill() {
+    buffer_offset_ += end_;
+    begin_ = end_ = 0;
+    ssize_t result = HANDLE_EINTR(read(fd_, buffer_.data(), buffer_.size()));
+    if (result > 0)
+      end_ = result;
+    return result;
+  }
+
+  const int fd_;
+  std::vector<char> buffer_;
+  // Offset in the file of |buffer_[0]|.
+  off_t buffer_offset_;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+};
+
+// Reads the next message from |reader| into |message|.
 //
 // |message| will be set to the empty string if no message could be read (EOF)
 // or the message was badly constructed.
 //
 // Returns false if no message can be read from this file anymore (EOF or
 // unrecoverable error).
-bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
+bool ReadMessage(BufferedFileReader* reader,
+                 std::string* message_out,
+                 size_t* bytes_used_out) {
   CHECK(message_out);
 
   int result;
@@ -106,7 +181,7 @@ bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
   const size_t message_hdr_size = sizeof(message_size);
   // The file containing the metrics does not leave the device, so the writer
   // and the reader always have the same endianness.
-  result = HANDLE_EINTR(read(fd, &message_size, sizeof(message_size)));
+  result = reader->Read(&message_size, sizeof(message_size));
   if (result < 0) {
     PLOG(ERROR) << "failed to read message header";
     return false;
@@ -125,8 +200,7 @@ bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
   // length field and the content.
   if (message_size > SerializationUtils::kMessageMaxLength) {
     LOG(ERROR) << "message too long, length = " << message_size;
-    if (HANDLE_EINTR(lseek(fd, message_size - message_hdr_size, SEEK_CUR)) ==
-        -1) {
+    if (!reader->Skip(message_size - message_hdr_size)) {
       PLOG(ERROR) << "error while skipping message. Aborting.";
       return false;
     }
@@ -143,7 +217,8 @@ bool ReadMessage(int fd, std::string* message_out, size_t* bytes_used_out) {
 
   message_size -= message_hdr_size;  // The message size includes itself.
   char buffer[SerializationUtils::kMessageMaxLength];
-  if (!base::ReadFromFD(fd, buffer, message_size)) {
+  if (reader->Read(buffer, message_size) !=
+      static_cast<ssize_t>(message_size)) {
     LOG(ERROR) << "failed to read message body";
     return false;
   }
@@ -193,6 +268,24 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
     const std::string& filename,
     std::vector<MetricSample>* metrics,
     size_t sample_batch_max_length) {
+  return ReadAndTruncateMetricsFromFileInChunks(
+      filename, kSampleChunkLength,
+      base::BindRepeating(
+          [](std::vector<MetricSample>* metrics,
+             std::vector<MetricSample> chunk) {
+            for (auto& sample : chunk)
+              metrics->push_back(std::move(sample));
+          },
+          metrics),
+      sample_batch_max_length);
+}
+
+bool SerializationUtils::ReadAndTruncateMetricsFromFileInChunks(
+    const std::string& filename,
+    size_t chunk_size,
+    const SampleChunkCallback& callback,
+    size_t sample_batch_max_length) {
+  DCHECK_GT(chunk_size, 0);
   struct stat stat_buf = {};
   int result;
   off_t total_length = 0;
@@ -233,26 +326,41 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
   // continue at the next call.  There are races on daemon crash or system
   // crash: resolve them by allowing the loss of samples.
   bool skip_truncation = false;
+  BufferedFileReader reader(fd.get());
+  std::vector<MetricSample> chunk;
   while (true) {
     std::string message;
     size_t bytes_used = 0;
 
-    if (!ReadMessage(fd.get(), &message, &bytes_used))
+    if (!ReadMessage(&reader, &message, &bytes_used))
       break;
 
     MetricSample sample = ParseSample(message);
-    if (sample.IsValid())
-      metrics->push_back(std::move(sample));
+    if (sample.IsValid()) {
+      chunk.push_back(std::move(sample));
+      if (chunk.size() >= chunk_size) {
+        callback.Run(std::move(chunk));
+        chunk.clear();
+      }
+    }
 
     total_length += bytes_used;
     if (total_length > sample_batch_max_length) {
       // Set up the file to continue processing.  Avoid final truncation,
-      // unless there were errors.
+      // unless there were errors.  The file offset is moved back from the
+      // read-ahead position to just after the last message read.
+      if (lseek(fd.get(), reader.offset(), SEEK_SET) < 0) {
+        PLOG(ERROR) << "cannot seek in metrics log";
+        break;
+      }
       skip_truncation = RemovePreviousSamples(fd.get());
       break;
     }
   }
 
+  if (!chunk.empty())
+    callback.Run(std::move(chunk));
+
   if (!skip_truncation) {
     result = ftruncate(fd.get(), 0);
     if (result < 0)
@@ -266,23 +374,35 @@ bool SerializationUtils::ReadAndTruncateMetricsFromFile(
   return total_length <= sample_batch_max_length;
 }
 
+bool SerializationUtils::SerializeSample(const MetricSample& sample,
+                                         std::string* output) {
+  if (!sample.IsValid()) {
+    return false;
+  }
+  std::string msg = sample.ToString();
+  int32_t size = msg.length() + sizeof(int32_t);
+  if (size > kMessageMaxLength) {
+    LOG(ERROR) << "cannot write message: too long, length = " << size;
+    return false;
+  }
+  output->append(reinterpret_cast<char*>(&size), sizeof(size));
+  output->append(msg);
+  return true;
+}
+
 bool SerializationUtils::WriteMetricsToFile(
     const std::vector<MetricSample>& samples, const std::string& filename) {
   std::string output;
   for (const auto& sample : samples) {
-    if (!sample.IsValid()) {
+    if (!SerializeSample(sample, &output)) {
       return false;
     }
-    std::string msg = sample.ToString();
-    int32_t size = msg.length() + sizeof(int32_t);
-    if (size > kMessageMaxLength) {
-      LOG(ERROR) << "cannot write message: too long, length = " << size;
-      return false;
-    }
-    output.append(reinterpret_cast<char*>(&size), sizeof(size));
-    output.append(msg);
   }
+  return WriteSerializedMetricsToFile(output, filename);
+}
 
+bool SerializationUtils::WriteSerializedMetricsToFile(
+    const std::string& output, const std::string& filename) {
   base::ScopedFD file_descriptor(open(filename.c_str(),
                                       O_WRONLY | O_APPEND | O_CREAT,
                                       READ_WRITE_ALL_FILE_FLAGS));
@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 
+#include <base/callback.h>
+
 namespace metrics {
 
 class MetricSample;
@@ -31,6 +33,19 @@ bool ReadAndTruncateMetricsFromFile(const std::string& filename,
                                     std::vector<MetricSample>* metrics,
                                     size_t sample_batch_max_length);
 
+// Same as ReadAndTruncateMetricsFromFile(), but hands the samples to
+// |callback| in chunks of at most |chunk_size| samples while the file is
+// parsed, instead of returning all of them at once. The memory usage is
+// bounded by |chunk_size| regardless of the file size. |callback| is called
+// with the file locked, so it should not block for long.
+using SampleChunkCallback =
+    base::RepeatingCallback<void(std::vector<MetricSample>)>;
+bool ReadAndTruncateMetricsFromFileInChunks(
+    const std::string& filename,
+    size_t chunk_size,
+    const SampleChunkCallback& callback,
+    size_t sample_batch_max_length);
+
 // Serializes a vector of samples and writes them to filename.
 // The format for each sample is:
 //  message_size, serialized_message
@@ -44,6 +59,15 @@ bool ReadAndTruncateMetricsFromFile(const std::string& filename,
 bool WriteMetricsToFile(const std::vector<MetricSample>& samples,
                         const std::string& filename);
 
+// Appends |sample| serialized in the format above to |output|. Returns false
+// if the sample is invalid or too long.
+bool SerializeSample(const MetricSample& sample, std::string* output);
+
+// Writes samples already serialized by SerializeSample() to filename, with a
+// single locked write.
+bool WriteSerializedMetricsToFile(const std::string& output,
+                                  const std::string& filename);
+
 // Maximum length of a serialized message.
 static const size_t kMessageMaxLength = 1024;
 
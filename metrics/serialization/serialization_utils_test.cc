@@ -13,6 +13,7 @@
 #include <base/files/scoped_temp_dir.h>
 #include <base/logging.h>
 #include <base/strings/stringprintf.h>
+#include <base/test/bind.h>
 #include <gtest/gtest.h>
 
 #include "metrics/serialization/metric_sample.h"
@@ -212,6 +213,34 @@ TEST_F(SerializationUtilsTest, WriteReadTest) {
   ASSERT_EQ(0, size);
 }
 
+TEST_F(SerializationUtilsTest, ReadInChunksTest) {
+  std::vector<MetricSample> output_samples;
+  for (int i = 0; i < 10; ++i)
+    output_samples.push_back(MetricSample::SparseHistogramSample("sparse", i));
+  SerializationUtils::WriteMetricsToFile(output_samples, filename_);
+
+  std::vector<size_t> chunk_sizes;
+  std::vector<MetricSample> samples;
+  EXPECT_TRUE(SerializationUtils::ReadAndTruncateMetricsFromFileInChunks(
+      filename_, 4,
+      base::BindLambdaForTesting([&](std::vector<MetricSample> chunk) {
+        chunk_sizes.push_back(chunk.size());
+        for (auto& sample : chunk)
+          samples.push_back(std::move(sample));
+      }),
+      SerializationUtils::kSampleBatchMaxLength));
+
+  EXPECT_EQ((std::vector<size_t>{4, 4, 2}), chunk_sizes);
+  ASSERT_EQ(output_samples.size(), samples.size());
+  for (size_t i = 0; i < output_samples.size(); ++i) {
+    EXPECT_TRUE(output_samples[i].IsEqual(samples[i]));
+  }
+
+  int64_t size = 0;
+  ASSERT_TRUE(base::GetFileSize(filepath_, &size));
+  ASSERT_EQ(0, size);
+}
+
 // Test of batched upload.  Creates a metrics log with enough samples to
 // trigger two uploads.
 TEST_F(SerializationUtilsTest, BatchedUploadTest) {
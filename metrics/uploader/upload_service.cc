@@ -26,6 +26,7 @@
 #include "metrics/uploader/system_profile_cache.h"
 
 const int UploadService::kMaxFailedUpload = 10;
+const size_t UploadService::kSampleChunkLength = 256;
 
 UploadService::UploadService(SystemProfileSetter* setter,
                              MetricsLibraryInterface* metrics_lib,
@@ -164,17 +165,27 @@ bool UploadService::ReadMetrics() {
   CHECK(!staged_log_)
       << "cannot read metrics until the old logs have been discarded";
 
-  std::vector<metrics::MetricSample> samples;
-  bool result = metrics::SerializationUtils::ReadAndTruncateMetricsFromFile(
-      metrics_file_, &samples,
-      metrics::SerializationUtils::kSampleBatchMaxLength);
+  // Adds the samples to the histograms as they are parsed, so that a large
+  // events file left after a long offline period doesn't have to be held in
+  // memory at once.
+  size_t num_samples = 0;
+  bool result =
+      metrics::SerializationUtils::ReadAndTruncateMetricsFromFileInChunks(
+          metrics_file_, kSampleChunkLength,
+          base::BindRepeating(&UploadService::AddSamples,
+                              base::Unretained(this), &num_samples),
+          metrics::SerializationUtils::kSampleBatchMaxLength);
+  DLOG(INFO) << num_samples << " samples found in uma-events";
 
+  return result;
+}
+
+void UploadService::AddSamples(size_t* num_samples,
+                               std::vector<metrics::MetricSample> samples) {
   for (const auto& sample : samples) {
     AddSample(sample);
   }
-  DLOG(INFO) << samples.size() << " samples found in uma-events";
-
-  return result;
+  *num_samples += samples.size();
 }
 
 void UploadService::AddSample(const metrics::MetricSample& sample) {
@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/metrics/histogram_base.h"
 #include "base/metrics/histogram_flattener.h"
@@ -104,6 +105,9 @@ class UploadService : public base::HistogramFlattener {
   // will be discarded.
   static const int kMaxFailedUpload;
 
+  // Number of samples parsed from the message file at once.
+  static const size_t kSampleChunkLength;
+
   // Resets the internal state.
   void Reset();
 
@@ -114,6 +118,11 @@ class UploadService : public base::HistogramFlattener {
   // Adds a generic sample to the current log.
   void AddSample(const metrics::MetricSample& sample);
 
+  // Adds a chunk of samples read by ReadMetrics() to the current log, and adds
+  // the number of them to |num_samples|.
+  void AddSamples(size_t* num_samples,
+                  std::vector<metrics::MetricSample> samples);
+
   // Adds a crash to the current log.
   void AddCrash(const std::string& crash_name);
 
@@ -105,6 +105,18 @@ class QueueOptions {
     max_single_file_size_ = max_single_file_size;
     return *this;
   }
+  QueueOptions& set_upload_from_mapped_files(bool upload_from_mapped_files) {
+    upload_from_mapped_files_ = upload_from_mapped_files;
+    return *this;
+  }
+  QueueOptions& set_write_batch_window(base::TimeDelta write_batch_window) {
+    write_batch_window_ = write_batch_window;
+    return *this;
+  }
+  QueueOptions& set_max_write_batch_size(size_t max_write_batch_size) {
+    max_write_batch_size_ = max_write_batch_size;
+    return *this;
+  }
   const base::FilePath& directory() const { return directory_; }
   const std::string& file_prefix() const { return file_prefix_; }
   size_t max_record_size() const { return storage_options_.max_record_size(); }
@@ -117,6 +129,9 @@ class QueueOptions {
   uint64_t max_single_file_size() const { return max_single_file_size_; }
   base::TimeDelta upload_period() const { return upload_period_; }
   base::TimeDelta upload_retry_delay() const { return upload_retry_delay_; }
+  bool upload_from_mapped_files() const { return upload_from_mapped_files_; }
+  base::TimeDelta write_batch_window() const { return write_batch_window_; }
+  size_t max_write_batch_size() const { return max_write_batch_size_; }
 
  private:
   // Whole storage options, which this queue options are based on.
@@ -140,6 +155,18 @@ class QueueOptions {
   // for further records. Note that each file must have at least
   // one record before it is closed, regardless of that record size.
   uint64_t max_single_file_size_ = 1 * 1024LL * 1024LL;  // 1 MiB
+  // If true, upload reads records directly from memory mapped data files
+  // instead of copying them into the read buffer first. Falls back to
+  // buffered reading for the files that cannot be mapped.
+  bool upload_from_mapped_files_ = false;
+  // Group commit settings. If |max_write_batch_size_| is 0 (default), every
+  // record is written with its own data append and metadata update.
+  // Otherwise records that are ready to be written at the same time (or
+  // within |write_batch_window_| from the first of them, if other writes are
+  // pending) are coalesced, up to |max_write_batch_size_| bytes, into a
+  // single append to the data file and a single metadata update.
+  base::TimeDelta write_batch_window_;
+  size_t max_write_batch_size_ = 0;
 };
 
 }  // namespace reporting
@@ -24,6 +24,7 @@
 #include <base/files/file_enumerator.h>
 #include <base/files/file_path.h>
 #include <base/files/file_util.h>
+#include <base/files/memory_mapped_file.h>
 #include <base/hash/hash.h>
 #include <base/logging.h>
 #include <base/memory/ptr_util.h>
@@ -525,6 +526,8 @@ Status StorageQueue::WriteHeaderAndBlock(
         base::StrCat({"Not enough disk space available to write into file=",
                       file->name()}));
   }
+  ++write_stats_.records;
+  ++write_stats_.data_appends;
   auto write_status = file->Append(base::StringPiece(
       reinterpret_cast<const char*>(&header), sizeof(header)));
   if (!write_status.ok()) {
@@ -533,6 +536,7 @@ Status StorageQueue::WriteHeaderAndBlock(
                                 " status=", write_status.status().ToString()}));
   }
   if (data.size() > 0) {
+    ++write_stats_.data_appends;
     write_status = file->Append(data);
     if (!write_status.ok()) {
       return Status(
@@ -546,6 +550,7 @@ Status StorageQueue::WriteHeaderAndBlock(
     const size_t pad_size = total_size - (sizeof(header) + data.size());
     char junk_bytes[FRAME_SIZE];
     crypto::RandBytes(junk_bytes, pad_size);
+    ++write_stats_.data_appends;
     write_status = file->Append(base::StringPiece(&junk_bytes[0], pad_size));
     if (!write_status.ok()) {
       return Status(error::RESOURCE_EXHAUSTED,
@@ -556,26 +561,120 @@ Status StorageQueue::WriteHeaderAndBlock(
   return Status::StatusOK();
 }
 
-Status StorageQueue::WriteMetadata(base::StringPiece current_record_digest) {
+void StorageQueue::ComposeHeaderAndBlock(base::StringPiece data,
+                                         std::string* output) {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(storage_queue_sequence_checker_);
+  // Prepare header.
+  RecordHeader header;
+  // Pad to the whole frame, if necessary.
+  const size_t total_size = RoundUpToFrameSize(sizeof(header) + data.size());
+  // Assign sequencing id.
+  header.record_sequencing_id = next_sequencing_id_++;
+  header.record_hash = base::PersistentHash(data.data(), data.size());
+  header.record_size = data.size();
+  output->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  output->append(data.data(), data.size());
+  if (total_size > sizeof(header) + data.size()) {
+    // Fill in with random bytes.
+    const size_t pad_size = total_size - (sizeof(header) + data.size());
+    char junk_bytes[FRAME_SIZE];
+    crypto::RandBytes(junk_bytes, pad_size);
+    output->append(&junk_bytes[0], pad_size);
+  }
+  ++write_stats_.records;
+}
+
+Status StorageQueue::AppendComposedBlocks(
+    base::StringPiece composed, scoped_refptr<StorageQueue::SingleFile> file) {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(storage_queue_sequence_checker_);
+  auto open_status = file->Open(/*read_only=*/false);
+  if (!open_status.ok()) {
+    return Status(error::ALREADY_EXISTS,
+                  base::StrCat({"Cannot open file=", file->name(),
+                                " status=", open_status.ToString()}));
+  }
+  if (!GetDiskResource()->Reserve(composed.size())) {
+    return Status(
+        error::RESOURCE_EXHAUSTED,
+        base::StrCat({"Not enough disk space available to write into file=",
+                      file->name()}));
+  }
+  ++write_stats_.data_appends;
+  auto write_status = file->Append(composed);
+  if (!write_status.ok()) {
+    return Status(error::RESOURCE_EXHAUSTED,
+                  base::StrCat({"Cannot write file=", file->name(),
+                                " status=", write_status.status().ToString()}));
+  }
+  return Status::StatusOK();
+}
+
+Status StorageQueue::WriteHeadersAndBlocks(
+    const std::vector<base::StringPiece>& blocks,
+    base::StringPiece last_record_digest) {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(storage_queue_sequence_checker_);
+  DCHECK(!blocks.empty());
+
+  // Test only: Simulate failure if requested
+  if (test_injected_failures_.count(
+          test::StorageQueueOperationKind::kWriteBlock) > 0) {
+    const auto& failures =
+        test_injected_failures_[test::StorageQueueOperationKind::kWriteBlock];
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      if (failures.count(next_sequencing_id_ + i)) {
+        return Status(
+            error::INTERNAL,
+            base::StrCat({"Simulated failure, seq=",
+                          base::NumberToString(next_sequencing_id_ + i)}));
+      }
+    }
+  }
+
+  // Compose records for the current last file, and append them with one
+  // operation once the file would become too large or all records are done.
+  std::string composed;
+  scoped_refptr<SingleFile> file;
+  for (const auto& data : blocks) {
+    if (file && !composed.empty() &&
+        file->size() + composed.size() + data.size() + sizeof(RecordHeader) +
+                FRAME_SIZE >
+            options_.max_single_file_size()) {
+      RETURN_IF_ERROR(AppendComposedBlocks(composed, file));
+      composed.clear();
+    }
+    // |file| size is now current, so assignment switches to the new file
+    // exactly when individual writes would.
+    ASSIGN_OR_RETURN(file, AssignLastFile(data.size()));
+    ComposeHeaderAndBlock(data, &composed);
+  }
+  RETURN_IF_ERROR(AppendComposedBlocks(composed, file));
+  // Store last record digest.
+  last_record_digest_.emplace(last_record_digest);
+  return Status::StatusOK();
+}
+
+Status StorageQueue::WriteMetadata(base::StringPiece current_record_digest,
+                                   int64_t sequencing_id) {
   DCHECK_CALLED_ON_VALID_SEQUENCE(storage_queue_sequence_checker_);
 
   // Test only: Simulate failure if requested
   if (test_injected_failures_.count(
           test::StorageQueueOperationKind::kWriteMetadata) > 0 &&
       test_injected_failures_[test::StorageQueueOperationKind::kWriteMetadata]
-          .count(next_sequencing_id_)) {
+          .count(sequencing_id)) {
     return Status(error::INTERNAL,
                   base::StrCat({"Simulated failure, seq=",
-                                base::NumberToString(next_sequencing_id_)}));
+                                base::NumberToString(sequencing_id)}));
   }
 
   // Synchronously write the metafile.
+  ++write_stats_.metadata_writes;
   ASSIGN_OR_RETURN(
       scoped_refptr<SingleFile> meta_file,
       SingleFile::Create(
           options_.directory()
               .Append(METADATA_NAME)
-              .AddExtensionASCII(base::NumberToString(next_sequencing_id_)),
+              .AddExtensionASCII(base::NumberToString(sequencing_id)),
           /*size=*/0));
   RETURN_IF_ERROR(meta_file->Open(/*read_only=*/false));
   // Account for the metadata file size.
@@ -618,7 +717,7 @@ Status StorageQueue::WriteMetadata(base::StringPiece current_record_digest) {
   base::ThreadPool::PostTask(
       FROM_HERE, {base::TaskPriority::BEST_EFFORT, base::MayBlock()},
       base::BindOnce(&StorageQueue::DeleteOutdatedMetadata, this,
-                     next_sequencing_id_));
+                     sequencing_id));
   return Status::StatusOK();
 }
 
@@ -980,6 +1079,11 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
 
   void OnCompletion() override {
     DCHECK_CALLED_ON_VALID_SEQUENCE(read_sequence_checker_);
+    // Release the mappings pinned by this upload.
+    for (const int64_t mapped_file_seq : mapped_files_) {
+      files_[mapped_file_seq]->Unmap();
+    }
+    mapped_files_.clear();
     // Unregister with storage_queue.
     if (!files_.empty()) {
       if (storage_queue_) {
@@ -1073,10 +1177,12 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
   }
 
   // Loads blob from the current file - reads header first, and then the body.
-  // (SingleFile::Read call makes sure all the data is in the buffer).
+  // (SingleFile::Read call makes sure all the data is in the buffer, or
+  // SingleFile::ReadMapped returns the data in the mapped file).
   // After reading, verifies that data matches the hash stored in the header.
   // If everything checks out, returns the reference to the data in the buffer:
-  // the buffer remains intact until the next call to SingleFile::Read.
+  // the buffer remains intact until the next call to SingleFile::Read (mapped
+  // data remains intact until the upload is completed).
   // If anything goes wrong (file is shorter than expected, or record hash does
   // not match), returns error.
   StatusOr<base::StringPiece> EnsureBlob(int64_t sequencing_id) {
@@ -1098,12 +1204,7 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
     }
 
     // Read from the current file at the current offset.
-    RETURN_IF_ERROR(current_file_->second->Open(/*read_only=*/true));
-    const size_t max_buffer_size =
-        RoundUpToFrameSize(storage_queue_->options_.max_record_size()) +
-        RoundUpToFrameSize(sizeof(RecordHeader));
-    auto read_result = current_file_->second->Read(
-        current_pos_, sizeof(RecordHeader), max_buffer_size);
+    auto read_result = ReadCurrentFile(sizeof(RecordHeader));
     RETURN_IF_ERROR(read_result.status());
     auto header_data = read_result.ValueOrDie();
     if (header_data.empty()) {
@@ -1133,8 +1234,7 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
     const size_t data_size = RoundUpToFrameSize(header.record_size);
     // From this point on, header in memory is no longer used and can be
     // overwritten when reading rest of the data.
-    read_result =
-        current_file_->second->Read(current_pos_, data_size, max_buffer_size);
+    read_result = ReadCurrentFile(data_size);
     RETURN_IF_ERROR(read_result.status());
     current_pos_ += read_result.ValueOrDie().size();
     if (read_result.ValueOrDie().size() != data_size) {
@@ -1166,6 +1266,47 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
     return read_result.ValueOrDie().substr(0, header.record_size);
   }
 
+  // Reads |size| bytes at |current_pos_| of the current file. If the queue
+  // uploads from mapped files, returns a view into the mapping (pinned until
+  // the upload is completed); otherwise, or if the file cannot be mapped,
+  // reads through the file buffer.
+  StatusOr<base::StringPiece> ReadCurrentFile(uint32_t size) {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(read_sequence_checker_);
+    if (storage_queue_->options_.upload_from_mapped_files()) {
+      if (mapped_files_.count(current_file_->first) == 0) {
+        Status map_status;
+        // Test only: simulate mapping failure, if requested.
+        if (storage_queue_->test_injected_failures_.count(
+                test::StorageQueueOperationKind::kMapFile) > 0 &&
+            storage_queue_
+                    ->test_injected_failures_
+                        [test::StorageQueueOperationKind::kMapFile]
+                    .count(current_file_->first) > 0) {
+          map_status = Status(
+              error::INTERNAL,
+              base::StrCat({"Simulated map failure, seq=",
+                            base::NumberToString(current_file_->first)}));
+        } else {
+          map_status = current_file_->second->Map();
+        }
+        if (map_status.ok()) {
+          mapped_files_.insert(current_file_->first);
+        } else {
+          LOG(WARNING) << "Falling back to buffered read, status="
+                       << map_status;
+        }
+      }
+      if (mapped_files_.count(current_file_->first) > 0) {
+        return current_file_->second->ReadMapped(current_pos_, size);
+      }
+    }
+    RETURN_IF_ERROR(current_file_->second->Open(/*read_only=*/true));
+    const size_t max_buffer_size =
+        RoundUpToFrameSize(storage_queue_->options_.max_record_size()) +
+        RoundUpToFrameSize(sizeof(RecordHeader));
+    return current_file_->second->Read(current_pos_, size, max_buffer_size);
+  }
+
   void CallRecordOrGap(int64_t sequencing_id) {
     DCHECK_CALLED_ON_VALID_SEQUENCE(read_sequence_checker_);
     if (!storage_queue_) {
@@ -1248,6 +1389,8 @@ class StorageQueue::ReadContext : public TaskRunnerContext<Status> {
   SequenceInformation sequence_info_;
   uint32_t current_pos_;
   std::map<int64_t, scoped_refptr<SingleFile>>::iterator current_file_;
+  // Files from |files_| mapped and pinned by this upload.
+  base::flat_set<int64_t> mapped_files_;
   const AsyncStartUploaderCb async_start_upload_cb_;
   const bool must_invoke_upload_;
   std::unique_ptr<UploaderInterface> uploader_;
@@ -1281,6 +1424,12 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
       storage_queue_->write_contexts_queue_.erase(in_contexts_queue_);
     }
 
+    // If the record has been written by the group commit leader, the leader
+    // takes care of resuming the queue and starting the upload.
+    if (batch_follower_) {
+      return;
+    }
+
     // If there is the context at the front of the queue and its buffer is
     // filled in, schedule respective |Write| to happen now.
     if (!storage_queue_->write_contexts_queue_.empty() &&
@@ -1453,6 +1602,25 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
       return;
     }
 
+    // In group commit mode, give other records a chance to get ready and be
+    // written together with this one. A record with no other writer pending
+    // behind it has nothing to wait for, and is written right away.
+    if (storage_queue_->options_.max_write_batch_size() > 0 &&
+        buffer_.size() <= storage_queue_->options_.max_record_size()) {
+      if (batch_scheduled_) {
+        return;  // Already waiting for the batch window to expire.
+      }
+      if (!storage_queue_->options_.write_batch_window().is_zero() &&
+          storage_queue_->write_contexts_queue_.size() > 1) {
+        batch_scheduled_ = true;
+        ScheduleAfter(storage_queue_->options_.write_batch_window(),
+                      &WriteContext::WriteRecordsBatch, base::Unretained(this));
+        return;
+      }
+      WriteRecordsBatch();
+      return;
+    }
+
     // We are at the head of the queue, remove ourselves.
     storage_queue_->write_contexts_queue_.pop_front();
     in_contexts_queue_ = storage_queue_->write_contexts_queue_.end();
@@ -1467,7 +1635,8 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
     scoped_refptr<SingleFile> last_file = assign_result.ValueOrDie();
 
     // Writing metadata ahead of the data write.
-    Status write_result = storage_queue_->WriteMetadata(current_record_digest_);
+    Status write_result = storage_queue_->WriteMetadata(
+        current_record_digest_, storage_queue_->next_sequencing_id_);
     if (!write_result.ok()) {
       Response(write_result);
       return;
@@ -1485,6 +1654,63 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
     Response(Status::StatusOK());
   }
 
+  void WriteRecordsBatch() {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(write_sequence_checker_);
+    DCHECK_EQ(storage_queue_->write_contexts_queue_.front(), this);
+
+    // Collect this context and the contexts following it that are ready to be
+    // written, up to the batch size. Records are taken in the queue order, so
+    // sequencing ids and the digest chain are the same as with individual
+    // writes.
+    std::vector<WriteContext*> batch;
+    std::vector<base::StringPiece> blocks;
+    size_t batch_size = 0;
+    for (WriteContext* const context : storage_queue_->write_contexts_queue_) {
+      if (context->buffer_.empty() ||
+          context->buffer_.size() >
+              storage_queue_->options_.max_record_size()) {
+        break;  // Not ready yet, or will fail on its own.
+      }
+      if (!batch.empty() &&
+          batch_size + context->buffer_.size() >
+              storage_queue_->options_.max_write_batch_size()) {
+        break;  // Batch is full.
+      }
+      batch_size += context->buffer_.size();
+      batch.push_back(context);
+      blocks.emplace_back(context->buffer_);
+    }
+    DCHECK(!batch.empty());
+    DCHECK_EQ(batch.front(), this);
+
+    // Remove the whole batch from the head of the queue.
+    for (WriteContext* const context : batch) {
+      DCHECK_EQ(storage_queue_->write_contexts_queue_.front(), context);
+      storage_queue_->write_contexts_queue_.pop_front();
+      context->in_contexts_queue_ = storage_queue_->write_contexts_queue_.end();
+    }
+
+    // Writing metadata for the last record of the batch ahead of the data
+    // write, then write all headers and blocks. Store the last record digest
+    // with the queue, advance next_sequencing_id_.
+    const std::string& last_record_digest =
+        batch.back()->current_record_digest_;
+    Status write_result = storage_queue_->WriteMetadata(
+        last_record_digest,
+        storage_queue_->next_sequencing_id_ + batch.size() - 1);
+    if (write_result.ok()) {
+      write_result =
+          storage_queue_->WriteHeadersAndBlocks(blocks, last_record_digest);
+    }
+
+    // Respond to the rest of the batch, then to ourselves.
+    for (size_t i = 1; i < batch.size(); ++i) {
+      batch[i]->batch_follower_ = true;
+      batch[i]->Response(write_result);
+    }
+    Response(write_result);
+  }
+
   scoped_refptr<StorageQueue> storage_queue_;
 
   Record record_;
@@ -1501,6 +1727,14 @@ class StorageQueue::WriteContext : public TaskRunnerContext<Status> {
   // executed. Empty until encryption is done.
   std::string buffer_;
 
+  // Set when the record has been written as a part of a group commit by
+  // another context.
+  bool batch_follower_ = false;
+
+  // Set when the group commit has been scheduled to happen after the batch
+  // window expires.
+  bool batch_scheduled_ = false;
+
   SEQUENCE_CHECKER(write_sequence_checker_);
 };
 
@@ -1666,6 +1900,19 @@ void StorageQueue::ReleaseAllFileInstances() {
   meta_file_.reset();
 }
 
+void StorageQueue::TestGetWriteStats(
+    base::OnceCallback<void(WriteStats)> cb) {
+  sequenced_task_runner_->PostTask(
+      FROM_HERE, base::BindOnce(
+                     [](scoped_refptr<StorageQueue> self,
+                        base::OnceCallback<void(WriteStats)> cb) {
+                       DCHECK_CALLED_ON_VALID_SEQUENCE(
+                           self->storage_queue_sequence_checker_);
+                       std::move(cb).Run(self->write_stats_);
+                     },
+                     base::WrapRefCounted(this), std::move(cb)));
+}
+
 void StorageQueue::TestInjectErrorsForOperation(
     const test::StorageQueueOperationKind operation_kind,
     std::initializer_list<int64_t> sequencing_ids) {
@@ -1833,6 +2080,42 @@ StatusOr<base::StringPiece> StorageQueue::SingleFile::Read(
   return read_data;
 }
 
+Status StorageQueue::SingleFile::Map() {
+  if (!mapped_file_) {
+    auto mapped_file = std::make_unique<base::MemoryMappedFile>();
+    if (!mapped_file->Initialize(filename_)) {
+      return Status(error::DATA_LOSS,
+                    base::StrCat({"Cannot map file=", name()}));
+    }
+    mapped_file_ = std::move(mapped_file);
+  }
+  ++map_pins_;
+  return Status::StatusOK();
+}
+
+void StorageQueue::SingleFile::Unmap() {
+  DCHECK(mapped_file_);
+  DCHECK_GT(map_pins_, 0u);
+  if (--map_pins_ == 0) {
+    mapped_file_.reset();
+  }
+}
+
+StatusOr<base::StringPiece> StorageQueue::SingleFile::ReadMapped(
+    uint32_t pos, uint32_t size) const {
+  if (!mapped_file_) {
+    return Status(error::UNAVAILABLE,
+                  base::StrCat({"File not mapped ", name()}));
+  }
+  const base::StringPiece mapped_data(
+      reinterpret_cast<const char*>(mapped_file_->data()),
+      mapped_file_->length());
+  if (pos >= mapped_data.size()) {
+    return base::StringPiece();  // EOF.
+  }
+  return mapped_data.substr(pos, size);
+}
+
 StatusOr<uint32_t> StorageQueue::SingleFile::Append(base::StringPiece data) {
   if (!handle_) {
     return Status(error::UNAVAILABLE, base::StrCat({"File not open ", name()}));
@@ -10,6 +10,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <base/callback.h>
 #include <base/containers/flat_map.h>
@@ -17,6 +18,7 @@
 #include <base/files/file.h>
 #include <base/files/file_enumerator.h>
 #include <base/files/file_path.h>
+#include <base/files/memory_mapped_file.h>
 #include <base/memory/ref_counted.h>
 #include <base/memory/ref_counted_delete_on_sequence.h>
 #include <base/memory/scoped_refptr.h>
@@ -43,7 +45,8 @@ namespace test {
 enum class StorageQueueOperationKind {
   kReadBlock,
   kWriteBlock,
-  kWriteMetadata
+  kWriteMetadata,
+  kMapFile
 };
 
 }  // namespace test
@@ -78,8 +81,11 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   // caller can "fire and forget" it (|completion_cb| allows to verify that
   // record has been successfully enqueued). If file is going to become too
   // large, it is closed and new file is created.
+  // If group commit is enabled in the queue options, records that are ready to
+  // be written together are stored with a single data append and a single
+  // metadata update.
   // Helper methods: AssignLastFile, WriteHeaderAndBlock, OpenNewWriteableFile,
-  // WriteMetadata, DeleteOutdatedMetadata.
+  // WriteMetadata, DeleteOutdatedMetadata, WriteHeadersAndBlocks.
   void Write(Record record, base::OnceCallback<void(Status)> completion_cb);
 
   // Confirms acceptance of the records up to |sequencing_id| (inclusively).
@@ -116,6 +122,17 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   // CollectFilesForUpload.
   void Flush();
 
+  // Counters of the write activity of the queue, used to evaluate the effect
+  // of group commit.
+  struct WriteStats {
+    uint64_t records = 0;          // Records written.
+    uint64_t data_appends = 0;     // Appends to the data files.
+    uint64_t metadata_writes = 0;  // Metadata files written.
+  };
+
+  // Test only: asynchronously returns write counters.
+  void TestGetWriteStats(base::OnceCallback<void(WriteStats)> cb);
+
   // Test only: makes specified records fail on specified operation kind.
   void TestInjectErrorsForOperation(
       const test::StorageQueueOperationKind operation_kind,
@@ -168,10 +185,23 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
                                      size_t max_buffer_size,
                                      bool expect_readonly = true);
 
+    // Maps the whole file into memory for reading (if it has not been mapped
+    // yet) and pins the mapping. Every successful call must be matched by
+    // Unmap; the mapping is released when the last pin is removed.
+    Status Map();
+    void Unmap();
+
+    // Zero-copy alternative to Read for the mapped file: returns a view of
+    // up to |size| bytes at position |pos| directly in the mapped data. The
+    // view remains valid as long as the mapping is pinned.
+    // End of file is indicated by empty data.
+    StatusOr<base::StringPiece> ReadMapped(uint32_t pos, uint32_t size) const;
+
     // Appends data to the file.
     StatusOr<uint32_t> Append(base::StringPiece data);
 
     bool is_opened() const { return handle_.get() != nullptr; }
+    bool is_mapped() const { return mapped_file_.get() != nullptr; }
     bool is_readonly() const {
       DCHECK(is_opened());
       return is_readonly_.value();
@@ -207,6 +237,11 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
     uint64_t file_position_ = 0;
     size_t buffer_size_ = 0;
     std::unique_ptr<char[]> buffer_;
+
+    // Read-only mapping of the file (set only when mapped), and the number
+    // of users that pinned it.
+    std::unique_ptr<base::MemoryMappedFile> mapped_file_;
+    size_t map_pins_ = 0;
   };
 
   // Private constructor, to be called by Create factory method only.
@@ -260,13 +295,15 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   StatusOr<scoped_refptr<SingleFile>> OpenNewWriteableFile();
 
   // Helper method for Write(): stores a file with metadata to match the
-  // incoming new record. Synchronously composes metadata to record, then
+  // incoming new record with |sequencing_id| (for group commit - the last
+  // record of the batch). Synchronously composes metadata to record, then
   // asynchronously writes it into a file with next sequencing id and then
   // notifies the Write operation that it can now complete. After that it
   // asynchronously deletes all other files with lower sequencing id
   // (multiple Writes can see the same files and attempt to delete them, and
   // that is not an error).
-  Status WriteMetadata(base::StringPiece current_record_digest);
+  Status WriteMetadata(base::StringPiece current_record_digest,
+                       int64_t sequencing_id);
 
   // Helper method for RestoreMetadata(): loads and verifies metadata file
   // contents. If accepted, adds the file to the set.
@@ -295,6 +332,24 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
                              base::StringPiece current_record_digest,
                              scoped_refptr<SingleFile> file);
 
+  // Helper method for Write() in group commit mode: composes headers for all
+  // |blocks| and writes them to the last file(s), followed by data, with one
+  // append per file. Switches to a new file, when the last one becomes too
+  // large, same as individual writes do. Stores |last_record_digest| in the
+  // queue, advances next sequencing id past all the records.
+  Status WriteHeadersAndBlocks(const std::vector<base::StringPiece>& blocks,
+                               base::StringPiece last_record_digest);
+
+  // Helper method for WriteHeadersAndBlocks(): composes record header for
+  // |data| with the next sequencing id, and appends it to |output|, followed
+  // by data and padding. Increments next sequencing id.
+  void ComposeHeaderAndBlock(base::StringPiece data, std::string* output);
+
+  // Helper method for WriteHeadersAndBlocks(): appends composed records to
+  // |file|, reserving disk space for them.
+  Status AppendComposedBlocks(base::StringPiece composed,
+                              scoped_refptr<SingleFile> file);
+
   // Helper method for Upload: if the last file is not empty (has at least one
   // record), close it and create the new one, so that its records are also
   // included in the reading.
@@ -386,6 +441,9 @@ class StorageQueue : public base::RefCountedDeleteOnSequence<StorageQueue> {
   // Compression module.
   scoped_refptr<CompressionModule> compression_module_;
 
+  // Write activity counters.
+  WriteStats write_stats_;
+
   // Test only: records specified to fail for a given operation kind.
   base::flat_map<test::StorageQueueOperationKind, base::flat_set<int64_t>>
       test_injected_failures_;
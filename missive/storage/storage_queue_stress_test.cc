@@ -4,9 +4,11 @@
 
 #include "missive/storage/storage_queue.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <initializer_list>
 #include <optional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -14,12 +16,16 @@
 #include <base/files/file_path.h>
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/process/process_metrics.h>
 #include <base/strings/strcat.h>
 #include <base/strings/string_number_conversions.h>
+#include <base/strings/string_split.h>
 #include <base/synchronization/waitable_event.h>
 #include <base/feature_list.h>
 #include <base/task/thread_pool.h>
 #include <base/test/task_environment.h>
+#include <base/time/time.h>
+#include <base/time/time_override.h>
 #include <crypto/sha2.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -51,8 +57,63 @@ namespace {
 
 constexpr size_t kTotalQueueStarts = 4;
 constexpr size_t kTotalWritesPerStart = 16;
+constexpr size_t kTotalBenchmarkWrites = 256;
+constexpr size_t kBenchmarkRecordSize = 64 * 1024u;
 constexpr char kDataPrefix[] = "Rec";
 
+// Returns resident set size of the current process, or 0 if not available.
+size_t GetCurrentRss() {
+  std::string statm;
+  if (!base::ReadFileToString(base::FilePath("/proc/self/statm"), &statm)) {
+    return 0;
+  }
+  const auto fields = base::SplitStringPiece(
+      statm, " ", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  size_t resident_pages = 0;
+  if (fields.size() < 2 || !base::StringToSizeT(fields[1], &resident_pages)) {
+    return 0;
+  }
+  return resident_pages * base::GetPageSize();
+}
+
+// Uploader that only counts uploaded data and samples peak RSS.
+class BenchmarkUploadClient : public UploaderInterface {
+ public:
+  struct Results {
+    size_t records = 0;
+    size_t bytes = 0;
+    size_t peak_rss = 0;
+  };
+
+  BenchmarkUploadClient(Results* results, base::OnceClosure done_cb)
+      : results_(results), done_cb_(std::move(done_cb)) {}
+
+  void ProcessRecord(EncryptedRecord encrypted_record,
+                     base::OnceCallback<void(bool)> processed_cb) override {
+    ++results_->records;
+    results_->bytes += encrypted_record.encrypted_wrapped_record().size();
+    if (results_->records % 16 == 1) {
+      results_->peak_rss = std::max(results_->peak_rss, GetCurrentRss());
+    }
+    std::move(processed_cb).Run(true);
+  }
+
+  void ProcessGap(SequenceInformation sequence_information,
+                  uint64_t count,
+                  base::OnceCallback<void(bool)> processed_cb) override {
+    ASSERT_TRUE(false) << "There should be no gaps";
+  }
+
+  void Completed(Status status) override {
+    EXPECT_OK(status);
+    std::move(done_cb_).Run();
+  }
+
+ private:
+  Results* const results_;
+  base::OnceClosure done_cb_;
+};
+
 class TestUploadClient : public UploaderInterface {
  public:
   // Mapping of <generation id, sequencing id> to matching record digest.
@@ -193,6 +254,12 @@ class StorageQueueStressTest : public ::testing::TestWithParam<size_t> {
       UploaderInterface::UploadReason reason,
       UploaderInterface::UploaderInterfaceResultCb start_uploader_cb) {
     // Ignore reason for stress test.
+    if (upload_benchmark_results_) {
+      std::move(start_uploader_cb)
+          .Run(std::make_unique<BenchmarkUploadClient>(
+              upload_benchmark_results_, upload_benchmark_done_cb_));
+      return;
+    }
     std::move(start_uploader_cb)
         .Run(std::make_unique<TestUploadClient>(&last_record_digest_map_));
   }
@@ -207,6 +274,91 @@ class StorageQueueStressTest : public ::testing::TestWithParam<size_t> {
     storage_queue_->Write(std::move(record), std::move(cb));
   }
 
+  // Writes |count| records into a new queue with |options| simultaneously,
+  // uploads them and returns the write counters. Logs records/sec measured
+  // by the real clock.
+  StorageQueue::WriteStats BenchmarkWrites(const QueueOptions& options,
+                                           size_t count,
+                                           base::StringPiece label) {
+    CreateTestStorageQueueOrDie(options);
+    const base::TimeTicks start_time =
+        base::subtle::TimeTicksNowIgnoringOverride();
+    {
+      test::TestCallbackWaiter write_waiter;
+      base::RepeatingCallback<void(Status)> cb = base::BindRepeating(
+          [](test::TestCallbackWaiter* waiter, Status status) {
+            EXPECT_OK(status);
+            waiter->Signal();
+          },
+          &write_waiter);
+      for (size_t iRec = 0; iRec < count; ++iRec) {
+        write_waiter.Attach();
+        WriteStringAsync(
+            base::StrCat({kDataPrefix, label, "_", base::NumberToString(iRec)}),
+            cb);
+      }
+      write_waiter.Wait();
+    }
+    const base::TimeDelta elapsed =
+        base::subtle::TimeTicksNowIgnoringOverride() - start_time;
+    test::TestEvent<StorageQueue::WriteStats> stats_event;
+    storage_queue_->TestGetWriteStats(stats_event.cb());
+    const StorageQueue::WriteStats stats = stats_event.result();
+    EXPECT_THAT(stats.records, Eq(count));
+    LOG(INFO) << label << ": "
+              << static_cast<double>(count) / elapsed.InSecondsF()
+              << " records/sec, "
+              << static_cast<double>(stats.data_appends) / stats.records
+              << " data appends/record, "
+              << static_cast<double>(stats.metadata_writes) / stats.records
+              << " metadata writes/record";
+    storage_queue_->Flush();
+    ResetTestStorageQueue();
+    return stats;
+  }
+
+  // Fills a new queue with |options| with |total_size| bytes of records and
+  // uploads them. Logs upload throughput and peak RSS measured during upload.
+  BenchmarkUploadClient::Results BenchmarkUpload(const QueueOptions& options,
+                                                 size_t total_size,
+                                                 base::StringPiece label) {
+    CreateTestStorageQueueOrDie(options);
+    const std::string data(kBenchmarkRecordSize, 'A');
+    for (size_t written = 0; written < total_size;
+         written += kBenchmarkRecordSize) {
+      test::TestEvent<Status> write_event;
+      WriteStringAsync(data, write_event.cb());
+      EXPECT_OK(write_event.result());
+    }
+
+    BenchmarkUploadClient::Results results;
+    const size_t initial_rss = GetCurrentRss();
+    const base::TimeTicks start_time =
+        base::subtle::TimeTicksNowIgnoringOverride();
+    {
+      test::TestCallbackWaiter upload_waiter;
+      upload_waiter.Attach();
+      upload_benchmark_results_ = &results;
+      upload_benchmark_done_cb_ = base::BindRepeating(
+          &test::TestCallbackWaiter::Signal, base::Unretained(&upload_waiter));
+      storage_queue_->Flush();
+      upload_waiter.Wait();
+      upload_benchmark_results_ = nullptr;
+      upload_benchmark_done_cb_.Reset();
+    }
+    const base::TimeDelta elapsed =
+        base::subtle::TimeTicksNowIgnoringOverride() - start_time;
+    LOG(INFO) << label << ": " << results.records << " records, "
+              << results.bytes / elapsed.InSecondsF() / (1024 * 1024)
+              << " MiB/sec uploaded, peak RSS growth "
+              << (results.peak_rss > initial_rss
+                      ? (results.peak_rss - initial_rss) / 1024
+                      : 0u)
+              << " KiB";
+    ResetTestStorageQueue();
+    return results;
+  }
+
   base::test::TaskEnvironment task_environment_{
       base::test::TaskEnvironment::TimeSource::MOCK_TIME};
 
@@ -218,6 +370,10 @@ class StorageQueueStressTest : public ::testing::TestWithParam<size_t> {
   scoped_refptr<test::TestCompressionModule> test_compression_module_;
   scoped_refptr<StorageQueue> storage_queue_;
 
+  // Set only while BenchmarkUpload is uploading.
+  BenchmarkUploadClient::Results* upload_benchmark_results_ = nullptr;
+  base::RepeatingClosure upload_benchmark_done_cb_;
+
   // Test-wide global mapping of <generation id, sequencing id> to record
   // digest. Serves all TestUploadClients created by test fixture.
   TestUploadClient::LastRecordDigestMap last_record_digest_map_;
@@ -268,6 +424,56 @@ TEST_P(StorageQueueStressTest,
   }
 }
 
+TEST_P(StorageQueueStressTest, GroupCommitBenchmark) {
+  const StorageQueue::WriteStats individual_stats = BenchmarkWrites(
+      BuildStorageQueueOptionsOnlyManual()
+          .set_subdirectory("Individual")
+          .set_max_single_file_size(GetParam()),
+      kTotalBenchmarkWrites, "Individual");
+
+  const StorageQueue::WriteStats batched_stats = BenchmarkWrites(
+      BuildStorageQueueOptionsOnlyManual()
+          .set_subdirectory("Batched")
+          .set_max_single_file_size(GetParam())
+          .set_write_batch_window(base::Milliseconds(10))
+          .set_max_write_batch_size(64 * 1024u),
+      kTotalBenchmarkWrites, "Batched");
+
+  EXPECT_THAT(last_record_digest_map_.size(), Eq(2 * kTotalBenchmarkWrites));
+  EXPECT_THAT(individual_stats.metadata_writes, Eq(kTotalBenchmarkWrites));
+  EXPECT_LT(batched_stats.metadata_writes, individual_stats.metadata_writes);
+  EXPECT_LT(batched_stats.data_appends, individual_stats.data_appends);
+}
+
+TEST_P(StorageQueueStressTest, UploadFromMappedFilesBenchmark) {
+  constexpr size_t kTotalSize = 4 * 1024LL * 1024LL;
+  const auto buffered_results = BenchmarkUpload(
+      BuildStorageQueueOptionsOnlyManual().set_subdirectory("Buffered"),
+      kTotalSize, "Buffered");
+  const auto mapped_results =
+      BenchmarkUpload(BuildStorageQueueOptionsOnlyManual()
+                          .set_subdirectory("Mapped")
+                          .set_upload_from_mapped_files(true),
+                      kTotalSize, "Mapped");
+  EXPECT_THAT(buffered_results.records, Eq(kTotalSize / kBenchmarkRecordSize));
+  EXPECT_THAT(mapped_results.records, Eq(buffered_results.records));
+  EXPECT_THAT(mapped_results.bytes, Eq(buffered_results.bytes));
+}
+
+// Large queue version of the benchmark above; run manually with
+// --gtest_also_run_disabled_tests.
+TEST_P(StorageQueueStressTest, DISABLED_UploadFromMappedFilesLargeBenchmark) {
+  constexpr size_t kTotalSize = 100 * 1024LL * 1024LL;
+  options_.set_max_total_files_size(4 * kTotalSize);
+  BenchmarkUpload(
+      BuildStorageQueueOptionsOnlyManual().set_subdirectory("Buffered"),
+      kTotalSize, "Buffered");
+  BenchmarkUpload(BuildStorageQueueOptionsOnlyManual()
+                      .set_subdirectory("Mapped")
+                      .set_upload_from_mapped_files(true),
+                  kTotalSize, "Mapped");
+}
+
 INSTANTIATE_TEST_SUITE_P(
     VaryingFileSize,
     StorageQueueStressTest,
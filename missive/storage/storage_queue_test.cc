@@ -4,6 +4,7 @@
 
 #include "missive/storage/storage_queue.h"
 
+#include <array>
 #include <atomic>
 #include <cstdint>
 #include <initializer_list>
@@ -582,6 +583,12 @@ class StorageQueueTest
     return BuildStorageQueueOptionsPeriodic(base::TimeDelta::Max());
   }
 
+  QueueOptions BuildStorageQueueOptionsGroupCommit() const {
+    return BuildStorageQueueOptionsOnlyManual()
+        .set_write_batch_window(base::Milliseconds(10))
+        .set_max_write_batch_size(64 * 1024u);
+  }
+
   void AsyncStartMockUploader(
       UploaderInterface::UploadReason reason,
       UploaderInterface::UploaderInterfaceResultCb start_uploader_cb) {
@@ -624,6 +631,29 @@ class StorageQueueTest
     return write_event.result();
   }
 
+  // Starts writing all |data| before waiting for any of the writes, so that
+  // they can be batched, and returns their results in order.
+  template <size_t N>
+  std::vector<Status> WriteStringsTogether(
+      const std::array<const char*, N>& data) {
+    EXPECT_TRUE(storage_queue_) << "StorageQueue not created yet";
+    std::array<test::TestEvent<Status>, N> write_events;
+    for (size_t i = 0; i < N; ++i) {
+      Record record;
+      record.set_data(data[i]);
+      record.set_destination(UPLOAD_EVENTS);
+      if (!dm_token_.empty()) {
+        record.set_dm_token(dm_token_);
+      }
+      storage_queue_->Write(std::move(record), write_events[i].cb());
+    }
+    std::vector<Status> results;
+    for (auto& write_event : write_events) {
+      results.push_back(write_event.result());
+    }
+    return results;
+  }
+
   void WriteStringOrDie(base::StringPiece data) {
     const Status write_result = WriteString(data);
     ASSERT_OK(write_result) << write_result;
@@ -778,6 +808,89 @@ TEST_P(StorageQueueTest, WriteIntoNewStorageQueueReopenWriteMoreAndUpload) {
   task_environment_.FastForwardBy(base::Seconds(1));
 }
 
+TEST_P(StorageQueueTest, WriteIntoNewStorageQueueAndUploadFromMappedFiles) {
+  CreateTestStorageQueueOrDie(
+      BuildStorageQueueOptionsPeriodic().set_upload_from_mapped_files(true));
+  WriteStringOrDie(kData[0]);
+  WriteStringOrDie(kData[1]);
+  WriteStringOrDie(kData[2]);
+
+  {
+    // Set uploader expectations.
+    test::TestCallbackAutoWaiter waiter;
+    EXPECT_CALL(set_mock_uploader_expectations_,
+                Call(Eq(UploaderInterface::UploadReason::PERIODIC)))
+        .WillOnce(
+            Invoke([&waiter, this](UploaderInterface::UploadReason reason) {
+              return TestUploader::SetUp(&waiter, this)
+                  .Required(0, kData[0])
+                  .Required(1, kData[1])
+                  .Required(2, kData[2])
+                  .Complete();
+            }))
+        .RetiresOnSaturation();
+
+    // Trigger upload.
+    task_environment_.FastForwardBy(base::Seconds(1));
+  }
+
+  // Confirm #0 and add more data: the next upload maps the files again and
+  // sees the data appended since the previous one.
+  ConfirmOrDie(/*sequencing_id=*/0);
+  WriteStringOrDie(kMoreData[0]);
+  WriteStringOrDie(kMoreData[1]);
+  WriteStringOrDie(kMoreData[2]);
+
+  {
+    // Set uploader expectations.
+    test::TestCallbackAutoWaiter waiter;
+    EXPECT_CALL(set_mock_uploader_expectations_,
+                Call(Eq(UploaderInterface::UploadReason::PERIODIC)))
+        .WillOnce(
+            Invoke([&waiter, this](UploaderInterface::UploadReason reason) {
+              return TestUploader::SetUp(&waiter, this)
+                  .Required(1, kData[1])
+                  .Required(2, kData[2])
+                  .Required(3, kMoreData[0])
+                  .Required(4, kMoreData[1])
+                  .Required(5, kMoreData[2])
+                  .Complete();
+            }))
+        .RetiresOnSaturation();
+
+    // Trigger upload.
+    task_environment_.FastForwardBy(base::Seconds(1));
+  }
+}
+
+TEST_P(StorageQueueTest, WriteIntoNewStorageQueueAndUploadWithMapFailures) {
+  CreateTestStorageQueueOrDie(
+      BuildStorageQueueOptionsPeriodic().set_upload_from_mapped_files(true));
+  WriteStringOrDie(kData[0]);
+  WriteStringOrDie(kData[1]);
+  WriteStringOrDie(kData[2]);
+
+  // Inject simulated failures: the first file cannot be mapped and is read
+  // through the file buffer instead.
+  InjectFailures(test::StorageQueueOperationKind::kMapFile, {0});
+
+  // Set uploader expectations.
+  test::TestCallbackAutoWaiter waiter;
+  EXPECT_CALL(set_mock_uploader_expectations_,
+              Call(Eq(UploaderInterface::UploadReason::PERIODIC)))
+      .WillOnce(Invoke([&waiter, this](UploaderInterface::UploadReason reason) {
+        return TestUploader::SetUp(&waiter, this)
+            .Required(0, kData[0])
+            .Required(1, kData[1])
+            .Required(2, kData[2])
+            .Complete();
+      }))
+      .RetiresOnSaturation();
+
+  // Trigger upload.
+  task_environment_.FastForwardBy(base::Seconds(1));
+}
+
 TEST_P(StorageQueueTest,
        WriteIntoNewStorageQueueReopenWithMissingMetadataWriteMoreAndUpload) {
   CreateTestStorageQueueOrDie(BuildStorageQueueOptionsPeriodic());
@@ -1767,6 +1880,33 @@ TEST_P(StorageQueueTest, WriteRecordWithWriteBlockFailures) {
   EXPECT_EQ(write_result.error_code(), error::INTERNAL);
 }
 
+TEST_P(StorageQueueTest, WriteBatchWithWriteMetadataFailures) {
+  CreateTestStorageQueueOrDie(BuildStorageQueueOptionsGroupCommit());
+  // Metadata is written once, for the last record of the batch.
+  InjectFailures(test::StorageQueueOperationKind::kWriteMetadata, {2});
+  for (const Status& write_result : WriteStringsTogether(kData)) {
+    EXPECT_FALSE(write_result.ok());
+    EXPECT_EQ(write_result.error_code(), error::INTERNAL);
+  }
+}
+
+TEST_P(StorageQueueTest, WriteBatchWithWriteBlockFailures) {
+  CreateTestStorageQueueOrDie(BuildStorageQueueOptionsGroupCommit());
+  InjectFailures(test::StorageQueueOperationKind::kWriteBlock, {1});
+  for (const Status& write_result : WriteStringsTogether(kData)) {
+    EXPECT_FALSE(write_result.ok());
+    EXPECT_EQ(write_result.error_code(), error::INTERNAL);
+  }
+}
+
+TEST_P(StorageQueueTest, WriteBatchOfSingleRecordWithoutWaiting) {
+  CreateTestStorageQueueOrDie(BuildStorageQueueOptionsGroupCommit());
+  const base::TimeTicks start_time = task_environment_.NowTicks();
+  WriteStringOrDie(kData[0]);
+  // No other writer was pending, so the batch window was not waited for.
+  EXPECT_EQ(task_environment_.NowTicks(), start_time);
+}
+
 TEST_P(StorageQueueTest, WriteRecordWithInvalidFilePrefix) {
   QueueOptions options = BuildStorageQueueOptionsPeriodic();
   options.set_file_prefix(kInvalidFilePrefix);
@@ -15,6 +15,8 @@
 #include <base/strings/string_split.h>
 #include <re2/re2.h>
 
+#include "patchpanel/xtables_counters.h"
+
 namespace patchpanel {
 
 namespace {
@@ -27,6 +29,14 @@ constexpr char kVpnChainTag[] = "vpn";
 constexpr char kRxTag[] = "rx_";
 constexpr char kTxTag[] = "tx_";
 
+// Counters are typically polled by the network usage UI, which does not need
+// a better resolution.
+constexpr base::TimeDelta kDefaultSnapshotMaxAge = base::Seconds(1);
+
+// The name of an accounting chain looks like "tx_eth0". This regex extracts
+// "tx" (direction), "eth0" (ifname) from this example.
+constexpr LazyRE2 kAccountingChain = {R"((rx|tx)_(\w+).*)"};
+
 // The following regexs and code is written and tested for iptables v1.6.2.
 // Output code of iptables can be found at:
 //   https://git.netfilter.org/iptables/tree/iptables/iptables.c?h=v1.6.2
@@ -69,6 +79,26 @@ bool MatchCounterLine(const std::string& line,
   return false;
 }
 
+// Adds |pkts| and |bytes| to the rx or tx values of |counter| depending on
+// |direction|.
+void AddToCounter(const std::string& direction,
+                  uint64_t pkts,
+                  uint64_t bytes,
+                  Counter* counter) {
+  if (direction == "rx") {
+    counter->rx_bytes += bytes;
+    counter->rx_packets += pkts;
+  } else {
+    counter->tx_bytes += bytes;
+    counter->tx_packets += pkts;
+  }
+}
+
+// Returns |after| - |before|, or |after| if the counter was reset in between.
+uint64_t CounterDelta(uint64_t before, uint64_t after) {
+  return after >= before ? after - before : after;
+}
+
 // Parses the output of `iptables -L -x -v` (or `ip6tables`) and adds the parsed
 // values into the corresponding counters in |counters|. An example of |output|
 // can be found in the test file. This function will try to find the pattern of:
@@ -136,14 +166,7 @@ bool ParseOutput(const std::string& output,
       key.ifname = ifname;
       key.source = TrafficSourceToProto(source);
       key.ip_family = ip_family;
-      auto& counter = (*counters)[key];
-      if (direction == "rx") {
-        counter.rx_bytes += bytes;
-        counter.rx_packets += pkts;
-      } else {
-        counter.tx_bytes += bytes;
-        counter.tx_packets += pkts;
-      }
+      AddToCounter(direction, pkts, bytes, &(*counters)[key]);
     }
 
     if (it == lines.cend())
@@ -154,11 +177,78 @@ bool ParseOutput(const std::string& output,
 
 }  // namespace
 
-CountersService::CountersService(Datapath* datapath) : datapath_(datapath) {}
+CountersService::CountersService(Datapath* datapath)
+    : datapath_(datapath), snapshot_max_age_(kDefaultSnapshotMaxAge) {}
 
 std::map<CounterKey, Counter> CountersService::GetCounters(
     const std::set<std::string>& devices) {
+  const auto* snapshot = GetSnapshot();
+  if (!snapshot)
+    return {};
+
   std::map<CounterKey, Counter> counters;
+  for (const auto& [key, counter] : *snapshot) {
+    if (devices.empty() || devices.find(key.ifname) != devices.end())
+      counters.emplace(key, counter);
+  }
+  return counters;
+}
+
+std::map<CounterKey, Counter> CountersService::GetCountersDelta(
+    const std::set<std::string>& devices) {
+  const auto* snapshot = GetSnapshot();
+  if (!snapshot)
+    return {};
+
+  std::map<CounterKey, Counter> deltas;
+  for (const auto& [key, counter] : *snapshot) {
+    if (!devices.empty() && devices.find(key.ifname) == devices.end())
+      continue;
+    // Only the baselines of the counters returned are moved forward, so that
+    // the counters excluded by |devices| keep accumulating their increase.
+    Counter& baseline = delta_baseline_[key];
+    const Counter before = baseline;
+    baseline = counter;
+    Counter delta;
+    delta.rx_bytes = CounterDelta(before.rx_bytes, counter.rx_bytes);
+    delta.rx_packets = CounterDelta(before.rx_packets, counter.rx_packets);
+    delta.tx_bytes = CounterDelta(before.tx_bytes, counter.tx_bytes);
+    delta.tx_packets = CounterDelta(before.tx_packets, counter.tx_packets);
+    if (delta.rx_packets != 0 || delta.tx_packets != 0 ||
+        delta.rx_bytes != 0 || delta.tx_bytes != 0) {
+      deltas.emplace(key, delta);
+    }
+  }
+  return deltas;
+}
+
+const std::map<CounterKey, Counter>* CountersService::GetSnapshot() {
+  const base::TimeTicks now = base::TimeTicks::Now();
+  if (!snapshot_time_.is_null() && now - snapshot_time_ < snapshot_max_age_)
+    return &snapshot_;
+
+  snapshot_.clear();
+  if (!ReadCounters(&snapshot_)) {
+    InvalidateSnapshot();
+    return nullptr;
+  }
+  snapshot_time_ = now;
+  return &snapshot_;
+}
+
+void CountersService::InvalidateSnapshot() {
+  snapshot_time_ = base::TimeTicks();
+  snapshot_.clear();
+}
+
+bool CountersService::ReadCounters(std::map<CounterKey, Counter>* counters) {
+  // Reading the rules directly from the kernel avoids running two processes
+  // and parsing their text output.
+  if (ReadCountersFromEntries(IpFamily::IPv4, counters) &&
+      ReadCountersFromEntries(IpFamily::IPv6, counters)) {
+    return true;
+  }
+  counters->clear();
 
   // Handles counters for IPv4 and IPv6 separately and returns failure if either
   // of the procession fails, since counters for only IPv4 or IPv6 are biased.
@@ -166,43 +256,89 @@ std::map<CounterKey, Counter> CountersService::GetCounters(
       datapath_->DumpIptables(IpFamily::IPv4, kMangleTable);
   if (iptables_result.empty()) {
     LOG(ERROR) << "Failed to query IPv4 counters";
-    return {};
+    return false;
   }
-  if (!ParseOutput(iptables_result, devices, TrafficCounter::IPV4, &counters)) {
+  if (!ParseOutput(iptables_result, {}, TrafficCounter::IPV4, counters)) {
     LOG(ERROR) << "Failed to parse IPv4 counters";
-    return {};
+    return false;
   }
 
   std::string ip6tables_result =
       datapath_->DumpIptables(IpFamily::IPv6, kMangleTable);
   if (ip6tables_result.empty()) {
     LOG(ERROR) << "Failed to query IPv6 counters";
-    return {};
+    return false;
   }
-  if (!ParseOutput(ip6tables_result, devices, TrafficCounter::IPV6,
-                   &counters)) {
+  if (!ParseOutput(ip6tables_result, {}, TrafficCounter::IPV6, counters)) {
     LOG(ERROR) << "Failed to parse IPv6 counters";
-    return {};
+    return false;
   }
 
-  return counters;
+  return true;
+}
+
+bool CountersService::ReadCountersFromEntries(
+    IpFamily family, std::map<CounterKey, Counter>* counters) {
+  XtablesEntries entries;
+  if (!datapath_->DumpIptablesEntries(family, kMangleTable, &entries))
+    return false;
+
+  std::vector<XtablesRuleCounter> rules;
+  if (!ParseXtablesEntries(family, entries, &rules)) {
+    LOG(ERROR) << "Failed to parse rules of the mangle table for " << family;
+    return false;
+  }
+
+  bool found_accounting_rule = false;
+  for (const auto& rule : rules) {
+    std::string direction, ifname;
+    if (!RE2::FullMatch(rule.chain, *kAccountingChain, &direction, &ifname))
+      continue;
+    found_accounting_rule = true;
+
+    TrafficSource source = TrafficSource::UNKNOWN;
+    if (rule.has_mark_match) {
+      if (rule.mark_mask != kFwmarkAllSourcesMask.Value()) {
+        LOG(ERROR) << "Unexpected mark match in " << rule.chain;
+        return false;
+      }
+      source = Fwmark{.fwmark = rule.mark}.Source();
+    }
+
+    if (rule.packets == 0 && rule.bytes == 0)
+      continue;
+
+    CounterKey key = {};
+    key.ifname = ifname;
+    key.source = TrafficSourceToProto(source);
+    key.ip_family = (family == IpFamily::IPv4) ? TrafficCounter::IPV4
+                                               : TrafficCounter::IPV6;
+    AddToCounter(direction, rule.packets, rule.bytes, &(*counters)[key]);
+  }
+  // The rules may not be visible from the kernel if iptables does not use the
+  // legacy backend, in which case the text output of iptables is needed.
+  return found_accounting_rule;
 }
 
 void CountersService::OnPhysicalDeviceAdded(const std::string& ifname) {
+  InvalidateSnapshot();
   SetupAccountingRules(ifname);
   SetupJumpRules("-A", ifname, ifname);
 }
 
 void CountersService::OnPhysicalDeviceRemoved(const std::string& ifname) {
+  InvalidateSnapshot();
   SetupJumpRules("-D", ifname, ifname);
 }
 
 void CountersService::OnVpnDeviceAdded(const std::string& ifname) {
+  InvalidateSnapshot();
   SetupAccountingRules(kVpnChainTag);
   SetupJumpRules("-A", ifname, kVpnChainTag);
 }
 
 void CountersService::OnVpnDeviceRemoved(const std::string& ifname) {
+  InvalidateSnapshot();
   SetupJumpRules("-D", ifname, kVpnChainTag);
 }
 
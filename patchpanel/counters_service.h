@@ -11,6 +11,7 @@
 #include <utility>
 #include <vector>
 
+#include <base/time/time.h>
 #include <patchpanel/proto_bindings/patchpanel_service.pb.h>
 
 #include "patchpanel/datapath.h"
@@ -44,9 +45,13 @@ namespace patchpanel {
 // and removed dynamically based on shill physical Device and shill vpn Device
 // creation and removal events.
 //
-// Query: Two commands (iptables and ip6tables) will be executed in the mangle
-// table to get all the chains and rules. And then we perform a text parsing on
-// the output to get the counters.
+// Query: The rules of the mangle table are read directly from the kernel for
+// IPv4 and IPv6 and the counters of the accounting rules are extracted from
+// them. If this fails, for instance because the kernel does not use the legacy
+// iptables backend, two commands (iptables and ip6tables) are executed instead
+// in the mangle table to get all the chains and rules, and their text output is
+// parsed to get the counters. The counters are cached for a short time since
+// they are typically polled.
 class CountersService {
  public:
   struct CounterKey {
@@ -83,8 +88,30 @@ class CountersService {
   // any failure.
   std::map<CounterKey, Counter> GetCounters(
       const std::set<std::string>& devices);
+  // Same as GetCounters() but returns for every counter its increase since the
+  // previous call to GetCountersDelta() that covered it, or since boot for the
+  // first one. Counters that did not change are omitted.
+  std::map<CounterKey, Counter> GetCountersDelta(
+      const std::set<std::string>& devices);
+
+  // Sets for how long the counters read from the kernel are reused by
+  // GetCounters() and GetCountersDelta(). A zero value disables caching.
+  void set_snapshot_max_age(base::TimeDelta max_age) {
+    snapshot_max_age_ = max_age;
+  }
 
  private:
+  // Returns the counters for all interfaces, from the cache if the last
+  // snapshot is recent enough. Returns nullptr on failure.
+  const std::map<CounterKey, Counter>* GetSnapshot();
+  // Reads the counters for all interfaces from the kernel or from iptables.
+  bool ReadCounters(std::map<CounterKey, Counter>* counters);
+  // Reads the counters for |family| from the kernel without running iptables.
+  bool ReadCountersFromEntries(IpFamily family,
+                               std::map<CounterKey, Counter>* counters);
+  // Invalidates the cached snapshot after accounting rules changed.
+  void InvalidateSnapshot();
+
   // Creates an iptables chain in the mangle table. Returns true if the chain
   // was created, or false if the chain already existed.
   bool MakeAccountingChain(const std::string& chain_name);
@@ -99,6 +126,13 @@ class CountersService {
                       const std::string& chain_tag);
 
   Datapath* datapath_;
+
+  base::TimeDelta snapshot_max_age_;
+  // Time of the last snapshot, or null if there is no valid snapshot.
+  base::TimeTicks snapshot_time_;
+  std::map<CounterKey, Counter> snapshot_;
+  // Value of each counter when GetCountersDelta() last covered it.
+  std::map<CounterKey, Counter> delta_baseline_;
 };
 
 TrafficCounter::Source TrafficSourceToProto(TrafficSource source);
@@ -0,0 +1,184 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of CountersService::GetCounters() when the counters are parsed
+// from the text output of iptables and when they are decoded from the rules
+// read from the kernel. By default both sources return synthetic rules for
+// |interfaces| interfaces so that only the parsing is measured. With --live,
+// the rules are read from the running system instead, which includes the cost
+// of running iptables and ip6tables and requires CAP_NET_ADMIN.
+//
+// Usage: counters_service_benchmark [--live] [interfaces] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/time/time.h>
+
+#include "patchpanel/counters_service.h"
+#include "patchpanel/datapath.h"
+#include "patchpanel/fake_xtables_entries.h"
+#include "patchpanel/routing_service.h"
+#include "patchpanel/system.h"
+#include "patchpanel/xtables_counters.h"
+
+namespace patchpanel {
+namespace {
+
+constexpr int kDefaultInterfaces = 8;
+constexpr int kDefaultIterations = 1000;
+
+// Returns the name of the |i|-th interface.
+std::string Ifname(int i) {
+  return base::StringPrintf("eth%d", i);
+}
+
+// Returns the same accounting rules in the format of `iptables -L -x -v -n`
+// and in the kernel binary format.
+std::string MakeIptablesOutput(int interfaces) {
+  std::string output;
+  for (const char* direction : {"rx", "tx"}) {
+    for (int i = 0; i < interfaces; i++) {
+      output += base::StringPrintf(
+          "Chain %s_%s (1 references)\n"
+          "    pkts      bytes target     prot opt in     out     source      "
+          "         destination\n",
+          direction, Ifname(i).c_str());
+      for (TrafficSource source : kAllSources) {
+        output += base::StringPrintf(
+            "  %6d %8d RETURN     all  --  *    *     0.0.0.0/0             "
+            "0.0.0.0/0             mark match %s/0x3f00\n",
+            1000 + i, 100000 + i,
+            Fwmark::FromSource(source).ToString().c_str());
+      }
+      output += base::StringPrintf(
+          "  %6d %8d            all  --  *    *     0.0.0.0/0             "
+          "0.0.0.0/0\n\n",
+          10 + i, 1000 + i);
+    }
+  }
+  return output;
+}
+
+XtablesEntries MakeXtablesEntries(IpFamily family, int interfaces) {
+  FakeXtablesEntries table(family);
+  for (const char* direction : {"rx", "tx"}) {
+    for (int i = 0; i < interfaces; i++) {
+      table.AddChain(base::StringPrintf("%s_%s", direction, Ifname(i).c_str()));
+      for (TrafficSource source : kAllSources) {
+        table.AddRule(1000 + i, 100000 + i, Fwmark::FromSource(source).Value(),
+                      kFwmarkAllSourcesMask.Value());
+      }
+      table.AddRule(10 + i, 1000 + i);
+    }
+  }
+  return table.Build();
+}
+
+// Returns canned rules, either as iptables text output only or also as kernel
+// entries.
+class FakeDatapath : public Datapath {
+ public:
+  FakeDatapath(int interfaces, bool kernel_entries)
+      : Datapath(nullptr, nullptr, nullptr),
+        iptables_output_(MakeIptablesOutput(interfaces)),
+        kernel_entries_(kernel_entries) {
+    if (kernel_entries_) {
+      entries_[IpFamily::IPv4] = MakeXtablesEntries(IpFamily::IPv4, interfaces);
+      entries_[IpFamily::IPv6] = MakeXtablesEntries(IpFamily::IPv6, interfaces);
+    }
+  }
+  FakeDatapath(const FakeDatapath&) = delete;
+  FakeDatapath& operator=(const FakeDatapath&) = delete;
+
+  std::string DumpIptables(IpFamily family, const std::string& table) override {
+    return iptables_output_;
+  }
+
+  bool DumpIptablesEntries(IpFamily family,
+                           const std::string& table,
+                           XtablesEntries* entries) override {
+    if (!kernel_entries_)
+      return false;
+    *entries = entries_[family];
+    return true;
+  }
+
+ private:
+  std::string iptables_output_;
+  bool kernel_entries_;
+  std::map<IpFamily, XtablesEntries> entries_;
+};
+
+// Reads the counters with the kernel entries disabled, for the live
+// benchmark.
+class IptablesOnlyDatapath : public Datapath {
+ public:
+  explicit IptablesOnlyDatapath(System* system) : Datapath(system) {}
+
+  bool DumpIptablesEntries(IpFamily family,
+                           const std::string& table,
+                           XtablesEntries* entries) override {
+    return false;
+  }
+};
+
+// Returns the average time of GetCounters() over |iterations| calls and
+// stores the number of counters returned in |num_counters|.
+base::TimeDelta Measure(Datapath* datapath, int iterations, int* num_counters) {
+  CountersService counters_svc(datapath);
+  counters_svc.set_snapshot_max_age(base::TimeDelta());
+  const base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < iterations; i++) {
+    *num_counters = counters_svc.GetCounters({}).size();
+  }
+  return (base::TimeTicks::Now() - start) / iterations;
+}
+
+}  // namespace
+}  // namespace patchpanel
+
+int main(int argc, char** argv) {
+  int arg = 1;
+  const bool live = argc > arg && strcmp(argv[arg], "--live") == 0;
+  if (live)
+    arg++;
+  const int interfaces = argc > arg ? strtol(argv[arg++], nullptr, 0)
+                                    : patchpanel::kDefaultInterfaces;
+  const int iterations = argc > arg ? strtol(argv[arg++], nullptr, 0)
+                                    : patchpanel::kDefaultIterations;
+
+  std::unique_ptr<patchpanel::Datapath> text_datapath;
+  std::unique_ptr<patchpanel::Datapath> kernel_datapath;
+  patchpanel::System system;
+  if (live) {
+    text_datapath =
+        std::make_unique<patchpanel::IptablesOnlyDatapath>(&system);
+    kernel_datapath = std::make_unique<patchpanel::Datapath>(&system);
+  } else {
+    text_datapath = std::make_unique<patchpanel::FakeDatapath>(
+        interfaces, false /*kernel_entries*/);
+    kernel_datapath = std::make_unique<patchpanel::FakeDatapath>(
+        interfaces, true /*kernel_entries*/);
+  }
+
+  printf("%8s %10s %12s\n", "source", "counters", "us/query");
+  int num_counters = 0;
+  base::TimeDelta elapsed =
+      patchpanel::Measure(text_datapath.get(), iterations, &num_counters);
+  printf("%8s %10d %12.1f\n", "iptables", num_counters,
+         elapsed.InMicrosecondsF());
+  elapsed =
+      patchpanel::Measure(kernel_datapath.get(), iterations, &num_counters);
+  printf("%8s %10d %12.1f\n", "kernel", num_counters,
+         elapsed.InMicrosecondsF());
+  return 0;
+}
@@ -34,6 +34,12 @@ class FakeDatapath : public Datapath {
     return data_;
   }
 
+  bool DumpIptablesEntries(IpFamily family,
+                           const std::string& table,
+                           XtablesEntries* entries) override {
+    return false;
+  }
+
  private:
   std::string data_;
 };
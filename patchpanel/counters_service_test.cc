@@ -15,6 +15,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "patchpanel/fake_xtables_entries.h"
 #include "patchpanel/mock_datapath.h"
 
 namespace patchpanel {
@@ -22,10 +23,13 @@ namespace patchpanel {
 using ::testing::_;
 using ::testing::AnyNumber;
 using ::testing::Contains;
+using ::testing::DoAll;
 using ::testing::Each;
 using ::testing::ElementsAreArray;
 using ::testing::Lt;
+using ::testing::Mock;
 using ::testing::Return;
+using ::testing::SetArgPointee;
 using ::testing::SizeIs;
 
 using Counter = CountersService::Counter;
@@ -670,5 +674,193 @@ Chain tx_wlan0 (1 references)
   TestBadIptablesOutput(kBadOutput, kIp6tablesOutput);
 }
 
+// Returns the rules of the mangle table with accounting chains for eth0 and
+// wlan0, in the kernel binary format.
+XtablesEntries MakeMangleEntries(IpFamily family) {
+  FakeXtablesEntries table(family);
+  table.AddChain("rx_eth0");
+  table.AddRule(73, 11938, 0x100, 0x3f00);
+  table.AddRule(0, 0, 0x200, 0x3f00);
+  table.AddRule(6, 345);
+  table.AddChain("tx_eth0");
+  table.AddRule(1366, 244427, 0x100, 0x3f00);
+  table.AddRule(5374, 876172, 0x2000, 0x3f00);
+  table.AddRule(4, 123);
+  table.AddChain("tx_wlan0");
+  table.AddRule(310, 57004, 0x100, 0x3f00);
+  table.AddRule(0, 0);
+  return table.Build();
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersFromKernel) {
+  EXPECT_CALL(*datapath_, DumpIptablesEntries(IpFamily::IPv4, "mangle", _))
+      .WillOnce(DoAll(SetArgPointee<2>(MakeMangleEntries(IpFamily::IPv4)),
+                      Return(true)));
+  EXPECT_CALL(*datapath_, DumpIptablesEntries(IpFamily::IPv6, "mangle", _))
+      .WillOnce(DoAll(SetArgPointee<2>(MakeMangleEntries(IpFamily::IPv6)),
+                      Return(true)));
+  EXPECT_CALL(*datapath_, DumpIptables(_, _)).Times(0);
+
+  auto actual = counters_svc_->GetCounters({});
+
+  std::map<CounterKey, Counter> expected;
+  for (auto family : {TrafficCounter::IPV4, TrafficCounter::IPV6}) {
+    expected[{"eth0", TrafficCounter::CHROME, family}] = {11938, 73, 244427,
+                                                          1366};
+    expected[{"eth0", TrafficCounter::ARC, family}] = {0, 0, 876172, 5374};
+    expected[{"eth0", TrafficCounter::UNKNOWN, family}] = {345, 6, 123, 4};
+    expected[{"wlan0", TrafficCounter::CHROME, family}] = {0, 0, 57004, 310};
+  }
+  EXPECT_TRUE(CompareCounters(expected, actual));
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersKernelFallback) {
+  // Without any accounting rule visible from the kernel, iptables is used.
+  EXPECT_CALL(*datapath_, DumpIptablesEntries(IpFamily::IPv4, "mangle", _))
+      .WillOnce(DoAll(SetArgPointee<2>(FakeXtablesEntries(IpFamily::IPv4)
+                                           .Build()),
+                      Return(true)));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(kIptablesOutput));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(kIp6tablesOutput));
+
+  auto actual = counters_svc_->GetCounters({"wlan0"});
+
+  std::map<CounterKey, Counter> expected{
+      {{"wlan0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {28098, 153, 57004, 310}},
+      {{"wlan0", TrafficCounter::SYSTEM, TrafficCounter::IPV4},
+       {840, 6, 2801, 24}},
+      {{"wlan0", TrafficCounter::CHROME, TrafficCounter::IPV6},
+       {28098, 153, 57004, 310}},
+      {{"wlan0", TrafficCounter::SYSTEM, TrafficCounter::IPV6},
+       {840, 6, 2801, 24}},
+  };
+  EXPECT_TRUE(CompareCounters(expected, actual));
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersCachesSnapshot) {
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(kIptablesOutput));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(kIp6tablesOutput));
+  counters_svc_->set_snapshot_max_age(base::Hours(1));
+
+  // The second query with a different filter is served from the snapshot.
+  EXPECT_EQ(16u, counters_svc_->GetCounters({}).size());
+  EXPECT_EQ(12u, counters_svc_->GetCounters({"eth0"}).size());
+  Mock::VerifyAndClearExpectations(datapath_.get());
+
+  // Any change of the accounting rules invalidates the snapshot.
+  counters_svc_->OnPhysicalDeviceRemoved("wlan0");
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(kIptablesOutput));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillOnce(Return(kIp6tablesOutput));
+  EXPECT_EQ(16u, counters_svc_->GetCounters({}).size());
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersDelta) {
+  const std::string before = R"(
+Chain tx_eth0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+    1366   244427 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+       4      123            all  --  *    *     0.0.0.0/0             0.0.0.0/0
+)";
+  const std::string after = R"(
+Chain tx_eth0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+    1400   250000 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+       4      123            all  --  *    *     0.0.0.0/0             0.0.0.0/0
+)";
+  counters_svc_->set_snapshot_max_age(base::TimeDelta());
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(before))
+      .WillOnce(Return(after));
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillRepeatedly(Return(before));
+
+  // The first delta is relative to boot.
+  std::map<CounterKey, Counter> expected{
+      {{"eth0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {0, 0, 244427, 1366}},
+      {{"eth0", TrafficCounter::UNKNOWN, TrafficCounter::IPV4},
+       {0, 0, 123, 4}},
+      {{"eth0", TrafficCounter::CHROME, TrafficCounter::IPV6},
+       {0, 0, 244427, 1366}},
+      {{"eth0", TrafficCounter::UNKNOWN, TrafficCounter::IPV6},
+       {0, 0, 123, 4}},
+  };
+  EXPECT_TRUE(CompareCounters(expected, counters_svc_->GetCountersDelta({})));
+
+  expected = {
+      {{"eth0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {0, 0, 250000 - 244427, 1400 - 1366}},
+  };
+  EXPECT_TRUE(CompareCounters(expected, counters_svc_->GetCountersDelta({})));
+}
+
+TEST_F(CountersServiceTest, QueryTrafficCountersDeltaWithDeviceFilter) {
+  const std::string first = R"(
+Chain tx_eth0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+     100     1000 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+
+Chain tx_wlan0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+      10      100 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+)";
+  const std::string second = R"(
+Chain tx_eth0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+     150     1500 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+
+Chain tx_wlan0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+      20      200 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+)";
+  const std::string third = R"(
+Chain tx_eth0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+     150     1500 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+
+Chain tx_wlan0 (1 references)
+    pkts      bytes target     prot opt in     out     source               destination
+      30      300 RETURN     all  --  *    *     0.0.0.0/0             0.0.0.0/0             mark match 0x100/0x3f00
+)";
+  counters_svc_->set_snapshot_max_age(base::TimeDelta());
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv4, "mangle"))
+      .WillOnce(Return(first))
+      .WillOnce(Return(second))
+      .WillOnce(Return(third));
+  // No IPv6 accounting chain.
+  EXPECT_CALL(*datapath_, DumpIptables(IpFamily::IPv6, "mangle"))
+      .WillRepeatedly(Return("\n"));
+
+  std::map<CounterKey, Counter> expected{
+      {{"eth0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {0, 0, 1000, 100}},
+      {{"wlan0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {0, 0, 100, 10}},
+  };
+  EXPECT_TRUE(CompareCounters(expected, counters_svc_->GetCountersDelta({})));
+
+  // Only the counters of eth0 are covered, and move forward.
+  expected = {
+      {{"eth0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {0, 0, 500, 50}},
+  };
+  EXPECT_TRUE(
+      CompareCounters(expected, counters_svc_->GetCountersDelta({"eth0"})));
+
+  // The increase of wlan0 while it was filtered out is not lost.
+  expected = {
+      {{"wlan0", TrafficCounter::CHROME, TrafficCounter::IPV4},
+       {0, 0, 200, 20}},
+  };
+  EXPECT_TRUE(CompareCounters(expected, counters_svc_->GetCountersDelta({})));
+}
+
 }  // namespace
 }  // namespace patchpanel
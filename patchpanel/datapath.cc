@@ -15,6 +15,8 @@
 #include <sys/socket.h>
 
 #include <algorithm>
+#include <set>
+#include <utility>
 
 #include <base/check.h>
 #include <base/files/scoped_file.h>
@@ -27,6 +29,7 @@
 
 #include "patchpanel/adb_proxy.h"
 #include "patchpanel/arc_service.h"
+#include "patchpanel/xtables_counters.h"
 
 namespace patchpanel {
 
@@ -99,6 +102,38 @@ std::string PrefixIfname(const std::string& prefix, const std::string& ifname) {
   return n;
 }
 
+// Returns true if the iptables command |argv| only modifies rules or chains
+// and can therefore be expressed as a line of iptables-restore input.
+bool IsRestorableIptablesCommand(const std::vector<std::string>& argv) {
+  static const std::set<std::string> kRestorableOps = {
+      "-A", "-I", "-D", "-R", "-N", "-F", "-X",
+  };
+  return !argv.empty() && kRestorableOps.count(argv[0]) > 0;
+}
+
+// Converts the iptables command |argv| to a line of iptables-restore input.
+// The "-w" option is dropped since iptables-restore takes the xtables lock
+// once for the whole input. Chains are created with a chain declaration
+// rather than with -N: declaring a chain that already exists flushes it,
+// while -N would fail and abort the whole table. Callers either flush a chain
+// right after creating it or create it after removing it.
+std::string IptablesRestoreLine(const std::vector<std::string>& argv) {
+  if (argv.size() >= 2 && argv[0] == "-N")
+    return ":" + argv[1] + " - [0:0]";
+
+  std::vector<std::string> args;
+  for (const auto& arg : argv) {
+    if (arg == "-w")
+      continue;
+    if (arg.find_first_of(" \t") != std::string::npos) {
+      args.push_back("\"" + arg + "\"");
+    } else {
+      args.push_back(arg);
+    }
+  }
+  return base::JoinString(args, " ");
+}
+
 // ioctl helper that manages the control fd creation and destruction.
 bool Ioctl(System* system, ioctl_req_t req, const char* arg) {
   base::ScopedFD control_fd(socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
@@ -124,7 +159,9 @@ std::string ArcBridgeName(const std::string& ifname) {
 }
 
 Datapath::Datapath(System* system)
-    : Datapath(new MinijailedProcessRunner(), new Firewall(), system) {}
+    : Datapath(new MinijailedProcessRunner(), new Firewall(), system) {
+  iptables_batching_ = true;
+}
 
 Datapath::Datapath(MinijailedProcessRunner* process_runner,
                    Firewall* firewall,
@@ -158,6 +195,10 @@ void Datapath::Start() {
                << " IPv6 functionality may be broken.";
   }
 
+  // All the rules below are applied together at the end of Start() with one
+  // iptables-restore invocation per IP family and table.
+  StartIptablesTransaction();
+
   // Creates all "stateless" iptables chains used by patchpanel and set up
   // basic jump rules from the builtin chains. All chains that needs to carry
   // some state when patchpanel restarts (for instance: chains for
@@ -272,16 +313,17 @@ void Datapath::Start() {
   }
 
   // Create a FORWARD ACCEPT rule for connections already established.
-  if (process_runner_->iptables(
-          "filter", {"-A", "FORWARD", "-m", "state", "--state",
-                     "ESTABLISHED,RELATED", "-j", "ACCEPT", "-w"}) != 0) {
+  if (!ModifyIptables(IpFamily::IPv4, "filter",
+                      {"-A", "FORWARD", "-m", "state", "--state",
+                       "ESTABLISHED,RELATED", "-j", "ACCEPT", "-w"})) {
     LOG(ERROR) << "Failed to install forwarding rule for established"
                << " connections.";
   }
 
   // Create a FORWARD ACCEPT rule for ICMP6.
-  if (process_runner_->ip6tables("filter", {"-A", "FORWARD", "-p", "ipv6-icmp",
-                                            "-j", "ACCEPT", "-w"}) != 0)
+  if (!ModifyIptables(IpFamily::IPv6, "filter",
+                      {"-A", "FORWARD", "-p", "ipv6-icmp", "-j", "ACCEPT",
+                       "-w"}))
     LOG(ERROR) << "Failed to install forwarding rule for ICMP6";
 
   // chromium:898210: Drop any locally originated traffic that would exit a
@@ -302,10 +344,10 @@ void Datapath::Start() {
   // vpn_accept and vpn_lockdown, insert it in front of the FORWARD chain last.
   std::string snatMark =
       kFwmarkLegacySNAT.ToString() + "/" + kFwmarkLegacySNAT.ToString();
-  if (process_runner_->iptables(
-          "filter",
+  if (!ModifyIptables(
+          IpFamily::IPv4, "filter",
           {"-I", kDropGuestInvalidIpv4Chain, "-m", "mark", "--mark", snatMark,
-           "-m", "state", "--state", "INVALID", "-j", "DROP", "-w"}) != 0) {
+           "-m", "state", "--state", "INVALID", "-j", "DROP", "-w"})) {
     LOG(ERROR) << "Failed to install FORWARD rule to drop INVALID packets";
   }
   // b/196899048: IPv4 TCP packets with TCP flags FIN,PSH coming from downstream
@@ -313,10 +355,11 @@ void Datapath::Start() {
   // but the --state INVALID rule above will also not match for these packets.
   // crbug/1241756: Make sure that only egress FINPSH packets are dropped.
   for (const auto& oif : kCellularIfnamePrefixes) {
-    if (process_runner_->iptables(
-            "filter", {"-I", kDropGuestInvalidIpv4Chain, "-s", kGuestIPv4Subnet,
-                       "-p", "tcp", "--tcp-flags", "FIN,PSH", "FIN,PSH", "-o",
-                       oif, "-j", "DROP", "-w"}) != 0) {
+    if (!ModifyIptables(
+            IpFamily::IPv4, "filter",
+            {"-I", kDropGuestInvalidIpv4Chain, "-s", kGuestIPv4Subnet, "-p",
+             "tcp", "--tcp-flags", "FIN,PSH", "FIN,PSH", "-o", oif, "-j",
+             "DROP", "-w"})) {
       LOG(ERROR) << "Failed to install FORWARD rule to drop TCP FIN,PSH "
                     "packets egressing "
                  << oif << " interfaces";
@@ -325,9 +368,9 @@ void Datapath::Start() {
 
   // Set static SNAT rules for any IPv4 traffic originated from a guest (ARC,
   // Crostini, ...) or a connected namespace.
-  if (process_runner_->iptables(
-          "nat", {"-A", "POSTROUTING", "-m", "mark", "--mark", snatMark, "-j",
-                  "MASQUERADE", "-w"}) != 0) {
+  if (!ModifyIptables(IpFamily::IPv4, "nat",
+                      {"-A", "POSTROUTING", "-m", "mark", "--mark", snatMark,
+                       "-j", "MASQUERADE", "-w"})) {
     LOG(ERROR) << "Failed to install SNAT mark rules.";
   }
 
@@ -410,6 +453,9 @@ void Datapath::Start() {
                  << " packets in OUTPUT";
     }
   }
+
+  if (!CommitIptablesTransaction())
+    LOG(ERROR) << "Failed to apply some of the initial iptables rules";
 }
 
 void Datapath::Stop() {
@@ -788,9 +834,9 @@ void Datapath::RemoveInterface(const std::string& ifname) {
 
 bool Datapath::AddSourceIPv4DropRule(const std::string& oif,
                                      const std::string& src_ip) {
-  return process_runner_->iptables(
-             "filter", {"-I", kDropGuestIpv4PrefixChain, "-o", oif, "-s",
-                        src_ip, "-j", "DROP", "-w"}) == 0;
+  return ModifyIptables(IpFamily::IPv4, "filter",
+                        {"-I", kDropGuestIpv4PrefixChain, "-o", oif, "-s",
+                         src_ip, "-j", "DROP", "-w"});
 }
 
 bool Datapath::StartRoutingNamespace(const ConnectedNamespace& nsinfo) {
@@ -1112,6 +1158,7 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
                                   TrafficSource source,
                                   bool route_on_vpn,
                                   uint32_t peer_ipv4_addr) {
+  StartIptablesTransaction();
   if (!ModifyJumpRule(IpFamily::Dual, "filter", "-A", "FORWARD", "ACCEPT",
                       "" /*iif*/, int_ifname)) {
     LOG(ERROR) << "Failed to enable IP forwarding from " << ext_ifname;
@@ -1154,6 +1201,7 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
     int ifindex = system_->IfNametoindex(ext_ifname);
     if (ifindex == 0) {
       LOG(ERROR) << "Failed to retrieve interface index of " << ext_ifname;
+      CommitIptablesTransaction();
       return;
     }
     if (!ModifyFwmarkRoutingTag(subchain, "-A", Fwmark::FromIfIndex(ifindex))) {
@@ -1175,10 +1223,11 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
     // source. Connected namespace interface can be identified by checking if
     // the value of |peer_ipv4_addr| not equal to 0.
     if (route_on_vpn && peer_ipv4_addr != 0 &&
-        process_runner_->iptables(
-            "mangle",
-            {"-A", subchain, "-s", IPv4AddressToString(peer_ipv4_addr), "-d",
-             IPv4AddressToString(int_ipv4_addr), "-j", "ACCEPT", "-w"}) != 0) {
+        !ModifyIptables(IpFamily::IPv4, "mangle",
+                        {"-A", subchain, "-s",
+                         IPv4AddressToString(peer_ipv4_addr), "-d",
+                         IPv4AddressToString(int_ipv4_addr), "-j", "ACCEPT",
+                         "-w"})) {
       LOG(ERROR) << "Failed to add connected namespace IPv4 VPN bypass rule";
     }
 
@@ -1198,6 +1247,9 @@ void Datapath::StartRoutingDevice(const std::string& ext_ifname,
     if (route_on_vpn && !ModifyFwmarkVpnJumpRule(subchain, "-A", {}, {}))
       LOG(ERROR) << "Failed to add jump rule to VPN chain for " << int_ifname;
   }
+
+  if (!CommitIptablesTransaction())
+    LOG(ERROR) << "Failed to apply some routing rules for " << int_ifname;
 }
 
 void Datapath::StopRoutingDevice(const std::string& ext_ifname,
@@ -1221,25 +1273,22 @@ void Datapath::AddInboundIPv4DNAT(const std::string& ifname,
                                   const std::string& ipv4_addr) {
   // Direct ingress IP traffic to existing sockets.
   bool success = true;
-  if (process_runner_->iptables(
-          "nat", {"-A", kIngressDefaultForwardingChain, "-i", ifname, "-m",
-                  "socket", "--nowildcard", "-j", "ACCEPT", "-w"}) != 0) {
-    success = false;
-  }
+  StartIptablesTransaction();
+  success &= ModifyIptables(
+      IpFamily::IPv4, "nat",
+      {"-A", kIngressDefaultForwardingChain, "-i", ifname, "-m", "socket",
+       "--nowildcard", "-j", "ACCEPT", "-w"});
 
   // Direct ingress TCP & UDP traffic to ARC interface for new connections.
-  if (process_runner_->iptables(
-          "nat", {"-A", kIngressDefaultForwardingChain, "-i", ifname, "-p",
-                  "tcp", "-j", "DNAT", "--to-destination", ipv4_addr, "-w"}) !=
-      0) {
-    success = false;
-  }
-  if (process_runner_->iptables(
-          "nat", {"-A", kIngressDefaultForwardingChain, "-i", ifname, "-p",
-                  "udp", "-j", "DNAT", "--to-destination", ipv4_addr, "-w"}) !=
-      0) {
-    success = false;
-  }
+  success &= ModifyIptables(
+      IpFamily::IPv4, "nat",
+      {"-A", kIngressDefaultForwardingChain, "-i", ifname, "-p", "tcp", "-j",
+       "DNAT", "--to-destination", ipv4_addr, "-w"});
+  success &= ModifyIptables(
+      IpFamily::IPv4, "nat",
+      {"-A", kIngressDefaultForwardingChain, "-i", ifname, "-p", "udp", "-j",
+       "DNAT", "--to-destination", ipv4_addr, "-w"});
+  success &= CommitIptablesTransaction();
 
   if (!success) {
     LOG(ERROR) << "Failed to configure ingress DNAT rules on " << ifname
@@ -1772,10 +1821,90 @@ bool Datapath::ModifyIptables(IpFamily family,
 
   bool success = true;
   if (family & IpFamily::IPv4) {
-    success &= process_runner_->iptables(table, argv, log_failures) == 0;
+    success &= RunOrQueueIptables(IpFamily::IPv4, table, argv, log_failures);
   }
   if (family & IpFamily::IPv6) {
-    success &= process_runner_->ip6tables(table, argv, log_failures) == 0;
+    success &= RunOrQueueIptables(IpFamily::IPv6, table, argv, log_failures);
+  }
+  return success;
+}
+
+void Datapath::StartIptablesTransaction() {
+  if (iptables_batching_)
+    iptables_transaction_depth_++;
+}
+
+bool Datapath::CommitIptablesTransaction() {
+  if (!iptables_batching_)
+    return true;
+  DCHECK_GT(iptables_transaction_depth_, 0);
+  if (--iptables_transaction_depth_ > 0)
+    return true;
+
+  bool success = iptables_transaction_success_;
+  iptables_transaction_success_ = true;
+  while (!iptables_transaction_.empty()) {
+    const auto key = iptables_transaction_.begin()->first;
+    success &= ApplyIptablesChanges(key.first, key.second);
+  }
+  return success;
+}
+
+bool Datapath::RunOrQueueIptables(IpFamily family,
+                                  const std::string& table,
+                                  const std::vector<std::string>& argv,
+                                  bool log_failures) {
+  if (iptables_transaction_depth_ > 0) {
+    // Changes expected to fail are not batched since a single failing change
+    // aborts the whole iptables-restore input of its table.
+    if (log_failures && IsRestorableIptablesCommand(argv)) {
+      iptables_transaction_[{family, table}].push_back(argv);
+      return true;
+    }
+    // Keep the ordering with the changes already queued for that table.
+    if (!ApplyIptablesChanges(family, table))
+      iptables_transaction_success_ = false;
+  }
+
+  int ret = (family == IpFamily::IPv4)
+                ? process_runner_->iptables(table, argv, log_failures)
+                : process_runner_->ip6tables(table, argv, log_failures);
+  return ret == 0;
+}
+
+bool Datapath::ApplyIptablesChanges(IpFamily family,
+                                    const std::string& table) {
+  auto it = iptables_transaction_.find({family, table});
+  if (it == iptables_transaction_.end())
+    return true;
+  std::vector<std::vector<std::string>> changes = std::move(it->second);
+  iptables_transaction_.erase(it);
+  if (changes.empty())
+    return true;
+
+  std::string input = "*" + table + "\n";
+  for (const auto& argv : changes) {
+    input += IptablesRestoreLine(argv);
+    input += "\n";
+  }
+  input += "COMMIT\n";
+  int ret = (family == IpFamily::IPv4)
+                ? process_runner_->iptables_restore(input)
+                : process_runner_->ip6tables_restore(input);
+  if (ret == 0)
+    return true;
+
+  // iptables-restore applies all the changes of a table atomically, so nothing
+  // was applied. Fall back to applying the changes one by one to install as
+  // many rules as possible and to report the failing ones.
+  LOG(WARNING) << "Failed to apply " << changes.size() << " changes to "
+               << (family == IpFamily::IPv4 ? "iptables " : "ip6tables ")
+               << table << " with iptables-restore, applying them one by one";
+  bool success = true;
+  for (const auto& argv : changes) {
+    ret = (family == IpFamily::IPv4) ? process_runner_->iptables(table, argv)
+                                     : process_runner_->ip6tables(table, argv);
+    success &= (ret == 0);
   }
   return success;
 }
@@ -1805,6 +1934,12 @@ std::string Datapath::DumpIptables(IpFamily family, const std::string& table) {
   return result;
 }
 
+bool Datapath::DumpIptablesEntries(IpFamily family,
+                                   const std::string& table,
+                                   XtablesEntries* entries) {
+  return ReadXtablesEntries(family, table, entries);
+}
+
 bool Datapath::AddIPv4Route(uint32_t gateway_addr,
                             uint32_t addr,
                             uint32_t netmask) {
@@ -13,6 +13,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST
@@ -28,6 +29,8 @@
 
 namespace patchpanel {
 
+struct XtablesEntries;
+
 // filter INPUT chain for ingress port access rules controlled by
 // permission_broker.
 constexpr char kIngressPortFirewallChain[] = "ingress_port_firewall";
@@ -342,9 +345,35 @@ class Datapath {
                               const std::string& table,
                               const std::vector<std::string>& argv,
                               bool log_failures = true);
+  // Starts collecting the changes sent with ModifyIptables() instead of
+  // applying them immediately. The changes are applied by the matching
+  // CommitIptablesTransaction() call with a single iptables-restore --noflush
+  // invocation per IP family and table, instead of one iptables process per
+  // rule. Transactions can be nested, in which case only the outermost commit
+  // applies the changes. Changes sent with |log_failures| false and commands
+  // that do not modify rules or chains are still run immediately. While a
+  // transaction is open, ModifyIptables() reports queued changes as
+  // successful.
+  void StartIptablesTransaction();
+  // Applies the changes collected since the matching
+  // StartIptablesTransaction(). If iptables-restore fails for a table, the
+  // changes of that table are applied one by one with iptables or ip6tables.
+  // Returns false if any of the changes could not be applied.
+  bool CommitIptablesTransaction();
+  // Enables or disables iptables transactions. When disabled, transactions
+  // are no-ops and all changes are applied immediately. Enabled by default
+  // except with the testing constructor.
+  void set_iptables_batching(bool enabled) { iptables_batching_ = enabled; }
+
   // Dumps the iptables chains rules for the table |table|. |family| must be
   // either IPv4 or IPv6.
   virtual std::string DumpIptables(IpFamily family, const std::string& table);
+  // Reads the rules of the table |table| with their counters directly from
+  // the kernel, without running iptables. |family| must be either IPv4 or
+  // IPv6.
+  virtual bool DumpIptablesEntries(IpFamily family,
+                                   const std::string& table,
+                                   XtablesEntries* entries);
 
   // Changes firewall rules based on |request|, allowing ingress traffic to a
   // port, forwarding ingress traffic to a port into ARC or Crostini, or
@@ -447,6 +476,15 @@ class Datapath {
                                    const std::string& uid,
                                    bool log_failures = true);
   bool ModifyRtentry(ioctl_req_t op, struct rtentry* route);
+  // Runs the iptables command |argv| for |family| and |table|, or queues it
+  // in the current transaction. |family| must be either IPv4 or IPv6.
+  bool RunOrQueueIptables(IpFamily family,
+                          const std::string& table,
+                          const std::vector<std::string>& argv,
+                          bool log_failures);
+  // Applies the changes of the current transaction queued for |family| and
+  // |table|.
+  bool ApplyIptablesChanges(IpFamily family, const std::string& table);
 
   std::unique_ptr<MinijailedProcessRunner> process_runner_;
   std::unique_ptr<Firewall> firewall_;
@@ -474,6 +512,19 @@ class Datapath {
   // Shill Device known by its interface name. This is used for redirecting
   // DNS queries of system services when a VPN is connected.
   std::map<std::string, std::string> physical_dns_addresses_;
+
+  // Whether StartIptablesTransaction() and CommitIptablesTransaction() batch
+  // iptables changes.
+  bool iptables_batching_ = false;
+  // Nesting depth of the current iptables transaction, 0 if there is none.
+  int iptables_transaction_depth_ = 0;
+  // False if a change of the current transaction already failed.
+  bool iptables_transaction_success_ = true;
+  // Changes of the current iptables transaction, keyed by IP family and
+  // table, in the order they were sent.
+  std::map<std::pair<IpFamily, std::string>,
+           std::vector<std::vector<std::string>>>
+      iptables_transaction_;
 };
 
 }  // namespace patchpanel
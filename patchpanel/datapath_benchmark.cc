@@ -0,0 +1,119 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the number of processes spawned and of the wall time needed by
+// Datapath::Start() followed by the setup of one ARC device, with and without
+// batching of iptables changes. Every process that Datapath would run is
+// replaced by /bin/true so that the benchmark measures the cost of process
+// spawning without requiring any privilege.
+//
+// Usage: datapath_benchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <brillo/process/process.h>
+
+#include "patchpanel/datapath.h"
+#include "patchpanel/firewall.h"
+#include "patchpanel/minijailed_process_runner.h"
+#include "patchpanel/net_util.h"
+#include "patchpanel/system.h"
+
+namespace patchpanel {
+namespace {
+
+constexpr int kDefaultIterations = 10;
+
+// Counts the processes that would be spawned and runs /bin/true instead.
+class ForkCountingProcessRunner : public MinijailedProcessRunner {
+ public:
+  explicit ForkCountingProcessRunner(int* forks) : forks_(forks) {}
+
+ protected:
+  int Run(const std::vector<std::string>& argv, bool log_failures) override {
+    return Spawn();
+  }
+
+  int RunSync(const std::vector<std::string>& argv,
+              bool log_failures,
+              std::string* output,
+              const std::string* input) override {
+    return Spawn();
+  }
+
+ private:
+  int Spawn() {
+    (*forks_)++;
+    brillo::ProcessImpl process;
+    process.AddArg("/bin/true");
+    return process.Run();
+  }
+
+  int* forks_;
+};
+
+// Pretends that all sysctl, ioctl and interface index lookups succeed.
+class NoopSystem : public System {
+ public:
+  bool SysNetSet(SysNet target,
+                 const std::string& content,
+                 const std::string& iface) override {
+    return true;
+  }
+  int Ioctl(int fd, ioctl_req_t request, const char* argp) override {
+    return 0;
+  }
+  uint32_t IfNametoindex(const std::string& ifname) override { return 1; }
+};
+
+// Runs Datapath::Start() and sets up the datapath of one ARC device, and
+// returns the number of processes spawned. Stores the elapsed time in
+// |elapsed|.
+int StartWithArcDevice(bool batching, base::TimeDelta* elapsed) {
+  int forks = 0;
+  NoopSystem system;
+  Datapath datapath(new ForkCountingProcessRunner(&forks), new Firewall(),
+                    &system);
+  datapath.set_iptables_batching(batching);
+
+  const uint32_t host_ipv4_addr = Ipv4Addr(100, 115, 92, 9);
+  const uint32_t guest_ipv4_addr = Ipv4Addr(100, 115, 92, 10);
+  const base::TimeTicks start = base::TimeTicks::Now();
+  datapath.Start();
+  CHECK(datapath.AddBridge("arc_eth0", host_ipv4_addr, 30));
+  CHECK(datapath.AddToBridge("arc_eth0", "vetheth0"));
+  datapath.StartRoutingDevice("eth0", "arc_eth0", guest_ipv4_addr,
+                              TrafficSource::ARC, false /*route_on_vpn*/);
+  datapath.AddInboundIPv4DNAT("eth0", IPv4AddressToString(guest_ipv4_addr));
+  *elapsed = base::TimeTicks::Now() - start;
+  return forks;
+}
+
+}  // namespace
+}  // namespace patchpanel
+
+int main(int argc, char** argv) {
+  const int iterations =
+      argc > 1 ? strtol(argv[1], nullptr, 0) : patchpanel::kDefaultIterations;
+
+  printf("%10s %8s %12s\n", "batching", "forks", "ms");
+  for (bool batching : {false, true}) {
+    int forks = 0;
+    base::TimeDelta total;
+    for (int i = 0; i < iterations; ++i) {
+      base::TimeDelta elapsed;
+      forks = patchpanel::StartWithArcDevice(batching, &elapsed);
+      total += elapsed;
+    }
+    printf("%10s %8d %12.1f\n", batching ? "on" : "off", forks,
+           total.InMillisecondsF() / iterations);
+  }
+  return 0;
+}
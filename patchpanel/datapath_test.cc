@@ -76,6 +76,10 @@ class MockProcessRunner : public MinijailedProcessRunner {
                    const std::vector<std::string>& argv,
                    bool log_failures,
                    std::string* output));
+  MOCK_METHOD2(iptables_restore,
+               int(const std::string& input, bool log_failures));
+  MOCK_METHOD2(ip6tables_restore,
+               int(const std::string& input, bool log_failures));
   MOCK_METHOD2(ip_netns_add,
                int(const std::string& netns_name, bool log_failures));
   MOCK_METHOD3(ip_netns_attach,
@@ -1753,4 +1757,97 @@ TEST(DatapathTest, ModifyPortRule) {
   Mock::VerifyAndClearExpectations(firewall);
 }
 
+TEST(DatapathTest, IptablesTransaction) {
+  auto runner = new MockProcessRunner();
+  auto firewall = new MockFirewall();
+  FakeSystem system;
+  Datapath datapath(runner, firewall, &system);
+  datapath.set_iptables_batching(true);
+
+  EXPECT_CALL(*runner, iptables(_, _, _, _)).Times(0);
+  EXPECT_CALL(*runner, ip6tables(_, _, _, _)).Times(0);
+  EXPECT_CALL(*runner, iptables_restore(StrEq("*filter\n"
+                                              ":foo - [0:0]\n"
+                                              "-A FORWARD -j foo\n"
+                                              "-A INPUT -j foo\n"
+                                              "COMMIT\n"),
+                                        _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*runner, iptables_restore(StrEq("*nat\n"
+                                              "-I PREROUTING -j bar\n"
+                                              "COMMIT\n"),
+                                        _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*runner, ip6tables_restore(StrEq("*filter\n"
+                                               ":foo - [0:0]\n"
+                                               "-A FORWARD -j foo\n"
+                                               "COMMIT\n"),
+                                         _))
+      .WillOnce(Return(0));
+
+  datapath.StartIptablesTransaction();
+  EXPECT_TRUE(datapath.ModifyChain(Dual, "filter", "-N", "foo"));
+  // Nested transactions are committed with the outermost transaction.
+  datapath.StartIptablesTransaction();
+  EXPECT_TRUE(datapath.ModifyIptables(Dual, "filter",
+                                      {"-A", "FORWARD", "-j", "foo", "-w"}));
+  EXPECT_TRUE(datapath.CommitIptablesTransaction());
+  EXPECT_TRUE(datapath.ModifyIptables(IPv4, "filter",
+                                      {"-A", "INPUT", "-j", "foo", "-w"}));
+  EXPECT_TRUE(datapath.ModifyIptables(IPv4, "nat",
+                                      {"-I", "PREROUTING", "-j", "bar", "-w"}));
+  EXPECT_TRUE(datapath.CommitIptablesTransaction());
+}
+
+TEST(DatapathTest, IptablesTransactionFallback) {
+  auto runner = new MockProcessRunner();
+  auto firewall = new MockFirewall();
+  FakeSystem system;
+  Datapath datapath(runner, firewall, &system);
+  datapath.set_iptables_batching(true);
+
+  testing::InSequence seq;
+  EXPECT_CALL(*runner, iptables_restore(_, _)).WillOnce(Return(1));
+  EXPECT_CALL(*runner, iptables(StrEq("filter"),
+                                ElementsAre("-N", "foo", "-w"), _, nullptr))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*runner,
+              iptables(StrEq("filter"),
+                       ElementsAre("-A", "FORWARD", "-j", "foo", "-w"), _,
+                       nullptr))
+      .WillOnce(Return(1));
+
+  datapath.StartIptablesTransaction();
+  datapath.ModifyChain(IPv4, "filter", "-N", "foo");
+  datapath.ModifyIptables(IPv4, "filter",
+                          {"-A", "FORWARD", "-j", "foo", "-w"});
+  EXPECT_FALSE(datapath.CommitIptablesTransaction());
+}
+
+TEST(DatapathTest, IptablesTransactionImmediateCommand) {
+  auto runner = new MockProcessRunner();
+  auto firewall = new MockFirewall();
+  FakeSystem system;
+  Datapath datapath(runner, firewall, &system);
+  datapath.set_iptables_batching(true);
+
+  // A change that is expected to fail is run immediately after the changes
+  // already queued for the same table.
+  testing::InSequence seq;
+  EXPECT_CALL(*runner, iptables_restore(StrEq("*mangle\n"
+                                              "-F foo\n"
+                                              "COMMIT\n"),
+                                        _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*runner, iptables(StrEq("mangle"),
+                                ElementsAre("-X", "foo", "-w"), false, nullptr))
+      .WillOnce(Return(1));
+
+  datapath.StartIptablesTransaction();
+  datapath.ModifyChain(IPv4, "mangle", "-F", "foo");
+  EXPECT_FALSE(datapath.ModifyChain(IPv4, "mangle", "-X", "foo",
+                                    false /*log_failures*/));
+  EXPECT_TRUE(datapath.CommitIptablesTransaction());
+}
+
 }  // namespace patchpanel
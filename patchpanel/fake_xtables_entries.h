@@ -0,0 +1,132 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PATCHPANEL_FAKE_XTABLES_ENTRIES_H_
+#define PATCHPANEL_FAKE_XTABLES_ENTRIES_H_
+
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv6/ip6_tables.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "patchpanel/xtables_counters.h"
+
+namespace patchpanel {
+
+// Builds the binary representation of an iptables or ip6tables table in the
+// same layout as the kernel and libiptc: the built-in chains first, then every
+// user-defined chain as a head entry, its rules, and an implicit RETURN rule.
+class FakeXtablesEntries {
+ public:
+  explicit FakeXtablesEntries(IpFamily family) : family_(family) {
+    // A single built-in chain holding only its policy.
+    entries_.builtin_chain_offsets.push_back(0);
+    AddStandardEntry(0, 0, NF_ACCEPT);
+  }
+  FakeXtablesEntries(const FakeXtablesEntries&) = delete;
+  FakeXtablesEntries& operator=(const FakeXtablesEntries&) = delete;
+
+  // Starts a new user-defined chain. The previous chain is terminated.
+  void AddChain(const std::string& name) {
+    EndChain();
+    AddErrorEntry(name);
+    in_chain_ = true;
+  }
+
+  // Adds a rule without target to the current chain, with a mark match if
+  // |mask| is not 0.
+  void AddRule(uint64_t packets,
+               uint64_t bytes,
+               uint32_t mark = 0,
+               uint32_t mask = 0) {
+    std::string match;
+    if (mask != 0) {
+      match.resize(XT_ALIGN(sizeof(struct xt_entry_match) +
+                            sizeof(struct xt_mark_mtinfo1)));
+      auto* m = reinterpret_cast<struct xt_entry_match*>(&match[0]);
+      m->u.user.match_size = match.size();
+      strncpy(m->u.user.name, "mark", sizeof(m->u.user.name));
+      m->u.user.revision = 1;
+      auto* info = reinterpret_cast<struct xt_mark_mtinfo1*>(m->data);
+      info->mark = mark;
+      info->mask = mask;
+    }
+    AddStandardEntry(packets, bytes, XT_CONTINUE, match);
+  }
+
+  // Terminates the table and returns it.
+  const XtablesEntries& Build() {
+    EndChain();
+    AddErrorEntry(XT_ERROR_TARGET);
+    return entries_;
+  }
+
+ private:
+  size_t EntrySize() const {
+    return family_ == IpFamily::IPv6 ? sizeof(struct ip6t_entry)
+                                     : sizeof(struct ipt_entry);
+  }
+
+  void EndChain() {
+    if (in_chain_)
+      AddStandardEntry(0, 0, XT_RETURN);
+    in_chain_ = false;
+  }
+
+  void AddStandardEntry(uint64_t packets,
+                        uint64_t bytes,
+                        int verdict,
+                        const std::string& match = "") {
+    std::string target(XT_ALIGN(sizeof(struct xt_standard_target)), '\0');
+    auto* t = reinterpret_cast<struct xt_standard_target*>(&target[0]);
+    t->target.u.user.target_size = target.size();
+    t->verdict = verdict;
+    AddEntry(packets, bytes, match, target);
+  }
+
+  void AddErrorEntry(const std::string& name) {
+    std::string target(XT_ALIGN(sizeof(struct xt_error_target)), '\0');
+    auto* t = reinterpret_cast<struct xt_error_target*>(&target[0]);
+    t->target.u.user.target_size = target.size();
+    strncpy(t->target.u.user.name, XT_ERROR_TARGET,
+            sizeof(t->target.u.user.name));
+    strncpy(t->errorname, name.c_str(), sizeof(t->errorname) - 1);
+    AddEntry(0, 0, "", target);
+  }
+
+  void AddEntry(uint64_t packets,
+                uint64_t bytes,
+                const std::string& match,
+                const std::string& target) {
+    const size_t target_offset = EntrySize() + match.size();
+    std::string entry(target_offset + target.size(), '\0');
+    struct xt_counters counters = {packets, bytes};
+    if (family_ == IpFamily::IPv6) {
+      auto* e = reinterpret_cast<struct ip6t_entry*>(&entry[0]);
+      e->target_offset = target_offset;
+      e->next_offset = entry.size();
+      e->counters = counters;
+    } else {
+      auto* e = reinterpret_cast<struct ipt_entry*>(&entry[0]);
+      e->target_offset = target_offset;
+      e->next_offset = entry.size();
+      e->counters = counters;
+    }
+    entry.replace(EntrySize(), match.size(), match);
+    entry.replace(target_offset, target.size(), target);
+    entries_.entries += entry;
+  }
+
+  IpFamily family_;
+  bool in_chain_ = false;
+  XtablesEntries entries_;
+};
+
+}  // namespace patchpanel
+
+#endif  // PATCHPANEL_FAKE_XTABLES_ENTRIES_H_
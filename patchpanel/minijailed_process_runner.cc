@@ -5,9 +5,13 @@
 #include "patchpanel/minijailed_process_runner.h"
 
 #include <linux/capability.h>
+#include <pthread.h>
+#include <signal.h>
+
 #include <utility>
 
 #include <base/check.h>
+#include <base/files/file_util.h>
 #include <base/files/scoped_file.h>
 #include <base/logging.h>
 #include <base/posix/eintr_wrapper.h>
@@ -32,6 +36,8 @@ constexpr uint64_t kNetRawAdminCapMask =
 constexpr char kIpPath[] = "/bin/ip";
 constexpr char kIptablesPath[] = "/sbin/iptables";
 constexpr char kIp6tablesPath[] = "/sbin/ip6tables";
+constexpr char kIptablesRestorePath[] = "/sbin/iptables-restore";
+constexpr char kIp6tablesRestorePath[] = "/sbin/ip6tables-restore";
 constexpr char kModprobePath[] = "/sbin/modprobe";
 
 // An empty string will be returned if read fails.
@@ -59,6 +65,30 @@ std::string ReadBlockingFDToStringAndClose(base::ScopedFD fd) {
   }
 }
 
+// Writes |input| to |fd|, the stdin of a child process. The child may exit
+// before reading all of it, for instance on a parse error: SIGPIPE is blocked
+// meanwhile so that the write fails with EPIPE instead of killing the whole
+// process, and the SIGPIPE left pending by that write is discarded.
+bool WriteChildInput(int fd, const std::string& input) {
+  sigset_t sigpipe_mask;
+  sigset_t old_mask;
+  sigemptyset(&sigpipe_mask);
+  sigaddset(&sigpipe_mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe_mask, &old_mask);
+
+  bool written = base::WriteFileDescriptor(fd, input);
+  int saved_errno = errno;
+  if (!written && saved_errno == EPIPE &&
+      !sigismember(&old_mask, SIGPIPE)) {
+    const struct timespec no_wait = {};
+    sigtimedwait(&sigpipe_mask, nullptr, &no_wait);
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  errno = saved_errno;
+  return written;
+}
+
 }  // namespace
 
 int MinijailedProcessRunner::RunSyncDestroy(
@@ -66,7 +96,8 @@ int MinijailedProcessRunner::RunSyncDestroy(
     brillo::Minijail* mj,
     minijail* jail,
     bool log_failures,
-    std::string* output) {
+    std::string* output,
+    const std::string* input) {
   std::vector<char*> args;
   for (const auto& arg : argv) {
     args.push_back(const_cast<char*>(arg.c_str()));
@@ -74,10 +105,22 @@ int MinijailedProcessRunner::RunSyncDestroy(
   args.push_back(nullptr);
 
   pid_t pid;
+  int fd_stdin = -1;
+  int* stdin_p = input ? &fd_stdin : nullptr;
   int fd_stdout = -1;
   int* stdout_p = output ? &fd_stdout : nullptr;
-  bool ran = mj->RunPipesAndDestroy(jail, args, &pid, nullptr /*stdin*/,
-                                    stdout_p, nullptr /*stderr*/);
+  bool ran = mj->RunPipesAndDestroy(jail, args, &pid, stdin_p, stdout_p,
+                                    nullptr /*stderr*/);
+  bool input_written = true;
+  if (ran && input) {
+    // Closing stdin signals the end of the input to the child process.
+    base::ScopedFD stdin_fd(fd_stdin);
+    input_written = WriteChildInput(stdin_fd.get(), *input);
+    if (!input_written) {
+      PLOG(ERROR) << "Failed to write stdin of '"
+                  << base::JoinString(argv, " ") << "'";
+    }
+  }
   if (output) {
     *output = ReadBlockingFDToStringAndClose(base::ScopedFD(fd_stdout));
   }
@@ -101,13 +144,18 @@ int MinijailedProcessRunner::RunSyncDestroy(
                    << "' exited with unknown status " << status;
     }
   }
+  // A child that did not get all of its input has not done what was asked,
+  // whatever its exit status.
+  if (!input_written)
+    return -1;
   return ran && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 }
 
 int MinijailedProcessRunner::RunSync(const std::vector<std::string>& argv,
                                      bool log_failures,
-                                     std::string* output) {
-  return RunSyncDestroy(argv, mj_, mj_->New(), log_failures, output);
+                                     std::string* output,
+                                     const std::string* input) {
+  return RunSyncDestroy(argv, mj_, mj_->New(), log_failures, output, input);
 }
 
 void EnterChildProcessJail() {
@@ -175,6 +223,18 @@ int MinijailedProcessRunner::ip6tables(const std::string& table,
   return RunSync(args, log_failures, output);
 }
 
+int MinijailedProcessRunner::iptables_restore(const std::string& input,
+                                              bool log_failures) {
+  return RunSync({kIptablesRestorePath, "--noflush", "-w"}, log_failures,
+                 nullptr, &input);
+}
+
+int MinijailedProcessRunner::ip6tables_restore(const std::string& input,
+                                               bool log_failures) {
+  return RunSync({kIp6tablesRestorePath, "--noflush", "-w"}, log_failures,
+                 nullptr, &input);
+}
+
 int MinijailedProcessRunner::modprobe_all(
     const std::vector<std::string>& modules, bool log_failures) {
   minijail* jail = mj_->New();
@@ -57,6 +57,15 @@ class MinijailedProcessRunner {
                         bool log_failures = true,
                         std::string* output = nullptr);
 
+  // Runs iptables-restore --noflush, feeding |input| on stdin. |input| must
+  // be in the iptables-save format and can contain changes for several tables.
+  // All changes of a table are applied atomically.
+  virtual int iptables_restore(const std::string& input,
+                               bool log_failures = true);
+
+  virtual int ip6tables_restore(const std::string& input,
+                                bool log_failures = true);
+
   // Installs all |modules| via modprobe.
   virtual int modprobe_all(const std::vector<std::string>& modules,
                            bool log_failures = true);
@@ -83,17 +92,20 @@ class MinijailedProcessRunner {
                   bool log_failures = true);
 
   // Invokes RunSyncDestroy() with |mj_|. If |output| is not nullptr, it will be
-  // filled with the result from stdout of the execution.
+  // filled with the result from stdout of the execution. If |input| is not
+  // nullptr, it is written to the stdin of the process.
   virtual int RunSync(const std::vector<std::string>& argv,
                       bool log_failures,
-                      std::string* output);
+                      std::string* output,
+                      const std::string* input = nullptr);
 
  private:
   int RunSyncDestroy(const std::vector<std::string>& argv,
                      brillo::Minijail* mj,
                      minijail* jail,
                      bool log_failures,
-                     std::string* output);
+                     std::string* output,
+                     const std::string* input = nullptr);
 
   brillo::Minijail* mj_;
   std::unique_ptr<System> system_;
@@ -6,9 +6,12 @@
 
 #include <linux/capability.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <memory>
+#include <string>
 
+#include <base/files/scoped_file.h>
 #include <brillo/minijail/mock_minijail.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -147,5 +150,56 @@ TEST(MinijailProcessRunnerTest, ip6tables) {
   EXPECT_TRUE(runner.ip6tables("table", {"arg1", "arg2"}));
 }
 
+TEST(MinijailProcessRunnerTest, iptables_restore) {
+  brillo::MockMinijail mj;
+  auto system = new MockSystem();
+  MinijailedProcessRunner runner(&mj, std::unique_ptr<System>(system));
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  base::ScopedFD read_fd(fds[0]);
+  pid_t pid = 123;
+  EXPECT_CALL(mj, New());
+  EXPECT_CALL(mj, DropRoot(_, _, _)).Times(0);
+  EXPECT_CALL(mj, UseCapabilities(_, _)).Times(0);
+  EXPECT_CALL(mj, RunPipesAndDestroy(
+                      _,
+                      ElementsAre(StrEq("/sbin/iptables-restore"),
+                                  StrEq("--noflush"), StrEq("-w"), nullptr),
+                      _, testing::NotNull(), nullptr, nullptr))
+      .WillOnce(DoAll(SetArgPointee<2>(pid), SetArgPointee<3>(fds[1]),
+                      Return(true)));
+  EXPECT_CALL(*system, WaitPid(pid, _, _))
+      .WillOnce(DoAll(SetArgPointee<1>(1), Return(pid)));
+
+  const std::string input = "*filter\n-A FORWARD -j ACCEPT\nCOMMIT\n";
+  EXPECT_TRUE(runner.iptables_restore(input));
+  char buf[64] = {0};
+  ASSERT_EQ(input.size(), read(read_fd.get(), buf, sizeof(buf)));
+  EXPECT_EQ(input, std::string(buf, input.size()));
+}
+
+TEST(MinijailProcessRunnerTest, iptables_restore_input_not_read) {
+  brillo::MockMinijail mj;
+  auto system = new MockSystem();
+  MinijailedProcessRunner runner(&mj, std::unique_ptr<System>(system));
+
+  // The child exits without reading its input: writing it raises SIGPIPE,
+  // which must not kill the caller, and the call fails even though the child
+  // exited successfully.
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  close(fds[0]);
+  pid_t pid = 123;
+  EXPECT_CALL(mj, New());
+  EXPECT_CALL(mj, RunPipesAndDestroy(_, _, _, testing::NotNull(), _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(pid), SetArgPointee<3>(fds[1]),
+                      Return(true)));
+  EXPECT_CALL(*system, WaitPid(pid, _, _))
+      .WillOnce(DoAll(SetArgPointee<1>(0), Return(pid)));
+
+  EXPECT_NE(0, runner.iptables_restore("*filter\nCOMMIT\n"));
+}
+
 }  // namespace
 }  // namespace patchpanel
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "patchpanel/datapath.h"
+#include "patchpanel/xtables_counters.h"
 
 namespace patchpanel {
 
@@ -71,6 +72,10 @@ class MockDatapath : public Datapath {
                bool(const std::string& ifname, const bool enable));
   MOCK_METHOD2(DumpIptables,
                std::string(IpFamily family, const std::string& table));
+  MOCK_METHOD3(DumpIptablesEntries,
+               bool(IpFamily family,
+                    const std::string& table,
+                    XtablesEntries* entries));
   MOCK_METHOD1(ModprobeAll, bool(const std::vector<std::string>& modules));
   MOCK_METHOD2(AddInboundIPv4DNAT,
                void(const std::string& ifname, const std::string& ipv4_addr));
@@ -7,10 +7,12 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/ip.h>
+#include <signal.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <utility>
 
@@ -43,6 +45,24 @@ bool SetPollEvents(Socket* socket, int cfd, uint32_t events) {
   return true;
 }
 
+// Returns the domain of |socket| if it is a stream socket, or AF_UNSPEC.
+int StreamSocketDomain(const Socket& socket) {
+  int type, domain;
+  socklen_t optlen = sizeof(type);
+  if (getsockopt(socket.fd(), SOL_SOCKET, SO_TYPE, &type, &optlen) != 0 ||
+      type != SOCK_STREAM) {
+    return AF_UNSPEC;
+  }
+  optlen = sizeof(domain);
+  if (getsockopt(socket.fd(), SOL_SOCKET, SO_DOMAIN, &domain, &optlen) != 0)
+    return AF_UNSPEC;
+  return domain;
+}
+
+bool IsTcpDomain(int domain) {
+  return domain == AF_INET || domain == AF_INET6;
+}
+
 }  // namespace
 
 SocketForwarder::SocketForwarder(const std::string& name,
@@ -53,6 +73,7 @@ SocketForwarder::SocketForwarder(const std::string& name,
       sock1_(std::move(sock1)),
       len0_(0),
       len1_(0),
+      splice_enabled_(true),
       eof_(-1),
       poll_(false),
       done_(false) {
@@ -74,6 +95,10 @@ void SocketForwarder::SetStopQuitClosureForTesting(base::OnceClosure closure) {
   stop_quit_closure_for_testing_ = std::move(closure);
 }
 
+void SocketForwarder::SetSpliceEnabledForTesting(bool enabled) {
+  splice_enabled_ = enabled;
+}
+
 void SocketForwarder::Run() {
   LOG(INFO) << "Starting forwarder: " << *sock0_ << " <-> " << *sock1_;
 
@@ -88,10 +113,15 @@ void SocketForwarder::Run() {
     return;
   }
 
+  if (splice_enabled_)
+    SetupSplice();
+
   Poll();
 
   LOG(INFO) << "Forwarder stopped: " << *sock0_ << " <-> " << *sock1_;
   done_ = true;
+  pipe1_ = Pipe();
+  pipe0_ = Pipe();
   sock1_.reset();
   sock0_.reset();
   if (stop_quit_closure_for_testing_)
@@ -150,18 +180,21 @@ bool SocketForwarder::ProcessEvents(uint32_t events, int efd, int cfd) {
   if (events & EPOLLOUT) {
     Socket* dst;
     char* buf;
+    Pipe* pipe;
     ssize_t* len;
     if (sock0_->fd() == efd) {
       dst = sock0_.get();
       buf = buf1_;
+      pipe = &pipe1_;
       len = &len1_;
     } else {
       dst = sock1_.get();
       buf = buf0_;
+      pipe = &pipe0_;
       len = &len0_;
     }
 
-    ssize_t bytes = dst->SendTo(buf, *len);
+    ssize_t bytes = Send(dst, buf, *len, pipe);
     if (bytes < 0) {
       PLOG(ERROR) << "Failed to send data to " << dst;
       return false;
@@ -171,9 +204,6 @@ bool SocketForwarder::ProcessEvents(uint32_t events, int efd, int cfd) {
     if (bytes == 0)
       return true;
 
-    // Partial write.
-    if (bytes < *len)
-      memmove(&buf[0], &buf[bytes], *len - bytes);
     *len -= bytes;
 
     // If all the buffered data was written to the socket and the peer socket is
@@ -184,16 +214,19 @@ bool SocketForwarder::ProcessEvents(uint32_t events, int efd, int cfd) {
 
   Socket *src, *dst;
   char* buf;
+  Pipe* pipe;
   ssize_t* len;
   if (sock0_->fd() == efd) {
     src = sock0_.get();
     dst = sock1_.get();
     buf = buf0_;
+    pipe = &pipe0_;
     len = &len0_;
   } else {
     src = sock1_.get();
     dst = sock0_.get();
     buf = buf1_;
+    pipe = &pipe1_;
     len = &len1_;
   }
 
@@ -203,30 +236,26 @@ bool SocketForwarder::ProcessEvents(uint32_t events, int efd, int cfd) {
     return true;
 
   if (events & EPOLLIN) {
-    *len = src->RecvFrom(buf, kBufSize);
-    if (*len < 0) {
+    *len = Receive(src, buf, pipe);
+    if (*len < 0 && errno == EAGAIN) {
+      // Nothing to splice yet.
+      *len = 0;
+    } else if (*len < 0) {
       PLOG(ERROR) << "Failed to receive data from " << src;
       return false;
-    }
-
-    if (*len == 0)
+    } else if (*len == 0) {
       return HandleConnectionClosed(src, dst, cfd);
-
-    ssize_t bytes = dst->SendTo(buf, *len);
-    if (bytes < 0) {
-      PLOG(ERROR) << "Failed to send data to " << dst;
-      return false;
-    }
-
-    if (bytes > 0) {
-      // Partial write.
-      if (bytes < *len)
-        memmove(&buf[0], &buf[bytes], *len - bytes);
+    } else {
+      ssize_t bytes = Send(dst, buf, *len, pipe);
+      if (bytes < 0) {
+        PLOG(ERROR) << "Failed to send data to " << dst;
+        return false;
+      }
       *len -= bytes;
-    }
 
-    if (*len > 0 && !SetPollEvents(dst, cfd, EPOLLOUT))
-      return false;
+      if (*len > 0 && !SetPollEvents(dst, cfd, EPOLLOUT))
+        return false;
+    }
   }
 
   if (events & EPOLLHUP) {
@@ -236,6 +265,75 @@ bool SocketForwarder::ProcessEvents(uint32_t events, int efd, int cfd) {
   return true;
 }
 
+void SocketForwarder::SetupSplice() {
+  const int domain0 = StreamSocketDomain(*sock0_);
+  const int domain1 = StreamSocketDomain(*sock1_);
+  if (!(IsTcpDomain(domain0) &&
+        (IsTcpDomain(domain1) || domain1 == AF_VSOCK)) &&
+      !(IsTcpDomain(domain1) && domain0 == AF_VSOCK)) {
+    return;
+  }
+
+  for (Pipe* pipe : {&pipe0_, &pipe1_}) {
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+      PLOG(WARNING) << "pipe2 failed, copying data between " << *sock0_
+                    << " and " << *sock1_;
+      pipe0_ = Pipe();
+      pipe1_ = Pipe();
+      return;
+    }
+    pipe->read_fd.reset(fds[0]);
+    pipe->write_fd.reset(fds[1]);
+  }
+
+  // Unlike send(), splice() cannot be given MSG_NOSIGNAL. Block SIGPIPE on
+  // this thread so that writing to a socket closed by its peer fails with
+  // EPIPE instead.
+  sigset_t sigpipe;
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+}
+
+ssize_t SocketForwarder::Receive(Socket* src, char* buf, Pipe* pipe) {
+  if (!pipe->write_fd.is_valid())
+    return src->RecvFrom(buf, kBufSize);
+
+  const ssize_t bytes =
+      splice(src->fd(), nullptr, pipe->write_fd.get(), nullptr, kPipeSize,
+             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (bytes >= 0 || errno != EINVAL)
+    return bytes;
+
+  // |src| does not support splice(), e.g. vsock sockets on older kernels.
+  // The pipe is empty since data is only received once all the previous data
+  // was written, so the buffer can be used instead from now on.
+  LOG(INFO) << "splice() not supported by " << *src << ", copying data";
+  *pipe = Pipe();
+  return src->RecvFrom(buf, kBufSize);
+}
+
+ssize_t SocketForwarder::Send(Socket* dst,
+                              char* buf,
+                              ssize_t len,
+                              Pipe* pipe) {
+  if (!pipe->read_fd.is_valid()) {
+    ssize_t bytes = dst->SendTo(buf, len);
+    // Partial write.
+    if (bytes > 0 && bytes < len)
+      memmove(&buf[0], &buf[bytes], len - bytes);
+    return bytes;
+  }
+
+  const ssize_t bytes =
+      splice(pipe->read_fd.get(), nullptr, dst->fd(), nullptr, len,
+             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (bytes < 0 && errno == EAGAIN)
+    return 0;
+  return bytes;
+}
+
 bool SocketForwarder::HandleConnectionClosed(Socket* src,
                                              Socket* dst,
                                              int cfd) {
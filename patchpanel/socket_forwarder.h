@@ -13,6 +13,7 @@
 #include <string>
 
 #include <base/callback.h>
+#include <base/files/scoped_file.h>
 #include <base/memory/weak_ptr.h>
 #include <base/threading/simple_thread.h>
 #include <brillo/brillo_export.h>
@@ -22,6 +23,9 @@
 namespace patchpanel {
 // Forwards data between a pair of sockets.
 // This is a simple implementation as a thread main function.
+// Data is moved between TCP sockets, or between a TCP and a vsock socket,
+// with splice() through a pipe so that it is never copied to userspace. Other
+// socket pairs, or sockets not supporting splice(), go through a buffer.
 class BRILLO_EXPORT SocketForwarder : public base::SimpleThread {
  public:
   SocketForwarder(const std::string& name,
@@ -41,18 +45,51 @@ class BRILLO_EXPORT SocketForwarder : public base::SimpleThread {
   // stopped.
   void SetStopQuitClosureForTesting(base::OnceClosure closure);
 
+  // Allows or forbids splicing data between the sockets, for testing. Must be
+  // called before the forwarder is started.
+  void SetSpliceEnabledForTesting(bool enabled);
+
  private:
   static constexpr int kBufSize = 4096;
+  // Maximum number of bytes moved by a single splice() call, which is also
+  // the default capacity of a pipe.
+  static constexpr int kPipeSize = 65536;
+
+  // Pipe holding the data received on a socket and not yet written to the
+  // other socket when data is spliced. Both fds are invalid otherwise.
+  struct Pipe {
+    base::ScopedFD read_fd;
+    base::ScopedFD write_fd;
+  };
 
   void Poll();
   bool ProcessEvents(uint32_t events, int efd, int cfd);
 
+  // Creates |pipe0_| and |pipe1_| if data can be spliced between |sock0_| and
+  // |sock1_|.
+  void SetupSplice();
+  // Reads data available on |src| into |buf|, or into |pipe| if it is valid.
+  // Returns the number of bytes read, 0 on EOF or -1 on error. If no data is
+  // available, returns -1 and sets errno to EAGAIN when splicing and returns
+  // 0 otherwise.
+  ssize_t Receive(Socket* src, char* buf, Pipe* pipe);
+  // Writes to |dst| the |len| bytes pending in |buf|, or in |pipe| if it is
+  // valid. Returns the number of bytes written, or -1 on error. Bytes not
+  // written are kept at the start of |buf|.
+  ssize_t Send(Socket* dst, char* buf, ssize_t len, Pipe* pipe);
+
   std::unique_ptr<Socket> sock0_;
   std::unique_ptr<Socket> sock1_;
   char buf0_[kBufSize] = {0};
   char buf1_[kBufSize] = {0};
+  // Data received on |sock0_| and on |sock1_| when splicing.
+  Pipe pipe0_;
+  Pipe pipe1_;
+  // Number of bytes received on |sock0_| and on |sock1_| and not yet written
+  // to the other socket, either in the buffers or in the pipes.
   ssize_t len0_;
   ssize_t len1_;
+  bool splice_enabled_;
   // Indicates if an EOF has been sent (if it is greater than -1) and which
   // socket fd it was received on. This means that the socket file descriptor
   // indicated here should not be read from, only written to.
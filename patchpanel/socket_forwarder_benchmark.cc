@@ -0,0 +1,135 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the throughput of SocketForwarder between TCP sockets
+// connected over the loopback interface, with data copied through its
+// buffers and with data spliced.
+//
+// Usage: socket_forwarder_benchmark [MiB]
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/time/time.h>
+
+#include "patchpanel/socket.h"
+#include "patchpanel/socket_forwarder.h"
+
+namespace patchpanel {
+namespace {
+
+constexpr size_t kDefaultMiB = 256;
+
+// Creates a pair of TCP sockets connected over the loopback interface.
+bool TcpSocketPair(std::unique_ptr<Socket>* sock0,
+                   std::unique_ptr<Socket>* sock1) {
+  Socket listener(AF_INET, SOCK_STREAM);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof(addr);
+  if (!listener.Bind(reinterpret_cast<const struct sockaddr*>(&addr),
+                     addrlen) ||
+      !listener.Listen(1) ||
+      getsockname(listener.fd(), reinterpret_cast<struct sockaddr*>(&addr),
+                  &addrlen) != 0) {
+    return false;
+  }
+  *sock0 = std::make_unique<Socket>(AF_INET, SOCK_STREAM);
+  if (!(*sock0)->Connect(reinterpret_cast<const struct sockaddr*>(&addr),
+                         addrlen)) {
+    return false;
+  }
+  *sock1 = listener.Accept();
+  return *sock1 != nullptr;
+}
+
+// Writes |size| bytes to |src| while reading them from |dst|.
+bool Transfer(Socket* src, Socket* dst, size_t size) {
+  constexpr int kTimeoutMs = 5000;
+  std::vector<char> out(1 << 16);
+  std::vector<char> in(1 << 16);
+
+  size_t sent = 0;
+  size_t received = 0;
+  while (received < size) {
+    struct pollfd fds[2] = {};
+    fds[0].fd = src->fd();
+    fds[0].events = sent < size ? POLLOUT : 0;
+    fds[1].fd = dst->fd();
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, kTimeoutMs) <= 0)
+      return false;
+
+    if (fds[0].revents & POLLOUT) {
+      const ssize_t bytes =
+          send(src->fd(), out.data(), std::min(out.size(), size - sent),
+               MSG_DONTWAIT);
+      if (bytes < 0 && errno != EAGAIN)
+        return false;
+      sent += std::max<ssize_t>(bytes, 0);
+    }
+    if (fds[1].revents & POLLIN) {
+      const ssize_t bytes = recv(dst->fd(), in.data(), in.size(), MSG_DONTWAIT);
+      if (bytes <= 0)
+        return false;
+      received += bytes;
+    }
+  }
+  return true;
+}
+
+// Returns the time needed to forward |size| bytes, or a zero TimeDelta on
+// failure.
+base::TimeDelta MeasureTransfer(bool splice, size_t size) {
+  std::unique_ptr<Socket> peer0, peer1, sock0, sock1;
+  if (!TcpSocketPair(&peer0, &sock0) || !TcpSocketPair(&peer1, &sock1))
+    return base::TimeDelta();
+
+  SocketForwarder forwarder("benchmark", std::move(sock0), std::move(sock1));
+  forwarder.SetSpliceEnabledForTesting(splice);
+  forwarder.Start();
+
+  const base::TimeTicks start = base::TimeTicks::Now();
+  const bool ok = Transfer(peer0.get(), peer1.get(), size);
+  const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  // Let the forwarder stop on its own before it is joined.
+  shutdown(peer0->fd(), SHUT_WR);
+  shutdown(peer1->fd(), SHUT_WR);
+  return ok ? elapsed : base::TimeDelta();
+}
+
+}  // namespace
+}  // namespace patchpanel
+
+int main(int argc, char** argv) {
+  const size_t mib =
+      argc > 1 ? strtoul(argv[1], nullptr, 0) : patchpanel::kDefaultMiB;
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+
+  printf("%10s %12s\n", "mode", "MiB/s");
+  for (bool splice : {false, true}) {
+    const base::TimeDelta elapsed =
+        patchpanel::MeasureTransfer(splice, mib << 20);
+    if (elapsed.is_zero()) {
+      fprintf(stderr, "Transfer failed\n");
+      return 1;
+    }
+    printf("%10s %12.1f\n", splice ? "splice" : "buffered",
+           mib / elapsed.InSecondsF());
+  }
+  return 0;
+}
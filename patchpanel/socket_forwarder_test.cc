@@ -4,10 +4,13 @@
 
 #include "patchpanel/socket_forwarder.h"
 
+#include <arpa/inet.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -41,6 +44,76 @@ bool Read(Socket* socket, char* buf, int expected_byte_count) {
     return false;
   return true;
 }
+
+// Creates a pair of TCP sockets connected over the loopback interface.
+bool TcpSocketPair(std::unique_ptr<Socket>* sock0,
+                   std::unique_ptr<Socket>* sock1) {
+  Socket listener(AF_INET, SOCK_STREAM);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof(addr);
+  if (!listener.Bind(reinterpret_cast<const struct sockaddr*>(&addr),
+                     addrlen) ||
+      !listener.Listen(1) ||
+      getsockname(listener.fd(), reinterpret_cast<struct sockaddr*>(&addr),
+                  &addrlen) != 0) {
+    return false;
+  }
+  *sock0 = std::make_unique<Socket>(AF_INET, SOCK_STREAM);
+  if (!(*sock0)->Connect(reinterpret_cast<const struct sockaddr*>(&addr),
+                         addrlen)) {
+    return false;
+  }
+  *sock1 = listener.Accept();
+  return *sock1 != nullptr;
+}
+
+// Writes |size| bytes to |src| while reading them from |dst|, and checks that
+// they are received unchanged. The byte at offset |i| of the stream is i % 251
+// so that reordered or duplicated blocks are detected.
+bool Transfer(Socket* src, Socket* dst, size_t size) {
+  constexpr int kTimeoutMs = 5000;
+  constexpr size_t kChunkSize = 251 * 256;
+  std::vector<char> out(kChunkSize);
+  for (size_t i = 0; i < out.size(); i++)
+    out[i] = i % 251;
+  std::vector<char> in(kChunkSize);
+
+  size_t sent = 0;
+  size_t received = 0;
+  while (received < size) {
+    struct pollfd fds[2] = {};
+    fds[0].fd = src->fd();
+    fds[0].events = sent < size ? POLLOUT : 0;
+    fds[1].fd = dst->fd();
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, kTimeoutMs) <= 0)
+      return false;
+
+    if (fds[0].revents & POLLOUT) {
+      const size_t offset = sent % kChunkSize;
+      const ssize_t bytes =
+          send(src->fd(), &out[offset], std::min(kChunkSize - offset,
+                                                 size - sent),
+               MSG_DONTWAIT);
+      if (bytes < 0 && errno != EAGAIN)
+        return false;
+      sent += std::max<ssize_t>(bytes, 0);
+    }
+    if (fds[1].revents & POLLIN) {
+      const ssize_t bytes = recv(dst->fd(), in.data(), in.size(), MSG_DONTWAIT);
+      if (bytes <= 0)
+        return false;
+      for (ssize_t i = 0; i < bytes; i++) {
+        if (in[i] != static_cast<char>((received + i) % 251))
+          return false;
+      }
+      received += bytes;
+    }
+  }
+  return true;
+}
 }  // namespace
 
 class SocketForwarderTest : public ::testing::Test {
@@ -105,4 +178,63 @@ TEST_F(SocketForwarderTest, PeerSignalEPOLLHUP) {
   EXPECT_FALSE(forwarder_->IsRunning());
 }
 
+// Forwards data between TCP sockets connected over the loopback interface.
+class SocketForwarderTcpTest : public ::testing::Test {
+ protected:
+  void StartForwarder(bool splice) {
+    std::unique_ptr<Socket> sock0, sock1;
+    ASSERT_TRUE(TcpSocketPair(&peer0_, &sock0));
+    ASSERT_TRUE(TcpSocketPair(&peer1_, &sock1));
+    forwarder_ =
+        std::make_unique<SocketForwarder>("test", std::move(sock0),
+                                          std::move(sock1));
+    forwarder_->SetSpliceEnabledForTesting(splice);
+    forwarder_->SetStopQuitClosureForTesting(loop_->QuitClosure());
+    forwarder_->Start();
+  }
+
+  // Closes both peers for writing and waits for the forwarder to stop.
+  void StopForwarder() {
+    EXPECT_NE(shutdown(peer0_->fd(), SHUT_WR), -1);
+    EXPECT_NE(shutdown(peer1_->fd(), SHUT_WR), -1);
+    loop_->Run();
+    EXPECT_FALSE(forwarder_->IsRunning());
+    forwarder_.reset();
+    loop_ = std::make_unique<base::RunLoop>();
+  }
+
+  std::unique_ptr<Socket> peer0_;
+  std::unique_ptr<Socket> peer1_;
+  std::unique_ptr<SocketForwarder> forwarder_;
+
+  base::SingleThreadTaskExecutor task_executor_{base::MessagePumpType::IO};
+  brillo::BaseMessageLoop brillo_loop_{task_executor_.task_runner()};
+  std::unique_ptr<base::RunLoop> loop_ = std::make_unique<base::RunLoop>();
+};
+
+TEST_F(SocketForwarderTcpTest, ForwardData) {
+  for (bool splice : {false, true}) {
+    StartForwarder(splice);
+    EXPECT_TRUE(Transfer(peer0_.get(), peer1_.get(), 1 << 20)) << splice;
+    EXPECT_TRUE(Transfer(peer1_.get(), peer0_.get(), 1 << 20)) << splice;
+    StopForwarder();
+  }
+}
+
+TEST_F(SocketForwarderTcpTest, ForwardDataAndClose) {
+  StartForwarder(true /* splice */);
+
+  std::vector<char> msg(kDataSize, 1);
+  EXPECT_EQ(peer0_->SendTo(msg.data(), msg.size()), kDataSize);
+  EXPECT_EQ(peer1_->SendTo(msg.data(), msg.size()), kDataSize);
+  StopForwarder();
+
+  std::vector<char> data_peer0(kDataSize);
+  std::vector<char> data_peer1(kDataSize);
+  EXPECT_TRUE(Read(peer1_.get(), data_peer1.data(), kDataSize));
+  EXPECT_TRUE(Read(peer0_.get(), data_peer0.data(), kDataSize));
+  EXPECT_THAT(data_peer0, Each(1));
+  EXPECT_THAT(data_peer1, Each(1));
+}
+
 }  // namespace patchpanel
@@ -0,0 +1,256 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/xtables_counters.h"
+
+#include <errno.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv6/ip6_tables.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <base/files/scoped_file.h>
+#include <base/logging.h>
+
+namespace patchpanel {
+
+namespace {
+
+// The rules of a table can be modified between the two getsockopt() calls
+// needed to read it, in which case the kernel returns EAGAIN.
+constexpr int kMaxReadAttempts = 3;
+
+// Binds the IPv4 and IPv6 variants of the socket options and structs used by
+// the kernel for its iptables tables.
+struct Ipv4Traits {
+  using Entry = struct ipt_entry;
+  using GetInfo = struct ipt_getinfo;
+  using GetEntries = struct ipt_get_entries;
+  static constexpr int kDomain = AF_INET;
+  static constexpr int kLevel = IPPROTO_IP;
+  static constexpr int kGetInfo = IPT_SO_GET_INFO;
+  static constexpr int kGetEntries = IPT_SO_GET_ENTRIES;
+};
+
+struct Ipv6Traits {
+  using Entry = struct ip6t_entry;
+  using GetInfo = struct ip6t_getinfo;
+  using GetEntries = struct ip6t_get_entries;
+  static constexpr int kDomain = AF_INET6;
+  static constexpr int kLevel = IPPROTO_IPV6;
+  static constexpr int kGetInfo = IP6T_SO_GET_INFO;
+  static constexpr int kGetEntries = IP6T_SO_GET_ENTRIES;
+};
+
+template <typename Traits>
+bool ReadEntries(const std::string& table, XtablesEntries* entries) {
+  typename Traits::GetInfo info;
+  if (table.size() >= sizeof(info.name)) {
+    LOG(ERROR) << "Invalid table name " << table;
+    return false;
+  }
+
+  base::ScopedFD fd(
+      socket(Traits::kDomain, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_RAW));
+  if (!fd.is_valid()) {
+    PLOG(ERROR) << "Failed to create socket for reading table " << table;
+    return false;
+  }
+
+  for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+    memset(&info, 0, sizeof(info));
+    strncpy(info.name, table.c_str(), sizeof(info.name) - 1);
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd.get(), Traits::kLevel, Traits::kGetInfo, &info, &len) !=
+        0) {
+      // The legacy table does not exist when iptables uses the nft backend.
+      // Callers then fall back to running iptables on every poll, so this is
+      // not worth an error each time.
+      if (errno == ENOENT || errno == ENOPROTOOPT) {
+        VPLOG(1) << "No legacy xtables table " << table;
+      } else {
+        PLOG(ERROR) << "Failed to get info of table " << table;
+      }
+      return false;
+    }
+
+    const size_t header_size =
+        offsetof(typename Traits::GetEntries, entrytable);
+    std::vector<char> buffer(header_size + info.size);
+    auto* get_entries =
+        reinterpret_cast<typename Traits::GetEntries*>(buffer.data());
+    strncpy(get_entries->name, table.c_str(), sizeof(get_entries->name) - 1);
+    get_entries->size = info.size;
+    len = buffer.size();
+    if (getsockopt(fd.get(), Traits::kLevel, Traits::kGetEntries,
+                   buffer.data(), &len) != 0) {
+      if (errno == EAGAIN)
+        continue;
+      PLOG(ERROR) << "Failed to get entries of table " << table;
+      return false;
+    }
+
+    entries->builtin_chain_offsets.clear();
+    for (int hook = 0; hook < NF_INET_NUMHOOKS; hook++) {
+      if (info.valid_hooks & (1 << hook))
+        entries->builtin_chain_offsets.push_back(info.hook_entry[hook]);
+    }
+    entries->entries.assign(buffer.data() + header_size, info.size);
+    return true;
+  }
+
+  LOG(ERROR) << "Table " << table << " kept changing while being read";
+  return false;
+}
+
+// Decodes the "mark" match of |entry| if it has one.
+template <typename Traits>
+bool ParseMarkMatch(const typename Traits::Entry* entry,
+                    XtablesRuleCounter* counter) {
+  const char* base = reinterpret_cast<const char*>(entry);
+  for (size_t offset = sizeof(typename Traits::Entry);
+       offset < entry->target_offset;) {
+    if (entry->target_offset - offset < sizeof(struct xt_entry_match))
+      return false;
+    const auto* match =
+        reinterpret_cast<const struct xt_entry_match*>(base + offset);
+    const size_t match_size = match->u.match_size;
+    if (match_size < sizeof(struct xt_entry_match) ||
+        match_size > entry->target_offset - offset) {
+      return false;
+    }
+    if (strncmp(match->u.user.name, "mark", sizeof(match->u.user.name)) == 0) {
+      // Only revision 1 is used by iptables for -m mark --mark.
+      if (match->u.user.revision != 1 ||
+          match_size - sizeof(struct xt_entry_match) <
+              sizeof(struct xt_mark_mtinfo1)) {
+        return false;
+      }
+      const auto* info =
+          reinterpret_cast<const struct xt_mark_mtinfo1*>(match->data);
+      if (info->invert)
+        return false;
+      counter->has_mark_match = true;
+      counter->mark = info->mark;
+      counter->mark_mask = info->mask;
+    }
+    offset += match_size;
+  }
+  return true;
+}
+
+template <typename Traits>
+bool ParseEntries(const XtablesEntries& entries,
+                  std::vector<XtablesRuleCounter>* counters) {
+  using Entry = typename Traits::Entry;
+  const std::string& blob = entries.entries;
+  // Name of the user-defined chain being parsed, or empty for a built-in
+  // chain.
+  std::string chain;
+  // Whether the last rule added to |counters| is the implicit RETURN rule at
+  // the end of |chain|.
+  bool pending_chain_tail = false;
+  size_t offset = 0;
+  while (offset < blob.size()) {
+    if (blob.size() - offset < sizeof(Entry)) {
+      LOG(ERROR) << "Truncated entry at offset " << offset;
+      return false;
+    }
+    const auto* entry = reinterpret_cast<const Entry*>(blob.data() + offset);
+    if (entry->next_offset > blob.size() - offset ||
+        entry->target_offset < sizeof(Entry) ||
+        entry->target_offset > entry->next_offset) {
+      LOG(ERROR) << "Invalid entry at offset " << offset;
+      return false;
+    }
+    const size_t target_size = entry->next_offset - entry->target_offset;
+    if (target_size < sizeof(struct xt_entry_target)) {
+      LOG(ERROR) << "Invalid target at offset " << offset;
+      return false;
+    }
+
+    if (std::find(entries.builtin_chain_offsets.begin(),
+                  entries.builtin_chain_offsets.end(),
+                  offset) != entries.builtin_chain_offsets.end()) {
+      if (pending_chain_tail)
+        counters->pop_back();
+      pending_chain_tail = false;
+      chain.clear();
+    }
+
+    const auto* target = reinterpret_cast<const struct xt_entry_target*>(
+        blob.data() + offset + entry->target_offset);
+    if (strncmp(target->u.user.name, XT_ERROR_TARGET,
+                sizeof(target->u.user.name)) == 0) {
+      // Head of a user-defined chain, or the last entry of the table.
+      if (target_size < sizeof(struct xt_error_target)) {
+        LOG(ERROR) << "Invalid chain head at offset " << offset;
+        return false;
+      }
+      if (pending_chain_tail)
+        counters->pop_back();
+      pending_chain_tail = false;
+      const auto* error_target =
+          reinterpret_cast<const struct xt_error_target*>(target);
+      chain.assign(error_target->errorname,
+                   strnlen(error_target->errorname,
+                           sizeof(error_target->errorname)));
+    } else if (!chain.empty()) {
+      XtablesRuleCounter counter;
+      counter.chain = chain;
+      counter.packets = entry->counters.pcnt;
+      counter.bytes = entry->counters.bcnt;
+      if (!ParseMarkMatch<Traits>(entry, &counter)) {
+        LOG(ERROR) << "Cannot decode mark match of rule in " << chain;
+        return false;
+      }
+      counters->push_back(std::move(counter));
+      pending_chain_tail = true;
+    }
+    offset += entry->next_offset;
+  }
+  if (pending_chain_tail)
+    counters->pop_back();
+  return true;
+}
+
+}  // namespace
+
+bool ReadXtablesEntries(IpFamily family,
+                        const std::string& table,
+                        XtablesEntries* entries) {
+  switch (family) {
+    case IPv4:
+      return ReadEntries<Ipv4Traits>(table, entries);
+    case IPv6:
+      return ReadEntries<Ipv6Traits>(table, entries);
+    default:
+      LOG(ERROR) << "Cannot read table " << table << " for IP family "
+                 << family;
+      return false;
+  }
+}
+
+bool ParseXtablesEntries(IpFamily family,
+                         const XtablesEntries& entries,
+                         std::vector<XtablesRuleCounter>* counters) {
+  switch (family) {
+    case IPv4:
+      return ParseEntries<Ipv4Traits>(entries, counters);
+    case IPv6:
+      return ParseEntries<Ipv6Traits>(entries, counters);
+    default:
+      LOG(ERROR) << "Cannot parse table for IP family " << family;
+      return false;
+  }
+}
+
+}  // namespace patchpanel
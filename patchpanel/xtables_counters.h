@@ -0,0 +1,53 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PATCHPANEL_XTABLES_COUNTERS_H_
+#define PATCHPANEL_XTABLES_COUNTERS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "patchpanel/datapath.h"
+
+namespace patchpanel {
+
+// Rules of an iptables or ip6tables table in the binary format used by the
+// kernel for the IPT_SO_GET_ENTRIES and IP6T_SO_GET_ENTRIES socket options.
+struct XtablesEntries {
+  // Offsets in |entries| of the first rule of each built-in chain.
+  std::vector<uint32_t> builtin_chain_offsets;
+  std::string entries;
+};
+
+// Counters of a rule in a user-defined chain.
+struct XtablesRuleCounter {
+  std::string chain;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  // Value and mask of the "mark" match of the rule, if the rule has one.
+  bool has_mark_match = false;
+  uint32_t mark = 0;
+  uint32_t mark_mask = 0;
+};
+
+// Reads all the rules of |table| for |family| directly from the kernel,
+// without running iptables. |family| must be either IPv4 or IPv6. Requires
+// CAP_NET_ADMIN and only sees the tables of the legacy iptables backend.
+bool ReadXtablesEntries(IpFamily family,
+                        const std::string& table,
+                        XtablesEntries* entries);
+
+// Parses |entries| and returns the counters of every rule in the user-defined
+// chains of the table, in order. The implicit RETURN rule at the end of each
+// user-defined chain is not included. Returns false if |entries| is malformed
+// or if a mark match cannot be decoded. |family| must be either IPv4 or IPv6.
+bool ParseXtablesEntries(IpFamily family,
+                         const XtablesEntries& entries,
+                         std::vector<XtablesRuleCounter>* counters);
+
+}  // namespace patchpanel
+
+#endif  // PATCHPANEL_XTABLES_COUNTERS_H_
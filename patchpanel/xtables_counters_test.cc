@@ -0,0 +1,80 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "patchpanel/xtables_counters.h"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "patchpanel/fake_xtables_entries.h"
+
+namespace patchpanel {
+namespace {
+
+class XtablesCountersTest : public testing::TestWithParam<IpFamily> {};
+
+TEST_P(XtablesCountersTest, ParseUserChains) {
+  FakeXtablesEntries table(GetParam());
+  table.AddChain("rx_eth0");
+  table.AddRule(73, 11938, 0x100, 0x3f00);
+  table.AddRule(6, 345);
+  table.AddChain("empty");
+  table.AddChain("tx_eth0");
+  table.AddRule(1366, 244427, 0x2000, 0x3f00);
+
+  std::vector<XtablesRuleCounter> counters;
+  ASSERT_TRUE(ParseXtablesEntries(GetParam(), table.Build(), &counters));
+  ASSERT_EQ(3u, counters.size());
+
+  EXPECT_EQ("rx_eth0", counters[0].chain);
+  EXPECT_EQ(73u, counters[0].packets);
+  EXPECT_EQ(11938u, counters[0].bytes);
+  EXPECT_TRUE(counters[0].has_mark_match);
+  EXPECT_EQ(0x100u, counters[0].mark);
+  EXPECT_EQ(0x3f00u, counters[0].mark_mask);
+
+  EXPECT_EQ("rx_eth0", counters[1].chain);
+  EXPECT_EQ(6u, counters[1].packets);
+  EXPECT_EQ(345u, counters[1].bytes);
+  EXPECT_FALSE(counters[1].has_mark_match);
+
+  EXPECT_EQ("tx_eth0", counters[2].chain);
+  EXPECT_EQ(1366u, counters[2].packets);
+  EXPECT_EQ(244427u, counters[2].bytes);
+  EXPECT_TRUE(counters[2].has_mark_match);
+  EXPECT_EQ(0x2000u, counters[2].mark);
+}
+
+TEST_P(XtablesCountersTest, ParseBuiltinChainsOnly) {
+  FakeXtablesEntries table(GetParam());
+  std::vector<XtablesRuleCounter> counters;
+  ASSERT_TRUE(ParseXtablesEntries(GetParam(), table.Build(), &counters));
+  EXPECT_TRUE(counters.empty());
+}
+
+TEST_P(XtablesCountersTest, ParseTruncatedEntries) {
+  FakeXtablesEntries table(GetParam());
+  table.AddChain("rx_eth0");
+  table.AddRule(73, 11938, 0x100, 0x3f00);
+  XtablesEntries entries = table.Build();
+
+  std::vector<XtablesRuleCounter> counters;
+  entries.entries.resize(entries.entries.size() - 1);
+  EXPECT_FALSE(ParseXtablesEntries(GetParam(), entries, &counters));
+}
+
+TEST(XtablesCountersFamilyTest, ParseInvalidFamily) {
+  FakeXtablesEntries table(IpFamily::IPv4);
+  std::vector<XtablesRuleCounter> counters;
+  EXPECT_FALSE(ParseXtablesEntries(IpFamily::Dual, table.Build(), &counters));
+}
+
+INSTANTIATE_TEST_SUITE_P(XtablesCountersTest,
+                         XtablesCountersTest,
+                         testing::Values(IpFamily::IPv4, IpFamily::IPv6));
+
+}  // namespace
+}  // namespace patchpanel
@@ -129,10 +129,12 @@ class Connection {
   // will actually be routed through a route in |table_id|. For example, if the
   // traffic matches one of the excluded destination addresses set up in
   // SetupExcludedRoutes, then no routes in the per-Device table for this
-  // Connection will be used for that traffic.
+  // Connection will be used for that traffic. The rules are appended to
+  // |rules|.
   void AllowTrafficThrough(uint32_t table_id,
                            uint32_t base_priority,
-                           bool no_ipv6);
+                           bool no_ipv6,
+                           std::vector<RoutingPolicyEntry>* rules);
 
   // Send our DNS configuration to the resolver.
   void PushDNSConfig();
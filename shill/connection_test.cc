@@ -28,10 +28,12 @@
 
 using testing::_;
 using testing::AnyNumber;
+using testing::Matcher;
 using testing::Mock;
 using testing::Return;
 using testing::StrictMock;
 using testing::Test;
+using testing::UnorderedElementsAreArray;
 using testing::WithArg;
 
 namespace shill {
@@ -225,33 +227,23 @@ class ConnectionTest : public Test {
 
   void AddNonPhysicalRoutingPolicyExpectations(DeviceRefPtr device,
                                                uint32_t priority) {
-    EXPECT_CALL(routing_table_, FlushRules(device->interface_index()));
-
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidOifRule(IPAddress::kFamilyIPv4, priority,
-                                       device->link_name())))
-        .WillOnce(Return(true));
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidOifRule(IPAddress::kFamilyIPv6, priority,
-                                       device->link_name())))
-        .WillOnce(Return(true));
+    std::vector<Matcher<const RoutingPolicyEntry&>> rules = {
+        IsValidOifRule(IPAddress::kFamilyIPv4, priority, device->link_name()),
+        IsValidOifRule(IPAddress::kFamilyIPv6, priority, device->link_name()),
+    };
 
     // Virtual interfaces will have fwmark rules to send to the per-interface
     // table if the fwmark routing tag matches.
     RoutingPolicyEntry::FwMark routing_fwmark;
     routing_fwmark.value = (1000 + device->interface_index()) << 16;
     routing_fwmark.mask = 0xffff0000;
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidFwMarkRule(IPAddress::kFamilyIPv4, priority,
-                                          routing_fwmark)))
-        .WillOnce(Return(true));
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidFwMarkRule(IPAddress::kFamilyIPv6, priority,
-                                          routing_fwmark)))
+    rules.push_back(
+        IsValidFwMarkRule(IPAddress::kFamilyIPv4, priority, routing_fwmark));
+    rules.push_back(
+        IsValidFwMarkRule(IPAddress::kFamilyIPv6, priority, routing_fwmark));
+
+    EXPECT_CALL(routing_table_, ReplaceRules(device->interface_index(),
+                                             UnorderedElementsAreArray(rules)))
         .WillOnce(Return(true));
   }
 
@@ -261,80 +253,48 @@ class ConnectionTest : public Test {
     EXPECT_CALL(*device_info_, GetAddresses(device->interface_index()))
         .Times(testing::AnyNumber());
 
-    EXPECT_CALL(routing_table_, FlushRules(device->interface_index()));
+    std::vector<Matcher<const RoutingPolicyEntry&>> rules;
 
     // Primary physical interface will create catch-all for IPv4 and v6.
     // It will also add a main routing table rule above its other rules for both
     // IPv4 and v6.
     if (is_primary_physical) {
-      EXPECT_CALL(
-          routing_table_,
-          AddRule(device->interface_index(),
-                  IsValidRoutingRule(IPAddress::kFamilyIPv4, priority - 1)))
-          .WillOnce(Return(true));
-      EXPECT_CALL(
-          routing_table_,
-          AddRule(device->interface_index(),
-                  IsValidRoutingRule(IPAddress::kFamilyIPv6, priority - 1)))
-          .WillOnce(Return(true));
-
-      EXPECT_CALL(routing_table_,
-                  AddRule(device->interface_index(),
-                          IsValidRoutingRule(IPAddress::kFamilyIPv4,
-                                             Connection::kCatchallPriority)))
-          .WillOnce(Return(true));
-      EXPECT_CALL(routing_table_,
-                  AddRule(device->interface_index(),
-                          IsValidRoutingRule(IPAddress::kFamilyIPv6,
-                                             Connection::kCatchallPriority)))
-          .WillOnce(Return(true));
+      rules.push_back(IsValidRoutingRule(IPAddress::kFamilyIPv4, priority - 1));
+      rules.push_back(IsValidRoutingRule(IPAddress::kFamilyIPv6, priority - 1));
+      rules.push_back(IsValidRoutingRule(IPAddress::kFamilyIPv4,
+                                         Connection::kCatchallPriority));
+      rules.push_back(IsValidRoutingRule(IPAddress::kFamilyIPv6,
+                                         Connection::kCatchallPriority));
     }
 
     for (const auto& address :
          device_info_->GetAddresses(device->interface_index())) {
-      EXPECT_CALL(routing_table_,
-                  AddRule(device->interface_index(),
-                          IsValidRoutingRule(address.family(), priority)))
-          .WillOnce(Return(true));
+      rules.push_back(IsValidRoutingRule(address.family(), priority));
     }
 
     // Physical interfaces will have both iif and oif rules to send to the
     // per-interface table if the interface name matches.
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidIifRule(IPAddress::kFamilyIPv4, priority,
-                                       device->link_name())))
-        .WillOnce(Return(true));
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidIifRule(IPAddress::kFamilyIPv6, priority,
-                                       device->link_name())))
-        .WillOnce(Return(true));
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidOifRule(IPAddress::kFamilyIPv4, priority,
-                                       device->link_name())))
-        .WillOnce(Return(true));
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidOifRule(IPAddress::kFamilyIPv6, priority,
-                                       device->link_name())))
-        .WillOnce(Return(true));
+    rules.push_back(
+        IsValidIifRule(IPAddress::kFamilyIPv4, priority, device->link_name()));
+    rules.push_back(
+        IsValidIifRule(IPAddress::kFamilyIPv6, priority, device->link_name()));
+    rules.push_back(
+        IsValidOifRule(IPAddress::kFamilyIPv4, priority, device->link_name()));
+    rules.push_back(
+        IsValidOifRule(IPAddress::kFamilyIPv6, priority, device->link_name()));
 
     // Physical interfaces will have fwmark rules to send to the per-interface
     // table if the fwmark routing tag matches.
     RoutingPolicyEntry::FwMark routing_fwmark;
     routing_fwmark.value = (1000 + device->interface_index()) << 16;
     routing_fwmark.mask = 0xffff0000;
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidFwMarkRule(IPAddress::kFamilyIPv4, priority,
-                                          routing_fwmark)))
-        .WillOnce(Return(true));
-    EXPECT_CALL(routing_table_,
-                AddRule(device->interface_index(),
-                        IsValidFwMarkRule(IPAddress::kFamilyIPv6, priority,
-                                          routing_fwmark)))
+    rules.push_back(
+        IsValidFwMarkRule(IPAddress::kFamilyIPv4, priority, routing_fwmark));
+    rules.push_back(
+        IsValidFwMarkRule(IPAddress::kFamilyIPv6, priority, routing_fwmark));
+
+    EXPECT_CALL(routing_table_, ReplaceRules(device->interface_index(),
+                                             UnorderedElementsAreArray(rules)))
         .WillOnce(Return(true));
   }
 
@@ -898,8 +858,7 @@ TEST_F(ConnectionTest, BlackholeIPv6) {
   EXPECT_CALL(*device_info_, HasOtherAddress(_, _)).WillOnce(Return(false));
   EXPECT_CALL(rtnl_handler_, AddInterfaceAddress(_, _, _, _));
   EXPECT_CALL(routing_table_, SetDefaultRoute(_, _, _, _));
-  EXPECT_CALL(routing_table_, FlushRules(_));
-  EXPECT_CALL(routing_table_, AddRule(_, _)).WillRepeatedly(Return(true));
+  EXPECT_CALL(routing_table_, ReplaceRules(_, _)).WillOnce(Return(true));
   EXPECT_CALL(routing_table_,
               CreateBlackholeRoute(device->interface_index(),
                                    IPAddress::kFamilyIPv6, 0, table_id))
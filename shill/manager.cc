@@ -169,6 +169,11 @@ constexpr base::TimeDelta kAlwaysOnVpnBackoffDelay = base::Milliseconds(500);
 // Maximum shift value used to compute the always-on VPN backoff time.
 constexpr uint32_t kAlwaysOnVpnBackoffMaxShift = 7u;
 
+// Services are sorted again from scratch when more than 1 out of
+// |kMaxReorderedServicesRatio| services must be moved. Otherwise, the services
+// to move are inserted one by one in the sorted list.
+constexpr size_t kMaxReorderedServicesRatio = 8;
+
 // Copied from patchpanel/net_util.h so avoid circular build dependency with
 // libpatchpanel-util.
 constexpr uint32_t IPv4Addr(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
@@ -379,6 +384,10 @@ void Manager::Start() {
     AddDefaultServiceObserver(metrics_);
   }
 
+  if (!storage_thread_.Start()) {
+    LOG(ERROR) << "Failed to start the storage thread, profiles will be "
+               << "written synchronously";
+  }
   InitializeProfiles();
   running_ = true;
   device_info_.Start();
@@ -439,6 +448,22 @@ void Manager::Stop() {
   power_manager_->Stop();
   power_manager_.reset();
   patchpanel_client_.reset();
+
+  // Write the pending changes before the storage thread goes away.
+  FlushPendingProfileWrites();
+  storage_thread_.Stop();
+}
+
+scoped_refptr<base::SequencedTaskRunner> Manager::storage_task_runner() const {
+  return storage_thread_.IsRunning() ? storage_thread_.task_runner() : nullptr;
+}
+
+void Manager::FlushPendingProfileWrites() {
+  for (const auto& profile : profiles_) {
+    if (!profile->FlushPendingWrites()) {
+      LOG(ERROR) << "Failed to write profile " << profile->GetFriendlyName();
+    }
+  }
 }
 
 void Manager::InitializeProfiles() {
@@ -1683,6 +1708,8 @@ bool Manager::EmitDefaultService() {
 
 void Manager::OnSuspendImminent() {
   metrics_->NotifySuspendActionsStarted();
+  // Do not leave profile changes in memory across the suspend.
+  FlushPendingProfileWrites();
   if (devices_.empty()) {
     // If there are no devices, then suspend actions succeeded synchronously.
     // Make a call to the Manager::OnSuspendActionsComplete directly, since
@@ -1720,6 +1747,7 @@ void Manager::OnSuspendDone() {
 }
 
 void Manager::OnDarkSuspendImminent() {
+  FlushPendingProfileWrites();
   if (devices_.empty()) {
     // If there are no devices, then suspend actions succeeded synchronously.
     // Make a call to the Manager::OnDarkResumeActionsComplete directly, since
@@ -1825,11 +1853,7 @@ void Manager::SortServicesTask() {
   // Refresh all traffic counters before the sort.
   RefreshAllTrafficCountersTask();
 
-  sort(services_.begin(), services_.end(),
-       [&order = technology_order_](ServiceRefPtr a, ServiceRefPtr b) {
-         return Service::Compare(a, b, true /* compare connectivity */, order)
-             .first;
-       });
+  ReorderServices();
 
   uint32_t priority = Connection::kDefaultPriority;
   bool found_dns = false;
@@ -2044,6 +2068,52 @@ bool Manager::IsServiceAlwaysOnVpn(const ServiceConstRefPtr& service) const {
              service->GetStorageIdentifier();
 }
 
+void Manager::ReorderServices() {
+  if (services_.size() < 2) {
+    return;
+  }
+
+  // Profiles higher in the stack are preferred. Services in the ephemeral
+  // profile come last.
+  std::map<const Profile*, uint16_t> profile_ranks;
+  for (size_t i = 0; i < profiles_.size(); ++i) {
+    profile_ranks[profiles_[i].get()] = i + 1;
+  }
+
+  // Take out the services whose key changed, and the services added out of
+  // order since the previous call. The other services are still sorted
+  // relative to each other.
+  std::vector<ServiceRefPtr> moved;
+  const Service::SortKey* last_key = nullptr;
+  const auto must_move = [&](const ServiceRefPtr& service) {
+    const auto it = profile_ranks.find(service->profile().get());
+    const uint16_t profile_rank = it != profile_ranks.end() ? it->second : 0;
+    if (service->UpdateSortKey(technology_order_, profile_rank) ||
+        (last_key && service->sort_key() < *last_key)) {
+      moved.push_back(service);
+      return true;
+    }
+    last_key = &service->sort_key();
+    return false;
+  };
+  services_.erase(std::remove_if(services_.begin(), services_.end(), must_move),
+                  services_.end());
+
+  const auto key_less = [](const ServiceRefPtr& a, const ServiceRefPtr& b) {
+    return a->sort_key() < b->sort_key();
+  };
+  if (moved.size() * kMaxReorderedServicesRatio > services_.size()) {
+    services_.insert(services_.end(), moved.begin(), moved.end());
+    std::sort(services_.begin(), services_.end(), key_less);
+    return;
+  }
+  for (const auto& service : moved) {
+    services_.insert(std::upper_bound(services_.begin(), services_.end(),
+                                      service, key_less),
+                     service);
+  }
+}
+
 void Manager::DeviceStatusCheckTask() {
   SLOG(this, 4) << "In " << __func__;
 
@@ -17,6 +17,8 @@
 #include <base/memory/ref_counted.h>
 #include <base/memory/weak_ptr.h>
 #include <base/observer_list.h>
+#include <base/task/sequenced_task_runner.h>
+#include <base/threading/thread.h>
 #include <chromeos/dbus/service_constants.h>
 #include <chromeos/patchpanel/dbus/client.h>
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST
@@ -403,6 +405,9 @@ class Manager {
   }
 #endif  // DISABLE_CELLULAR
   PowerManager* power_manager() const { return power_manager_.get(); }
+  // Task runner writing the profiles to disk in the background, or null if
+  // they are written synchronously.
+  scoped_refptr<base::SequencedTaskRunner> storage_task_runner() const;
   virtual EthernetProvider* ethernet_provider() {
     return ethernet_provider_.get();
   }
@@ -585,6 +590,7 @@ class Manager {
   friend class ModemManagerTest;
   friend class OpenVPNDriverTest;
   friend class ServiceTest;
+  friend class SortServicesBenchmark;
   friend class VPNServiceTest;
   friend class WiFiObjectTest;
 
@@ -632,6 +638,7 @@ class Manager {
   FRIEND_TEST(ManagerTest, SetAlwaysOnVpnPackage);
   FRIEND_TEST(ManagerTest, ShouldBlackholeUserTraffic);
   FRIEND_TEST(ManagerTest, SortServicesWithConnection);
+  FRIEND_TEST(ManagerTest, SortServicesWithSortKeysMatchesCompare);
   FRIEND_TEST(ManagerTest, StartupPortalList);
   FRIEND_TEST(ManagerTest, SetDNSProxyAddresses);
   FRIEND_TEST(ServiceTest, IsAutoConnectable);
@@ -738,6 +745,9 @@ class Manager {
   void OnProfilesChanged();
 
   void SortServicesTask();
+  // Sorts |services_| by their sort key. Only the services whose key changed
+  // since the previous call are moved, unless most of them changed.
+  void ReorderServices();
   void DeviceStatusCheckTask();
   void ConnectionStatusCheck();
   void DevicePresenceStatusCheck();
@@ -777,6 +787,9 @@ class Manager {
   // suspend is imminent).
   void OnDarkSuspendImminent();
 
+  // Waits for the profile writes deferred to the storage thread to complete.
+  void FlushPendingProfileWrites();
+
   void OnSuspendActionsComplete(const Error& error);
   void OnDarkResumeActionsComplete(const Error& error);
 
@@ -879,6 +892,9 @@ class Manager {
   ProfileRefPtr ephemeral_profile_;
   std::unique_ptr<PowerManager> power_manager_;
   std::unique_ptr<Upstart> upstart_;
+  // Thread on which the profiles are written to disk, so that the writes do
+  // not block the event loop.
+  base::Thread storage_thread_{"shill_storage"};
 
   // The priority order of technologies
   std::vector<Technology> technology_order_;
@@ -4,6 +4,7 @@
 
 #include "shill/manager.h"
 
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <memory>
@@ -2187,6 +2188,39 @@ TEST_F(ManagerTest, DevicePresenceStatusCheck) {
   manager()->DevicePresenceStatusCheck();
 }
 
+// Moving services by their sort keys after the priority of one of them
+// changed must give the same order as comparing every pair of services with
+// Service::Compare().
+TEST_F(ManagerTest, SortServicesWithSortKeysMatchesCompare) {
+  constexpr int kNumServices = 500;
+  constexpr int kIterations = 100;
+
+  std::vector<MockServiceRefPtr> services;
+  for (int i = 0; i < kNumServices; ++i) {
+    MockServiceRefPtr service(new NiceMock<MockService>(manager()));
+    service->SetPriority(i % 10, nullptr);
+    service->SetStrength(i % 100);
+    service->SetHasEverConnected(i % 3 == 0);
+    manager()->RegisterService(service);
+    services.push_back(service);
+  }
+  manager()->ReorderServices();
+
+  const auto compare = [&order = manager()->technology_order_](
+                           ServiceRefPtr a, ServiceRefPtr b) {
+    return Service::Compare(a, b, true /* compare connectivity */, order)
+        .first;
+  };
+  for (int i = 0; i < kIterations; ++i) {
+    services[(i * 37) % kNumServices]->SetPriority(i, nullptr);
+
+    std::vector<ServiceRefPtr> expected = manager()->services_;
+    std::sort(expected.begin(), expected.end(), compare);
+    manager()->ReorderServices();
+    EXPECT_TRUE(expected == manager()->services_);
+  }
+}
+
 TEST_F(ManagerTest, SortServicesWithConnection) {
   MockServiceRefPtr mock_service0(new NiceMock<MockService>(manager()));
   MockServiceRefPtr mock_service1(new NiceMock<MockService>(manager()));
@@ -5,6 +5,8 @@
 #ifndef SHILL_MOCK_ROUTING_TABLE_H_
 #define SHILL_MOCK_ROUTING_TABLE_H_
 
+#include <vector>
+
 #include <gmock/gmock.h>
 
 #include "shill/routing_table.h"
@@ -50,6 +52,10 @@ class MockRoutingTable : public RoutingTable {
   MOCK_METHOD(uint32_t, RequestAdditionalTableId, (), (override));
   MOCK_METHOD(void, FreeAdditionalTableId, (uint32_t), (override));
   MOCK_METHOD(bool, AddRule, (int, const RoutingPolicyEntry&), (override));
+  MOCK_METHOD(bool,
+              ReplaceRules,
+              (int, const std::vector<RoutingPolicyEntry>&),
+              (override));
   MOCK_METHOD(void, FlushRules, (int), (override));
 };
 
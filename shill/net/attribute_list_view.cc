@@ -0,0 +1,161 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "shill/net/attribute_list_view.h"
+
+#include <linux/netlink.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace shill {
+
+namespace {
+
+template <typename T>
+bool CopyValue(const AttributeView& attribute, T* value) {
+  if (attribute.length() < sizeof(T))
+    return false;
+  if (value)
+    memcpy(value, attribute.data(), sizeof(T));
+  return true;
+}
+
+// Reads the header of the attribute at |offset| within the |length| bytes of
+// |data|.  Returns false if there is no complete attribute at |offset|.
+bool ReadHeader(const unsigned char* data,
+                size_t length,
+                size_t offset,
+                nlattr* header) {
+  if (length - offset < sizeof(*header))
+    return false;
+  memcpy(header, data + offset, sizeof(*header));
+  return header->nla_len >= sizeof(*header) &&
+         header->nla_len <= length - offset;
+}
+
+}  // namespace
+
+bool AttributeView::GetU8Value(uint8_t* value) const {
+  return CopyValue(*this, value);
+}
+
+bool AttributeView::GetU16Value(uint16_t* value) const {
+  return CopyValue(*this, value);
+}
+
+bool AttributeView::GetU32Value(uint32_t* value) const {
+  return CopyValue(*this, value);
+}
+
+bool AttributeView::GetU64Value(uint64_t* value) const {
+  return CopyValue(*this, value);
+}
+
+base::StringPiece AttributeView::GetStringValue() const {
+  const char* str = reinterpret_cast<const char*>(data_);
+  const void* nul = length_ ? memchr(str, '\0', length_) : nullptr;
+  return base::StringPiece(
+      str, nul ? static_cast<const char*>(nul) - str : length_);
+}
+
+ByteString AttributeView::GetRawValue() const {
+  return ByteString(data_, length_);
+}
+
+AttributeListView AttributeView::GetNestedAttributeList() const {
+  return AttributeListView(data_, length_);
+}
+
+AttributeListView::Iterator::Iterator(const unsigned char* data,
+                                      size_t length,
+                                      size_t offset)
+    : data_(data), length_(length), offset_(offset) {
+  Load();
+}
+
+AttributeListView::Iterator& AttributeListView::Iterator::operator++() {
+  offset_ = std::min(length_,
+                     offset_ + NLA_ALIGN(NLA_HDRLEN + attribute_.length()));
+  Load();
+  return *this;
+}
+
+void AttributeListView::Iterator::Load() {
+  nlattr header;
+  if (offset_ >= length_ || !ReadHeader(data_, length_, offset_, &header)) {
+    offset_ = length_;
+    return;
+  }
+  attribute_ = AttributeView(header.nla_type, data_ + offset_ + NLA_HDRLEN,
+                             header.nla_len - NLA_HDRLEN);
+}
+
+bool AttributeListView::IsValid() const {
+  size_t offset = 0;
+  while (length_ - offset >= sizeof(nlattr)) {
+    nlattr header;
+    if (!ReadHeader(data_, length_, offset, &header))
+      return false;
+    offset = std::min(length_, offset + NLA_ALIGN(header.nla_len));
+  }
+  return true;
+}
+
+bool AttributeListView::GetAttribute(int id, AttributeView* attribute) const {
+  for (const AttributeView& candidate : *this) {
+    if (candidate.id() == id) {
+      if (attribute)
+        *attribute = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AttributeListView::GetU8AttributeValue(int id, uint8_t* value) const {
+  AttributeView attribute;
+  return GetAttribute(id, &attribute) && attribute.GetU8Value(value);
+}
+
+bool AttributeListView::GetU16AttributeValue(int id, uint16_t* value) const {
+  AttributeView attribute;
+  return GetAttribute(id, &attribute) && attribute.GetU16Value(value);
+}
+
+bool AttributeListView::GetU32AttributeValue(int id, uint32_t* value) const {
+  AttributeView attribute;
+  return GetAttribute(id, &attribute) && attribute.GetU32Value(value);
+}
+
+bool AttributeListView::GetU64AttributeValue(int id, uint64_t* value) const {
+  AttributeView attribute;
+  return GetAttribute(id, &attribute) && attribute.GetU64Value(value);
+}
+
+bool AttributeListView::GetStringAttributeValue(
+    int id, base::StringPiece* value) const {
+  AttributeView attribute;
+  if (!GetAttribute(id, &attribute))
+    return false;
+  if (value)
+    *value = attribute.GetStringValue();
+  return true;
+}
+
+bool AttributeListView::GetNestedAttributeList(int id,
+                                               AttributeListView* value) const {
+  AttributeView attribute;
+  if (!GetAttribute(id, &attribute))
+    return false;
+  if (value)
+    *value = attribute.GetNestedAttributeList();
+  return true;
+}
+
+bool AttributeListView::IsFlagAttributeTrue(int id) const {
+  return GetAttribute(id, nullptr);
+}
+
+}  // namespace shill
@@ -0,0 +1,137 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SHILL_NET_ATTRIBUTE_LIST_VIEW_H_
+#define SHILL_NET_ATTRIBUTE_LIST_VIEW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <base/strings/string_piece.h>
+
+#include "shill/net/byte_string.h"
+#include "shill/net/shill_export.h"
+
+namespace shill {
+
+class AttributeListView;
+
+// AttributeView refers to a netlink attribute stored in a buffer owned by
+// someone else, typically the NetlinkPacket or the GenericNetlinkMessage the
+// attribute was received in.  It is only valid as long as that buffer is.
+//
+// Unlike NetlinkAttribute, an AttributeView carries no datatype: the
+// accessors interpret the payload as requested by the caller, with the same
+// rules as the corresponding NetlinkAttribute::InitFromValue() methods.
+class SHILL_EXPORT AttributeView {
+ public:
+  AttributeView() = default;
+  AttributeView(int id, const unsigned char* data, size_t length)
+      : id_(id), data_(data), length_(length) {}
+
+  // Accessors for the attribute's id and payload (NOT including the nlattr
+  // header).
+  int id() const { return id_; }
+  const unsigned char* data() const { return data_; }
+  size_t length() const { return length_; }
+
+  // Copy the beginning of the payload to |value|.  Return false if the
+  // payload is too short.
+  bool GetU8Value(uint8_t* value) const;
+  bool GetU16Value(uint16_t* value) const;
+  bool GetU32Value(uint32_t* value) const;
+  bool GetU64Value(uint64_t* value) const;
+
+  // Returns the payload up to its first NUL character, if any.
+  base::StringPiece GetStringValue() const;
+
+  // Returns a copy of the payload.
+  ByteString GetRawValue() const;
+
+  // Returns the attributes nested in this one.
+  AttributeListView GetNestedAttributeList() const;
+
+ private:
+  int id_ = 0;
+  const unsigned char* data_ = nullptr;
+  size_t length_ = 0;
+};
+
+// AttributeListView walks a list of netlink attributes in place.  Iterating
+// over the attributes or looking one up, including nested ones, neither
+// copies nor allocates anything; the lookups are linear in the number of
+// attributes of the list.
+//
+// Attributes are visited in the order in which they appear in the buffer.  A
+// malformed attribute ends the list: use |IsValid()| to tell a malformed list
+// from a short one.
+class SHILL_EXPORT AttributeListView {
+ public:
+  class SHILL_EXPORT Iterator {
+   public:
+    const AttributeView& operator*() const { return attribute_; }
+    const AttributeView* operator->() const { return &attribute_; }
+    Iterator& operator++();
+    bool operator==(const Iterator& other) const {
+      return offset_ == other.offset_;
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class AttributeListView;
+
+    Iterator(const unsigned char* data, size_t length, size_t offset);
+
+    // Loads the attribute at |offset_| into |attribute_|, or moves to the end
+    // of the list if there is none.
+    void Load();
+
+    const unsigned char* data_;
+    size_t length_;
+    size_t offset_;
+    AttributeView attribute_;
+  };
+
+  AttributeListView() = default;
+  AttributeListView(const unsigned char* data, size_t length)
+      : data_(data), length_(length) {}
+
+  // Returns false if an attribute of the list indicates a length that is
+  // smaller than its header or larger than what remains in the buffer.
+  // Trailing bytes that are too few to hold an attribute header are ignored,
+  // as they are by AttributeList::IterateAttributes().
+  bool IsValid() const;
+
+  Iterator begin() const { return Iterator(data_, length_, 0); }
+  Iterator end() const { return Iterator(data_, length_, length_); }
+  bool IsEmpty() const { return begin() == end(); }
+
+  // Pointer to and length of the attributes, including their headers.
+  const unsigned char* data() const { return data_; }
+  size_t length() const { return length_; }
+
+  // Finds the first attribute of type |id|.  Returns false if there is none.
+  // |attribute| may be null.
+  bool GetAttribute(int id, AttributeView* attribute) const;
+
+  // Get the value of the attribute of type |id|.  Return false if there is
+  // no such attribute or if its payload is too short.  |value| may be null.
+  bool GetU8AttributeValue(int id, uint8_t* value) const;
+  bool GetU16AttributeValue(int id, uint16_t* value) const;
+  bool GetU32AttributeValue(int id, uint32_t* value) const;
+  bool GetU64AttributeValue(int id, uint64_t* value) const;
+  bool GetStringAttributeValue(int id, base::StringPiece* value) const;
+  bool GetNestedAttributeList(int id, AttributeListView* value) const;
+
+  // The presence of a flag attribute means that it is true.
+  bool IsFlagAttributeTrue(int id) const;
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t length_ = 0;
+};
+
+}  // namespace shill
+
+#endif  // SHILL_NET_ATTRIBUTE_LIST_VIEW_H_
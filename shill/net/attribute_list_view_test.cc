@@ -0,0 +1,159 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "shill/net/attribute_list_view.h"
+
+#include <linux/netlink.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "shill/net/byte_string.h"
+
+using testing::Test;
+
+namespace shill {
+
+class AttributeListViewTest : public Test {
+ protected:
+  static constexpr uint16_t kType1 = 1;
+  static constexpr uint16_t kType2 = 2;
+  static constexpr uint16_t kType3 = 3;
+  static constexpr uint16_t kTypeNested = 4;
+
+  // Appends to |payload| an attribute of type |type| with |value| as its
+  // payload, padded to NLA_ALIGNTO.
+  static void AppendAttribute(ByteString* payload,
+                              uint16_t type,
+                              const ByteString& value) {
+    nlattr attribute{static_cast<uint16_t>(NLA_HDRLEN + value.GetLength()),
+                     type};
+    payload->Append(ByteString(reinterpret_cast<const char*>(&attribute),
+                               sizeof(attribute)));
+    payload->Append(value);
+    payload->Resize(NLA_ALIGN(payload->GetLength()));
+  }
+
+  static AttributeListView View(const ByteString& payload) {
+    return AttributeListView(payload.GetConstData(), payload.GetLength());
+  }
+};
+
+TEST_F(AttributeListViewTest, Empty) {
+  AttributeListView view;
+  EXPECT_TRUE(view.IsValid());
+  EXPECT_TRUE(view.IsEmpty());
+  EXPECT_FALSE(view.GetAttribute(kType1, nullptr));
+}
+
+TEST_F(AttributeListViewTest, Values) {
+  ByteString payload;
+  AppendAttribute(&payload, kType1, ByteString::CreateFromCPUUInt32(0x12345));
+  AppendAttribute(&payload, kType2, ByteString(std::string("ssid"), true));
+  AppendAttribute(&payload, kType3, ByteString());
+  const AttributeListView view = View(payload);
+  EXPECT_TRUE(view.IsValid());
+
+  uint32_t u32;
+  EXPECT_TRUE(view.GetU32AttributeValue(kType1, &u32));
+  EXPECT_EQ(0x12345, u32);
+  uint8_t u8;
+  EXPECT_TRUE(view.GetU8AttributeValue(kType1, &u8));
+  // Too short.
+  uint64_t u64;
+  EXPECT_FALSE(view.GetU64AttributeValue(kType1, &u64));
+
+  base::StringPiece str;
+  EXPECT_TRUE(view.GetStringAttributeValue(kType2, &str));
+  EXPECT_EQ("ssid", str);
+  EXPECT_TRUE(view.GetStringAttributeValue(kType3, &str));
+  EXPECT_EQ("", str);
+
+  EXPECT_TRUE(view.IsFlagAttributeTrue(kType3));
+  EXPECT_FALSE(view.IsFlagAttributeTrue(kTypeNested));
+  EXPECT_FALSE(view.GetU32AttributeValue(kTypeNested, &u32));
+}
+
+TEST_F(AttributeListViewTest, Iterate) {
+  ByteString payload;
+  for (const auto& [type, value] :
+       std::vector<std::pair<uint16_t, std::string>>{
+           {kType1, "0123456789"}, {kType2, "123"}, {kType1, "12345"}}) {
+    AppendAttribute(&payload, type, ByteString(value, false));
+  }
+
+  std::vector<int> ids;
+  std::vector<std::string> values;
+  for (const AttributeView& attribute : View(payload)) {
+    ids.push_back(attribute.id());
+    values.push_back(std::string(attribute.GetStringValue()));
+  }
+  EXPECT_EQ((std::vector<int>{kType1, kType2, kType1}), ids);
+  EXPECT_EQ((std::vector<std::string>{"0123456789", "123", "12345"}), values);
+
+  // Lookups return the first attribute of a type.
+  AttributeView attribute;
+  EXPECT_TRUE(View(payload).GetAttribute(kType1, &attribute));
+  EXPECT_EQ(10, attribute.length());
+  EXPECT_TRUE(attribute.GetRawValue().Equals(
+      ByteString(std::string("0123456789"), false)));
+}
+
+TEST_F(AttributeListViewTest, Nested) {
+  ByteString inner;
+  AppendAttribute(&inner, kType1, ByteString::CreateFromCPUUInt32(7));
+  ByteString middle;
+  AppendAttribute(&middle, kTypeNested, inner);
+  ByteString payload;
+  AppendAttribute(&payload, kType2, ByteString::CreateFromCPUUInt32(1));
+  AppendAttribute(&payload, kTypeNested, middle);
+
+  AttributeListView nested;
+  ASSERT_TRUE(View(payload).GetNestedAttributeList(kTypeNested, &nested));
+  ASSERT_TRUE(nested.GetNestedAttributeList(kTypeNested, &nested));
+  uint32_t value;
+  EXPECT_TRUE(nested.GetU32AttributeValue(kType1, &value));
+  EXPECT_EQ(7, value);
+  // The nested list points into |payload|.
+  EXPECT_GE(nested.data(), payload.GetConstData());
+  EXPECT_LE(nested.data() + nested.length(),
+            payload.GetConstData() + payload.GetLength());
+}
+
+TEST_F(AttributeListViewTest, Malformed) {
+  ByteString payload;
+  AppendAttribute(&payload, kType1, ByteString::CreateFromCPUUInt32(1));
+  ByteString malformed(payload);
+  // An attribute that claims more bytes than the buffer holds.
+  nlattr attribute{64, kType2};
+  malformed.Append(ByteString(reinterpret_cast<const char*>(&attribute),
+                              sizeof(attribute)));
+  EXPECT_FALSE(View(malformed).IsValid());
+  // The attributes before the malformed one can still be read.
+  EXPECT_TRUE(View(malformed).GetU32AttributeValue(kType1, nullptr));
+  EXPECT_FALSE(View(malformed).GetAttribute(kType2, nullptr));
+
+  // An attribute shorter than its header.
+  malformed = payload;
+  attribute.nla_len = NLA_HDRLEN - 1;
+  malformed.Append(ByteString(reinterpret_cast<const char*>(&attribute),
+                              sizeof(attribute)));
+  EXPECT_FALSE(View(malformed).IsValid());
+
+  // Trailing bytes that cannot hold a header are ignored.
+  ByteString trailing(payload);
+  trailing.Append(ByteString(2));
+  EXPECT_TRUE(View(trailing).IsValid());
+  int count = 0;
+  for (const AttributeView& entry : View(trailing)) {
+    EXPECT_EQ(kType1, entry.id());
+    count++;
+  }
+  EXPECT_EQ(1, count);
+}
+
+}  // namespace shill
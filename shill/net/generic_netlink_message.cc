@@ -57,7 +57,7 @@ ByteString GenericNetlinkMessage::Encode(uint32_t sequence_number) {
 
   // Build and append attributes (padding is included by
   // AttributeList::Encode).
-  ByteString attribute_string = attributes_->Encode();
+  ByteString attribute_string = const_attributes()->Encode();
 
   // Need to re-calculate |header| since |Append|, above, moves the data.
   nlmsghdr* pheader = reinterpret_cast<nlmsghdr*>(result.GetData());
@@ -89,6 +89,45 @@ bool GenericNetlinkMessage::InitAndStripHeader(NetlinkPacket* packet) {
   return true;
 }
 
+bool GenericNetlinkMessage::ConsumeAttributes(
+    NetlinkPacket* packet, const AttributeList::NewFromIdMethod& factory) {
+  if (!packet->ConsumeAttributeViews(&payload_, &attribute_views_)) {
+    return false;
+  }
+  attribute_factory_ = factory;
+  return true;
+}
+
+void GenericNetlinkMessage::DecodeAttributes() const {
+  if (attribute_factory_.is_null()) {
+    return;
+  }
+  const size_t offset = attribute_views_.data() - payload_->GetConstData();
+  if (!attributes_->Decode(*payload_, offset, attribute_factory_)) {
+    LOG(ERROR) << "Couldn't decode all the attributes of " << ToString();
+  }
+  attribute_factory_.Reset();
+}
+
+AttributeListConstRefPtr GenericNetlinkMessage::const_attributes() const {
+  DecodeAttributes();
+  return attributes_;
+}
+
+AttributeListRefPtr GenericNetlinkMessage::attributes() {
+  DecodeAttributes();
+  return attributes_;
+}
+
+AttributeListView GenericNetlinkMessage::attribute_views() const {
+  if (payload_) {
+    return attribute_views_;
+  }
+  encoded_attributes_ = attributes_->Encode();
+  return AttributeListView(encoded_attributes_.GetConstData(),
+                           encoded_attributes_.GetLength());
+}
+
 std::string GenericNetlinkMessage::ToString() const {
   return base::StringPrintf("Message %s (%d)", command_string(), command());
 }
@@ -96,7 +135,10 @@ std::string GenericNetlinkMessage::ToString() const {
 void GenericNetlinkMessage::Print(int header_log_level,
                                   int detail_log_level) const {
   SLOG(this, header_log_level) << ToString();
-  attributes_->Print(detail_log_level, 1);
+  // Do not decode the attributes only to drop their log messages.
+  if (VLOG_IS_ON(detail_log_level)) {
+    const_attributes()->Print(detail_log_level, 1);
+  }
 }
 
 // Control Message
@@ -114,8 +156,8 @@ bool ControlNetlinkMessage::InitFromPacket(
     return false;
   }
 
-  return packet->ConsumeAttributes(
-      base::Bind(&NetlinkAttribute::NewControlAttributeFromId), attributes_);
+  return ConsumeAttributes(
+      packet, base::Bind(&NetlinkAttribute::NewControlAttributeFromId));
 }
 
 // Specific Control types.
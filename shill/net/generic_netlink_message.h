@@ -9,6 +9,7 @@
 #include <string>
 
 #include "shill/net/attribute_list.h"
+#include "shill/net/attribute_list_view.h"
 #include "shill/net/byte_string.h"
 #include "shill/net/netlink_message.h"
 #include "shill/net/shill_export.h"
@@ -62,9 +63,9 @@ class SHILL_EXPORT GenericNetlinkMessage : public NetlinkMessage {
                         uint8_t command,
                         const char* command_string)
       : NetlinkMessage(my_message_type),
-        attributes_(new AttributeList),
         command_(command),
-        command_string_(command_string) {}
+        command_string_(command_string),
+        attributes_(new AttributeList) {}
   GenericNetlinkMessage(const GenericNetlinkMessage&) = delete;
   GenericNetlinkMessage& operator=(const GenericNetlinkMessage&) = delete;
 
@@ -74,8 +75,17 @@ class SHILL_EXPORT GenericNetlinkMessage : public NetlinkMessage {
 
   uint8_t command() const { return command_; }
   const char* command_string() const { return command_string_; }
-  AttributeListConstRefPtr const_attributes() const { return attributes_; }
-  AttributeListRefPtr attributes() { return attributes_; }
+  // The attributes of a message received from the kernel are decoded the
+  // first time one of these methods is called.
+  AttributeListConstRefPtr const_attributes() const;
+  AttributeListRefPtr attributes();
+  // Returns views of the attributes of the message.  For a message received
+  // from the kernel, they point into the received packet and looking them up,
+  // nested ones included, does not allocate.  Prefer them to
+  // |const_attributes()| to read a few attributes of frequent messages.  For
+  // a message built locally, the attributes are encoded on each call and the
+  // views are only valid until the next one.
+  AttributeListView attribute_views() const;
   std::string ToString() const override;
   void Print(int header_log_level, int detail_log_level) const override;
 
@@ -86,10 +96,30 @@ class SHILL_EXPORT GenericNetlinkMessage : public NetlinkMessage {
   // Reads the |nlmsghdr| and |genlmsghdr| headers and consumes the latter
   // from the payload of |packet|.
   bool InitAndStripHeader(NetlinkPacket* packet) override;
+  // Takes the attributes remaining in the payload of |packet| without
+  // decoding them.  They are decoded with |factory| when first accessed
+  // through |const_attributes()| or |attributes()|.
+  bool ConsumeAttributes(NetlinkPacket* packet,
+                         const AttributeList::NewFromIdMethod& factory);
 
-  AttributeListRefPtr attributes_;
   const uint8_t command_;
   const char* command_string_;
+
+ private:
+  // Decodes the attributes received from the kernel into |attributes_|, if
+  // not done yet.
+  void DecodeAttributes() const;
+
+  mutable AttributeListRefPtr attributes_;
+  // Payload of the packet the message was received in, and the attributes
+  // within it.
+  std::shared_ptr<const ByteString> payload_;
+  AttributeListView attribute_views_;
+  // Factory used to decode |attribute_views_| into |attributes_|.  Reset once
+  // the attributes are decoded.
+  mutable AttributeList::NewFromIdMethod attribute_factory_;
+  // Attributes encoded by |attribute_views()| for a message built locally.
+  mutable ByteString encoded_attributes_;
 };
 
 // Control Messages
@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <gmock/gmock.h>
 
@@ -57,6 +58,21 @@ class MockRTNLHandler : public RTNLHandler {
                    uint32_t* seq) override {
     return DoSendMessage(message.get(), seq);
   }
+  // The size of a batch is passed to DoSendMessages(), then its messages to
+  // DoSendMessage() one at a time.
+  MOCK_METHOD(bool, DoSendMessages, (size_t));
+  bool SendMessages(std::vector<std::unique_ptr<RTNLMessage>> messages,
+                    ResponseCallback response_callback) override {
+    if (!DoSendMessages(messages.size())) {
+      return false;
+    }
+    for (const auto& message : messages) {
+      if (!DoSendMessage(message.get(), nullptr)) {
+        return false;
+      }
+    }
+    return true;
+  }
 };
 
 }  // namespace shill
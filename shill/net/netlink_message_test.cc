@@ -455,6 +455,53 @@ TEST_F(NetlinkMessageTest, Parse_NL80211_CMD_NEW_SCAN_RESULTS) {
       NL80211_ATTR_SUPPORT_MESH_AUTH));
 }
 
+TEST_F(NetlinkMessageTest, AttributeViews) {
+  std::unique_ptr<NetlinkMessage> netlink_message;
+  {
+    NetlinkPacket packet(kNL80211_CMD_NEW_SCAN_RESULTS,
+                         sizeof(kNL80211_CMD_NEW_SCAN_RESULTS));
+    netlink_message = message_factory_.CreateMessage(
+        &packet, NetlinkMessage::MessageContext());
+  }
+  ASSERT_NE(nullptr, netlink_message);
+  std::unique_ptr<Nl80211Message> message(
+      static_cast<Nl80211Message*>(netlink_message.release()));
+
+  // The views remain valid after the packet is gone.
+  const AttributeListView views = message->attribute_views();
+  uint32_t value;
+  EXPECT_TRUE(views.GetU32AttributeValue(NL80211_ATTR_WIPHY, &value));
+  EXPECT_EQ(kWiPhy, value);
+  EXPECT_TRUE(views.GetU32AttributeValue(NL80211_ATTR_IFINDEX, &value));
+  EXPECT_EQ(kExpectedIfIndex, value);
+  EXPECT_TRUE(views.IsFlagAttributeTrue(NL80211_ATTR_SUPPORT_MESH_AUTH));
+
+  AttributeListView frequencies;
+  ASSERT_TRUE(views.GetNestedAttributeList(NL80211_ATTR_SCAN_FREQUENCIES,
+                                           &frequencies));
+  std::vector<uint32_t> list;
+  for (const AttributeView& frequency : frequencies) {
+    ASSERT_TRUE(frequency.GetU32Value(&value));
+    list.push_back(value);
+  }
+  EXPECT_EQ(std::vector<uint32_t>(std::begin(kScanFrequencyResults),
+                                  std::end(kScanFrequencyResults)),
+            list);
+
+  // The attributes are still decoded on demand.
+  std::vector<uint32_t> decoded;
+  EXPECT_TRUE(GetScanFrequenciesFromMessage(*message, &decoded));
+  EXPECT_EQ(list, decoded);
+
+  // Views of the attributes of a message built locally.
+  TriggerScanMessage trigger_scan;
+  trigger_scan.attributes()->SetU32AttributeValue(NL80211_ATTR_IFINDEX,
+                                                  kExpectedIfIndex);
+  EXPECT_TRUE(trigger_scan.attribute_views().GetU32AttributeValue(
+      NL80211_ATTR_IFINDEX, &value));
+  EXPECT_EQ(kExpectedIfIndex, value);
+}
+
 TEST_F(NetlinkMessageTest, Parse_NL80211_CMD_NEW_STATION) {
   NetlinkPacket netlink_packet(kNL80211_CMD_NEW_STATION,
                                sizeof(kNL80211_CMD_NEW_STATION));
@@ -26,7 +26,8 @@ NetlinkPacket::NetlinkPacket(const unsigned char* buf, size_t len)
     return;
   }
 
-  payload_.reset(new ByteString(buf + sizeof(header_), len - sizeof(header_)));
+  payload_ = std::make_shared<ByteString>(buf + sizeof(header_),
+                                         len - sizeof(header_));
 }
 
 NetlinkPacket::~NetlinkPacket() {}
@@ -64,6 +65,24 @@ bool NetlinkPacket::ConsumeAttributes(
   return result;
 }
 
+bool NetlinkPacket::ConsumeAttributeViews(
+    std::shared_ptr<const ByteString>* payload,
+    AttributeListView* attributes) {
+  const ByteString& data = GetPayload();
+  const size_t offset = std::min(data.GetLength(), NLA_ALIGN(consumed_bytes_));
+  AttributeListView views(data.GetConstData() + offset,
+                          data.GetLength() - offset);
+  consumed_bytes_ = data.GetLength();
+  if (!views.IsValid()) {
+    LOG(ERROR) << "Malformed nla attribute in " << views.length()
+               << " bytes of attributes.";
+    return false;
+  }
+  *payload = payload_;
+  *attributes = views;
+  return true;
+}
+
 bool NetlinkPacket::ConsumeData(size_t len, void* data) {
   if (GetRemainingLength() < len) {
     LOG(ERROR) << "Not enough bytes remaining.";
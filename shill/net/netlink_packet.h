@@ -11,6 +11,7 @@
 #include <memory>
 
 #include "shill/net/attribute_list.h"
+#include "shill/net/attribute_list_view.h"
 #include "shill/net/shill_export.h"
 
 namespace shill {
@@ -51,6 +52,13 @@ class SHILL_EXPORT NetlinkPacket {
   bool ConsumeAttributes(const AttributeList::NewFromIdMethod& factory,
                          const AttributeListRefPtr& attributes);
 
+  // Consume netlink attributes from the remaining payload without decoding
+  // them.  |payload| shares the payload buffer with the packet so that
+  // |attributes|, which refers to the attributes within it, can outlive the
+  // packet.  Returns false if the attributes are malformed.
+  bool ConsumeAttributeViews(std::shared_ptr<const ByteString>* payload,
+                             AttributeListView* attributes);
+
   // Consume |len| bytes out of the payload, and place them in |data|.
   // Any trailing alignment padding in |payload| is also consumed.  Returns
   // true if there is enough data, otherwise returns false and does not
@@ -79,7 +87,7 @@ class SHILL_EXPORT NetlinkPacket {
   friend class NetlinkPacketTest;
 
   nlmsghdr header_;
-  std::unique_ptr<ByteString> payload_;
+  std::shared_ptr<ByteString> payload_;
   size_t consumed_bytes_;
 };
 
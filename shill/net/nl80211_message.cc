@@ -69,9 +69,9 @@ bool Nl80211Message::InitFromPacket(NetlinkPacket* packet,
     return false;
   }
 
-  return packet->ConsumeAttributes(
-      base::Bind(&NetlinkAttribute::NewNl80211AttributeFromId, context),
-      attributes_);
+  return ConsumeAttributes(
+      packet,
+      base::Bind(&NetlinkAttribute::NewNl80211AttributeFromId, context));
 }
 
 Nl80211Frame::Nl80211Frame(const ByteString& raw_frame)
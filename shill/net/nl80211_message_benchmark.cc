@@ -0,0 +1,273 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the decoding of NL80211_CMD_NEW_SCAN_RESULTS messages, which
+// reports the number of heap allocations and the time spent per message when
+// the attributes are decoded into an AttributeList and when they are read
+// through AttributeListView.  In both cases the BSSID, frequency, signal and
+// information elements of the BSS are read, as a scan result consumer would.
+//
+// A scan result carries the information elements of the beacon or probe
+// response frame it was built from.  If a directory is given, typically the
+// corpus of nl80211_message_fuzzer, one scan result is built with the content
+// of each of its files as information elements.  Otherwise a few typical sets
+// of information elements are used.
+//
+// Usage: nl80211_message_benchmark [corpus directory] [iterations]
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/nl80211.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/files/file_enumerator.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+
+#include "shill/net/attribute_list.h"
+#include "shill/net/attribute_list_view.h"
+#include "shill/net/byte_string.h"
+#include "shill/net/netlink_packet.h"
+#include "shill/net/nl80211_message.h"
+
+namespace {
+
+std::atomic<size_t> g_allocations{0};
+
+}  // namespace
+
+// Count the allocations made by the whole process, libshill-net included.
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size ? size : 1);
+  if (!ptr)
+    abort();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+namespace shill {
+namespace {
+
+constexpr uint16_t kNl80211FamilyId = 0x13;
+constexpr int kDefaultIterations = 10000;
+constexpr uint32_t kWiPhy = 0;
+constexpr uint32_t kIfIndex = 3;
+constexpr unsigned char kBssid[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+
+// SSID, supported rates, DS parameter set, RSN and HT capabilities.
+constexpr unsigned char kWpa2Ies[] = {
+    0x00, 0x0b, 'G',  'o',  'o',  'g',  'l',  'e',  'G',  'u',  'e',  's',
+    't',  0x01, 0x08, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24, 0x03,
+    0x01, 0x06, 0x30, 0x14, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00,
+    0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x02, 0x0c, 0x00,
+    0x2d, 0x1a, 0xef, 0x01, 0x1b, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00};
+// SSID, supported rates, DS parameter set and a WPS vendor element.
+constexpr unsigned char kOpenIes[] = {
+    0x00, 0x04, 'o',  'p',  'e',  'n',  0x01, 0x04, 0x02, 0x04, 0x0b,
+    0x16, 0x03, 0x01, 0x0b, 0xdd, 0x0e, 0x00, 0x50, 0xf2, 0x04, 0x10,
+    0x4a, 0x00, 0x01, 0x10, 0x10, 0x44, 0x00, 0x01, 0x02};
+
+void AppendAttribute(ByteString* payload,
+                     uint16_t type,
+                     const unsigned char* data,
+                     size_t length) {
+  const nlattr header = {static_cast<uint16_t>(NLA_HDRLEN + length), type};
+  payload->Append(
+      ByteString(reinterpret_cast<const unsigned char*>(&header), NLA_HDRLEN));
+  payload->Append(ByteString(data, length));
+  payload->Resize(NLA_ALIGN(payload->GetLength()));
+}
+
+template <typename T>
+void AppendValue(ByteString* payload, uint16_t type, T value) {
+  AppendAttribute(payload, type, reinterpret_cast<const unsigned char*>(&value),
+                  sizeof(value));
+}
+
+// Returns a NL80211_CMD_NEW_SCAN_RESULTS message for a BSS advertising |ies|.
+ByteString MakeScanResult(const ByteString& ies) {
+  ByteString bss;
+  AppendAttribute(&bss, NL80211_BSS_BSSID, kBssid, sizeof(kBssid));
+  AppendValue<uint32_t>(&bss, NL80211_BSS_FREQUENCY, 2437);
+  AppendValue<uint64_t>(&bss, NL80211_BSS_TSF, 0x123456789);
+  AppendValue<uint16_t>(&bss, NL80211_BSS_BEACON_INTERVAL, 100);
+  AppendValue<uint16_t>(&bss, NL80211_BSS_CAPABILITY, 0x431);
+  AppendAttribute(&bss, NL80211_BSS_INFORMATION_ELEMENTS, ies.GetConstData(),
+                  ies.GetLength());
+  AppendValue<int32_t>(&bss, NL80211_BSS_SIGNAL_MBM, -5500);
+  AppendValue<uint32_t>(&bss, NL80211_BSS_SEEN_MS_AGO, 20);
+
+  ByteString attributes;
+  AppendValue<uint32_t>(&attributes, NL80211_ATTR_WIPHY, kWiPhy);
+  AppendValue<uint32_t>(&attributes, NL80211_ATTR_GENERATION, 42);
+  AppendValue<uint32_t>(&attributes, NL80211_ATTR_IFINDEX, kIfIndex);
+  AppendValue<uint64_t>(&attributes, NL80211_ATTR_WDEV, 1);
+  AppendAttribute(&attributes, NL80211_ATTR_BSS, bss.GetConstData(),
+                  bss.GetLength());
+
+  nlmsghdr header = {};
+  header.nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN + attributes.GetLength();
+  header.nlmsg_type = kNl80211FamilyId;
+  header.nlmsg_flags = NLM_F_MULTI;
+  genlmsghdr genl_header = {};
+  genl_header.cmd = NL80211_CMD_NEW_SCAN_RESULTS;
+  genl_header.version = 1;
+
+  ByteString message(reinterpret_cast<const unsigned char*>(&header),
+                     sizeof(header));
+  message.Append(ByteString(
+      reinterpret_cast<const unsigned char*>(&genl_header), GENL_HDRLEN));
+  message.Append(attributes);
+  return message;
+}
+
+std::unique_ptr<Nl80211Message> CreateMessage(
+    const NetlinkMessageFactory& factory, const ByteString& bytes) {
+  NetlinkPacket packet(bytes.GetConstData(), bytes.GetLength());
+  std::unique_ptr<NetlinkMessage> message =
+      factory.CreateMessage(&packet, NetlinkMessage::MessageContext());
+  return std::unique_ptr<Nl80211Message>(
+      static_cast<Nl80211Message*>(message.release()));
+}
+
+// Reads the scan result from the decoded attributes.  Returns false if it is
+// incomplete.
+bool ReadDecoded(const Nl80211Message& message) {
+  AttributeListConstRefPtr bss;
+  ByteString bssid;
+  uint32_t frequency;
+  uint32_t signal;
+  AttributeListConstRefPtr ies;
+  return message.const_attributes()->ConstGetNestedAttributeList(
+             NL80211_ATTR_BSS, &bss) &&
+         bss->GetRawAttributeValue(NL80211_BSS_BSSID, &bssid) &&
+         bss->GetU32AttributeValue(NL80211_BSS_FREQUENCY, &frequency) &&
+         bss->GetU32AttributeValue(NL80211_BSS_SIGNAL_MBM, &signal) &&
+         bss->ConstGetNestedAttributeList(NL80211_BSS_INFORMATION_ELEMENTS,
+                                          &ies);
+}
+
+// Reads the scan result through attribute views.  Returns false if it is
+// incomplete.
+bool ReadViews(const Nl80211Message& message) {
+  AttributeListView bss;
+  AttributeView bssid;
+  uint32_t frequency;
+  uint32_t signal;
+  AttributeView ies;
+  return message.attribute_views().GetNestedAttributeList(NL80211_ATTR_BSS,
+                                                          &bss) &&
+         bss.GetAttribute(NL80211_BSS_BSSID, &bssid) &&
+         bss.GetU32AttributeValue(NL80211_BSS_FREQUENCY, &frequency) &&
+         bss.GetU32AttributeValue(NL80211_BSS_SIGNAL_MBM, &signal) &&
+         bss.GetAttribute(NL80211_BSS_INFORMATION_ELEMENTS, &ies);
+}
+
+struct Result {
+  double allocations_per_message;
+  base::TimeDelta time_per_message;
+  int failures;
+};
+
+Result Measure(const NetlinkMessageFactory& factory,
+               const std::vector<ByteString>& messages,
+               int iterations,
+               bool (*read_scan_result)(const Nl80211Message&)) {
+  Result result = {};
+  size_t allocations = 0;
+  base::TimeDelta elapsed;
+  for (int i = 0; i < iterations; i++) {
+    for (const ByteString& bytes : messages) {
+      const size_t allocations_before = g_allocations.load();
+      const base::TimeTicks start = base::TimeTicks::Now();
+      std::unique_ptr<Nl80211Message> message = CreateMessage(factory, bytes);
+      const bool ok = message && read_scan_result(*message);
+      message.reset();
+      elapsed += base::TimeTicks::Now() - start;
+      allocations += g_allocations.load() - allocations_before;
+      if (!ok && i == 0)
+        result.failures++;
+    }
+  }
+  const size_t count = iterations * messages.size();
+  result.allocations_per_message = static_cast<double>(allocations) / count;
+  result.time_per_message = elapsed / count;
+  return result;
+}
+
+}  // namespace
+}  // namespace shill
+
+int main(int argc, char** argv) {
+  // Malformed corpus entries are expected.
+  logging::SetMinLogLevel(logging::LOGGING_FATAL);
+
+  std::vector<shill::ByteString> ies;
+  if (argc > 1) {
+    base::FileEnumerator files(base::FilePath(argv[1]), false /* recursive */,
+                               base::FileEnumerator::FILES);
+    for (base::FilePath path = files.Next(); !path.empty();
+         path = files.Next()) {
+      std::string data;
+      // The information elements must fit in a nested attribute.
+      if (!base::ReadFileToString(path, &data) ||
+          data.size() > std::numeric_limits<uint16_t>::max() / 2) {
+        continue;
+      }
+      ies.emplace_back(data, false /* copy_terminator */);
+    }
+  } else {
+    ies.emplace_back(shill::kWpa2Ies, sizeof(shill::kWpa2Ies));
+    ies.emplace_back(shill::kOpenIes, sizeof(shill::kOpenIes));
+  }
+  const int iterations = argc > 2 ? strtol(argv[2], nullptr, 0)
+                                  : shill::kDefaultIterations;
+  if (ies.empty() || iterations <= 0) {
+    fprintf(stderr, "Usage: %s [corpus directory] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<shill::ByteString> messages;
+  for (const shill::ByteString& elements : ies)
+    messages.push_back(shill::MakeScanResult(elements));
+
+  shill::NetlinkMessageFactory factory;
+  factory.AddFactoryMethod(shill::kNl80211FamilyId,
+                           base::Bind(&shill::Nl80211Message::CreateMessage));
+  shill::Nl80211Message::SetMessageType(shill::kNl80211FamilyId);
+
+  printf("%zu scan results, %d iterations\n", messages.size(), iterations);
+  printf("%8s %14s %12s %10s\n", "mode", "allocs/message", "us/message",
+         "failures");
+  const shill::Result decoded = shill::Measure(factory, messages, iterations,
+                                               &shill::ReadDecoded);
+  printf("%8s %14.1f %12.2f %10d\n", "decoded", decoded.allocations_per_message,
+         decoded.time_per_message.InMicrosecondsF(), decoded.failures);
+  const shill::Result views =
+      shill::Measure(factory, messages, iterations, &shill::ReadViews);
+  printf("%8s %14.1f %12.2f %10d\n", "views", views.allocations_per_message,
+         views.time_per_message.InMicrosecondsF(), views.failures);
+  return 0;
+}
@@ -128,6 +128,7 @@ void RTNLHandler::Stop() {
   last_dump_sequence_ = 0;
   stored_requests_.clear();
   oldest_request_sequence_ = 0;
+  batches_.clear();
 
   SLOG(this, 2) << "RTNLHandler stopped";
 }
@@ -294,6 +295,13 @@ void RTNLHandler::ParseRTNL(InputData* data) {
     // Swapping out of |stored_requests_| here ensures that the RTNLMessage will
     // be destructed regardless of the control flow below.
     std::unique_ptr<RTNLMessage> request_msg = PopStoredRequest(hdr->nlmsg_seq);
+    const RTNLMessage* request = request_msg.get();
+    auto batch = FindBatch(hdr->nlmsg_seq);
+    size_t batch_index = 0;
+    if (batch != batches_.end()) {
+      batch_index = hdr->nlmsg_seq - batch->first_sequence;
+      request = batch->messages[batch_index].get();
+    }
 
     if (!msg.Decode(payload)) {
       SLOG(this, 5) << __func__ << ": rtnl packet type " << hdr->nlmsg_type
@@ -319,11 +327,12 @@ void RTNLHandler::ParseRTNL(InputData* data) {
               reinterpret_cast<nlmsgerr*>(NLMSG_DATA(hdr))->error;
           std::string request_str;
           RTNLMessage::Mode mode = RTNLMessage::kModeUnknown;
-          if (request_msg) {
-            request_str = " (" + request_msg->ToString() + ")";
-            mode = request_msg->mode();
+          if (request) {
+            request_str = " (" + request->ToString() + ")";
+            mode = request->mode();
           }
 
+          bool unexpected_error = false;
           if (error_number == 0) {
             SLOG(this, 3) << base::StringPrintf(
                 "sequence %d%s received success", hdr->nlmsg_seq,
@@ -333,13 +342,16 @@ void RTNLHandler::ParseRTNL(InputData* data) {
             LOG(ERROR) << base::StringPrintf(
                 "sequence %d%s received invalid error %d", hdr->nlmsg_seq,
                 request_str.c_str(), error_number);
+            unexpected_error = true;
           } else {
             error_number = -error_number;
             std::string error_msg = base::StringPrintf(
                 "sequence %d%s received error %d (%s)", hdr->nlmsg_seq,
                 request_str.c_str(), error_number, strerror(error_number));
-            if (base::Contains(GetAndClearErrorMask(hdr->nlmsg_seq),
-                               error_number) ||
+            const ErrorMask error_mask =
+                batch != batches_.end() ? batch->error_masks[batch_index]
+                                        : GetAndClearErrorMask(hdr->nlmsg_seq);
+            if (base::Contains(error_mask, error_number) ||
                 (error_number == EEXIST && mode == RTNLMessage::kModeAdd) ||
                 (mode == RTNLMessage::kModeDelete &&
                  (error_number == ENOENT || error_number == ESRCH ||
@@ -349,7 +361,24 @@ void RTNLHandler::ParseRTNL(InputData* data) {
               SLOG(this, 3) << error_msg;
             } else {
               LOG(ERROR) << error_msg;
+              unexpected_error = true;
+            }
+          }
+
+          if (batch != batches_.end()) {
+            if (unexpected_error && batch->error == 0) {
+              batch->error = error_number;
             }
+            if (batch_index == batch->messages.size() - 1) {
+              ResponseCallback response_callback =
+                  std::move(batch->response_callback);
+              const int32_t batch_error = batch->error;
+              batches_.erase(batch);
+              if (!response_callback.is_null()) {
+                std::move(response_callback).Run(batch_error);
+              }
+            }
+            break;
           }
 
           auto response_callback_iter =
@@ -500,16 +529,81 @@ bool RTNLHandler::AddInterface(const std::string& interface_name,
 
 bool RTNLHandler::SendMessage(std::unique_ptr<RTNLMessage> message,
                               uint32_t* msg_seq) {
+  ErrorMask error_mask = GetExpectedErrors(*message);
+  return SendMessageWithErrorMask(std::move(message), error_mask, msg_seq);
+}
+
+bool RTNLHandler::SendMessages(
+    std::vector<std::unique_ptr<RTNLMessage>> messages,
+    ResponseCallback response_callback) {
+  if (messages.empty()) {
+    if (!response_callback.is_null()) {
+      std::move(response_callback).Run(0);
+    }
+    return true;
+  }
+
+  messages.back()->set_flags(messages.back()->flags() | NLM_F_ACK);
+  Batch batch;
+  batch.first_sequence = request_sequence_;
+  batch.response_callback = std::move(response_callback);
+  batch.error = 0;
+  ByteString data;
+  for (auto& message : messages) {
+    message->set_seq(batch.first_sequence + batch.error_masks.size());
+    ByteString msgdata = message->Encode();
+    if (msgdata.GetLength() == 0) {
+      return false;
+    }
+    // Every message of a multipart payload starts on a NLMSG_ALIGNTO
+    // boundary.
+    data.Resize(NLMSG_ALIGN(data.GetLength()));
+    data.Append(msgdata);
+    batch.error_masks.push_back(GetExpectedErrors(*message));
+  }
+
+  SLOG(this, 5) << "RTNL sending " << messages.size()
+                << " messages with request sequences " << request_sequence_
+                << " to " << request_sequence_ + messages.size() - 1
+                << ", length " << data.GetLength();
+
+  request_sequence_ += messages.size();
+
+  if (sockets_->Send(rtnl_socket_, data.GetConstData(), data.GetLength(), 0) <
+      0) {
+    PLOG(ERROR) << "RTNL send failed";
+    return false;
+  }
+
+  batch.messages = std::move(messages);
+  batches_.push_back(std::move(batch));
+  return true;
+}
+
+// static
+RTNLHandler::ErrorMask RTNLHandler::GetExpectedErrors(
+    const RTNLMessage& message) {
   ErrorMask error_mask;
-  if (message->mode() == RTNLMessage::kModeAdd) {
+  if (message.mode() == RTNLMessage::kModeAdd) {
     error_mask = {EEXIST};
-  } else if (message->mode() == RTNLMessage::kModeDelete) {
+  } else if (message.mode() == RTNLMessage::kModeDelete) {
     error_mask = {ESRCH, ENODEV};
-    if (message->type() == RTNLMessage::kTypeAddress) {
+    if (message.type() == RTNLMessage::kTypeAddress) {
       error_mask.insert(EADDRNOTAVAIL);
     }
   }
-  return SendMessageWithErrorMask(std::move(message), error_mask, msg_seq);
+  return error_mask;
+}
+
+std::list<RTNLHandler::Batch>::iterator RTNLHandler::FindBatch(
+    uint32_t sequence) {
+  for (auto it = batches_.begin(); it != batches_.end(); ++it) {
+    // Unsigned arithmetic handles the wrap-around of sequence numbers.
+    if (sequence - it->first_sequence < it->messages.size()) {
+      return it;
+    }
+  }
+  return batches_.end();
 }
 
 bool RTNLHandler::SendMessageWithErrorMask(std::unique_ptr<RTNLMessage> message,
@@ -557,6 +651,13 @@ void RTNLHandler::ResetSocket() {
     std::move(it->second).Run(EIO);
     response_callbacks_.erase(it);
   }
+  std::list<Batch> batches;
+  batches.swap(batches_);
+  for (auto& batch : batches) {
+    if (!batch.response_callback.is_null()) {
+      std::move(batch.response_callback).Run(EIO);
+    }
+  }
   Stop();
   Start(netlink_groups_mask_);
 }
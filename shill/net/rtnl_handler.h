@@ -6,6 +6,7 @@
 #define SHILL_NET_RTNL_HANDLER_H_
 
 #include <cstdint>
+#include <list>
 #include <map>
 #include <memory>
 #include <set>
@@ -132,6 +133,15 @@ class SHILL_EXPORT RTNLHandler {
   // not null, then it will be set to the message's assigned sequence number.
   virtual bool SendMessage(std::unique_ptr<RTNLMessage> message, uint32_t* seq);
 
+  // Sends |messages| to the kernel in a single send. Only the last message
+  // requests an acknowledgement: the kernel processes the messages in order
+  // and reports the failure of any of them, so |response_callback| is called
+  // once the response to the last message is received, with the first error
+  // of the batch which is not expected for its message (e.g. EEXIST when
+  // adding an entry), or 0. Returns false on sending failures.
+  virtual bool SendMessages(std::vector<std::unique_ptr<RTNLMessage>> messages,
+                            ResponseCallback response_callback);
+
  protected:
   RTNLHandler();
   RTNLHandler(const RTNLHandler&) = delete;
@@ -159,6 +169,19 @@ class SHILL_EXPORT RTNLHandler {
   // haven't yet gotten a response.
   static const uint32_t kStoredRequestWindowSize;
 
+  // Messages sent by SendMessages() whose last message has not gotten a
+  // response yet. They are kept here rather than in |stored_requests_| and
+  // |error_mask_window_| so that batches larger than these windows are
+  // handled.
+  struct Batch {
+    uint32_t first_sequence;
+    std::vector<std::unique_ptr<RTNLMessage>> messages;
+    std::vector<ErrorMask> error_masks;
+    ResponseCallback response_callback;
+    // First unexpected error received for the messages of the batch.
+    int32_t error;
+  };
+
   // This stops the event-monitoring function of the RTNL handler -- it is
   // private since it will never happen in normal running, but is useful for
   // tests.
@@ -191,6 +214,14 @@ class SHILL_EXPORT RTNLHandler {
                                 const ErrorMask& error_mask,
                                 uint32_t* msg_seq);
 
+  // Returns the errors which are expected for |message| and should not be
+  // logged.
+  static ErrorMask GetExpectedErrors(const RTNLMessage& message);
+
+  // Returns the batch that the message of sequence |sequence| belongs to, or
+  // |batches_.end()|.
+  std::list<Batch>::iterator FindBatch(uint32_t sequence);
+
   // Called by the RTNL read handler on exceptional events.
   void OnReadError(const std::string& error_msg);
 
@@ -239,6 +270,10 @@ class SHILL_EXPORT RTNLHandler {
   // matched by message sequence id must be called with encoded error in
   // |NLMSG_ERROR| message.
   std::unordered_map<uint32_t, ResponseCallback> response_callbacks_;
+
+  // Batches waiting for the response to their last message, in the order in
+  // which they were sent.
+  std::list<Batch> batches_;
 };
 
 }  // namespace shill
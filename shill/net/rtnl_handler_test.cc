@@ -5,8 +5,10 @@
 #include "shill/net/rtnl_handler.h"
 
 #include <limits>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <net/if.h>
@@ -595,4 +597,67 @@ TEST_F(RTNLHandlerTest, AddInterfaceTest) {
   StopRTNLHandler();
 }
 
+TEST_F(RTNLHandlerTest, SendMessages) {
+  StartRTNLHandler();
+  constexpr uint32_t kSequenceNumber = 1000;
+  // Larger than the windows of error masks and of stored requests.
+  constexpr int kNumMessages = 40;
+  SetRequestSequence(kSequenceNumber);
+
+  ByteString sent;
+  EXPECT_CALL(*sockets_, Send(kTestSocket, _, _, 0))
+      .WillOnce([&](int, const void* buf, size_t len, int flags) {
+        sent = ByteString(reinterpret_cast<const unsigned char*>(buf), len);
+        return len;
+      });
+
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
+  for (int i = 0; i < kNumMessages; i++) {
+    messages.push_back(std::make_unique<RTNLMessage>(
+        RTNLMessage::kTypeRoute,
+        i % 2 ? RTNLMessage::kModeAdd : RTNLMessage::kModeDelete,
+        NLM_F_REQUEST, 0, 0, 0, IPAddress::kFamilyIPv4));
+  }
+  std::vector<int32_t> errors;
+  EXPECT_TRUE(RTNLHandler::GetInstance()->SendMessages(
+      std::move(messages),
+      base::BindOnce(
+          [](std::vector<int32_t>* errors, int32_t error) {
+            errors->push_back(error);
+          },
+          &errors)));
+  EXPECT_EQ(kSequenceNumber + kNumMessages, GetRequestSequence());
+
+  // All the messages are sent at once, and only the last one requests an
+  // acknowledgement.
+  const unsigned char* buf = sent.GetConstData();
+  size_t len = sent.GetLength();
+  int num_messages = 0;
+  for (const nlmsghdr* hdr = reinterpret_cast<const nlmsghdr*>(buf);
+       NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len)) {
+    EXPECT_EQ(kSequenceNumber + num_messages, hdr->nlmsg_seq);
+    const bool is_last = num_messages == kNumMessages - 1;
+    EXPECT_EQ(is_last, !!(hdr->nlmsg_flags & NLM_F_ACK));
+    num_messages++;
+  }
+  EXPECT_EQ(kNumMessages, num_messages);
+  EXPECT_EQ(0, len);
+
+  // Expected errors are ignored and the first unexpected error is reported
+  // once the last message gets its response.
+  ReturnError(kSequenceNumber, ESRCH);
+  ReturnError(kSequenceNumber + 1, EEXIST);
+  ReturnError(kSequenceNumber + 2, EPERM);
+  ReturnError(kSequenceNumber + 4, EINVAL);
+  EXPECT_TRUE(errors.empty());
+  ReturnError(kSequenceNumber + kNumMessages - 1, 0);
+  EXPECT_THAT(errors, ElementsAre(EPERM));
+
+  // The batch is done.
+  ReturnError(kSequenceNumber + kNumMessages - 1, 0);
+  EXPECT_EQ(1, errors.size());
+
+  StopRTNLHandler();
+}
+
 }  // namespace shill
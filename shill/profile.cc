@@ -96,7 +96,8 @@ void Profile::OnPropertyChanged(const std::string& /*name*/) {
 bool Profile::InitStorage(InitStorageOption storage_option, Error* error) {
   CHECK(!persistent_profile_path_.empty());
   std::unique_ptr<StoreInterface> storage =
-      CreateStore(persistent_profile_path_, name_.user_hash);
+      CreateStore(persistent_profile_path_, name_.user_hash,
+                  manager_->storage_task_runner());
   bool already_exists = !storage->IsEmpty();
   if (!already_exists && storage_option != kCreateNew &&
       storage_option != kCreateOrOpenExisting) {
@@ -435,6 +436,10 @@ bool Profile::Save() {
   return storage_->Flush();
 }
 
+bool Profile::FlushPendingWrites() {
+  return !storage_ || storage_->FlushPendingWrites();
+}
+
 RpcIdentifiers Profile::EnumerateAvailableServices(Error* error) {
   // We should return the Manager's service list if this is the active profile.
   if (manager_->IsActiveProfile(this)) {
@@ -150,6 +150,10 @@ class Profile : public base::RefCounted<Profile> {
   // Write all in-memory state to disk via |storage_|.
   virtual bool Save();
 
+  // Waits for the writes of |storage_| deferred by Save() and the other
+  // methods persisting entries to complete.
+  bool FlushPendingWrites();
+
   // Parses a profile identifier. There're two acceptable forms of the |raw|
   // identifier: "identifier" and "~user/identifier". Both "user" and
   // "identifier" must be suitable for use in a D-Bus object path. Returns true
@@ -19,8 +19,10 @@
 #include <unistd.h>
 
 #include <limits>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <base/bind.h>
 #include <base/check.h>
@@ -192,16 +194,23 @@ void RoutingTable::RegisterDevice(int interface_index,
 
   uint32_t table_id = GetInterfaceTableId(interface_index);
   // Move existing entries for this interface to the per-Device table.
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
   for (auto& nent : tables_[interface_index]) {
     if (nent.table == table_id) {
       continue;
     }
     RoutingTableEntry new_entry = nent;
     new_entry.table = table_id;
-    AddRouteToKernelTable(interface_index, new_entry);
-    RemoveRouteFromKernelTable(interface_index, nent);
+    messages.push_back(CreateRouteMessage(interface_index, new_entry,
+                                          RTNLMessage::kModeAdd,
+                                          NLM_F_CREATE | NLM_F_EXCL));
+    messages.push_back(CreateRouteMessage(interface_index, nent,
+                                          RTNLMessage::kModeDelete, 0));
     nent.table = table_id;
   }
+  if (!messages.empty()) {
+    SendMessages(std::move(messages));
+  }
 
   // Set accept_ra_rt_table to -N to cause routes created by the reception of
   // RAs to be sent to the table id (interface_index + N).
@@ -364,29 +373,37 @@ void RoutingTable::FlushRoutes(int interface_index) {
   SLOG(this, 2) << __func__;
 
   auto table = tables_.find(interface_index);
-  if (table == tables_.end()) {
+  if (table == tables_.end() || table->second.empty()) {
     return;
   }
 
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
   for (const auto& nent : table->second) {
-    RemoveRouteFromKernelTable(interface_index, nent);
+    messages.push_back(CreateRouteMessage(interface_index, nent,
+                                          RTNLMessage::kModeDelete, 0));
   }
+  SendMessages(std::move(messages));
   table->second.clear();
 }
 
 void RoutingTable::FlushRoutesWithTag(int tag) {
   SLOG(this, 2) << __func__;
 
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
   for (auto& table : tables_) {
     for (auto nent = table.second.begin(); nent != table.second.end();) {
       if (nent->tag == tag) {
-        RemoveRouteFromKernelTable(table.first, *nent);
+        messages.push_back(CreateRouteMessage(table.first, *nent,
+                                              RTNLMessage::kModeDelete, 0));
         nent = table.second.erase(nent);
       } else {
         ++nent;
       }
     }
   }
+  if (!messages.empty()) {
+    SendMessages(std::move(messages));
+  }
 }
 
 void RoutingTable::ResetTable(int interface_index) {
@@ -555,9 +572,13 @@ void RoutingTable::RouteMsgHandler(const RTNLMessage& message) {
   if (is_managed && entry.table != target_table && entry.type == RTN_UNICAST) {
     RoutingTableEntry oldEntry(entry);
     entry.table = target_table;
-    ApplyRoute(interface_index, entry, RTNLMessage::kModeAdd,
-               NLM_F_CREATE | NLM_F_REPLACE);
-    RemoveRouteFromKernelTable(interface_index, oldEntry);
+    std::vector<std::unique_ptr<RTNLMessage>> messages;
+    messages.push_back(CreateRouteMessage(interface_index, entry,
+                                          RTNLMessage::kModeAdd,
+                                          NLM_F_CREATE | NLM_F_REPLACE));
+    messages.push_back(CreateRouteMessage(interface_index, oldEntry,
+                                          RTNLMessage::kModeDelete, 0));
+    SendMessages(std::move(messages));
   }
 
   if (!entry_exists) {
@@ -569,6 +590,15 @@ bool RoutingTable::ApplyRoute(uint32_t interface_index,
                               const RoutingTableEntry& entry,
                               RTNLMessage::Mode mode,
                               unsigned int flags) {
+  return rtnl_handler_->SendMessage(
+      CreateRouteMessage(interface_index, entry, mode, flags), nullptr);
+}
+
+std::unique_ptr<RTNLMessage> RoutingTable::CreateRouteMessage(
+    uint32_t interface_index,
+    const RoutingTableEntry& entry,
+    RTNLMessage::Mode mode,
+    unsigned int flags) {
   DCHECK(entry.table != RT_TABLE_UNSPEC && entry.table != RT_TABLE_COMPAT)
       << "Attempted to apply route: " << entry;
 
@@ -607,7 +637,14 @@ bool RoutingTable::ApplyRoute(uint32_t interface_index,
                           ByteString::CreateFromCPUUInt32(interface_index));
   }
 
-  return rtnl_handler_->SendMessage(std::move(message), nullptr);
+  return message;
+}
+
+bool RoutingTable::SendMessages(
+    std::vector<std::unique_ptr<RTNLMessage>> messages) {
+  // Errors are logged by RTNLHandler.
+  return rtnl_handler_->SendMessages(std::move(messages),
+                                     RTNLHandler::ResponseCallback());
 }
 
 // Somewhat surprisingly, the kernel allows you to create multiple routes
@@ -623,11 +660,15 @@ void RoutingTable::ReplaceMetric(uint32_t interface_index,
                 << metric;
   RoutingTableEntry new_entry = *entry;
   new_entry.metric = metric;
-  // First create the route at the new metric.
-  ApplyRoute(interface_index, new_entry, RTNLMessage::kModeAdd,
-             NLM_F_CREATE | NLM_F_REPLACE);
-  // Then delete the route at the old metric.
-  RemoveRouteFromKernelTable(interface_index, *entry);
+  // First create the route at the new metric, then delete the route at the
+  // old metric.
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
+  messages.push_back(CreateRouteMessage(interface_index, new_entry,
+                                        RTNLMessage::kModeAdd,
+                                        NLM_F_CREATE | NLM_F_REPLACE));
+  messages.push_back(CreateRouteMessage(interface_index, *entry,
+                                        RTNLMessage::kModeDelete, 0));
+  SendMessages(std::move(messages));
   // Now, update our routing table (via |*entry|) from |new_entry|.
   *entry = new_entry;
 }
@@ -728,6 +769,15 @@ bool RoutingTable::ApplyRule(uint32_t interface_index,
                              const RoutingPolicyEntry& entry,
                              RTNLMessage::Mode mode,
                              unsigned int flags) {
+  return rtnl_handler_->SendMessage(
+      CreateRuleMessage(interface_index, entry, mode, flags), nullptr);
+}
+
+std::unique_ptr<RTNLMessage> RoutingTable::CreateRuleMessage(
+    uint32_t interface_index,
+    const RoutingPolicyEntry& entry,
+    RTNLMessage::Mode mode,
+    unsigned int flags) {
   SLOG(this, 2) << base::StringPrintf(
       "%s: index %d family %s prio %d", __func__, interface_index,
       IPAddress::GetAddressFamilyName(entry.family).c_str(), entry.priority);
@@ -771,7 +821,7 @@ bool RoutingTable::ApplyRule(uint32_t interface_index,
     message->SetAttribute(FRA_SRC, entry.src.address());
   }
 
-  return rtnl_handler_->SendMessage(std::move(message), nullptr);
+  return message;
 }
 
 bool RoutingTable::ParseRoutingPolicyMessage(const RTNLMessage& message,
@@ -904,16 +954,63 @@ void RoutingTable::FlushRules(int interface_index) {
   SLOG(this, 2) << __func__;
 
   auto table = policy_tables_.find(interface_index);
-  if (table == policy_tables_.end()) {
+  if (table == policy_tables_.end() || table->second.empty()) {
     return;
   }
 
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
   for (const auto& nent : table->second) {
-    ApplyRule(interface_index, nent, RTNLMessage::kModeDelete, 0);
+    messages.push_back(CreateRuleMessage(interface_index, nent,
+                                         RTNLMessage::kModeDelete, 0));
   }
+  SendMessages(std::move(messages));
   table->second.clear();
 }
 
+bool RoutingTable::ReplaceRules(
+    int interface_index, const std::vector<RoutingPolicyEntry>& entries) {
+  SLOG(this, 2) << __func__ << " index " << interface_index;
+
+  PolicyTableEntryVector& table = policy_tables_[interface_index];
+  // Match every installed rule with an identical rule of |entries|. The
+  // unmatched installed rules are removed and the unmatched new rules added.
+  std::vector<bool> matched(entries.size(), false);
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
+  PolicyTableEntryVector kept;
+  for (const auto& nent : table) {
+    size_t i = 0;
+    while (i < entries.size() && (matched[i] || !(entries[i] == nent))) {
+      i++;
+    }
+    if (i < entries.size()) {
+      matched[i] = true;
+      kept.push_back(nent);
+    } else {
+      messages.push_back(CreateRuleMessage(interface_index, nent,
+                                           RTNLMessage::kModeDelete, 0));
+    }
+  }
+  // Removals are sent first, like when the rules are flushed and added
+  // again, so that a removal never matches a rule that was just added.
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (!matched[i]) {
+      messages.push_back(CreateRuleMessage(interface_index, entries[i],
+                                           RTNLMessage::kModeAdd,
+                                           NLM_F_CREATE | NLM_F_EXCL));
+      kept.push_back(entries[i]);
+    }
+  }
+  if (messages.empty()) {
+    return true;
+  }
+
+  if (!SendMessages(std::move(messages))) {
+    return false;
+  }
+  table = std::move(kept);
+  return true;
+}
+
 // static
 uint32_t RoutingTable::GetInterfaceTableId(int interface_index) {
   return static_cast<uint32_t>(interface_index + kInterfaceTableIdIncrement);
@@ -930,16 +1027,21 @@ uint32_t RoutingTable::RequestAdditionalTableId() {
 
   // Flush any entries currently in this table before letting the caller
   // use it.
+  std::vector<std::unique_ptr<RTNLMessage>> messages;
   for (auto& table : tables_) {
     for (auto nent = table.second.begin(); nent != table.second.end();) {
       if (nent->table == table_id) {
-        RemoveRouteFromKernelTable(table.first, *nent);
+        messages.push_back(CreateRouteMessage(table.first, *nent,
+                                              RTNLMessage::kModeDelete, 0));
         nent = table.second.erase(nent);
       } else {
         ++nent;
       }
     }
   }
+  if (!messages.empty()) {
+    SendMessages(std::move(messages));
+  }
   return table_id;
 }
 
@@ -72,6 +72,12 @@ class RoutingTable {
   // Add an entry to the routing rule table.
   virtual bool AddRule(int interface_index, const RoutingPolicyEntry& entry);
 
+  // Replace the routing rules of |interface_index| with |entries|. Only the
+  // rules that are not already installed are added and only the installed
+  // rules that are not part of |entries| are removed, in a single RTNL batch.
+  virtual bool ReplaceRules(int interface_index,
+                            const std::vector<RoutingPolicyEntry>& entries);
+
   // Get the default route associated with an interface of a given addr family.
   // The route is copied into |*entry|.
   virtual bool GetDefaultRoute(int interface_index,
@@ -189,6 +195,13 @@ class RoutingTable {
                   const RoutingTableEntry& entry,
                   RTNLMessage::Mode mode,
                   unsigned int flags);
+  std::unique_ptr<RTNLMessage> CreateRouteMessage(
+      uint32_t interface_index,
+      const RoutingTableEntry& entry,
+      RTNLMessage::Mode mode,
+      unsigned int flags);
+  // Sends |messages| to the kernel in a single RTNL batch.
+  bool SendMessages(std::vector<std::unique_ptr<RTNLMessage>> messages);
   // Get the default route associated with an interface of a given addr family.
   // A pointer to the route is placed in |*entry|.
   virtual bool GetDefaultRouteInternal(int interface_index,
@@ -203,6 +216,11 @@ class RoutingTable {
                  const RoutingPolicyEntry& entry,
                  RTNLMessage::Mode mode,
                  unsigned int flags);
+  std::unique_ptr<RTNLMessage> CreateRuleMessage(
+      uint32_t interface_index,
+      const RoutingPolicyEntry& entry,
+      RTNLMessage::Mode mode,
+      unsigned int flags);
   bool ParseRoutingPolicyMessage(const RTNLMessage& message,
                                  RoutingPolicyEntry* entry);
   bool HandleRoutingPolicyMessage(const RTNLMessage& message);
@@ -4,6 +4,7 @@
 
 #include "shill/routing_table.h"
 
+#include <linux/fib_rules.h>
 #include <linux/rtnetlink.h>
 #include <sys/socket.h>
 
@@ -27,7 +28,9 @@
 #include "shill/net/rtnl_message.h"
 
 using testing::_;
+using testing::AnyNumber;
 using testing::Field;
+using testing::InSequence;
 using testing::Invoke;
 using testing::Return;
 using testing::StrictMock;
@@ -43,6 +46,9 @@ class RoutingTableTest : public Test {
   void SetUp() override {
     routing_table_->rtnl_handler_ = &rtnl_handler_;
     ON_CALL(rtnl_handler_, DoSendMessage(_, _)).WillByDefault(Return(true));
+    EXPECT_CALL(rtnl_handler_, DoSendMessages(_))
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
   }
 
   void TearDown() override { RTNLHandler::GetInstance()->Stop(); }
@@ -69,6 +75,13 @@ class RoutingTableTest : public Test {
 
   int CountRoutingPolicyEntries();
 
+  // Returns a new RoutingTable sending its messages to |rtnl_handler_|.
+  std::unique_ptr<RoutingTable> CreateRoutingTable() {
+    std::unique_ptr<RoutingTable> routing_table(new RoutingTable());
+    routing_table->rtnl_handler_ = &rtnl_handler_;
+    return routing_table;
+  }
+
   bool SetSequenceForMessage(uint32_t* seq) {
     *seq = RoutingTableTest::kTestRequestSeq;
     return true;
@@ -191,6 +204,13 @@ MATCHER_P4(IsRoutingPacket, mode, index, entry, flags, "") {
          priority == entry.metric;
 }
 
+MATCHER_P2(IsRulePacket, mode, priority, "") {
+  uint32_t rule_priority;
+  return arg->type() == RTNLMessage::kTypeRule && arg->mode() == mode &&
+         arg->GetAttribute(FRA_PRIORITY).ConvertToCPUUInt32(&rule_priority) &&
+         rule_priority == priority;
+}
+
 }  // namespace
 
 void RoutingTableTest::SendRouteEntry(RTNLMessage::Mode mode,
@@ -833,4 +853,212 @@ TEST_F(RoutingTableTest, CreateLinkRoute) {
       RoutingTable::GetInterfaceTableId(kTestDeviceIndex0)));
 }
 
+TEST_F(RoutingTableTest, ReplaceRules) {
+  const int kInterfaceIndex = 3;
+  auto rule = [](uint32_t priority) {
+    return RoutingPolicyEntry::Create(IPAddress::kFamilyIPv4)
+        .SetPriority(priority)
+        .SetTable(RoutingTable::GetInterfaceTableId(kInterfaceIndex));
+  };
+
+  {
+    InSequence s;
+    EXPECT_CALL(rtnl_handler_, DoSendMessages(3)).WillOnce(Return(true));
+    for (uint32_t priority : {10, 11, 12}) {
+      EXPECT_CALL(rtnl_handler_,
+                  DoSendMessage(IsRulePacket(RTNLMessage::kModeAdd, priority),
+                                _))
+          .WillOnce(Return(true));
+    }
+  }
+  EXPECT_TRUE(routing_table_->ReplaceRules(kInterfaceIndex,
+                                           {rule(10), rule(11), rule(12)}));
+  EXPECT_EQ(3, CountRoutingPolicyEntries());
+
+  // Only the difference is sent, removals first, in a single batch.
+  {
+    InSequence s;
+    EXPECT_CALL(rtnl_handler_, DoSendMessages(2)).WillOnce(Return(true));
+    EXPECT_CALL(rtnl_handler_,
+                DoSendMessage(IsRulePacket(RTNLMessage::kModeDelete, 11), _))
+        .WillOnce(Return(true));
+    EXPECT_CALL(rtnl_handler_,
+                DoSendMessage(IsRulePacket(RTNLMessage::kModeAdd, 13), _))
+        .WillOnce(Return(true));
+  }
+  EXPECT_TRUE(routing_table_->ReplaceRules(kInterfaceIndex,
+                                           {rule(12), rule(13), rule(10)}));
+  EXPECT_EQ(3, CountRoutingPolicyEntries());
+
+  // Nothing is sent when the rules do not change.
+  EXPECT_TRUE(routing_table_->ReplaceRules(kInterfaceIndex,
+                                           {rule(13), rule(12), rule(10)}));
+
+  // The rules are not recorded if they could not be sent.
+  EXPECT_CALL(rtnl_handler_, DoSendMessages(1)).WillOnce(Return(false));
+  EXPECT_FALSE(routing_table_->ReplaceRules(
+      kInterfaceIndex, {rule(10), rule(12), rule(13), rule(14)}));
+  EXPECT_EQ(3, CountRoutingPolicyEntries());
+
+  EXPECT_CALL(rtnl_handler_, DoSendMessages(3)).WillOnce(Return(true));
+  for (uint32_t priority : {10, 12, 13}) {
+    EXPECT_CALL(rtnl_handler_,
+                DoSendMessage(IsRulePacket(RTNLMessage::kModeDelete, priority),
+                              _))
+        .WillOnce(Return(true));
+  }
+  routing_table_->FlushRules(kInterfaceIndex);
+  EXPECT_EQ(0, CountRoutingPolicyEntries());
+}
+
+TEST_F(RoutingTableTest, FlushRoutesInOneBatch) {
+  auto entry = [](const char* dst) {
+    IPAddress address(IPAddress::kFamilyIPv4);
+    CHECK(address.SetAddressFromString(dst));
+    return RoutingTableEntry::Create(address, IPAddress(IPAddress::kFamilyIPv4),
+                                     IPAddress(IPAddress::kFamilyIPv4))
+        .SetTable(RoutingTable::GetInterfaceTableId(kTestDeviceIndex0));
+  };
+  for (const char* dst : {kTestNetAddress0, kTestNetAddress1}) {
+    EXPECT_CALL(rtnl_handler_, DoSendMessage(_, _)).WillOnce(Return(true));
+    EXPECT_TRUE(routing_table_->AddRoute(kTestDeviceIndex0, entry(dst)));
+  }
+
+  InSequence s;
+  EXPECT_CALL(rtnl_handler_, DoSendMessages(2)).WillOnce(Return(true));
+  for (const char* dst : {kTestNetAddress0, kTestNetAddress1}) {
+    EXPECT_CALL(rtnl_handler_,
+                DoSendMessage(IsRoutingPacket(RTNLMessage::kModeDelete,
+                                              kTestDeviceIndex0, entry(dst), 0),
+                              _))
+        .WillOnce(Return(true));
+  }
+  routing_table_->FlushRoutes(kTestDeviceIndex0);
+}
+
+// Counts the RTNL messages and sends needed to update the routing rules of an
+// Ethernet, a WiFi and a VPN connection while the default network switches
+// between them, when the rules are flushed and added again and when they are
+// replaced.
+TEST_F(RoutingTableTest, ReplaceRulesOnNetworkSwitch) {
+  struct Network {
+    int index;
+    const char* name;
+    const char* address;
+    bool is_vpn;
+  };
+  const Network kEthernet = {2, "eth0", "192.168.1.2", false};
+  const Network kWiFi = {3, "wlan0", "10.0.0.2", false};
+  const Network kVPN = {4, "tun0", "10.8.0.2", true};
+  constexpr int kNumVpnUids = 8;
+  // Approximates the rules of Connection::UpdateRoutingPolicy().
+  auto rules = [](const Network& network, uint32_t priority,
+                  bool is_primary_physical) {
+    const uint32_t table = RoutingTable::GetInterfaceTableId(network.index);
+    std::vector<RoutingPolicyEntry> entries;
+    for (auto family : {IPAddress::kFamilyIPv4, IPAddress::kFamilyIPv6}) {
+      RoutingPolicyEntry::FwMark fwmark;
+      fwmark.value = table << 16;
+      fwmark.mask = 0xffff0000;
+      entries.push_back(RoutingPolicyEntry::Create(family)
+                            .SetPriority(priority)
+                            .SetTable(table)
+                            .SetFwMark(fwmark));
+      entries.push_back(RoutingPolicyEntry::CreateFromSrc(IPAddress(family))
+                            .SetPriority(priority)
+                            .SetTable(table)
+                            .SetOif(network.name));
+      if (network.is_vpn) {
+        for (int uid = 0; uid < kNumVpnUids; uid++) {
+          entries.push_back(RoutingPolicyEntry::Create(family)
+                                .SetPriority(10)
+                                .SetTable(table)
+                                .SetUid(1000 + uid));
+        }
+        continue;
+      }
+      entries.push_back(RoutingPolicyEntry::CreateFromSrc(IPAddress(family))
+                            .SetPriority(priority)
+                            .SetTable(table)
+                            .SetIif(network.name));
+      if (is_primary_physical) {
+        entries.push_back(RoutingPolicyEntry::CreateFromSrc(IPAddress(family))
+                              .SetPriority(priority - 1)
+                              .SetTable(RT_TABLE_MAIN));
+        entries.push_back(RoutingPolicyEntry::CreateFromSrc(IPAddress(family))
+                              .SetPriority(32765)
+                              .SetTable(table));
+      }
+    }
+    IPAddress address(IPAddress::kFamilyIPv4);
+    CHECK(address.SetAddressFromString(network.address));
+    entries.push_back(RoutingPolicyEntry::CreateFromSrc(address)
+                          .SetPriority(priority)
+                          .SetTable(table));
+    return entries;
+  };
+  struct Update {
+    Network network;
+    uint32_t priority;
+    bool is_primary_physical;
+  };
+  // Ethernet is the default network, then WiFi as Ethernet is unplugged, then
+  // a VPN connects over WiFi, then Ethernet comes back under the VPN.
+  const std::vector<std::vector<Update>> steps = {
+      {{kEthernet, 1000, true}, {kWiFi, 1010, false}},
+      {{kWiFi, 1000, true}, {kEthernet, 1010, false}},
+      {{kVPN, 1000, false}, {kWiFi, 1010, true}, {kEthernet, 1020, false}},
+      {{kVPN, 1000, false}, {kEthernet, 1010, true}, {kWiFi, 1020, false}},
+  };
+
+  int num_messages = 0;
+  int num_batched_messages = 0;
+  int num_batches = 0;
+  EXPECT_CALL(rtnl_handler_, DoSendMessage(_, _))
+      .WillRepeatedly([&](RTNLMessage*, uint32_t*) {
+        num_messages++;
+        return true;
+      });
+  EXPECT_CALL(rtnl_handler_, DoSendMessages(_))
+      .WillRepeatedly([&](size_t size) {
+        num_batches++;
+        num_batched_messages += size;
+        return true;
+      });
+
+  // Returns the number of sends needed for the whole scenario.
+  auto run = [&](bool replace) {
+    std::unique_ptr<RoutingTable> routing_table = CreateRoutingTable();
+    num_messages = 0;
+    num_batched_messages = 0;
+    num_batches = 0;
+    for (const auto& step : steps) {
+      for (const auto& update : step) {
+        const auto entries = rules(update.network, update.priority,
+                                   update.is_primary_physical);
+        if (replace) {
+          EXPECT_TRUE(
+              routing_table->ReplaceRules(update.network.index, entries));
+        } else {
+          routing_table->FlushRules(update.network.index);
+          for (const auto& entry : entries) {
+            EXPECT_TRUE(routing_table->AddRule(update.network.index, entry));
+          }
+        }
+      }
+    }
+    // The messages of a batch are sent at once.
+    return num_messages - num_batched_messages + num_batches;
+  };
+
+  // Every rule is removed and added one message at a time, removals of an
+  // interface being batched.
+  EXPECT_EQ(121, run(false));
+  EXPECT_EQ(189, num_messages);
+  // Only rules that change are removed or added, in one batch per interface
+  // whose rules change.
+  EXPECT_EQ(9, run(true));
+  EXPECT_EQ(143, num_messages);
+}
+
 }  // namespace shill
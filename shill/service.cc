@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <limits>
 #include <map>
 #include <optional>
 #include <set>
@@ -194,6 +195,7 @@ Service::Service(Manager* manager, Technology technology)
       store_(PropertyStore::PropertyChangeCallback(base::Bind(
           &Service::OnPropertyChanged, weak_ptr_factory_.GetWeakPtr()))),
       serial_number_(next_serial_number_++),
+      has_sort_key_(false),
       adaptor_(manager->control_interface()->CreateServiceAdaptor(this)),
       manager_(manager),
       link_monitor_disabled_(false),
@@ -1448,6 +1450,10 @@ bool Service::CompareWithSameTechnology(const ServiceRefPtr& service,
   return false;
 }
 
+uint64_t Service::SameTechnologySortKey() const {
+  return 0;
+}
+
 // static
 std::string Service::GetCurrentTrafficCounterKey(
     patchpanel::TrafficCounter::Source source, std::string suffix) {
@@ -1545,6 +1551,51 @@ std::pair<bool, const char*> Service::Compare(
   return std::make_pair(ret, kServiceSortSerialNumber);
 }
 
+bool Service::UpdateSortKey(const std::vector<Technology>& tech_order,
+                            uint16_t profile_rank) {
+  // Same criteria and order as Compare(). The connectivity criteria are
+  // derived from the state as in IsOnline(), IsConnected() and so on.
+  const ConnectState connect_state = state();
+  const bool failed =
+      connect_state == kStateFailure || !failed_time_.is_null();
+  uint64_t technology_rank = 0;
+  const auto it =
+      std::find(tech_order.begin(), tech_order.end(), technology());
+  if (it != tech_order.end())
+    technology_rank = std::min<uint64_t>(tech_order.end() - it, 0xff);
+  // Shift the priority to compare it as an unsigned integer.
+  const uint64_t priority = static_cast<uint64_t>(priority_) -
+                            std::numeric_limits<int32_t>::min();
+
+  uint64_t high = 0;
+  high |= static_cast<uint64_t>(connect_state == kStateOnline) << 63;
+  high |= static_cast<uint64_t>(IsConnectedState(connect_state)) << 62;
+  high |= static_cast<uint64_t>(!IsPortalledState(connect_state)) << 61;
+  high |= static_cast<uint64_t>(IsConnectingState(connect_state)) << 60;
+  high |= static_cast<uint64_t>(!failed) << 59;
+  high |= static_cast<uint64_t>(connectable_) << 58;
+  high |= technology_rank << 50;
+  high |= (priority & 0xffffffff) << 18;
+  high |= std::min<uint64_t>(SourcePriority(), 0xff) << 10;
+  high |= static_cast<uint64_t>(managed_credentials_) << 9;
+  high |= static_cast<uint64_t>(auto_connect_) << 8;
+  high |= std::min<uint64_t>(SecurityLevel(), 0xff);
+
+  uint64_t low = 0;
+  low |= static_cast<uint64_t>(profile_rank) << 48;
+  low |= static_cast<uint64_t>(has_ever_connected_) << 47;
+  low |= (SameTechnologySortKey() & ((1ULL << 33) - 1)) << 14;
+  low |= static_cast<uint64_t>(strength_) << 6;
+
+  // Preferred services have the smallest keys.
+  const SortKey key = {~high, ~low, serial_number_};
+  if (has_sort_key_ && key == sort_key_)
+    return false;
+  sort_key_ = key;
+  has_sort_key_ = true;
+  return true;
+}
+
 // static
 std::string Service::SanitizeStorageIdentifier(std::string identifier) {
   std::replace_if(
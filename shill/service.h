@@ -10,6 +10,7 @@
 #include <optional>
 #include <set>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <valarray>
 #include <vector>
@@ -528,6 +529,33 @@ class Service : public base::RefCounted<Service> {
       bool compare_connectivity_state,
       const std::vector<Technology>& tech_order);
 
+  // Packed form of the criteria used by Compare() with the connectivity state,
+  // so that services can be sorted with integer comparisons only. A service
+  // with a smaller key should be displayed above a service with a larger key.
+  struct SortKey {
+    // Complements of the ranking criteria from the most significant to the
+    // least significant one. The serial number breaks the remaining ties.
+    uint64_t high = 0;
+    uint64_t low = 0;
+    unsigned int serial_number = 0;
+
+    bool operator==(const SortKey& other) const {
+      return high == other.high && low == other.low &&
+             serial_number == other.serial_number;
+    }
+    bool operator<(const SortKey& other) const {
+      return std::tie(high, low, serial_number) <
+             std::tie(other.high, other.low, other.serial_number);
+    }
+  };
+
+  // Recomputes the sort key of the service for the technology order
+  // |tech_order| and for the rank |profile_rank| of its profile, higher ranks
+  // being preferred. Returns true if the key changed since the previous call.
+  bool UpdateSortKey(const std::vector<Technology>& tech_order,
+                     uint16_t profile_rank);
+  const SortKey& sort_key() const { return sort_key_; }
+
   // Returns a sanitized version of |identifier| for use as a service storage
   // identifier by replacing any character in |identifier| that is not
   // alphanumeric or '_' with '_'.
@@ -788,6 +816,10 @@ class Service : public base::RefCounted<Service> {
   virtual bool CompareWithSameTechnology(const ServiceRefPtr& service,
                                          bool* decision);
 
+  // Returns the criteria of CompareWithSameTechnology() packed in the 33 least
+  // significant bits of an integer, higher values being preferred.
+  virtual uint64_t SameTechnologySortKey() const;
+
   // Utility function that returns true if a is different from b.  When they
   // are, "decision" is populated with the boolean value of "a > b".
   static bool DecideBetween(int a, int b, bool* decision);
@@ -1044,6 +1076,10 @@ class Service : public base::RefCounted<Service> {
   // A unique identifier for the service.
   unsigned int serial_number_;
 
+  // Sort key computed by the last call to UpdateSortKey(), if any.
+  SortKey sort_key_;
+  bool has_sort_key_;
+
   // List of subject names reported by remote entity during TLS setup.
   std::vector<std::string> remote_certification_;
 
@@ -0,0 +1,116 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the sorting of the services of the Manager after the priority
+// of one of them changed: std::sort() comparing every pair of services with
+// Service::Compare(), against Manager::ReorderServices(), which only moves the
+// services whose sort key changed. Both orders are checked to be the same.
+//
+// Usage: sort_services_benchmark [services] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <gmock/gmock.h>
+
+#include "shill/manager.h"
+#include "shill/mock_control.h"
+#include "shill/mock_metrics.h"
+#include "shill/mock_service.h"
+#include "shill/test_event_dispatcher.h"
+
+namespace shill {
+namespace {
+
+constexpr int kDefaultServices = 500;
+constexpr int kDefaultIterations = 100;
+
+}  // namespace
+
+// Friend of Manager, to time its private sorting of |services_|.
+class SortServicesBenchmark {
+ public:
+  SortServicesBenchmark() {
+    CHECK(dir_.CreateUniqueTempDir());
+    manager_ = std::make_unique<Manager>(&control_, &dispatcher_, &metrics_,
+                                         dir_.GetPath().value(),
+                                         dir_.GetPath().value(), "");
+  }
+  SortServicesBenchmark(const SortServicesBenchmark&) = delete;
+  SortServicesBenchmark& operator=(const SortServicesBenchmark&) = delete;
+
+  // Returns false if the orders given by Service::Compare() and by the sort
+  // keys differ.
+  bool Run(int num_services, int iterations) {
+    std::vector<MockServiceRefPtr> services;
+    for (int i = 0; i < num_services; ++i) {
+      MockServiceRefPtr service(
+          new testing::NiceMock<MockService>(manager_.get()));
+      service->SetPriority(i % 10, nullptr);
+      service->SetStrength(i % 100);
+      service->SetHasEverConnected(i % 3 == 0);
+      manager_->RegisterService(service);
+      services.push_back(service);
+    }
+    manager_->ReorderServices();
+
+    const auto compare = [&order = manager_->technology_order_](
+                             ServiceRefPtr a, ServiceRefPtr b) {
+      return Service::Compare(a, b, true /* compare connectivity */, order)
+          .first;
+    };
+    base::TimeDelta compare_time;
+    base::TimeDelta sort_key_time;
+    for (int i = 0; i < iterations; ++i) {
+      services[(i * 37) % num_services]->SetPriority(i, nullptr);
+
+      std::vector<ServiceRefPtr> expected = manager_->services_;
+      base::TimeTicks start = base::TimeTicks::Now();
+      std::sort(expected.begin(), expected.end(), compare);
+      compare_time += base::TimeTicks::Now() - start;
+
+      start = base::TimeTicks::Now();
+      manager_->ReorderServices();
+      sort_key_time += base::TimeTicks::Now() - start;
+
+      if (expected != manager_->services_) {
+        fprintf(stderr, "Orders differ after %d iterations\n", i + 1);
+        return false;
+      }
+    }
+
+    printf("%10s %12s %12s\n", "services", "Compare us", "sort key us");
+    printf("%10d %12.1f %12.1f\n", num_services,
+           compare_time.InMicrosecondsF() / iterations,
+           sort_key_time.InMicrosecondsF() / iterations);
+    return true;
+  }
+
+ private:
+  testing::NiceMock<MockControl> control_;
+  EventDispatcherForTest dispatcher_;
+  testing::NiceMock<MockMetrics> metrics_;
+  base::ScopedTempDir dir_;
+  std::unique_ptr<Manager> manager_;
+};
+
+}  // namespace shill
+
+int main(int argc, char** argv) {
+  const int services =
+      argc > 1 ? strtol(argv[1], nullptr, 0) : shill::kDefaultServices;
+  const int iterations =
+      argc > 2 ? strtol(argv[2], nullptr, 0) : shill::kDefaultIterations;
+  logging::SetMinLogLevel(logging::LOGGING_WARNING);
+
+  shill::SortServicesBenchmark benchmark;
+  return benchmark.Run(services, iterations) ? 0 : 1;
+}
@@ -63,6 +63,10 @@ bool FakeStore::Flush() {
   return true;
 }
 
+bool FakeStore::FlushPendingWrites() {
+  return true;
+}
+
 bool FakeStore::MarkAsCorrupted() {
   return true;
 }
@@ -32,6 +32,7 @@ class FakeStore : public StoreInterface {
   bool Open() override;
   bool Close() override;
   bool Flush() override;
+  bool FlushPendingWrites() override;
   bool MarkAsCorrupted() override;
   std::set<std::string> GetGroups() const override;
   std::set<std::string> GetGroupsWithKey(const std::string& key) const override;
@@ -13,17 +13,20 @@
 #include <utility>
 #include <vector>
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/check_op.h>
 #include <base/containers/cxx20_erase.h>
 #include <base/files/file_util.h>
 #include <base/files/important_file_writer.h>
 #include <base/logging.h>
+#include <base/memory/ref_counted.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
-#include <brillo/scoped_umask.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/thread_task_runner_handle.h>
 #include <fcntl.h>
 #include <re2/re2.h>
 #include <sys/stat.h>
@@ -298,7 +301,7 @@ class KeyFileStore::KeyFile {
     }
 
     return std::unique_ptr<KeyFile>(
-        new KeyFile(path, std::move(pre_group_comments), std::move(groups),
+        new KeyFile(std::move(pre_group_comments), std::move(groups),
                     std::move(index)));
   }
 
@@ -366,7 +369,7 @@ class KeyFileStore::KeyFile {
     }
   }
 
-  bool Flush() const {
+  std::string Serialize() const {
     std::string to_write;
     for (const std::string& line : pre_group_comments_) {
       to_write += line + '\n';
@@ -374,45 +377,101 @@ class KeyFileStore::KeyFile {
     for (const Group& group : groups_) {
       to_write += group.Serialize(&group == &groups_.back());
     }
-
-    brillo::ScopedUmask owner_only_umask(~(S_IRUSR | S_IWUSR) & 0777);
-    if (!base::ImportantFileWriter::WriteFileAtomically(path_, to_write)) {
-      LOG(ERROR) << "Failed to store key file: " << path_.value();
-      return false;
-    }
-    return true;
+    return to_write;
   }
 
  private:
-  KeyFile(const base::FilePath& path,
-          std::list<std::string> pre_group_comments,
+  KeyFile(std::list<std::string> pre_group_comments,
           std::list<Group> groups,
           std::map<std::string, Group*> index)
-      : path_(path),
-        pre_group_comments_(pre_group_comments),
+      : pre_group_comments_(pre_group_comments),
         groups_(std::move(groups)),
         index_(std::move(index)) {}
   KeyFile(const KeyFile&) = delete;
   KeyFile& operator=(const KeyFile&) = delete;
 
-  base::FilePath path_;
   std::list<std::string> pre_group_comments_;
   std::list<Group> groups_;
   std::map<std::string, Group*> index_;
 };
 
+// Writes the serialized key file to disk, from the sequence of the store or
+// from its write task runner. Every write is tagged with a generation and a
+// write older than the last successful one is skipped, so that a write posted
+// to the write task runner never overwrites a more recent synchronous one.
+class KeyFileStore::Writer : public base::RefCountedThreadSafe<Writer> {
+ public:
+  explicit Writer(const base::FilePath& path) : path_(path) {}
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  bool Write(uint64_t generation, const std::string& data) {
+    base::AutoLock lock(lock_);
+    if (generation <= written_generation_) {
+      return true;
+    }
+    // The file is written to a temporary file created by mkstemp(), hence
+    // readable and writable by the owner only, before being renamed.
+    if (!base::ImportantFileWriter::WriteFileAtomically(path_, data)) {
+      LOG(ERROR) << "Failed to store key file: " << path_.value();
+      return false;
+    }
+    written_generation_ = generation;
+    // Any earlier failure is made up for.
+    write_behind_failed_ = false;
+    return true;
+  }
+
+  // Same as Write(), for the writes posted to the write task runner, whose
+  // failure is only reported by TakeWriteBehindFailure().
+  void WriteBehind(uint64_t generation, const std::string& data) {
+    if (!Write(generation, data)) {
+      base::AutoLock lock(lock_);
+      write_behind_failed_ = true;
+    }
+  }
+
+  // Returns whether a write behind failed since the last successful write,
+  // and forgets about it.
+  bool TakeWriteBehindFailure() {
+    base::AutoLock lock(lock_);
+    return std::exchange(write_behind_failed_, false);
+  }
+
+  uint64_t written_generation() const {
+    base::AutoLock lock(lock_);
+    return written_generation_;
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<Writer>;
+  ~Writer() = default;
+
+  const base::FilePath path_;
+  mutable base::Lock lock_;
+  uint64_t written_generation_ = 0;
+  bool write_behind_failed_ = false;
+};
+
 const char KeyFileStore::kCorruptSuffix[] = ".corrupted";
 
-KeyFileStore::KeyFileStore(const base::FilePath& path,
-                           const std::string& user_hash)
+KeyFileStore::KeyFileStore(
+    const base::FilePath& path,
+    const std::string& user_hash,
+    scoped_refptr<base::SequencedTaskRunner> write_task_runner)
     : key_file_(nullptr),
       path_(path),
       user_hash_(user_hash),
-      slot_id_(KeyFileStore::kInvalidSlot) {
+      slot_id_(KeyFileStore::kInvalidSlot),
+      write_task_runner_(std::move(write_task_runner)),
+      writer_(base::MakeRefCounted<Writer>(path)) {
   CHECK(!path_.empty());
 }
 
-KeyFileStore::~KeyFileStore() = default;
+KeyFileStore::~KeyFileStore() {
+  // Do not lose the changes whose writing was deferred.
+  FlushPendingWrites();
+}
 
 bool KeyFileStore::IsEmpty() const {
   int64_t file_size = 0;
@@ -437,13 +496,51 @@ bool KeyFileStore::Open() {
 }
 
 bool KeyFileStore::Close() {
-  bool success = Flush();
+  bool success = WriteNow();
   key_file_.reset();
   return success;
 }
 
 bool KeyFileStore::Flush() {
-  return key_file_->Flush();
+  CHECK(key_file_);
+  if (!write_task_runner_) {
+    return WriteNow();
+  }
+  // A failed write behind, already logged by the writer, is reported here.
+  // Its changes are written again along with the ones of this flush.
+  const bool success = !writer_->TakeWriteBehindFailure();
+  if (!dirty_) {
+    dirty_ = true;
+    write_behind_callback_.Reset(
+        base::BindOnce(&KeyFileStore::WriteBehind, base::Unretained(this)));
+    base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+        FROM_HERE, write_behind_callback_.callback(), kWriteBehindDelay);
+  }
+  return success;
+}
+
+bool KeyFileStore::FlushPendingWrites() {
+  if (!key_file_ || !write_task_runner_ ||
+      (!dirty_ && writer_->written_generation() == generation_)) {
+    return true;
+  }
+  // A write of the latest generation might still be in progress on the
+  // write task runner; writing a new one waits for it.
+  return WriteNow();
+}
+
+bool KeyFileStore::WriteNow() {
+  write_behind_callback_.Cancel();
+  dirty_ = false;
+  return writer_->Write(++generation_, key_file_->Serialize());
+}
+
+void KeyFileStore::WriteBehind() {
+  dirty_ = false;
+  ++generation_;
+  write_task_runner_->PostTask(
+      FROM_HERE, base::BindOnce(&Writer::WriteBehind, writer_, generation_,
+                                key_file_->Serialize()));
 }
 
 bool KeyFileStore::MarkAsCorrupted() {
@@ -828,9 +925,12 @@ bool KeyFileStore::TryGetPKCS11SlotID() const {
   return true;
 }
 
-std::unique_ptr<StoreInterface> CreateStore(const base::FilePath& path,
-                                            const std::string& user_hash) {
-  return std::make_unique<KeyFileStore>(path, user_hash);
+std::unique_ptr<StoreInterface> CreateStore(
+    const base::FilePath& path,
+    const std::string& user_hash,
+    scoped_refptr<base::SequencedTaskRunner> write_task_runner) {
+  return std::make_unique<KeyFileStore>(path, user_hash,
+                                        std::move(write_task_runner));
 }
 
 }  // namespace shill
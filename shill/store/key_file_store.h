@@ -10,7 +10,11 @@
 #include <string>
 #include <vector>
 
+#include <base/cancelable_callback.h>
 #include <base/files/file_path.h>
+#include <base/memory/scoped_refptr.h>
+#include <base/task/sequenced_task_runner.h>
+#include <base/time/time.h>
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST
 
 #include "shill/store/crypto.h"
@@ -26,12 +30,23 @@ namespace shill {
 // for details of the GLib API that is being reimplemented here.
 // This implementation does not support locales because we do not use locale
 // strings and never have.
+//
+// If a |write_task_runner| is provided, the store is written behind: Flush()
+// only marks the store as dirty, and the flushes made within
+// kWriteBehindDelay of each other are coalesced into a single write of the
+// file, performed on |write_task_runner|. Close(), FlushPendingWrites() and
+// the destructor write the pending changes synchronously. Flush() then
+// returns before its write happens: it returns false if the previous write
+// behind failed, in which case its changes are written again.
 class KeyFileStore : public StoreInterface {
  public:
   static constexpr CK_SLOT_ID kInvalidSlot = ULONG_MAX;
+  static constexpr base::TimeDelta kWriteBehindDelay = base::Seconds(2);
 
-  explicit KeyFileStore(const base::FilePath& path,
-                        const std::string& user_hash = "");
+  explicit KeyFileStore(
+      const base::FilePath& path,
+      const std::string& user_hash = "",
+      scoped_refptr<base::SequencedTaskRunner> write_task_runner = nullptr);
   KeyFileStore(const KeyFileStore&) = delete;
   KeyFileStore& operator=(const KeyFileStore&) = delete;
 
@@ -42,6 +57,7 @@ class KeyFileStore : public StoreInterface {
   bool Open() override;
   bool Close() override;
   bool Flush() override;
+  bool FlushPendingWrites() override;
   bool MarkAsCorrupted() override;
   std::set<std::string> GetGroups() const override;
   std::set<std::string> GetGroupsWithKey(const std::string& key) const override;
@@ -108,6 +124,7 @@ class KeyFileStore : public StoreInterface {
   FRIEND_TEST(KeyFileStoreTest, OpenFail);
 
   class KeyFile;
+  class Writer;
 
   static const char kCorruptSuffix[];
 
@@ -116,16 +133,33 @@ class KeyFileStore : public StoreInterface {
 
   bool TryGetPKCS11SlotID() const;
 
+  // Serializes the key file and writes it on the calling sequence.
+  bool WriteNow();
+  // Serializes the key file and posts its writing to |write_task_runner_|.
+  void WriteBehind();
+
   std::unique_ptr<KeyFile> key_file_;
   const base::FilePath path_;
   const std::string user_hash_;
   mutable CK_SLOT_ID slot_id_;
+
+  const scoped_refptr<base::SequencedTaskRunner> write_task_runner_;
+  // Shared with the writes posted to |write_task_runner_|.
+  const scoped_refptr<Writer> writer_;
+  // Generation of the last write issued.
+  uint64_t generation_ = 0;
+  // Whether Flush() was called since the last write was issued.
+  bool dirty_ = false;
+  base::CancelableOnceClosure write_behind_callback_;
 };
 
 // Creates a store, implementing StoreInterface, at the specified |path|.
 // A |user_hash| can be provided to enable PKCS#11 access to the user token.
-std::unique_ptr<StoreInterface> CreateStore(const base::FilePath& path,
-                                            const std::string& user_hash = "");
+// If |write_task_runner| is provided, the store is written behind on it.
+std::unique_ptr<StoreInterface> CreateStore(
+    const base::FilePath& path,
+    const std::string& user_hash = "",
+    scoped_refptr<base::SequencedTaskRunner> write_task_runner = nullptr);
 
 }  // namespace shill
 
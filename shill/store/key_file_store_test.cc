@@ -18,6 +18,9 @@
 #include <base/files/scoped_temp_dir.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/stringprintf.h>
+#include <base/test/task_environment.h>
+#include <base/test/test_simple_task_runner.h>
+#include <base/time/time.h>
 #include <gtest/gtest.h>
 #include <inttypes.h>
 
@@ -1083,4 +1086,136 @@ TEST_F(KeyFileStoreTest, Combo) {
             ReadKeyFile());
 }
 
+// Stores with a write task runner, run manually by the tests.
+class KeyFileStoreWriteBehindTest : public KeyFileStoreTest {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    test_file_ = temp_dir_.GetPath().Append("test-key-file-store");
+    write_task_runner_ = base::MakeRefCounted<base::TestSimpleTaskRunner>();
+    store_.reset(new KeyFileStore(test_file_, "", write_task_runner_));
+  }
+
+  void TearDown() override {
+    store_.reset();
+    KeyFileStoreTest::TearDown();
+  }
+
+ protected:
+  base::test::TaskEnvironment task_environment_{
+      base::test::TaskEnvironment::TimeSource::MOCK_TIME};
+  scoped_refptr<base::TestSimpleTaskRunner> write_task_runner_;
+};
+
+TEST_F(KeyFileStoreWriteBehindTest, FlushIsDeferred) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key1", "value1"));
+  ASSERT_TRUE(store_->Flush());
+  ASSERT_TRUE(store_->SetString(kGroup, "key2", "value2"));
+  ASSERT_TRUE(store_->Flush());
+
+  // Nothing is written until the delay expires.
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay / 2);
+  EXPECT_FALSE(write_task_runner_->HasPendingTask());
+  EXPECT_EQ("", ReadKeyFile());
+
+  // Both changes are then written at once by the write task runner.
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay / 2);
+  EXPECT_EQ(1u, write_task_runner_->NumPendingTasks());
+  EXPECT_EQ("", ReadKeyFile());
+  write_task_runner_->RunPendingTasks();
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey1=value1\nkey2=value2\n", kGroup),
+            ReadKeyFile());
+  EXPECT_TRUE(store_->FlushPendingWrites());
+  EXPECT_FALSE(write_task_runner_->HasPendingTask());
+}
+
+TEST_F(KeyFileStoreWriteBehindTest, FlushPendingWrites) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "value"));
+  ASSERT_TRUE(store_->Flush());
+  EXPECT_TRUE(store_->FlushPendingWrites());
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey=value\n", kGroup), ReadKeyFile());
+
+  // The deferred write is cancelled.
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay);
+  EXPECT_FALSE(write_task_runner_->HasPendingTask());
+}
+
+TEST_F(KeyFileStoreWriteBehindTest, StaleWriteSkipped) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "old"));
+  ASSERT_TRUE(store_->Flush());
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay);
+  ASSERT_TRUE(write_task_runner_->HasPendingTask());
+
+  // The write still pending on the write task runner must not overwrite the
+  // more recent one.
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "new"));
+  EXPECT_TRUE(store_->FlushPendingWrites());
+  write_task_runner_->RunPendingTasks();
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey=new\n", kGroup), ReadKeyFile());
+}
+
+TEST_F(KeyFileStoreWriteBehindTest, CloseWrites) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "value"));
+  ASSERT_TRUE(store_->Flush());
+  ASSERT_TRUE(store_->Close());
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey=value\n", kGroup), ReadKeyFile());
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay);
+  EXPECT_FALSE(write_task_runner_->HasPendingTask());
+}
+
+TEST_F(KeyFileStoreWriteBehindTest, DestructorWrites) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "value"));
+  ASSERT_TRUE(store_->Flush());
+  store_.reset();
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey=value\n", kGroup), ReadKeyFile());
+}
+
+TEST_F(KeyFileStoreWriteBehindTest, FlushReturnsBeforeWrite) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "value"));
+
+  // The write is left to the write task runner, which is not run.
+  EXPECT_TRUE(store_->Flush());
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay);
+  EXPECT_TRUE(write_task_runner_->HasPendingTask());
+  EXPECT_EQ("", ReadKeyFile());
+
+  EXPECT_TRUE(store_->FlushPendingWrites());
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey=value\n", kGroup), ReadKeyFile());
+}
+
+TEST_F(KeyFileStoreWriteBehindTest, FlushReportsFailedWriteBehind) {
+  static const char kGroup[] = "string-group";
+  ASSERT_TRUE(store_->Open());
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "old"));
+  ASSERT_TRUE(store_->Flush());
+
+  // Writing fails while a directory stands in the way of the file.
+  ASSERT_TRUE(base::DeleteFile(test_file_));
+  ASSERT_TRUE(base::CreateDirectory(test_file_));
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay);
+  write_task_runner_->RunPendingTasks();
+
+  // The next flush reports the failure, once, and writes the changes again.
+  ASSERT_TRUE(base::DeletePathRecursively(test_file_));
+  ASSERT_TRUE(store_->SetString(kGroup, "key", "new"));
+  EXPECT_FALSE(store_->Flush());
+  EXPECT_TRUE(store_->Flush());
+  task_environment_.FastForwardBy(KeyFileStore::kWriteBehindDelay);
+  write_task_runner_->RunPendingTasks();
+  EXPECT_EQ(base::StringPrintf("[%s]\nkey=new\n", kGroup), ReadKeyFile());
+  EXPECT_TRUE(store_->Flush());
+}
+
 }  // namespace shill
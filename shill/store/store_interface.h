@@ -35,9 +35,14 @@ class StoreInterface {
   // store are undefined.
   virtual bool Close() = 0;
 
-  // Flush current in-memory data to disk.
+  // Flush current in-memory data to disk. The store may defer the actual
+  // writing, see FlushPendingWrites().
   virtual bool Flush() = 0;
 
+  // Writes to disk the data whose writing was deferred by Flush(), if any,
+  // before returning. Returns true on success.
+  virtual bool FlushPendingWrites() = 0;
+
   // Mark the underlying file store as corrupted, moving the data file
   // to a new filename.  This will prevent the file from being re-opened
   // the next time Open() is called.
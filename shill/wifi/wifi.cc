@@ -441,8 +441,16 @@ void WiFi::AddPendingScanResult(const RpcIdentifier& path,
     pending_scan_results_.reset(new PendingScanResults(
         base::Bind(&WiFi::PendingScanResultsHandler,
                    weak_ptr_factory_while_started_.GetWeakPtr())));
-    dispatcher()->PostTask(FROM_HERE,
-                           pending_scan_results_->callback.callback());
+    if (GetScanPending(nullptr)) {
+      // Supplicant reports every BSS of a scan separately. Apply them all at
+      // once when the scan is done rather than as they trickle in.
+      dispatcher()->PostDelayedTask(FROM_HERE,
+                                    pending_scan_results_->callback.callback(),
+                                    kMaxPendingScanResultsDelay);
+    } else {
+      dispatcher()->PostTask(FROM_HERE,
+                             pending_scan_results_->callback.callback());
+    }
   }
   pending_scan_results_->results.emplace_back(path, properties, is_removal);
 }
@@ -499,6 +507,12 @@ void WiFi::ScanDone(const bool& success) {
   // handler.
   if (pending_scan_results_) {
     pending_scan_results_->is_complete = true;
+    // The results might have been held back until the end of the scan.
+    pending_scan_results_->callback.Reset(
+        base::Bind(&WiFi::PendingScanResultsHandler,
+                   weak_ptr_factory_while_started_.GetWeakPtr()));
+    dispatcher()->PostTask(FROM_HERE,
+                           pending_scan_results_->callback.callback());
     return;
   }
   if (success) {
@@ -828,6 +842,11 @@ void WiFi::ClearCachedCredentials(const WiFiService* service) {
 }
 
 void WiFi::NotifyEndpointChanged(const WiFiEndpointConstRefPtr& endpoint) {
+  // Apply the change along with the pending scan results, if any.
+  if (pending_scan_results_ && !pending_scan_results_->is_processing) {
+    pending_scan_results_->updated_endpoints.insert(endpoint);
+    return;
+  }
   provider_->OnEndpointUpdated(endpoint);
 }
 
@@ -1598,19 +1617,49 @@ void WiFi::PendingScanResultsHandler() {
   SLOG(this, 2) << __func__ << " with " << pending_scan_results_->results.size()
                 << " results and is_complete set to "
                 << pending_scan_results_->is_complete;
-  for (const auto& result : pending_scan_results_->results) {
+  pending_scan_results_->is_processing = true;
+
+  // An addition is superseded by any later event for the same BSS. Removals
+  // are always applied so that a BSS replaced in the meantime leaves its
+  // Service before its successor is added.
+  const std::vector<ScanResult>& results = pending_scan_results_->results;
+  std::map<RpcIdentifier, size_t> last_event;
+  for (size_t i = 0; i < results.size(); ++i) {
+    last_event[results[i].path] = i;
+  }
+
+  provider_->StartEndpointBatch();
+  for (size_t i = 0; i < results.size(); ++i) {
+    const ScanResult& result = results[i];
     if (result.is_removal) {
       BSSRemovedTask(result.path);
-    } else {
+    } else if (last_event[result.path] == i) {
       BSSAddedTask(result.path, result.properties);
     }
   }
+  for (const auto& endpoint : pending_scan_results_->updated_endpoints) {
+    provider_->OnEndpointUpdated(endpoint);
+  }
+  provider_->FinishEndpointBatch();
+
+  // BSSAddedTask() and BSSRemovedTask() leave this to the end of the batch.
+  if (current_service_) {
+    ReconfigureBgscan(current_service_.get());
+  }
+  if (pending_service_) {
+    ReconfigureBgscan(pending_service_.get());
+  }
+
   if (pending_scan_results_->is_complete) {
     ScanDoneTask();
   }
   pending_scan_results_.reset();
 }
 
+bool WiFi::IsProcessingScanResults() const {
+  return pending_scan_results_ && pending_scan_results_->is_processing;
+}
+
 bool WiFi::ParseWiphyIndex(const Nl80211Message& nl80211_message) {
   // Verify NL80211_CMD_NEW_WIPHY.
   if (nl80211_message.command() != NewWiphyMessage::kCommand) {
@@ -1844,7 +1893,8 @@ void WiFi::BSSAddedTask(const RpcIdentifier& path,
   // Adding a single endpoint can change the bgscan parameters for no more than
   // one active Service. Try pending_service_ only if current_service_ doesn't
   // change.
-  if ((!current_service_ || !ReconfigureBgscan(current_service_.get())) &&
+  if (!IsProcessingScanResults() &&
+      (!current_service_ || !ReconfigureBgscan(current_service_.get())) &&
       pending_service_) {
     ReconfigureBgscan(pending_service_.get());
   }
@@ -1880,6 +1930,9 @@ void WiFi::BSSRemovedTask(const RpcIdentifier& path) {
   WiFiEndpointRefPtr endpoint = i->second;
   CHECK(endpoint);
   endpoint_by_rpcid_.erase(i);
+  if (pending_scan_results_) {
+    pending_scan_results_->updated_endpoints.erase(endpoint);
+  }
 
   if (endpoint->hs20_information().supported) {
     CHECK_NE(hs20_bss_count_, 0u);
@@ -1891,7 +1944,8 @@ void WiFi::BSSRemovedTask(const RpcIdentifier& path) {
     // Removing a single endpoint can change the bgscan parameters for no more
     // than one active Service. Try pending_service_ only if current_service_
     // doesn't change.
-    if ((!current_service_ || !ReconfigureBgscan(current_service_.get())) &&
+    if (!IsProcessingScanResults() &&
+        (!current_service_ || !ReconfigureBgscan(current_service_.get())) &&
         pending_service_) {
       ReconfigureBgscan(pending_service_.get());
     }
@@ -283,9 +283,15 @@ class WiFi : public Device, public SupplicantEventDelegateInterface {
     // List of pending scan results to process.
     std::vector<ScanResult> results;
 
+    // Endpoints whose properties changed while the results were pending.
+    std::set<WiFiEndpointConstRefPtr> updated_endpoints;
+
     // If true, denotes that the scan is complete (ScanDone() was called).
     bool is_complete;
 
+    // If true, the results are being applied by PendingScanResultsHandler().
+    bool is_processing = false;
+
     // Cancelable closure used to process the scan results.
     base::CancelableClosure callback;
   };
@@ -404,6 +410,10 @@ class WiFi : public Device, public SupplicantEventDelegateInterface {
   // Time to wait after failing to launch a scan before resetting the scan state
   // to idle.
   static constexpr base::TimeDelta kPostScanFailedDelay = base::Seconds(10);
+  // Longest time the results received during a scan are held back waiting for
+  // ScanDone() before they are processed.
+  static constexpr base::TimeDelta kMaxPendingScanResultsDelay =
+      base::Seconds(1);
   // Used when enabling MAC randomization to request that the OUI remain
   // constant and the last three octets are randomized.
   static const std::vector<unsigned char> kRandomMacMask;
@@ -665,14 +675,21 @@ class WiFi : public Device, public SupplicantEventDelegateInterface {
   void ReportConnectedToServiceAfterWake();
 
   // Add a scan result to the list of pending scan results, and post a task
-  // for handling these results if one is not already running.
+  // for handling these results if one is not already running. While a scan
+  // is in progress, the results are batched until ScanDone() is received or
+  // kMaxPendingScanResultsDelay elapses.
   void AddPendingScanResult(const RpcIdentifier& path,
                             const KeyValueStore& properties,
                             bool is_removal);
 
   // Callback invoked to handle pending scan results from AddPendingScanResult.
+  // Only the last event of each BSS is applied, and services are updated and
+  // background scan parameters reconfigured once for all the results.
   void PendingScanResultsHandler();
 
+  // Returns true while PendingScanResultsHandler() applies a batch of results.
+  bool IsProcessingScanResults() const;
+
   // Given a NL80211_CMD_NEW_WIPHY message |nl80211_message|, parses the
   // wiphy index of the NIC and sets |wiphy_index_| with the parsed index.
   // Returns true iff the wiphy index was parsed successfully, false otherwise.
@@ -13,6 +13,7 @@
 
 #include "shill/logging.h"
 #include "shill/metrics.h"
+#include "shill/net/attribute_list_view.h"
 #include "shill/net/netlink_message.h"
 #include "shill/net/nl80211_message.h"
 #include "shill/scope_logger.h"
@@ -114,8 +115,8 @@ void WiFiCQM::OnCQMNotify(const Nl80211Message& nl80211_message) {
     return;
   }
 
-  AttributeListConstRefPtr cqm_attrs;
-  if (!nl80211_message.const_attributes()->ConstGetNestedAttributeList(
+  AttributeListView cqm_attrs;
+  if (!nl80211_message.attribute_views().GetNestedAttributeList(
           NL80211_ATTR_CQM, &cqm_attrs)) {
     LOG(ERROR) << "Could not find NL80211_ATTR_CQM tag.";
     return;
@@ -124,8 +125,8 @@ void WiFiCQM::OnCQMNotify(const Nl80211Message& nl80211_message) {
   // Return after RSSI message is processed. The CQM in kernel is designed to
   // publish one notification type in a given CQM message.
   uint32_t trigger_state;
-  if (cqm_attrs->GetU32AttributeValue(NL80211_ATTR_CQM_RSSI_THRESHOLD_EVENT,
-                                      &trigger_state)) {
+  if (cqm_attrs.GetU32AttributeValue(NL80211_ATTR_CQM_RSSI_THRESHOLD_EVENT,
+                                     &trigger_state)) {
     SLOG(this, 3) << "CQM NL80211_ATTR_CQM_RSSI_THRESHOLD_EVENT event found.";
     return;
   }
@@ -143,8 +144,8 @@ void WiFiCQM::OnCQMNotify(const Nl80211Message& nl80211_message) {
   }
 
   uint32_t packet_loss;
-  if (cqm_attrs->GetU32AttributeValue(NL80211_ATTR_CQM_PKT_LOSS_EVENT,
-                                      &packet_loss)) {
+  if (cqm_attrs.GetU32AttributeValue(NL80211_ATTR_CQM_PKT_LOSS_EVENT,
+                                     &packet_loss)) {
     SLOG(this, 3) << "CQM Packet loss event received, total packet losses: "
                   << packet_loss;
     metrics_->SendEnumToUMA(Metrics::kMetricWiFiCQMNotification,
@@ -153,9 +154,7 @@ void WiFiCQM::OnCQMNotify(const Nl80211Message& nl80211_message) {
     return;
   }
 
-  bool beacon_flag;
-  if (cqm_attrs->GetFlagAttributeValue(NL80211_ATTR_CQM_BEACON_LOSS_EVENT,
-                                       &beacon_flag)) {
+  if (cqm_attrs.IsFlagAttributeTrue(NL80211_ATTR_CQM_BEACON_LOSS_EVENT)) {
     SLOG(this, 3) << "CQM notification for Beacon loss observed.";
     metrics_->SendEnumToUMA(Metrics::kMetricWiFiCQMNotification,
                             Metrics::kWiFiCQMBeaconLoss, Metrics::kWiFiCQMMax);
@@ -381,10 +381,13 @@ bool WiFiProvider::OnEndpointAdded(const WiFiEndpointConstRefPtr& endpoint) {
     SLOG(this, 1) << asgn_endpoint_log;
   }
 
+  const bool batched = AddToEndpointBatch(service);
   service->AddEndpoint(endpoint);
   service_by_endpoint_[endpoint.get()] = service;
 
-  manager_->UpdateService(service);
+  if (!batched) {
+    manager_->UpdateService(service);
+  }
   // Return whether the service has already matched with a set of credentials
   // or not.
   return service->parent_credentials() != nullptr;
@@ -405,6 +408,7 @@ WiFiServiceRefPtr WiFiProvider::OnEndpointRemoved(
       "Removed endpoint %s from service %s", endpoint->bssid_string().c_str(),
       service->log_name().c_str());
 
+  const bool batched = AddToEndpointBatch(service);
   service->RemoveEndpoint(endpoint);
   service_by_endpoint_.erase(endpoint.get());
 
@@ -417,7 +421,9 @@ WiFiServiceRefPtr WiFiProvider::OnEndpointRemoved(
   if (service->HasEndpoints() || service->IsRemembered()) {
     // Keep services around if they are in a profile or have remaining
     // endpoints.
-    manager_->UpdateService(service);
+    if (!batched) {
+      manager_->UpdateService(service);
+    }
     return nullptr;
   }
 
@@ -440,6 +446,7 @@ void WiFiProvider::OnEndpointUpdated(const WiFiEndpointConstRefPtr& endpoint) {
   if (service->ssid() == endpoint->ssid() &&
       service->mode() == endpoint->network_mode() &&
       service->IsSecurityMatch(endpoint->security_mode())) {
+    AddToEndpointBatch(service);
     service->NotifyEndpointUpdated(endpoint);
     return;
   }
@@ -451,6 +458,20 @@ void WiFiProvider::OnEndpointUpdated(const WiFiEndpointConstRefPtr& endpoint) {
   OnEndpointAdded(endpoint);
 }
 
+void WiFiProvider::StartEndpointBatch() {
+  in_endpoint_batch_ = true;
+}
+
+void WiFiProvider::FinishEndpointBatch() {
+  in_endpoint_batch_ = false;
+  std::set<WiFiServiceRefPtr> services;
+  services.swap(batched_services_);
+  for (const auto& service : services) {
+    service->ResumeUpdatesFromEndpoints();
+    manager_->UpdateService(service);
+  }
+}
+
 bool WiFiProvider::OnServiceUnloaded(
     const WiFiServiceRefPtr& service,
     const PasspointCredentialsRefPtr& credentials) {
@@ -536,10 +557,23 @@ void WiFiProvider::ForgetService(const WiFiServiceRefPtr& service) {
   if (it == services_.end()) {
     return;
   }
+  if (batched_services_.erase(service)) {
+    service->ResumeUpdatesFromEndpoints();
+  }
   (*it)->ResetWiFi();
   services_.erase(it);
 }
 
+bool WiFiProvider::AddToEndpointBatch(const WiFiServiceRefPtr& service) {
+  if (!in_endpoint_batch_) {
+    return false;
+  }
+  if (batched_services_.insert(service).second) {
+    service->DeferUpdatesFromEndpoints();
+  }
+  return true;
+}
+
 void WiFiProvider::ReportRememberedNetworkCount() {
   metrics()->SendToUMA(
       Metrics::kMetricRememberedWiFiNetworkCount,
@@ -6,6 +6,7 @@
 #define SHILL_WIFI_WIFI_PROVIDER_H_
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -101,6 +102,13 @@ class WiFiProvider : public ProviderInterface {
   // the endpoint.
   virtual void OnEndpointUpdated(const WiFiEndpointConstRefPtr& endpoint);
 
+  // Called by a Device before and after it applies a batch of endpoint
+  // changes, such as the results of a scan. In between, the services are
+  // neither updated from their endpoints nor reported to the Manager for
+  // each change: this is done once per service in FinishEndpointBatch().
+  void StartEndpointBatch();
+  void FinishEndpointBatch();
+
   // Called by a WiFiService when it is unloaded and no longer visible.
   // |credentials| contains the set of Passpoint credentials of the service,
   // if any.
@@ -189,6 +197,10 @@ class WiFiProvider : public ProviderInterface {
   // services_ vector.
   void ForgetService(const WiFiServiceRefPtr& service);
 
+  // Adds |service| to the current endpoint batch and defers its updates from
+  // endpoints. Returns false if no batch is in progress.
+  bool AddToEndpointBatch(const WiFiServiceRefPtr& service);
+
   // Removes the set of credentials referenced by |credentials| from both the
   // provider and the WiFi device.
   bool RemoveCredentials(const PasspointCredentialsRefPtr& credentials);
@@ -209,6 +221,11 @@ class WiFiProvider : public ProviderInterface {
 
   bool running_;
 
+  // Services whose endpoints changed since StartEndpointBatch(), if a batch
+  // is in progress.
+  bool in_endpoint_batch_ = false;
+  std::set<WiFiServiceRefPtr> batched_services_;
+
   // Disable 802.11ac Very High Throughput (VHT) connections.
   bool disable_vht_;
 };
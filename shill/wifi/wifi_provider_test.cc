@@ -1078,6 +1078,46 @@ TEST_F(WiFiProviderTest, OnEndpointAdded) {
   EXPECT_TRUE(service1 != service0);
 }
 
+TEST_F(WiFiProviderTest, EndpointBatch) {
+  provider_.Start();
+  const std::string ssid0("an_ssid");
+  const std::vector<uint8_t> ssid0_bytes(ssid0.begin(), ssid0.end());
+  WiFiEndpointRefPtr endpoint0 =
+      MakeOpenEndpoint(ssid0, "00:00:00:00:00:00", 2412, -60);
+  WiFiEndpointRefPtr endpoint1 =
+      MakeOpenEndpoint(ssid0, "00:00:00:00:00:01", 5180, -40);
+  WiFiEndpointRefPtr endpoint2 =
+      MakeOpenEndpoint(ssid0, "00:00:00:00:00:02", 2437, -50);
+
+  // Neither the Service nor the Manager is updated for each endpoint.
+  EXPECT_CALL(manager_, RegisterService(_)).Times(1);
+  EXPECT_CALL(manager_, UpdateService(_)).Times(0);
+  provider_.StartEndpointBatch();
+  provider_.OnEndpointAdded(endpoint0);
+  provider_.OnEndpointAdded(endpoint1);
+  provider_.OnEndpointAdded(endpoint2);
+  provider_.OnEndpointRemoved(endpoint2);
+  Mock::VerifyAndClearExpectations(&manager_);
+  WiFiServiceRefPtr service0(
+      FindService(ssid0_bytes, kModeManaged, kSecurityNone));
+  ASSERT_NE(nullptr, service0);
+  EXPECT_EQ(2, service0->GetEndpointCount());
+  EXPECT_EQ(0, service0->frequency());
+
+  // Both are updated once when the batch is finished.
+  EXPECT_CALL(manager_, UpdateService(RefPtrMatch(service0))).Times(1);
+  provider_.FinishEndpointBatch();
+  Mock::VerifyAndClearExpectations(&manager_);
+  EXPECT_EQ(5180, service0->frequency());
+  EXPECT_EQ("00:00:00:00:00:01", service0->bssid());
+
+  // Endpoints are applied right away again after the batch.
+  EXPECT_CALL(manager_, UpdateService(RefPtrMatch(service0))).Times(1);
+  provider_.OnEndpointRemoved(endpoint1);
+  Mock::VerifyAndClearExpectations(&manager_);
+  EXPECT_EQ(2412, service0->frequency());
+}
+
 TEST_F(WiFiProviderTest, OnEndpointAddedWithSecurity) {
   provider_.Start();
   const std::string ssid0("an_ssid");
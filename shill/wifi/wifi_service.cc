@@ -355,6 +355,18 @@ void WiFiService::NotifyEndpointUpdated(
   UpdateFromEndpoints();
 }
 
+void WiFiService::DeferUpdatesFromEndpoints() {
+  updates_from_endpoints_deferred_ = true;
+}
+
+void WiFiService::ResumeUpdatesFromEndpoints() {
+  updates_from_endpoints_deferred_ = false;
+  if (endpoints_changed_while_deferred_) {
+    endpoints_changed_while_deferred_ = false;
+    UpdateFromEndpoints();
+  }
+}
+
 std::string WiFiService::GetStorageIdentifier() const {
   return storage_identifier_;
 }
@@ -1086,6 +1098,11 @@ void WiFiService::UpdateConnectable() {
 }
 
 void WiFiService::UpdateFromEndpoints() {
+  if (updates_from_endpoints_deferred_) {
+    endpoints_changed_while_deferred_ = true;
+    return;
+  }
+
   const WiFiEndpoint* representative_endpoint = nullptr;
 
   if (current_endpoint_) {
@@ -1637,4 +1654,12 @@ bool WiFiService::CompareWithSameTechnology(const ServiceRefPtr& service,
   return false;
 }
 
+uint64_t WiFiService::SameTechnologySortKey() const {
+  // Same criteria as CompareWithSameTechnology(): services without Passpoint
+  // credentials first, then the lowest match priority.
+  constexpr uint64_t kMaxMatchPriority = std::numeric_limits<uint32_t>::max();
+  return (static_cast<uint64_t>(parent_credentials_ == nullptr) << 32) |
+         (kMaxMatchPriority - std::min(match_priority_, kMaxMatchPriority));
+}
+
 }  // namespace shill
@@ -85,6 +85,12 @@ class WiFiService : public Service {
   // (Not necessarily the currently connected endpoint.)
   mockable void NotifyEndpointUpdated(const WiFiEndpointConstRefPtr& endpoint);
 
+  // While deferred, changes to the endpoints of the service do not update the
+  // properties derived from them. These are updated, and their changes
+  // emitted, once when ResumeUpdatesFromEndpoints() is called.
+  void DeferUpdatesFromEndpoints();
+  void ResumeUpdatesFromEndpoints();
+
   // wifi_<MAC>_<BSSID>_<mode_string>_<security_string>
   std::string GetStorageIdentifier() const override;
 
@@ -253,6 +259,7 @@ class WiFiService : public Service {
 
   bool CompareWithSameTechnology(const ServiceRefPtr& service,
                                  bool* decision) override;
+  uint64_t SameTechnologySortKey() const override;
 
  private:
   friend class WiFiServiceSecurityTest;
@@ -455,6 +462,9 @@ class WiFiService : public Service {
   WiFiRefPtr wifi_;
   std::set<WiFiEndpointConstRefPtr> endpoints_;
   WiFiEndpointConstRefPtr current_endpoint_;
+  // See DeferUpdatesFromEndpoints().
+  bool updates_from_endpoints_deferred_ = false;
+  bool endpoints_changed_while_deferred_ = false;
   const std::vector<uint8_t> ssid_;
   // Flag indicating if service disconnect is initiated by user for
   // connecting to other service.
@@ -178,6 +178,9 @@ class WiFiServiceTest : public PropertyStoreTest {
     bool decision;
     return service0->CompareWithSameTechnology(service1, &decision) && decision;
   }
+  uint64_t SameTechnologySortKey(const WiFiServiceRefPtr& service) {
+    return service->SameTechnologySortKey();
+  }
   scoped_refptr<MockWiFi> wifi() { return wifi_; }
   MockManager* mock_manager() { return &mock_manager_; }
   MockWiFiProvider* provider() { return &provider_; }
@@ -2228,6 +2231,32 @@ TEST_F(WiFiServiceTest, CompareWithSameTechnology) {
   EXPECT_FALSE(SortingOrderIs(a, b));
 }
 
+TEST_F(WiFiServiceTest, SameTechnologySortKeyMatchesCompare) {
+  PasspointCredentialsRefPtr credentials = new PasspointCredentials("an_id");
+
+  // Services without Passpoint credentials, then with credentials and
+  // decreasing match priorities.
+  std::vector<WiFiServiceRefPtr> services;
+  services.push_back(MakeServiceWithWiFi(kSecurity8021x));
+  for (uint64_t priority : {0, 1, 2, 3}) {
+    WiFiServiceRefPtr service = MakeServiceWithWiFi(kSecurity8021x);
+    service->set_parent_credentials(credentials);
+    service->set_match_priority(priority);
+    services.push_back(service);
+  }
+
+  // A larger key must be preferred exactly when CompareWithSameTechnology()
+  // decides for the service, and equal keys when it makes no decision.
+  for (const auto& a : services) {
+    for (const auto& b : services) {
+      EXPECT_EQ(SortingOrderIs(a, b),
+                SameTechnologySortKey(a) > SameTechnologySortKey(b));
+      EXPECT_EQ(!SortingOrderIs(a, b) && !SortingOrderIs(b, a),
+                SameTechnologySortKey(a) == SameTechnologySortKey(b));
+    }
+  }
+}
+
 TEST_F(WiFiServiceTest, ConnectionAttemptInfoSuccess) {
   WiFiEndpointRefPtr ep = MakeOpenEndpoint("a", "00:00:00:00:00:01", 0, 0);
   WiFiServiceRefPtr service = MakeServiceWithWiFi(kSecurityNone);
@@ -75,6 +75,7 @@
 #include "shill/wifi/passpoint_credentials.h"
 #include "shill/wifi/wake_on_wifi.h"
 #include "shill/wifi/wifi_endpoint.h"
+#include "shill/wifi/wifi_provider.h"
 #include "shill/wifi/wifi_service.h"
 
 using ::testing::_;
@@ -664,6 +665,8 @@ class WiFiObjectTest : public ::testing::TestWithParam<std::string> {
   }
 
   void SetUp() override {
+    saved_log_scopes_ = ScopeLogger::GetInstance()->GetEnabledScopeNames();
+    saved_log_verbose_level_ = ScopeLogger::GetInstance()->verbose_level();
     // EnableScopes... so that we can EXPECT_CALL for scoped log messages.
     ScopeLogger::GetInstance()->EnableScopesByName("wifi");
     ScopeLogger::GetInstance()->set_verbose_level(3);
@@ -686,9 +689,9 @@ class WiFiObjectTest : public ::testing::TestWithParam<std::string> {
     // services reference a WiFi instance, creating a cycle.)
     wifi_->Stop(nullptr, ResultCallback());
     wifi_->set_dhcp_provider(nullptr);
-    // Reset scope logging, to avoid interfering with other tests.
-    ScopeLogger::GetInstance()->EnableScopesByName("-wifi");
-    ScopeLogger::GetInstance()->set_verbose_level(0);
+    // Restore scope logging, to avoid interfering with other tests.
+    ScopeLogger::GetInstance()->EnableScopesByName(saved_log_scopes_);
+    ScopeLogger::GetInstance()->set_verbose_level(saved_log_verbose_level_);
   }
 
   // Needs to be public since it is called via Invoke().
@@ -899,6 +902,8 @@ class WiFiObjectTest : public ::testing::TestWithParam<std::string> {
   const WiFi::EndpointMap& GetEndpointMap() {
     return wifi_->endpoint_by_rpcid_;
   }
+  void SetWiFiProvider(WiFiProvider* provider) { wifi_->provider_ = provider; }
+  void ResetWiFiProvider() { wifi_->provider_ = &wifi_provider_; }
   const WiFiServiceRefPtr& GetPendingService() {
     return wifi_->pending_service_;
   }
@@ -1333,6 +1338,10 @@ class WiFiObjectTest : public ::testing::TestWithParam<std::string> {
   MockSupplicantEAPStateHandler* eap_state_handler_;
 
  private:
+  // Scope logging state before the test, restored on TearDown().
+  std::string saved_log_scopes_;
+  int saved_log_verbose_level_;
+
   std::unique_ptr<SupplicantInterfaceProxyInterface>
   CreateSupplicantInterfaceProxy(SupplicantEventDelegateInterface* delegate,
                                  const RpcIdentifier& object_path) {
@@ -4818,7 +4827,8 @@ TEST_F(WiFiMainTest, TriggerPassiveScan_HasResults) {
 
 TEST_F(WiFiMainTest, PendingScanEvents) {
   // This test essentially performs ReportBSS(), but ensures that the
-  // WiFi object successfully dispatches events in order.
+  // WiFi object successfully dispatches events in order, skipping the
+  // additions superseded by a later event for the same BSS.
   StartWiFi();
   BSSAdded(RpcIdentifier("bss0"),
            CreateBSSProperties("ssid0", "00:00:00:00:00:00", 0, 0,
@@ -4836,11 +4846,9 @@ TEST_F(WiFiMainTest, PendingScanEvents) {
   WiFiEndpointRefPtr ap2 = MakeEndpoint("ssid2", "00:00:00:00:00:02");
 
   InSequence seq;
-  EXPECT_CALL(*wifi_provider(), OnEndpointAdded(EndpointMatch(ap0)));
+  EXPECT_CALL(*wifi_provider(), OnEndpointAdded(EndpointMatch(ap0))).Times(0);
+  EXPECT_CALL(*wifi_provider(), OnEndpointRemoved(_)).Times(0);
   EXPECT_CALL(*wifi_provider(), OnEndpointAdded(EndpointMatch(ap1)));
-  WiFiServiceRefPtr null_service;
-  EXPECT_CALL(*wifi_provider(), OnEndpointRemoved(EndpointMatch(ap0)))
-      .WillOnce(Return(null_service));
   EXPECT_CALL(*wifi_provider(), OnEndpointAdded(EndpointMatch(ap2)));
   event_dispatcher_->DispatchPendingEvents();
   Mock::VerifyAndClearExpectations(wifi_provider());
@@ -4849,6 +4857,101 @@ TEST_F(WiFiMainTest, PendingScanEvents) {
   EXPECT_EQ(2, endpoints_by_rpcid.size());
 }
 
+TEST_F(WiFiMainTest, PendingScanEventsBatchedUntilScanDone) {
+  StartWiFi();
+  SetScanState(WiFi::kScanScanning, WiFi::kScanMethodFull, __func__);
+  BSSAdded(RpcIdentifier("bss0"),
+           CreateBSSProperties("ssid0", "00:00:00:00:00:00", 0, 0,
+                               kNetworkModeInfrastructure));
+  BSSAdded(RpcIdentifier("bss0"),
+           CreateBSSProperties("ssid1", "00:00:00:00:00:01", 0, 0,
+                               kNetworkModeInfrastructure));
+
+  // The results are held back while the scan is in progress.
+  EXPECT_CALL(*wifi_provider(), OnEndpointAdded(_)).Times(0);
+  event_dispatcher_->DispatchPendingEvents();
+  Mock::VerifyAndClearExpectations(wifi_provider());
+
+  // Only the last event for the BSS is applied once the scan is done.
+  WiFiEndpointRefPtr ap1 = MakeEndpoint("ssid1", "00:00:00:00:00:01");
+  EXPECT_CALL(*wifi_provider(), OnEndpointAdded(EndpointMatch(ap1)));
+  ScanDone(true);
+  event_dispatcher_->DispatchPendingEvents();
+  Mock::VerifyAndClearExpectations(wifi_provider());
+
+  EXPECT_EQ(1, GetEndpointMap().size());
+  VerifyScanState(WiFi::kScanIdle, WiFi::kScanMethodNone);
+}
+
+// Applies the results of a scan in a dense environment, 400 BSSes spread over
+// 100 SSIDs added then removed through a WiFiProvider, first one event at a
+// time, then all the events in one batch. Services are reported to the Manager
+// once per batch that changes their endpoints.
+TEST_F(WiFiMainTest, PendingScanEventsBatchServiceUpdates) {
+  constexpr int kNumBSSes = 400;
+  constexpr int kNumSSIDs = 100;
+
+  StartWiFi();
+  event_dispatcher_->DispatchPendingEvents();
+  // Apply the results as soon as they are dispatched rather than holding
+  // them back until the initial scan is done.
+  SetScanState(WiFi::kScanIdle, WiFi::kScanMethodNone, __func__);
+  WiFiProvider provider(manager());
+  provider.Start();
+  SetWiFiProvider(&provider);
+
+  int num_updates = 0;
+  EXPECT_CALL(*manager(), RegisterService(_)).Times(AnyNumber());
+  EXPECT_CALL(*manager(), DeregisterService(_)).Times(AnyNumber());
+  EXPECT_CALL(*manager(), UpdateService(_))
+      .WillRepeatedly(InvokeWithoutArgs([&num_updates]() { ++num_updates; }));
+  EXPECT_CALL(*control_interface(), CreateSupplicantBSSProxy(_, _))
+      .Times(AnyNumber());
+
+  std::vector<std::pair<RpcIdentifier, KeyValueStore>> scan;
+  for (int i = 0; i < kNumBSSes; ++i) {
+    scan.emplace_back(
+        RpcIdentifier(base::StringPrintf("bss%d", i)),
+        CreateBSSProperties(
+            base::StringPrintf("ssid%d", i % kNumSSIDs),
+            base::StringPrintf("00:00:00:00:%02x:%02x", i >> 8, i & 0xff),
+            -30 - i % 60, 2412 + 5 * (i % 13), kNetworkModeInfrastructure));
+  }
+
+  // Returns the number of Service updates reported to the Manager.
+  auto add_and_remove = [&](bool batched) {
+    num_updates = 0;
+    for (const auto& [path, properties] : scan) {
+      BSSAdded(path, properties);
+      if (!batched) {
+        event_dispatcher_->DispatchPendingEvents();
+      }
+    }
+    event_dispatcher_->DispatchPendingEvents();
+    EXPECT_EQ(kNumBSSes, GetEndpointMap().size());
+
+    for (const auto& [path, properties] : scan) {
+      BSSRemoved(path);
+      if (!batched) {
+        event_dispatcher_->DispatchPendingEvents();
+      }
+    }
+    event_dispatcher_->DispatchPendingEvents();
+    EXPECT_TRUE(GetEndpointMap().empty());
+    return num_updates;
+  };
+
+  // Every addition, and every removal but the last of each service, updates
+  // the service.
+  EXPECT_EQ(2 * kNumBSSes - kNumSSIDs, add_and_remove(false));
+  // Each service is updated once for its additions. It is deregistered
+  // rather than updated when its endpoints are removed.
+  EXPECT_EQ(kNumSSIDs, add_and_remove(true));
+
+  provider.Stop();
+  ResetWiFiProvider();
+}
+
 TEST_F(WiFiMainTest, ParseWiphyIndex_Success) {
   // Verify that the wiphy index in kNewWiphyNlMsg is parsed, and that the flag
   // for having the wiphy index is set by ParseWiphyIndex.
@@ -13,11 +13,13 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <base/bits.h>
 #include <base/check.h>
 #include <base/check_op.h>
 #include <base/logging.h>
+#include <base/threading/simple_thread.h>
 #include <crypto/secure_hash.h>
 #include <crypto/sha2.h>
 
@@ -164,6 +166,13 @@ int dm_bht_create(struct dm_bht* bht,
 
   bht->have_salt = false;
   bht->externally_allocated = false;
+  bht->cache_max_entries = 0;
+  bht->cache_entries = 0;
+  bht->cache_hits = 0;
+  bht->cache_misses = 0;
+  bht->lru_head = NULL;
+  bht->lru_tail = NULL;
+  bht->pinned_blocks = NULL;
 
   bht->digest_size = crypto::kSHA256Length;
   /* We expect to be able to pack >=2 hashes into a page */
@@ -349,6 +358,110 @@ void dm_bht_read_completed(struct dm_bht_entry* entry, int status) {
 
 namespace {
 
+/*-----------------------------------------------
+ * Verification cache
+ *-----------------------------------------------*/
+
+bool dm_bht_lru_linked(struct dm_bht* bht, struct dm_bht_entry* entry) {
+  return entry->lru_prev || bht->lru_head == entry;
+}
+
+void dm_bht_lru_unlink(struct dm_bht* bht, struct dm_bht_entry* entry) {
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    bht->lru_head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    bht->lru_tail = entry->lru_prev;
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+void dm_bht_lru_push_front(struct dm_bht* bht, struct dm_bht_entry* entry) {
+  entry->lru_prev = NULL;
+  entry->lru_next = bht->lru_head;
+  if (bht->lru_head)
+    bht->lru_head->lru_prev = entry;
+  else
+    bht->lru_tail = entry;
+  bht->lru_head = entry;
+}
+
+/* Marks @entry as most recently used, if it is in the cache. */
+void dm_bht_lru_touch(struct dm_bht* bht, struct dm_bht_entry* entry) {
+  if (!dm_bht_lru_linked(bht, entry) || bht->lru_head == entry)
+    return;
+  dm_bht_lru_unlink(bht, entry);
+  dm_bht_lru_push_front(bht, entry);
+}
+
+/* Returns true if @entry may be released: it is verified, it is not the
+ * root entry, and no populated block still waiting to be verified needs it.
+ */
+bool dm_bht_entry_evictable(struct dm_bht* bht, struct dm_bht_entry* entry) {
+  struct dm_bht_level* root_level = dm_bht_get_level(bht, 0);
+
+  if (entry->state != DM_BHT_ENTRY_VERIFIED || entry->pins)
+    return false;
+  return entry < root_level->entries ||
+         entry >= root_level->entries + root_level->count;
+}
+
+/* Pins (@delta is 1) or unpins (@delta is -1) every entry on the path from
+ * @block to the root. The whole path is pinned, not only the entries that
+ * verification will walk, so that unpinning undoes exactly what pinning did
+ * whatever was verified in between.
+ */
+void dm_bht_pin_path(struct dm_bht* bht, unsigned int block, int delta) {
+  int depth;
+
+  for (depth = bht->depth - 1; depth >= 0; --depth) {
+    struct dm_bht_entry* entry = dm_bht_get_entry(bht, depth, block);
+    if (delta > 0)
+      ++entry->pins;
+    else if (entry->pins)
+      --entry->pins;
+  }
+}
+
+/* Returns whether the path of @block is pinned, and records whether it is
+ * from now on as @pinned.
+ */
+bool dm_bht_set_block_pinned(struct dm_bht* bht,
+                             unsigned int block,
+                             bool pinned) {
+  uint8_t* byte = &bht->pinned_blocks[block / 8];
+  const uint8_t bit = 1 << (block % 8);
+  const bool was_pinned = *byte & bit;
+
+  if (pinned)
+    *byte |= bit;
+  else
+    *byte &= ~bit;
+  return was_pinned;
+}
+
+/* Releases least recently used entries until the cache fits its budget. */
+void dm_bht_cache_trim(struct dm_bht* bht) {
+  struct dm_bht_entry* entry = bht->lru_tail;
+
+  if (!bht->cache_max_entries)
+    return;
+  while (entry && bht->cache_entries > bht->cache_max_entries) {
+    struct dm_bht_entry* prev = entry->lru_prev;
+    if (dm_bht_entry_evictable(bht, entry)) {
+      dm_bht_lru_unlink(bht, entry);
+      free(entry->nodes);
+      entry->nodes = NULL;
+      entry->state = DM_BHT_ENTRY_UNALLOCATED;
+      --bht->cache_entries;
+    }
+    entry = prev;
+  }
+}
+
 /* dm_bht_verify_path
  * Verifies the path. Returns 0 on ok.
  */
@@ -371,6 +484,7 @@ int dm_bht_verify_path(struct dm_bht* bht,
      * are already populated (i.e. READY) via dm_bht_populate.
      */
     CHECK_GE(state, DM_BHT_ENTRY_READY);
+    dm_bht_lru_touch(bht, entry);
     node = dm_bht_get_node(bht, entry, depth, block);
 
     if (dm_bht_compute_hash(bht, buffer, digest) ||
@@ -487,6 +601,10 @@ int dm_bht_populate(struct dm_bht* bht, void* ctx, unsigned int block) {
     if (state == DM_BHT_ENTRY_UNALLOCATED)
       entry->state = DM_BHT_ENTRY_PENDING;
 
+    if (state > DM_BHT_ENTRY_UNALLOCATED) {
+      ++bht->cache_hits;
+      dm_bht_lru_touch(bht, entry);
+    }
     if (state == DM_BHT_ENTRY_VERIFIED)
       break;
     if (state <= DM_BHT_ENTRY_ERROR)
@@ -501,6 +619,9 @@ int dm_bht_populate(struct dm_bht* bht, void* ctx, unsigned int block) {
 
     /* dm-bht guarantees page-aligned memory for callbacks. */
     entry->nodes = buffer;
+    ++bht->cache_misses;
+    ++bht->cache_entries;
+    dm_bht_lru_push_front(bht, entry);
 
     /* TODO(wad) error check callback here too */
 
@@ -510,6 +631,16 @@ int dm_bht_populate(struct dm_bht* bht, void* ctx, unsigned int block) {
                  entry->nodes, to_sector(PAGE_SIZE), entry);
   }
 
+  /* Keep the path loaded until @block is verified. */
+  if (!bht->pinned_blocks) {
+    bht->pinned_blocks =
+        static_cast<uint8_t*>(calloc((bht->block_count + 7) / 8, 1));
+    if (!bht->pinned_blocks)
+      goto nomem;
+  }
+  if (!dm_bht_set_block_pinned(bht, block, true))
+    dm_bht_pin_path(bht, block, 1);
+  dm_bht_cache_trim(bht);
   return 0;
 
 error_state:
@@ -537,9 +668,51 @@ int dm_bht_verify_block(struct dm_bht* bht,
                         unsigned int block,
                         const uint8_t* buffer,
                         unsigned int offset) {
+  int r;
+
   CHECK_EQ(offset, 0);
 
-  return dm_bht_verify_path(bht, block, buffer);
+  r = dm_bht_verify_path(bht, block, buffer);
+  /* Only a successful dm_bht_populate() of @block pinned its path. */
+  if (bht->pinned_blocks && dm_bht_set_block_pinned(bht, block, false))
+    dm_bht_pin_path(bht, block, -1);
+  dm_bht_cache_trim(bht);
+  return r;
+}
+
+/**
+ * dm_bht_set_cache_size - bounds the number of entries kept for verification
+ * @bht: pointer to a dm_bht_create()d bht
+ * @max_entries: maximum number of entries (pages) loaded by dm_bht_populate
+ *               to keep; 0 keeps all of them
+ *
+ * Repeated random-access verification touches each interior entry only once
+ * as long as it stays cached. Released entries are loaded and verified again
+ * by the next dm_bht_populate() that needs them, so callers must populate
+ * each block before verifying it. A successful dm_bht_populate() keeps the
+ * path of its block loaded until the next dm_bht_verify_block() of that
+ * block, so any number of blocks may be populated before being verified; the
+ * cache then grows beyond @max_entries until they are.
+ *
+ * Nothing in this tree verifies blocks: verity only computes hash trees. The
+ * bound is meant for users of libdm-bht that verify images in userspace.
+ */
+void dm_bht_set_cache_size(struct dm_bht* bht, unsigned int max_entries) {
+  bht->cache_max_entries = max_entries;
+  dm_bht_cache_trim(bht);
+}
+
+/**
+ * dm_bht_cache_stats - returns verification cache counters
+ * @bht: pointer to a dm_bht_create()d bht
+ * @hits: number of entries dm_bht_populate found already loaded
+ * @misses: number of entries dm_bht_populate had to load
+ */
+void dm_bht_cache_stats(const struct dm_bht* bht,
+                        uint64_t* hits,
+                        uint64_t* misses) {
+  *hits = bht->cache_hits;
+  *misses = bht->cache_misses;
 }
 
 /**
@@ -576,6 +749,8 @@ int dm_bht_destroy(struct dm_bht* bht) {
     bht->levels[depth].entries = NULL;
   }
   free(bht->levels);
+  free(bht->pinned_blocks);
+  bht->pinned_blocks = NULL;
   return 0;
 }
 
@@ -609,33 +784,120 @@ void dm_bht_set_buffer(struct dm_bht* bht, void* buffer) {
  * hashes below.
  */
 int dm_bht_compute(struct dm_bht* bht) {
+  return dm_bht_compute_parallel(bht, 1);
+}
+
+namespace {
+
+/* dm_bht_compute_entries
+ * Computes the hashes of entries [@first, @last) at @depth from the hashes
+ * at @depth + 1. Entries do not share children, so disjoint ranges of the
+ * same level may be computed concurrently. Returns 0 on success.
+ */
+int dm_bht_compute_entries(struct dm_bht* bht,
+                           int depth,
+                           unsigned int first,
+                           unsigned int last) {
+  struct dm_bht_level* level = dm_bht_get_level(bht, depth);
+  struct dm_bht_level* child_level = level + 1;
+  struct dm_bht_entry* entry = level->entries + first;
+  struct dm_bht_entry* child =
+      child_level->entries + first * bht->node_count;
+  unsigned int i, j;
+  int r;
+
+  for (i = first; i < last; i++, entry++) {
+    unsigned int count = bht->node_count;
+
+    memset(entry->nodes, 0, PAGE_SIZE);
+    entry->state = DM_BHT_ENTRY_READY;
+
+    if (i == (level->count - 1))
+      count = child_level->count % bht->node_count;
+    if (count == 0)
+      count = bht->node_count;
+    for (j = 0; j < count; j++, child++) {
+      uint8_t* digest = dm_bht_node(bht, entry, j);
+
+      r = dm_bht_compute_hash(bht, child->nodes, digest);
+      if (r) {
+        DLOG(ERROR) << "Failed to update (d=" << depth << ",i=" << i << ")";
+        return r;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Computes a contiguous range of entries of one level on a worker thread. */
+class ComputeEntriesDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  ComputeEntriesDelegate(struct dm_bht* bht,
+                         int depth,
+                         unsigned int first,
+                         unsigned int last)
+      : bht_(bht), depth_(depth), first_(first), last_(last) {}
+  ComputeEntriesDelegate(const ComputeEntriesDelegate&) = delete;
+  ComputeEntriesDelegate& operator=(const ComputeEntriesDelegate&) = delete;
+
+  void Run() override {
+    result_ = dm_bht_compute_entries(bht_, depth_, first_, last_);
+  }
+
+  int result() const { return result_; }
+
+ private:
+  struct dm_bht* const bht_;
+  const int depth_;
+  const unsigned int first_;
+  const unsigned int last_;
+  int result_ = 0;
+};
+
+}  // namespace
+
+/**
+ * dm_bht_compute_parallel - dm_bht_compute() using up to @threads threads
+ * @bht: pointer to a dm_bht_create()d bht
+ * @threads: maximum number of threads hashing each level
+ *
+ * Returns 0 on success, and <0 when an error has occurred.
+ *
+ * Levels are computed one after another from the bottom up, the entries of
+ * each level are split between the threads. The result is identical to
+ * dm_bht_compute().
+ */
+int dm_bht_compute_parallel(struct dm_bht* bht, unsigned int threads) {
   int depth, r = 0;
 
   for (depth = bht->depth - 2; depth >= 0; depth--) {
     struct dm_bht_level* level = dm_bht_get_level(bht, depth);
-    struct dm_bht_level* child_level = level + 1;
-    struct dm_bht_entry* entry = level->entries;
-    struct dm_bht_entry* child = child_level->entries;
-    unsigned int i, j;
-
-    for (i = 0; i < level->count; i++, entry++) {
-      unsigned int count = bht->node_count;
-
-      memset(entry->nodes, 0, PAGE_SIZE);
-      entry->state = DM_BHT_ENTRY_READY;
-
-      if (i == (level->count - 1))
-        count = child_level->count % bht->node_count;
-      if (count == 0)
-        count = bht->node_count;
-      for (j = 0; j < count; j++, child++) {
-        uint8_t* digest = dm_bht_node(bht, entry, j);
-
-        r = dm_bht_compute_hash(bht, child->nodes, digest);
-        if (r) {
-          DLOG(ERROR) << "Failed to update (d=" << depth << ",i=" << i << ")";
-          goto out;
-        }
+    unsigned int workers = std::min(std::max(threads, 1u), level->count);
+
+    if (workers == 1) {
+      r = dm_bht_compute_entries(bht, depth, 0, level->count);
+      if (r)
+        goto out;
+      continue;
+    }
+
+    std::vector<std::unique_ptr<ComputeEntriesDelegate>> delegates;
+    std::vector<std::unique_ptr<base::DelegateSimpleThread>> workers_threads;
+    unsigned int per_worker = DIV_ROUND_UP(level->count, workers);
+    for (unsigned int first = 0; first < level->count; first += per_worker) {
+      unsigned int last = std::min(first + per_worker, level->count);
+      delegates.push_back(
+          std::make_unique<ComputeEntriesDelegate>(bht, depth, first, last));
+      workers_threads.push_back(std::make_unique<base::DelegateSimpleThread>(
+          delegates.back().get(), "dm_bht_compute"));
+      workers_threads.back()->Start();
+    }
+    for (auto& worker : workers_threads)
+      worker->Join();
+    for (const auto& delegate : delegates) {
+      if (delegate->result()) {
+        r = delegate->result();
+        goto out;
       }
     }
   }
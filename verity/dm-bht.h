@@ -65,6 +65,15 @@ struct dm_bht_entry {
   // NOLINTNEXTLINE(readability/multiline_comment)
   uint8_t* nodes; /* The hash data used to verify the children.
                    * Guaranteed to be page-aligned. */
+  /* Position in the verification cache LRU list (only for entries loaded
+   * by dm_bht_populate).
+   */
+  struct dm_bht_entry* lru_prev;
+  struct dm_bht_entry* lru_next;
+  /* Number of populated blocks that are not verified yet and whose path to
+   * the root goes through this entry. Pinned entries are never released.
+   */
+  unsigned int pins;
 };
 
 /* dm_bht_level
@@ -123,6 +132,21 @@ struct dm_bht {
   dm_bht_callback read_cb;
   /* True if the buffers are externally allocated. */
   bool externally_allocated;
+
+  /* Verification cache of entries loaded by dm_bht_populate. When
+   * cache_max_entries is non-zero, verified entries beyond it are released
+   * in least recently used order, and loaded again when needed.
+   */
+  unsigned int cache_max_entries; /* 0 means unbounded */
+  unsigned int cache_entries;     /* entries currently loaded */
+  uint64_t cache_hits;            /* entries found loaded by populate */
+  uint64_t cache_misses;          /* entries loaded by populate */
+  struct dm_bht_entry* lru_head;  /* most recently used */
+  struct dm_bht_entry* lru_tail;  /* least recently used */
+  /* Bitmap of the blocks whose path is pinned: populated by dm_bht_populate
+   * and not verified yet. Allocated by the first dm_bht_populate.
+   */
+  uint8_t* pinned_blocks;
 };
 
 /* Constructor for struct dm_bht instances. */
@@ -167,6 +191,17 @@ int dm_bht_zeroread_callback(void* ctx,
 BRILLO_EXPORT
 void dm_bht_read_completed(struct dm_bht_entry* entry, int status);
 
+/* Bounds the number of tree entries kept loaded for verification. The root
+ * entry and entries on the path of a block populated but not yet verified
+ * are never released.
+ */
+BRILLO_EXPORT
+void dm_bht_set_cache_size(struct dm_bht* bht, unsigned int max_entries);
+BRILLO_EXPORT
+void dm_bht_cache_stats(const struct dm_bht* bht,
+                        uint64_t* hits,
+                        uint64_t* misses);
+
 int dm_bht_compute_hash(struct dm_bht* bht,
                         const uint8_t* buffer,
                         uint8_t* digest);
@@ -177,6 +212,11 @@ int dm_bht_compute_hash(struct dm_bht* bht,
  */
 BRILLO_EXPORT
 int dm_bht_compute(struct dm_bht* bht);
+/* Same as dm_bht_compute(), splitting each level across up to @threads
+ * threads. Produces byte-identical trees.
+ */
+BRILLO_EXPORT
+int dm_bht_compute_parallel(struct dm_bht* bht, unsigned int threads);
 BRILLO_EXPORT
 void dm_bht_set_buffer(struct dm_bht* bht, void* buffer);
 BRILLO_EXPORT
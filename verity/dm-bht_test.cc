@@ -125,6 +125,17 @@ class MemoryBhtTest : public ::testing::Test {
   void SetupBht(const unsigned int total_blocks,
                 const char* digest_algorithm,
                 const char* salt) {
+    SetupUnpopulatedBht(total_blocks, digest_algorithm, salt);
+
+    // Load the tree from the pre-populated hash data
+    unsigned int blocks;
+    for (blocks = 0; blocks < total_blocks; blocks += bht_->node_count)
+      EXPECT_GE(dm_bht_populate(bht_, reinterpret_cast<void*>(this), blocks),
+                0);
+  }
+  void SetupUnpopulatedBht(const unsigned int total_blocks,
+                           const char* digest_algorithm,
+                           const char* salt) {
     if (bht_)
       delete bht_;
     bht_ = new dm_bht;
@@ -138,12 +149,6 @@ class MemoryBhtTest : public ::testing::Test {
 
     SetupHash(total_blocks, digest_algorithm, salt, &hash_data_[0]);
     dm_bht_set_read_cb(bht_, MemoryBhtTest::ReadCallback);
-
-    // Load the tree from the pre-populated hash data
-    unsigned int blocks;
-    for (blocks = 0; blocks < total_blocks; blocks += bht_->node_count)
-      EXPECT_GE(dm_bht_populate(bht_, reinterpret_cast<void*>(this), blocks),
-                0);
   }
 
   struct dm_bht* bht_;
@@ -173,6 +178,110 @@ TEST_F(MemoryBhtTest, CreateThenVerifyOk) {
   free(zero_page);
 }
 
+TEST_F(MemoryBhtTest, CreateThenVerifyBoundedCache) {
+  static const unsigned int total_blocks = 16384;
+  static const unsigned int kCacheSize = 8;
+  // Set the root hash for a 0-filled image
+  static const char kRootDigest[] =
+      "45d65d6f9e5a962f4d80b5f1bd7a918152251c27bdad8c5f52b590c129833372";
+  // A page of all zeros
+  uint8_t* zero_page = static_cast<uint8_t*>(my_memalign(PAGE_SIZE, PAGE_SIZE));
+
+  memset(zero_page, 0, PAGE_SIZE);
+
+  SetupUnpopulatedBht(total_blocks, "sha256", NULL);
+  dm_bht_set_root_hexdigest(bht_,
+                            reinterpret_cast<const uint8_t*>(kRootDigest));
+  dm_bht_set_cache_size(bht_, kCacheSize);
+
+  // Verify twice, populating every block right before verifying it.
+  for (int pass = 0; pass < 2; ++pass) {
+    for (unsigned int blocks = 0; blocks < total_blocks; ++blocks) {
+      EXPECT_GE(dm_bht_populate(bht_, reinterpret_cast<void*>(this), blocks),
+                0);
+      EXPECT_EQ(0, dm_bht_verify_block(bht_, blocks, zero_page, 0));
+    }
+    EXPECT_LE(bht_->cache_entries, kCacheSize);
+  }
+
+  // The root entry is loaded once. Every leaf entry is loaded once per pass
+  // and is found loaded for the rest of the blocks it covers; the root entry
+  // is found loaded whenever a leaf entry is loaded after it.
+  uint64_t hits, misses;
+  dm_bht_cache_stats(bht_, &hits, &misses);
+  const unsigned int leaf_entries = total_blocks / bht_->node_count;
+  EXPECT_EQ(1 + 2 * leaf_entries, misses);
+  EXPECT_EQ(2 * total_blocks - 1, hits);
+
+  EXPECT_EQ(0, dm_bht_destroy(bht_));
+  free(zero_page);
+}
+
+TEST_F(MemoryBhtTest, BatchPopulateThenVerifyBoundedCache) {
+  static const unsigned int total_blocks = 16384;
+  static const unsigned int kCacheSize = 1;
+  // Set the root hash for a 0-filled image
+  static const char kRootDigest[] =
+      "45d65d6f9e5a962f4d80b5f1bd7a918152251c27bdad8c5f52b590c129833372";
+  // A page of all zeros
+  uint8_t* zero_page = static_cast<uint8_t*>(my_memalign(PAGE_SIZE, PAGE_SIZE));
+
+  memset(zero_page, 0, PAGE_SIZE);
+
+  SetupUnpopulatedBht(total_blocks, "sha256", NULL);
+  dm_bht_set_root_hexdigest(bht_,
+                            reinterpret_cast<const uint8_t*>(kRootDigest));
+  dm_bht_set_cache_size(bht_, kCacheSize);
+
+  // Blocks sharing leaf entries, populated all together before any of them
+  // is verified. Verifying the first block of a leaf entry must not release
+  // it while other blocks under it still wait to be verified.
+  const unsigned int node_count = bht_->node_count;
+  const std::vector<unsigned int> blocks = {
+      0, node_count, 1, 2 * node_count, node_count + 1, 2};
+  for (int pass = 0; pass < 2; ++pass) {
+    for (unsigned int block : blocks)
+      EXPECT_GE(dm_bht_populate(bht_, reinterpret_cast<void*>(this), block),
+                0);
+    for (unsigned int block : blocks)
+      EXPECT_EQ(0, dm_bht_verify_block(bht_, block, zero_page, 0));
+    // Once every block is verified, the cache is back within its budget.
+    EXPECT_LE(bht_->cache_entries, kCacheSize);
+  }
+
+  EXPECT_EQ(0, dm_bht_destroy(bht_));
+  free(zero_page);
+}
+
+TEST_F(MemoryBhtTest, VerifyUnpopulatedBlockKeepsPopulatedPath) {
+  static const unsigned int total_blocks = 16384;
+  static const unsigned int kCacheSize = 1;
+  // Set the root hash for a 0-filled image
+  static const char kRootDigest[] =
+      "45d65d6f9e5a962f4d80b5f1bd7a918152251c27bdad8c5f52b590c129833372";
+  // A page of all zeros
+  uint8_t* zero_page = static_cast<uint8_t*>(my_memalign(PAGE_SIZE, PAGE_SIZE));
+
+  memset(zero_page, 0, PAGE_SIZE);
+
+  SetupUnpopulatedBht(total_blocks, "sha256", NULL);
+  dm_bht_set_root_hexdigest(bht_,
+                            reinterpret_cast<const uint8_t*>(kRootDigest));
+  dm_bht_set_cache_size(bht_, kCacheSize);
+
+  // Block 1 shares its leaf entry with block 0, so it can be verified even
+  // though only block 0 was populated. That must not release the leaf entry
+  // block 0 still waits on.
+  EXPECT_GE(dm_bht_populate(bht_, reinterpret_cast<void*>(this), 0), 0);
+  EXPECT_EQ(0, dm_bht_verify_block(bht_, 1, zero_page, 0));
+  EXPECT_TRUE(dm_bht_is_populated(bht_, 0));
+  EXPECT_EQ(0, dm_bht_verify_block(bht_, 0, zero_page, 0));
+  EXPECT_LE(bht_->cache_entries, kCacheSize);
+
+  EXPECT_EQ(0, dm_bht_destroy(bht_));
+  free(zero_page);
+}
+
 TEST_F(MemoryBhtTest, CreateThenVerifySingleLevel) {
   static const unsigned int total_blocks = 32;
   // Set the root hash for a 0-filled image
@@ -14,6 +14,8 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,6 +23,7 @@
 #include <base/check.h>
 #include <base/files/file.h>
 #include <base/logging.h>
+#include <base/threading/simple_thread.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_util.h>
 
@@ -43,8 +46,40 @@ int64_t GetFileSize(base::File* file) {
   }
   return file->GetLength();
 }
+
+// Number of blocks read at once by the parallel hashing threads.
+constexpr unsigned int kBlocksPerRead = 64;
 }  // namespace
 
+// Runs FileHasher::HashBlocks() on a worker thread.
+class FileHasher::HashBlocksDelegate
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  HashBlocksDelegate(FileHasher* hasher,
+                     int64_t source_offset,
+                     unsigned int first,
+                     unsigned int last)
+      : hasher_(hasher),
+        source_offset_(source_offset),
+        first_(first),
+        last_(last) {}
+  HashBlocksDelegate(const HashBlocksDelegate&) = delete;
+  HashBlocksDelegate& operator=(const HashBlocksDelegate&) = delete;
+
+  void Run() override {
+    result_ = hasher_->HashBlocks(source_offset_, first_, last_);
+  }
+
+  bool result() const { return result_; }
+
+ private:
+  FileHasher* const hasher_;
+  const int64_t source_offset_;
+  const unsigned int first_;
+  const unsigned int last_;
+  bool result_ = false;
+};
+
 FileHasher::~FileHasher() {
   if (initialized_)
     dm_bht_destroy(&tree_);
@@ -100,6 +135,9 @@ bool FileHasher::Store() {
 }
 
 bool FileHasher::Hash() {
+  if (threads_ > 1)
+    return HashParallel();
+
   // TODO(wad) abstract size when dm-bht needs to do break from PAGE_SIZE
   uint8_t block_data[PAGE_SIZE];
   uint32_t block = 0;
@@ -119,6 +157,78 @@ bool FileHasher::Hash() {
   return !dm_bht_compute(&tree_);
 }
 
+bool FileHasher::HashBlocks(int64_t source_offset,
+                            unsigned int first,
+                            unsigned int last) {
+  std::vector<uint8_t> data(kBlocksPerRead * PAGE_SIZE);
+  for (unsigned int block = first; block < last; block += kBlocksPerRead) {
+    const unsigned int count = std::min(last - block, kBlocksPerRead);
+    const int size = count * PAGE_SIZE;
+    const int64_t offset =
+        source_offset + static_cast<int64_t>(block) * PAGE_SIZE;
+    // pread() based, so no shared file position between the threads. Reads
+    // may be short on block devices, so keep reading until the whole range
+    // is in.
+    for (int done = 0; done < size;) {
+      const int bytes =
+          source_->Read(offset + done,
+                        reinterpret_cast<char*>(data.data()) + done,
+                        size - done);
+      if (bytes <= 0) {
+        PLOG(ERROR) << "Failed to read for block: "
+                    << block + done / PAGE_SIZE;
+        return false;
+      }
+      done += bytes;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+      if (dm_bht_store_block(&tree_, block + i, &data[i * PAGE_SIZE])) {
+        LOG(ERROR) << "Failed to store block " << block + i;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool FileHasher::HashParallel() {
+  const int64_t source_offset = source_->Seek(base::File::FROM_CURRENT, 0);
+  if (source_offset < 0) {
+    PLOG(ERROR) << "Failed to get the source position";
+    return false;
+  }
+
+  // Leaves are independent, so each thread hashes a contiguous range of
+  // blocks. Upper levels are reduced by dm_bht_compute_parallel().
+  const unsigned int workers = std::min(threads_, std::max(block_limit_, 1u));
+  const unsigned int per_worker = (block_limit_ + workers - 1) / workers;
+  std::vector<std::unique_ptr<HashBlocksDelegate>> delegates;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> hash_threads;
+  for (unsigned int first = 0; first < block_limit_; first += per_worker) {
+    delegates.push_back(std::make_unique<HashBlocksDelegate>(
+        this, source_offset, first,
+        std::min(first + per_worker, block_limit_)));
+    hash_threads.push_back(std::make_unique<base::DelegateSimpleThread>(
+        delegates.back().get(), "verity_hash"));
+    hash_threads.back()->Start();
+  }
+  for (auto& thread : hash_threads)
+    thread->Join();
+  for (const auto& delegate : delegates) {
+    if (!delegate->result())
+      return false;
+  }
+
+  // Leave the source positioned after the hashed data, like Hash() does.
+  if (source_->Seek(base::File::FROM_BEGIN,
+                    source_offset +
+                        static_cast<int64_t>(block_limit_) * PAGE_SIZE) < 0) {
+    PLOG(ERROR) << "Failed to seek the source";
+    return false;
+  }
+  return !dm_bht_compute_parallel(&tree_, threads_);
+}
+
 void FileHasher::set_salt(const char* salt) {
   if (!strcmp(salt, "random"))
     salt = RandomSalt();
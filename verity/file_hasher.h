@@ -47,7 +47,19 @@ class BRILLO_EXPORT FileHasher {
   virtual void set_salt(const char* salt);
   virtual const char* salt(void) { return salt_; }
 
+  // Number of threads Hash() reads and hashes the blocks with. The tree is
+  // identical regardless of the number of threads.
+  virtual void set_threads(unsigned int threads) { threads_ = threads; }
+  virtual unsigned int threads(void) { return threads_; }
+
  private:
+  class HashBlocksDelegate;
+
+  // Hashes blocks [first, last) of the source at |source_offset| into the
+  // leaves of the tree. Safe to be run concurrently for disjoint ranges.
+  bool HashBlocks(int64_t source_offset, unsigned int first, unsigned int last);
+  bool HashParallel();
+
   std::unique_ptr<base::File> source_;
   std::unique_ptr<base::File> destination_;
   unsigned int block_limit_;
@@ -58,6 +70,7 @@ class BRILLO_EXPORT FileHasher {
   struct dm_bht tree_;
   sector_t sectors_;
   bool initialized_;
+  unsigned int threads_ = 1;
 
   FileHasher(const FileHasher&) = delete;
   FileHasher& operator=(const FileHasher&) = delete;
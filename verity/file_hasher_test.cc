@@ -4,10 +4,14 @@
 //
 // Tests for verity::FileHasher
 
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/rand_util.h>
 #include <gtest/gtest.h>
 
 #include "verity/file_hasher.h"
@@ -88,4 +92,40 @@ TEST_F(FileHasherTest, BadBlockSize) {
   EXPECT_FALSE(hasher.Initialize());
 }
 
+TEST_F(FileHasherTest, ParallelMatchesSerial) {
+  // A few blocks per thread, and enough for two leaf hash blocks, the last
+  // one partial.
+  constexpr unsigned int kBlocks = 128 + 5;
+  const base::FilePath source_path = temp_dir_.GetPath().Append("source.bin");
+  const std::string source_data = base::RandBytesAsString(kBlocks * PAGE_SIZE);
+  ASSERT_TRUE(base::WriteFile(source_path, source_data));
+
+  std::vector<std::string> tables;
+  std::vector<std::string> trees;
+  for (unsigned int threads : {1, 2, 3, 8}) {
+    const base::FilePath tree_path = temp_dir_.GetPath().Append(
+        "tree" + std::to_string(threads) + ".bin");
+    verity::FileHasher hasher(
+        std::make_unique<base::File>(
+            source_path, base::File::FLAG_OPEN | base::File::FLAG_READ),
+        std::make_unique<base::File>(
+            tree_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE),
+        0, kSha256HashName);
+    ASSERT_TRUE(hasher.Initialize());
+    hasher.set_salt(reinterpret_cast<const char*>(kSalt));
+    hasher.set_threads(threads);
+    EXPECT_TRUE(hasher.Hash());
+    EXPECT_TRUE(hasher.Store());
+    tables.push_back(hasher.GetTable(true));
+
+    std::string tree;
+    ASSERT_TRUE(base::ReadFileToString(tree_path, &tree));
+    trees.push_back(std::move(tree));
+  }
+  for (size_t i = 1; i < tables.size(); ++i) {
+    EXPECT_EQ(tables[0], tables[i]);
+    EXPECT_EQ(trees[0], trees[i]);
+  }
+}
+
 }  // namespace verity
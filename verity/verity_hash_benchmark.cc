@@ -0,0 +1,94 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by the GPL v2 license that can
+// be found in the LICENSE file.
+//
+// Benchmark of verity::FileHasher hashing throughput against the number of
+// hashing threads.
+//
+// Usage: verity_hash_benchmark [size_in_mib] [max_threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+
+#include <base/files/file.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/rand_util.h>
+#include <base/system/sys_info.h>
+#include <base/time/time.h>
+
+#include "verity/file_hasher.h"
+
+namespace {
+
+constexpr unsigned int kDefaultSizeMiB = 256;
+constexpr char kSalt[] =
+    "abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789";
+
+// Hashes |source_path| with |threads| threads and returns the dm table, or an
+// empty string on failure. Stores the elapsed time in |elapsed|.
+std::string HashFile(const base::FilePath& source_path,
+                     const base::FilePath& tree_path,
+                     unsigned int threads,
+                     base::TimeDelta* elapsed) {
+  verity::FileHasher hasher(
+      std::make_unique<base::File>(
+          source_path, base::File::FLAG_OPEN | base::File::FLAG_READ),
+      std::make_unique<base::File>(
+          tree_path, base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE),
+      0, verity::kSha256HashName);
+  if (!hasher.Initialize())
+    return std::string();
+  hasher.set_salt(kSalt);
+  hasher.set_threads(threads);
+
+  const base::TimeTicks start = base::TimeTicks::Now();
+  if (!hasher.Hash())
+    return std::string();
+  *elapsed = base::TimeTicks::Now() - start;
+  return hasher.GetTable(false);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const unsigned int size_mib =
+      argc > 1 ? strtoul(argv[1], nullptr, 0) : kDefaultSizeMiB;
+  const unsigned int max_threads =
+      argc > 2 ? strtoul(argv[2], nullptr, 0)
+               : base::SysInfo::NumberOfProcessors();
+
+  base::ScopedTempDir temp_dir;
+  CHECK(temp_dir.CreateUniqueTempDir());
+  const base::FilePath source_path = temp_dir.GetPath().Append("source.bin");
+  const base::FilePath tree_path = temp_dir.GetPath().Append("tree.bin");
+  {
+    base::File source(source_path,
+                      base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+    CHECK(source.IsValid());
+    const std::string chunk = base::RandBytesAsString(1024 * 1024);
+    for (unsigned int i = 0; i < size_mib; ++i) {
+      CHECK_EQ(source.WriteAtCurrentPos(chunk.data(), chunk.size()),
+               static_cast<int>(chunk.size()));
+    }
+  }
+
+  std::string serial_table;
+  printf("%8s %12s\n", "threads", "MiB/s");
+  for (unsigned int threads = 1; threads <= max_threads; ++threads) {
+    base::TimeDelta elapsed;
+    const std::string table =
+        HashFile(source_path, tree_path, threads, &elapsed);
+    CHECK(!table.empty()) << "Hashing failed with " << threads << " threads";
+    if (threads == 1)
+      serial_table = table;
+    CHECK_EQ(table, serial_table) << "Tree differs with " << threads
+                                  << " threads";
+    printf("%8u %12.1f\n", threads, size_mib / elapsed.InSecondsF());
+  }
+  return 0;
+}
@@ -11,6 +11,7 @@
 
 #include <base/files/file.h>
 #include <base/logging.h>
+#include <base/system/sys_info.h>
 #include <brillo/syslog_logging.h>
 
 #include "verity/file_hasher.h"
@@ -31,6 +32,7 @@ void print_usage(const char* name) {
       "  hashtree          Path to a hash tree to create or read from\n"
       "  root_hexdigest    Digest of the root node (in hex) for verification\n"
       "  salt              Salt (in hex)\n"
+      "  threads           Number of hashing threads (0 for one per CPU)\n"
       "\n",
       name);
 }
@@ -46,7 +48,8 @@ static int verity_create(const char* alg,
                          const char* image_path,
                          unsigned int image_blocks,
                          const char* hash_path,
-                         const char* salt);
+                         const char* salt,
+                         unsigned int threads);
 
 void splitarg(char* arg, char** key, char** val) {
   char* sp = NULL;
@@ -61,6 +64,7 @@ int main(int argc, char** argv) {
   const char* hashtree = NULL;
   const char* salt = NULL;
   unsigned int payload_blocks = 0;
+  unsigned int threads = 1;
   int i;
   char *key, *val;
 
@@ -87,6 +91,10 @@ int main(int argc, char** argv) {
       // Silently drop the mode for now...
     } else if (!strcmp(key, "salt")) {
       salt = val;
+    } else if (!strcmp(key, "threads")) {
+      threads = parse_blocks(val);
+      if (threads == 0)
+        threads = base::SysInfo::NumberOfProcessors();
     } else {
       fprintf(stderr, "bogus key: '%s'\n", key);
       print_usage(argv[0]);
@@ -102,7 +110,8 @@ int main(int argc, char** argv) {
   }
 
   if (mode == VERITY_CREATE) {
-    return verity_create(alg, payload, payload_blocks, hashtree, salt);
+    return verity_create(alg, payload, payload_blocks, hashtree, salt,
+                         threads);
   } else {
     LOG(FATAL) << "Verification not done yet";
   }
@@ -113,7 +122,8 @@ static int verity_create(const char* alg,
                          const char* image_path,
                          unsigned int image_blocks,
                          const char* hash_path,
-                         const char* salt) {
+                         const char* salt,
+                         unsigned int threads) {
   auto source = std::make_unique<base::File>(
       base::FilePath(image_path),
       base::File::FLAG_OPEN | base::File::FLAG_READ);
@@ -131,6 +141,7 @@ static int verity_create(const char* alg,
   LOG_IF(FATAL, !hasher.Initialize()) << "Failed to initialize hasher";
   if (salt)
     hasher.set_salt(salt);
+  hasher.set_threads(threads);
   LOG_IF(FATAL, !hasher.Hash()) << "Failed to hash hasher";
   LOG_IF(FATAL, !hasher.Store()) << "Failed to store hasher";
   hasher.PrintTable(true);
@@ -11,6 +11,7 @@
 #include <memory>
 #include <utility>
 
+#include <base/bind.h>
 #include <base/check.h>
 #include <base/files/file.h>
 #include <base/files/file_util.h>
@@ -20,6 +21,7 @@
 #include <base/stl_util.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/stringprintf.h>
+#include <base/system/sys_info.h>
 
 #include "vm_tools/concierge/disk_image.h"
 #include "vm_tools/concierge/plugin_vm_config.h"
@@ -31,6 +33,9 @@ namespace {
 
 constexpr gid_t kPluginVmGid = 20128;
 
+// Upper bound on the number of threads compressing an exported image.
+constexpr int kMaxExportCompressionThreads = 4;
+
 }  // namespace
 
 namespace vm_tools {
@@ -236,6 +241,7 @@ VmExportOperation::~VmExportOperation() {
   // can invoke callbacks that rely on data in this object.
   in_.reset();
   out_.reset();
+  gzip_.reset();
 }
 
 bool VmExportOperation::PrepareInput() {
@@ -281,14 +287,16 @@ bool VmExportOperation::PrepareOutput() {
       }
       break;
     case ArchiveFormat::TAR_GZ:
-      ret = archive_write_add_filter_gzip(out_.get());
-      if (ret != ARCHIVE_OK) {
-        set_failure_reason(base::StringPrintf(
-            "libarchive: failed to initialize gzip filter: %s, %s",
-            archive_error_string(out_.get()),
-            strerror(archive_errno(out_.get()))));
-        return false;
-      }
+      // libarchive's gzip filter compresses on a single thread, so the tar
+      // stream is compressed by |gzip_| instead. Holes in the image are
+      // neither read nor compressed: the disk reader finds them and the pax
+      // format stores them as sparse entries. One core is left to the main
+      // thread, which reads the image and writes the output.
+      gzip_ = std::make_unique<ParallelGzipWriter>(
+          std::clamp(base::SysInfo::NumberOfProcessors() - 1, 1,
+                     kMaxExportCompressionThreads),
+          base::BindRepeating(&VmExportOperation::WriteOutput,
+                              base::Unretained(this)));
 
       ret = archive_write_set_format_pax_restricted(out_.get());
       if (ret != ARCHIVE_OK) {
@@ -326,6 +334,14 @@ ssize_t VmExportOperation::OutputFileWriteCallback(archive* a,
                                                    size_t length) {
   VmExportOperation* op = reinterpret_cast<VmExportOperation*>(data);
 
+  if (op->gzip_) {
+    if (!op->gzip_->Write(buf, length)) {
+      archive_set_error(a, errno, "Write error");
+      return -1;
+    }
+    return length;
+  }
+
   ssize_t bytes_written = HANDLE_EINTR(write(op->out_fd_.get(), buf, length));
   if (bytes_written <= 0) {
     archive_set_error(a, errno, "Write error");
@@ -341,6 +357,17 @@ int VmExportOperation::OutputFileCloseCallback(archive* a, void* data) {
   return ARCHIVE_OK;
 }
 
+bool VmExportOperation::WriteOutput(const uint8_t* data, size_t size) {
+  if (!base::WriteFileDescriptor(
+          out_fd_.get(),
+          base::StringPiece(reinterpret_cast<const char*>(data), size))) {
+    return false;
+  }
+
+  sha256_->Update(data, size);
+  return true;
+}
+
 void VmExportOperation::MarkFailed(const char* msg, struct archive* a) {
   if (a) {
     set_status(archive_errno(a) == ENOSPC ? DISK_STATUS_NOT_ENOUGH_SPACE
@@ -357,6 +384,7 @@ void VmExportOperation::MarkFailed(const char* msg, struct archive* a) {
 
   // Release resources.
   out_.reset();
+  gzip_.reset();
   out_fd_.reset();
   out_digest_fd_.reset();
   in_.reset();
@@ -474,8 +502,14 @@ void VmExportOperation::Finalize() {
     MarkFailed("libarchive: failed to close writer", out_.get());
     return;
   }
+  if (gzip_ && !gzip_->Close()) {
+    archive_set_error(out_.get(), errno, "Compression error");
+    MarkFailed("failed to finish compressed output", out_.get());
+    return;
+  }
   // Free the output archive structures.
   out_.reset();
+  gzip_.reset();
   // Close the file descriptor.
   out_fd_.reset();
 
@@ -22,6 +22,7 @@
 #include <vm_concierge/proto_bindings/concierge_service.pb.h>
 
 #include "vm_tools/common/vm_id.h"
+#include "vm_tools/concierge/parallel_gzip_writer.h"
 
 namespace vm_tools {
 namespace concierge {
@@ -161,6 +162,10 @@ class VmExportOperation : public DiskImageOperation {
                                          size_t length);
   static int OutputFileCloseCallback(archive* a, void* data);
 
+  // Writes |size| bytes at |data| to the output file and adds them to the
+  // digest. Returns false on failure, with errno set.
+  bool WriteOutput(const uint8_t* data, size_t size);
+
   VmExportOperation(const VmId vm_id,
                     const base::FilePath disk_path,
                     base::ScopedFD out_fd,
@@ -205,6 +210,10 @@ class VmExportOperation : public DiskImageOperation {
   // Output archive format.
   ArchiveFormat out_fmt_;
 
+  // Compresses the output of TAR_GZ exports, which |out_| writes as a plain
+  // tar stream.
+  std::unique_ptr<ParallelGzipWriter> gzip_;
+
   // Hasher to generate digest of the produced image.
   std::unique_ptr<crypto::SecureHash> sha256_;
 };
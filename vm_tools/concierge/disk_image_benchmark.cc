@@ -0,0 +1,196 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the export of a sparse VM disk image to a .tar.gz file, as
+// done for Crostini. Creates a sparse image with 64 MiB of data in each GiB,
+// then compares the wall time and output size of VmExportOperation with
+// those of a single-threaded export through libarchive's gzip filter, which
+// is how VmExportOperation used to compress.
+//
+// Usage: disk_image_benchmark [image size in GiB] [directory]
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/time/time.h>
+
+#include "vm_tools/common/vm_id.h"
+#include "vm_tools/concierge/disk_image.h"
+
+namespace vm_tools {
+namespace concierge {
+namespace {
+
+constexpr int64_t kGiB = 1024 * 1024 * 1024;
+constexpr int64_t kDataPerGiB = 64 * 1024 * 1024;
+constexpr int kDefaultImageGiB = 20;
+// Same as the I/O limit of each step run by Service.
+constexpr uint64_t kIoLimit = 1024 * 1024;
+
+// Creates a |size_gib| GiB sparse image at |path| holding kDataPerGiB of data
+// that compresses to about half its size at the start of each GiB.
+bool CreateSparseImage(const base::FilePath& path, int size_gib) {
+  base::ScopedFD fd(
+      HANDLE_EINTR(open(path.value().c_str(), O_WRONLY | O_CREAT, 0600)));
+  if (!fd.is_valid() || ftruncate(fd.get(), size_gib * kGiB) < 0)
+    return false;
+
+  std::vector<uint8_t> data(kDataPerGiB);
+  uint32_t state = 1;
+  for (int i = 0; i < size_gib; i++) {
+    for (auto& byte : data) {
+      state = state * 1103515245 + 12345;
+      byte = (state >> 16) % 16;
+    }
+    if (HANDLE_EINTR(pwrite(fd.get(), data.data(), data.size(), i * kGiB)) !=
+        static_cast<ssize_t>(data.size())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Exports |image| to |out| the way VmExportOperation did before compressing
+// in parallel.
+bool ExportWithGzipFilter(const base::FilePath& image,
+                          const base::FilePath& out) {
+  ArchiveReader in(archive_read_disk_new());
+  archive_read_disk_set_behavior(
+      in.get(), ARCHIVE_READDISK_NO_TRAVERSE_MOUNTS |
+                    ARCHIVE_READDISK_NO_FFLAGS | ARCHIVE_READDISK_NO_XATTR);
+  archive_read_disk_set_symlink_physical(in.get());
+  if (archive_read_disk_open(in.get(), image.value().c_str()) != ARCHIVE_OK)
+    return false;
+
+  ArchiveWriter writer(archive_write_new());
+  if (archive_write_add_filter_gzip(writer.get()) != ARCHIVE_OK ||
+      archive_write_set_format_pax_restricted(writer.get()) != ARCHIVE_OK ||
+      archive_write_open_filename(writer.get(), out.value().c_str()) !=
+          ARCHIVE_OK) {
+    return false;
+  }
+
+  struct archive_entry* entry;
+  while (archive_read_next_header(in.get(), &entry) == ARCHIVE_OK) {
+    archive_entry_set_pathname(entry, image.BaseName().value().c_str());
+    if (archive_write_header(writer.get(), entry) != ARCHIVE_OK)
+      return false;
+
+    uint8_t buf[16384];
+    la_ssize_t count;
+    while ((count = archive_read_data(in.get(), buf, sizeof(buf))) > 0) {
+      if (archive_write_data(writer.get(), buf, count) < 0)
+        return false;
+    }
+    if (count < 0 || archive_write_finish_entry(writer.get()) != ARCHIVE_OK)
+      return false;
+  }
+  return archive_write_close(writer.get()) == ARCHIVE_OK;
+}
+
+// Exports |image| to |out| with VmExportOperation, checking that progress
+// is reported all along.
+bool ExportWithOperation(const base::FilePath& image,
+                         const base::FilePath& out) {
+  base::ScopedFD fd(HANDLE_EINTR(
+      open(out.value().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600)));
+  if (!fd.is_valid())
+    return false;
+
+  auto op = VmExportOperation::Create(VmId("benchmark", "vm"), image,
+                                      std::move(fd), base::ScopedFD(),
+                                      ArchiveFormat::TAR_GZ);
+  int progress = 0;
+  while (op->status() == DISK_STATUS_IN_PROGRESS) {
+    op->Run(kIoLimit);
+    if (op->GetProgress() < progress) {
+      LOG(ERROR) << "Progress went back from " << progress << " to "
+                 << op->GetProgress();
+      return false;
+    }
+    progress = op->GetProgress();
+  }
+  if (op->status() != DISK_STATUS_CREATED) {
+    LOG(ERROR) << "Export failed: " << op->failure_reason();
+    return false;
+  }
+  return true;
+}
+
+void Report(const char* name,
+            const base::FilePath& out,
+            base::TimeDelta elapsed) {
+  int64_t size = 0;
+  base::GetFileSize(out, &size);
+  printf("%-24s %10.2f %14lld\n", name, elapsed.InSecondsF(),
+         static_cast<long long>(size));
+}
+
+}  // namespace
+}  // namespace concierge
+}  // namespace vm_tools
+
+int main(int argc, char** argv) {
+  using vm_tools::concierge::ExportWithGzipFilter;
+  using vm_tools::concierge::ExportWithOperation;
+  using vm_tools::concierge::Report;
+
+  base::AtExitManager at_exit;
+
+  int size_gib = argc > 1 ? atoi(argv[1])
+                          : vm_tools::concierge::kDefaultImageGiB;
+  if (size_gib <= 0) {
+    fprintf(stderr, "usage: %s [image size in GiB] [directory]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  base::ScopedTempDir temp_dir;
+  bool created = argc > 2
+                     ? temp_dir.CreateUniqueTempDirUnderPath(
+                           base::FilePath(argv[2]))
+                     : temp_dir.CreateUniqueTempDir();
+  if (!created) {
+    LOG(ERROR) << "Failed to create temporary directory";
+    return EXIT_FAILURE;
+  }
+  base::FilePath image = temp_dir.GetPath().Append("disk.img");
+  if (!vm_tools::concierge::CreateSparseImage(image, size_gib)) {
+    PLOG(ERROR) << "Failed to create " << image.value();
+    return EXIT_FAILURE;
+  }
+
+  printf("%-24s %10s %14s\n", "export", "seconds", "output bytes");
+
+  base::FilePath filter_out = temp_dir.GetPath().Append("filter.tar.gz");
+  base::TimeTicks start = base::TimeTicks::Now();
+  if (!ExportWithGzipFilter(image, filter_out)) {
+    LOG(ERROR) << "Export through the gzip filter failed";
+    return EXIT_FAILURE;
+  }
+  Report("libarchive gzip filter", filter_out,
+         base::TimeTicks::Now() - start);
+
+  base::FilePath op_out = temp_dir.GetPath().Append("operation.tar.gz");
+  start = base::TimeTicks::Now();
+  if (!ExportWithOperation(image, op_out))
+    return EXIT_FAILURE;
+  Report("VmExportOperation", op_out, base::TimeTicks::Now() - start);
+
+  return EXIT_SUCCESS;
+}
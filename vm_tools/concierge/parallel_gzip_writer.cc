@@ -0,0 +1,173 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "vm_tools/concierge/parallel_gzip_writer.h"
+
+#include <errno.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/synchronization/waitable_event.h>
+
+namespace vm_tools {
+namespace concierge {
+
+namespace {
+
+// Input compressed into each gzip member. Every member restarts compression
+// from an empty dictionary, which costs well under 1% of output size at this
+// block size.
+constexpr size_t kBlockSize = 1024 * 1024;
+
+// Blocks each thread may have in flight. Bounds memory use while leaving
+// every thread with work queued up.
+constexpr size_t kBlocksPerThread = 2;
+
+}  // namespace
+
+struct ParallelGzipWriter::Block {
+  std::vector<uint8_t> input;
+  std::vector<uint8_t> output;
+  bool compressed = false;
+  base::WaitableEvent done;
+};
+
+ParallelGzipWriter::ParallelGzipWriter(size_t num_threads,
+                                       OutputCallback output)
+    : output_(std::move(output)), current_(std::make_unique<Block>()) {
+  current_->input.reserve(kBlockSize);
+
+  for (size_t i = 0; i < num_threads; i++) {
+    auto thread = std::make_unique<base::Thread>(
+        base::StringPrintf("gzip_writer_%zu", i));
+    if (!thread->Start()) {
+      LOG(WARNING) << "Failed to start compression thread " << i;
+      break;
+    }
+    threads_.push_back(std::move(thread));
+  }
+}
+
+ParallelGzipWriter::~ParallelGzipWriter() = default;
+
+bool ParallelGzipWriter::Write(const void* data, size_t size) {
+  const uint8_t* input = static_cast<const uint8_t*>(data);
+
+  while (size > 0 && !failed_) {
+    size_t count = std::min(size, kBlockSize - current_->input.size());
+    current_->input.insert(current_->input.end(), input, input + count);
+    input += count;
+    size -= count;
+
+    if (current_->input.size() == kBlockSize)
+      SubmitBlock();
+  }
+
+  if (failed_) {
+    errno = error_;
+    return false;
+  }
+  return true;
+}
+
+bool ParallelGzipWriter::Close() {
+  // An empty stream still needs one member to be a valid gzip file.
+  if (!failed_ && (!current_->input.empty() || blocks_submitted_ == 0))
+    SubmitBlock();
+
+  while (!failed_ && !pending_.empty())
+    OutputOldestBlock();
+
+  if (failed_) {
+    errno = error_;
+    return false;
+  }
+  return true;
+}
+
+// static
+void ParallelGzipWriter::CompressBlock(Block* block) {
+  z_stream stream = {};
+
+  // Adding 16 to the window bits wraps the deflate stream in a gzip header and
+  // trailer.
+  int ret = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+  if (ret != Z_OK) {
+    LOG(ERROR) << "deflateInit2 failed: " << ret;
+    block->done.Signal();
+    return;
+  }
+
+  block->output.resize(deflateBound(&stream, block->input.size()));
+  stream.next_in = block->input.data();
+  stream.avail_in = block->input.size();
+  stream.next_out = block->output.data();
+  stream.avail_out = block->output.size();
+
+  ret = deflate(&stream, Z_FINISH);
+  if (ret == Z_STREAM_END) {
+    block->output.resize(stream.total_out);
+    block->compressed = true;
+  } else {
+    LOG(ERROR) << "deflate failed: " << ret;
+  }
+  deflateEnd(&stream);
+
+  // The input is no longer needed, don't hold on to it until the block is
+  // written out.
+  std::vector<uint8_t>().swap(block->input);
+  block->done.Signal();
+}
+
+void ParallelGzipWriter::SubmitBlock() {
+  size_t max_pending = std::max<size_t>(threads_.size(), 1) * kBlocksPerThread;
+  while (!failed_ && pending_.size() >= max_pending)
+    OutputOldestBlock();
+  if (failed_)
+    return;
+
+  Block* block = current_.get();
+  if (threads_.empty()) {
+    CompressBlock(block);
+  } else {
+    threads_[blocks_submitted_ % threads_.size()]->task_runner()->PostTask(
+        FROM_HERE, base::BindOnce(&ParallelGzipWriter::CompressBlock,
+                                  base::Unretained(block)));
+  }
+  blocks_submitted_++;
+  pending_.push_back(std::move(current_));
+
+  current_ = std::make_unique<Block>();
+  current_->input.reserve(kBlockSize);
+
+  // Write out whatever is already compressed, without waiting.
+  while (!failed_ && !pending_.empty() && pending_.front()->done.IsSignaled())
+    OutputOldestBlock();
+}
+
+void ParallelGzipWriter::OutputOldestBlock() {
+  std::unique_ptr<Block> block = std::move(pending_.front());
+  pending_.pop_front();
+
+  block->done.Wait();
+  if (!block->compressed) {
+    failed_ = true;
+    error_ = EIO;
+    return;
+  }
+
+  if (!output_.Run(block->output.data(), block->output.size())) {
+    failed_ = true;
+    error_ = errno;
+  }
+}
+
+}  // namespace concierge
+}  // namespace vm_tools
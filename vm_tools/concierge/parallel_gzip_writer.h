@@ -0,0 +1,86 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef VM_TOOLS_CONCIERGE_PARALLEL_GZIP_WRITER_H_
+#define VM_TOOLS_CONCIERGE_PARALLEL_GZIP_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/threading/thread.h>
+
+namespace vm_tools {
+namespace concierge {
+
+// Compresses a stream to gzip format on several threads. Like pigz, the
+// input is cut into blocks that are compressed independently, each into its
+// own gzip member. A series of gzip members is a standard gzip file: gzip,
+// zlib and libarchive decompress it as a single stream.
+//
+// Compressed data is passed to the output callback in order, on the thread
+// that calls Write() and Close().
+class ParallelGzipWriter {
+ public:
+  // Writes all |size| bytes at |data|. Returns false on failure, with errno
+  // set.
+  using OutputCallback =
+      base::RepeatingCallback<bool(const uint8_t* data, size_t size)>;
+
+  // Compresses on |num_threads| threads, or on the calling thread if none
+  // can be started.
+  ParallelGzipWriter(size_t num_threads, OutputCallback output);
+  ParallelGzipWriter(const ParallelGzipWriter&) = delete;
+  ParallelGzipWriter& operator=(const ParallelGzipWriter&) = delete;
+  ~ParallelGzipWriter();
+
+  // Compresses |size| bytes at |data|. Blocks while too many blocks are
+  // waiting to be compressed or written. Returns false on failure, with
+  // errno set.
+  bool Write(const void* data, size_t size);
+
+  // Compresses the rest of the input and waits until all of it has been
+  // written. Returns false on failure, with errno set.
+  bool Close();
+
+ private:
+  struct Block;
+
+  static void CompressBlock(Block* block);
+
+  // Starts compressing the block being filled.
+  void SubmitBlock();
+
+  // Waits for the oldest block to be compressed and writes it.
+  void OutputOldestBlock();
+
+  OutputCallback output_;
+
+  // Block being filled by Write().
+  std::unique_ptr<Block> current_;
+
+  // Blocks being compressed or waiting to be written, oldest first.
+  std::deque<std::unique_ptr<Block>> pending_;
+
+  size_t blocks_submitted_ = 0;
+
+  // Set once compressing or writing has failed. Later calls do nothing.
+  bool failed_ = false;
+
+  // Set when failing, as errno may have changed by the time it is reported.
+  int error_ = 0;
+
+  // Declared last so that the threads are stopped before the blocks they may
+  // be working on are freed.
+  std::vector<std::unique_ptr<base::Thread>> threads_;
+};
+
+}  // namespace concierge
+}  // namespace vm_tools
+
+#endif  // VM_TOOLS_CONCIERGE_PARALLEL_GZIP_WRITER_H_
@@ -0,0 +1,109 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "vm_tools/concierge/parallel_gzip_writer.h"
+
+#include <errno.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <base/bind.h>
+#include <gtest/gtest.h>
+
+namespace vm_tools {
+namespace concierge {
+namespace {
+
+bool AppendOutput(std::vector<uint8_t>* output,
+                  const uint8_t* data,
+                  size_t size) {
+  output->insert(output->end(), data, data + size);
+  return true;
+}
+
+bool FailOutput(const uint8_t* data, size_t size) {
+  errno = ENOSPC;
+  return false;
+}
+
+// Decompresses |gzip|, which may hold several gzip members, into |output|.
+bool Gunzip(const std::vector<uint8_t>& gzip, std::vector<uint8_t>* output) {
+  z_stream stream = {};
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    return false;
+
+  stream.next_in = const_cast<uint8_t*>(gzip.data());
+  stream.avail_in = gzip.size();
+  bool ok = true;
+  while (ok && stream.avail_in > 0) {
+    uint8_t buf[4096];
+    stream.next_out = buf;
+    stream.avail_out = sizeof(buf);
+    int ret = inflate(&stream, Z_NO_FLUSH);
+    output->insert(output->end(), buf, stream.next_out);
+    if (ret == Z_STREAM_END)
+      ok = inflateReset(&stream) == Z_OK;
+    else
+      ok = ret == Z_OK;
+  }
+  inflateEnd(&stream);
+  return ok;
+}
+
+// Returns |size| bytes that compress, but not to nothing.
+std::vector<uint8_t> MakeInput(size_t size) {
+  std::vector<uint8_t> input(size);
+  uint32_t state = 1;
+  for (size_t i = 0; i < size; i++) {
+    state = state * 1103515245 + 12345;
+    input[i] = (state >> 16) % 16;
+  }
+  return input;
+}
+
+}  // namespace
+
+TEST(ParallelGzipWriterTest, OutputDecompressesToInput) {
+  std::vector<uint8_t> input = MakeInput(3 * 1024 * 1024 + 4321);
+  std::vector<uint8_t> output;
+  ParallelGzipWriter writer(3, base::BindRepeating(&AppendOutput, &output));
+
+  // Write in odd sizes, so that writes straddle blocks.
+  for (size_t offset = 0; offset < input.size(); offset += 65537) {
+    size_t size = std::min<size_t>(65537, input.size() - offset);
+    ASSERT_TRUE(writer.Write(&input[offset], size));
+  }
+  ASSERT_TRUE(writer.Close());
+
+  EXPECT_LT(output.size(), input.size());
+  std::vector<uint8_t> decompressed;
+  ASSERT_TRUE(Gunzip(output, &decompressed));
+  EXPECT_EQ(decompressed, input);
+}
+
+TEST(ParallelGzipWriterTest, EmptyInputIsValidGzip) {
+  std::vector<uint8_t> output;
+  ParallelGzipWriter writer(2, base::BindRepeating(&AppendOutput, &output));
+  ASSERT_TRUE(writer.Close());
+
+  EXPECT_FALSE(output.empty());
+  std::vector<uint8_t> decompressed;
+  ASSERT_TRUE(Gunzip(output, &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+}
+
+TEST(ParallelGzipWriterTest, ReportsOutputErrors) {
+  std::vector<uint8_t> input = MakeInput(64 * 1024);
+  ParallelGzipWriter writer(2, base::BindRepeating(&FailOutput));
+
+  ASSERT_TRUE(writer.Write(input.data(), input.size()));
+  errno = 0;
+  EXPECT_FALSE(writer.Close());
+  EXPECT_EQ(errno, ENOSPC);
+}
+
+}  // namespace concierge
+}  // namespace vm_tools
@@ -0,0 +1,247 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the Wayland channel between sommelier and the host. A
+// synthetic client commits a small shm surface as fast as it can, every
+// commit attaching the buffer and damaging a pixel, which is about the
+// densest stream of requests a client can send. Every few commits also asks
+// for a frame callback, which sommelier forwards to the host compositor: the
+// time until it is done includes the time the commit spent queued behind the
+// earlier ones on its way to the host.
+//
+// Run it in the VM against sommelier, with WAYLAND_DISPLAY set. It reports
+// the commit throughput and the frame callback latency.
+//
+// Usage: sommelier_commit_storm_benchmark [commits] [commits per callback]
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "xdg-shell-client-protocol.h"  // NOLINT(build/include_directory)
+
+namespace {
+
+constexpr int32_t kWidth = 64;
+constexpr int32_t kHeight = 64;
+constexpr int32_t kStride = kWidth * 4;
+constexpr int kDefaultCommits = 10000;
+constexpr int kDefaultCommitsPerCallback = 100;
+// How long to wait for the host once all commits are sent.
+constexpr int kDrainTimeoutMs = 5000;
+
+struct Client {
+  wl_display* display = nullptr;
+  wl_compositor* compositor = nullptr;
+  wl_shm* shm = nullptr;
+  xdg_wm_base* wm_base = nullptr;
+  bool configured = false;
+  int pending_callbacks = 0;
+  std::vector<double> callback_ms;
+};
+
+void RegistryGlobal(void* data,
+                    wl_registry* registry,
+                    uint32_t name,
+                    const char* interface,
+                    uint32_t version) {
+  Client* client = static_cast<Client*>(data);
+  if (!strcmp(interface, wl_compositor_interface.name)) {
+    client->compositor = static_cast<wl_compositor*>(
+        wl_registry_bind(registry, name, &wl_compositor_interface, 1));
+  } else if (!strcmp(interface, wl_shm_interface.name)) {
+    client->shm = static_cast<wl_shm*>(
+        wl_registry_bind(registry, name, &wl_shm_interface, 1));
+  } else if (!strcmp(interface, xdg_wm_base_interface.name)) {
+    client->wm_base = static_cast<xdg_wm_base*>(
+        wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+  }
+}
+
+void RegistryGlobalRemove(void* data, wl_registry* registry, uint32_t name) {}
+
+const wl_registry_listener kRegistryListener = {RegistryGlobal,
+                                                RegistryGlobalRemove};
+
+void WmBasePing(void* data, xdg_wm_base* wm_base, uint32_t serial) {
+  xdg_wm_base_pong(wm_base, serial);
+}
+
+const xdg_wm_base_listener kWmBaseListener = {WmBasePing};
+
+void XdgSurfaceConfigure(void* data,
+                         xdg_surface* xdg_surface,
+                         uint32_t serial) {
+  xdg_surface_ack_configure(xdg_surface, serial);
+  static_cast<Client*>(data)->configured = true;
+}
+
+const xdg_surface_listener kXdgSurfaceListener = {XdgSurfaceConfigure};
+
+double NowMs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+struct FrameCallback {
+  Client* client;
+  double start_ms;
+};
+
+void FrameCallbackDone(void* data, wl_callback* callback, uint32_t time) {
+  FrameCallback* frame = static_cast<FrameCallback*>(data);
+  frame->client->callback_ms.push_back(NowMs() - frame->start_ms);
+  frame->client->pending_callbacks--;
+  wl_callback_destroy(callback);
+  delete frame;
+}
+
+const wl_callback_listener kFrameCallbackListener = {FrameCallbackDone};
+
+// Dispatches the events received within |timeout_ms|. Returns false on
+// error.
+bool Dispatch(wl_display* display, int timeout_ms) {
+  while (wl_display_prepare_read(display) != 0)
+    wl_display_dispatch_pending(display);
+  pollfd fd = {wl_display_get_fd(display), POLLIN, 0};
+  if (poll(&fd, 1, timeout_ms) > 0) {
+    if (wl_display_read_events(display) < 0)
+      return false;
+  } else {
+    wl_display_cancel_read(display);
+  }
+  return wl_display_dispatch_pending(display) >= 0;
+}
+
+// Sends the queued requests, waiting for sommelier to catch up as needed.
+bool Flush(wl_display* display) {
+  while (wl_display_flush(display) < 0) {
+    if (errno != EAGAIN)
+      return false;
+    pollfd fd = {wl_display_get_fd(display), POLLOUT, 0};
+    poll(&fd, 1, -1);
+  }
+  return true;
+}
+
+wl_buffer* CreateBuffer(wl_shm* shm) {
+  const int32_t size = kStride * kHeight;
+  int fd = memfd_create("sommelier_commit_storm_benchmark", MFD_CLOEXEC);
+  if (fd < 0 || ftruncate(fd, size) < 0) {
+    perror("failed to create shm buffer");
+    return nullptr;
+  }
+  wl_shm_pool* pool = wl_shm_create_pool(shm, fd, size);
+  wl_buffer* buffer = wl_shm_pool_create_buffer(
+      pool, 0, kWidth, kHeight, kStride, WL_SHM_FORMAT_ARGB8888);
+  wl_shm_pool_destroy(pool);
+  close(fd);
+  return buffer;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  return sorted[std::min(sorted.size() - 1,
+                         static_cast<size_t>(p * sorted.size()))];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int commits = argc > 1 ? atoi(argv[1]) : kDefaultCommits;
+  int commits_per_callback =
+      argc > 2 ? atoi(argv[2]) : kDefaultCommitsPerCallback;
+  if (commits <= 0 || commits_per_callback <= 0) {
+    fprintf(stderr, "usage: %s [commits] [commits per callback]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Client client;
+  client.display = wl_display_connect(nullptr);
+  if (!client.display) {
+    fprintf(stderr, "failed to connect to the Wayland display\n");
+    return EXIT_FAILURE;
+  }
+  wl_registry* registry = wl_display_get_registry(client.display);
+  wl_registry_add_listener(registry, &kRegistryListener, &client);
+  wl_display_roundtrip(client.display);
+  if (!client.compositor || !client.shm || !client.wm_base) {
+    fprintf(stderr, "missing wl_compositor, wl_shm or xdg_wm_base\n");
+    return EXIT_FAILURE;
+  }
+  xdg_wm_base_add_listener(client.wm_base, &kWmBaseListener, nullptr);
+
+  wl_surface* surface = wl_compositor_create_surface(client.compositor);
+  xdg_surface* xdg_surface =
+      xdg_wm_base_get_xdg_surface(client.wm_base, surface);
+  xdg_surface_add_listener(xdg_surface, &kXdgSurfaceListener, &client);
+  xdg_toplevel* toplevel = xdg_surface_get_toplevel(xdg_surface);
+  xdg_toplevel_set_title(toplevel, "sommelier_commit_storm_benchmark");
+  wl_surface_commit(surface);
+  while (!client.configured) {
+    if (wl_display_dispatch(client.display) < 0) {
+      fprintf(stderr, "failed to map the surface\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  wl_buffer* buffer = CreateBuffer(client.shm);
+  if (!buffer)
+    return EXIT_FAILURE;
+
+  double start = NowMs();
+  for (int i = 1; i <= commits; ++i) {
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, i % kWidth, (i / kWidth) % kHeight, 1, 1);
+    if (i % commits_per_callback == 0) {
+      wl_callback* callback = wl_surface_frame(surface);
+      wl_callback_add_listener(callback, &kFrameCallbackListener,
+                               new FrameCallback{&client, NowMs()});
+      client.pending_callbacks++;
+    }
+    wl_surface_commit(surface);
+    if (!Flush(client.display) || !Dispatch(client.display, 0)) {
+      fprintf(stderr, "failed to send commit %d\n", i);
+      return EXIT_FAILURE;
+    }
+  }
+  double elapsed_ms = NowMs() - start;
+
+  double drain_start = NowMs();
+  while (client.pending_callbacks &&
+         NowMs() - drain_start < kDrainTimeoutMs) {
+    if (!Dispatch(client.display, kDrainTimeoutMs)) {
+      fprintf(stderr, "failed to wait for frame callbacks\n");
+      return EXIT_FAILURE;
+    }
+  }
+  if (client.callback_ms.empty()) {
+    fprintf(stderr, "no frame callback was done\n");
+    return EXIT_FAILURE;
+  }
+
+  std::vector<double>& latency = client.callback_ms;
+  std::sort(latency.begin(), latency.end());
+  printf("%-10s %10s %10s %10s %10s %10s %10s\n", "commits", "commits/s",
+         "callbacks", "min ms", "p50 ms", "p99 ms", "max ms");
+  printf("%-10d %10.0f %10zu %10.3f %10.3f %10.3f %10.3f\n", commits,
+         commits * 1e3 / elapsed_ms, latency.size(), latency.front(),
+         Percentile(latency, 0.5), Percentile(latency, 0.99), latency.back());
+
+  wl_buffer_destroy(buffer);
+  xdg_toplevel_destroy(toplevel);
+  xdg_surface_destroy(xdg_surface);
+  wl_surface_destroy(surface);
+  wl_display_disconnect(client.display);
+  return EXIT_SUCCESS;
+}
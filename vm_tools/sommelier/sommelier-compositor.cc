@@ -2,9 +2,10 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-#include "sommelier.h"          // NOLINT(build/include_directory)
-#include "sommelier-timing.h"   // NOLINT(build/include_directory)
-#include "sommelier-tracing.h"  // NOLINT(build/include_directory)
+#include "sommelier.h"              // NOLINT(build/include_directory)
+#include "sommelier-damage-copy.h"  // NOLINT(build/include_directory)
+#include "sommelier-timing.h"       // NOLINT(build/include_directory)
+#include "sommelier-tracing.h"      // NOLINT(build/include_directory)
 
 #include <assert.h>
 #include <errno.h>
@@ -57,8 +58,8 @@ struct sl_output_buffer {
   uint32_t format;
   struct wl_buffer* internal;
   struct sl_mmap* mmap;
-  struct pixman_region32 surface_damage;
-  struct pixman_region32 buffer_damage;
+  // Frame of |damage_history| whose contents the buffer holds, 0 if unknown.
+  uint64_t frame;
   struct sl_host_surface* surface;
 };
 
@@ -99,8 +100,6 @@ static uint32_t sl_drm_format_for_shm_format(int format) {
 static void sl_output_buffer_destroy(struct sl_output_buffer* buffer) {
   wl_buffer_destroy(buffer->internal);
   sl_mmap_unref(buffer->mmap);
-  pixman_region32_fini(&buffer->surface_damage);
-  pixman_region32_fini(&buffer->buffer_damage);
   wl_list_remove(&buffer->link);
   free(buffer);
 }
@@ -158,6 +157,7 @@ static void sl_host_surface_attach(struct wl_client* client,
     sl_mmap_unref(host->contents_shm_mmap);
     host->contents_shm_mmap = NULL;
   }
+  host->buffer_attached = true;
 
   if (host_buffer) {
     host->contents_width = host_buffer->width;
@@ -168,18 +168,22 @@ static void sl_host_surface_attach(struct wl_client* client,
   }
 
   if (host->contents_shm_mmap) {
-    while (!wl_list_empty(&host->released_buffers)) {
-      host->current_buffer = wl_container_of(host->released_buffers.next,
-                                             host->current_buffer, link);
+    struct sl_output_buffer *buffer, *next;
 
-      if (host->current_buffer->width == host_buffer->width &&
-          host->current_buffer->height == host_buffer->height &&
-          host->current_buffer->format == host_buffer->shm_format) {
-        break;
+    // Reuse the released buffer holding the most recent contents, as it has
+    // the fewest stale pixels to copy.
+    wl_list_for_each_safe(buffer, next, &host->released_buffers, link) {
+      // The buffer of a commit held back still has to be copied to.
+      if (buffer == host->committed_buffer)
+        continue;
+      if (buffer->width != host_buffer->width ||
+          buffer->height != host_buffer->height ||
+          buffer->format != host_buffer->shm_format) {
+        sl_output_buffer_destroy(buffer);
+        continue;
       }
-
-      sl_output_buffer_destroy(host->current_buffer);
-      host->current_buffer = NULL;
+      if (!host->current_buffer || buffer->frame > host->current_buffer->frame)
+        host->current_buffer = buffer;
     }
 
     // Allocate new output buffer.
@@ -200,10 +204,7 @@ static void sl_host_surface_attach(struct wl_client* client,
       host->current_buffer->height = height;
       host->current_buffer->format = shm_format;
       host->current_buffer->surface = host;
-      pixman_region32_init_rect(&host->current_buffer->surface_damage, 0, 0,
-                                MAX_SIZE, MAX_SIZE);
-      pixman_region32_init_rect(&host->current_buffer->buffer_damage, 0, 0,
-                                MAX_SIZE, MAX_SIZE);
+      host->current_buffer->frame = 0;
 
       if (host->ctx->channel->supports_dmabuf()) {
         int rv;
@@ -335,7 +336,15 @@ static void sl_host_surface_attach(struct wl_client* client,
 
   if (host->current_buffer) {
     assert(host->current_buffer->internal);
-    wl_surface_attach(host->proxy, host->current_buffer->internal, x, y);
+    buffer_proxy = host->current_buffer->internal;
+  }
+  if (host->commit_pending) {
+    // The host surface still needs the buffer of the commit held back, so
+    // this attach is only sent along with the next commit.
+    host->attach_deferred = true;
+    host->deferred_attach_proxy = buffer_proxy;
+    host->deferred_attach_x = x;
+    host->deferred_attach_y = y;
   } else {
     wl_surface_attach(host->proxy, buffer_proxy, x, y);
   }
@@ -398,20 +407,14 @@ static void sl_host_surface_damage(struct wl_client* client,
                                    int32_t height) {
   TRACE_EVENT("surface", "sl_host_surface_damage", "resource_id",
               try_wl_resource_get_id(resource));
-  const struct sl_host_surface* host =
+  struct sl_host_surface* host =
       static_cast<sl_host_surface*>(wl_resource_get_user_data(resource));
   const double scale = host->ctx->scale;
-  struct sl_output_buffer* buffer;
   int64_t x1, y1, x2, y2;
 
-  wl_list_for_each(buffer, &host->busy_buffers, link) {
-    pixman_region32_union_rect(&buffer->surface_damage, &buffer->surface_damage,
-                               x, y, width, height);
-  }
-  wl_list_for_each(buffer, &host->released_buffers, link) {
-    pixman_region32_union_rect(&buffer->surface_damage, &buffer->surface_damage,
-                               x, y, width, height);
-  }
+  pixman_region32_union_rect(&host->pending_surface_damage,
+                             &host->pending_surface_damage, x, y, width,
+                             height);
 
   x1 = x;
   y1 = y;
@@ -436,18 +439,12 @@ static void sl_host_surface_damage_buffer(struct wl_client* client,
                                           int32_t height) {
   TRACE_EVENT("surface", "sl_host_surface_damage_buffer", "resource_id",
               try_wl_resource_get_id(resource));
-  const struct sl_host_surface* host =
+  struct sl_host_surface* host =
       static_cast<sl_host_surface*>(wl_resource_get_user_data(resource));
-  struct sl_output_buffer* buffer;
 
-  wl_list_for_each(buffer, &host->busy_buffers, link) {
-    pixman_region32_union_rect(&buffer->buffer_damage, &buffer->buffer_damage,
-                               x, y, width, height);
-  }
-  wl_list_for_each(buffer, &host->released_buffers, link) {
-    pixman_region32_union_rect(&buffer->buffer_damage, &buffer->buffer_damage,
-                               x, y, width, height);
-  }
+  pixman_region32_union_rect(&host->pending_buffer_damage,
+                             &host->pending_buffer_damage, x, y, width,
+                             height);
 
   // Forward wl_surface_damage() call to the host. Since the damage region is
   // given in buffer pixel coordinates, convert to surface coordinates first.
@@ -554,53 +551,68 @@ static void sl_host_surface_set_input_region(
                               host_region ? host_region->proxy : NULL);
 }  // NOLINT(whitespace/indent)
 
-static void copy_damaged_rect(sl_host_surface* host,
-                              pixman_box32_t* rect,
-                              double scale_x,
-                              double scale_y,
-                              double offset_x,
-                              double offset_y) {
-  uint8_t* src_addr = static_cast<uint8_t*>(host->contents_shm_mmap->addr);
-  uint8_t* dst_addr = static_cast<uint8_t*>(host->current_buffer->mmap->addr);
-  size_t* src_offset = host->contents_shm_mmap->offset;
-  size_t* dst_offset = host->current_buffer->mmap->offset;
-  size_t* src_stride = host->contents_shm_mmap->stride;
-  size_t* dst_stride = host->current_buffer->mmap->stride;
-  size_t* y_ss = host->contents_shm_mmap->y_ss;
-  size_t bpp = host->contents_shm_mmap->bpp;
-  size_t num_planes = host->contents_shm_mmap->num_planes;
+// Adds to |damage| the rect enclosing |rect| after applying scale and offset,
+// clamped to the contents of |host|.
+static void add_damaged_rect(const sl_host_surface* host,
+                             pixman_region32_t* damage,
+                             pixman_box32_t* rect,
+                             double scale_x,
+                             double scale_y,
+                             double offset_x,
+                             double offset_y) {
   int32_t x1, y1, x2, y2;
 
-  // Enclosing rect after applying scale and offset.
-  x1 = rect->x1 * scale_x + offset_x;
-  y1 = rect->y1 * scale_y + offset_y;
-  x2 = rect->x2 * scale_x + offset_x + 0.5;
-  y2 = rect->y2 * scale_y + offset_y + 0.5;
-
-  x1 = MAX(0, x1);
-  y1 = MAX(0, y1);
-  x2 = MIN(static_cast<int32_t>(host->contents_width), x2);
-  y2 = MIN(static_cast<int32_t>(host->contents_height), y2);
-
-  if (x1 < x2 && y1 < y2) {
-    size_t i;
-
-    for (i = 0; i < num_planes; ++i) {
-      uint8_t* src_base = src_addr + src_offset[i];
-      uint8_t* dst_base = dst_addr + dst_offset[i];
-      uint8_t* src = src_base + y1 * src_stride[i] + x1 * bpp;
-      uint8_t* dst = dst_base + y1 * dst_stride[i] + x1 * bpp;
-      int32_t width = x2 - x1;
-      int32_t height = (y2 - y1) / y_ss[i];
-      size_t bytes = width * bpp;
-
-      while (height--) {
-        memcpy(dst, src, bytes);
-        dst += dst_stride[i];
-        src += src_stride[i];
+  x1 = MAX(0.0, rect->x1 * scale_x + offset_x);
+  y1 = MAX(0.0, rect->y1 * scale_y + offset_y);
+  x2 = MIN(host->contents_width, rect->x2 * scale_x + offset_x + 0.5);
+  y2 = MIN(host->contents_height, rect->y2 * scale_y + offset_y + 0.5);
+
+  if (x1 < x2 && y1 < y2)
+    pixman_region32_union_rect(damage, damage, x1, y1, x2 - x1, y2 - y1);
+}
+
+static void sl_host_surface_flush_commit(struct sl_host_surface* host);
+
+static void sl_pacing_callback_done(void* data,
+                                    struct wl_callback* callback,
+                                    uint32_t time) {
+  struct sl_host_surface* host = static_cast<sl_host_surface*>(data);
+  auto resource_id = try_wl_resource_get_id(host->resource);
+  TRACE_EVENT("surface", "sl_pacing_callback_done", "resource_id", resource_id,
+              "commit_pending", host->commit_pending);
+
+  wl_callback_destroy(callback);
+  host->pacing_callback = NULL;
+  if (host->ctx->timing != NULL) {
+    host->ctx->timing->UpdateFramePresented(resource_id,
+                                            host->presented_commit_time);
+  }
+  if (host->commit_pending)
+    sl_host_surface_flush_commit(host);
+}
+
+static const struct wl_callback_listener sl_pacing_callback_listener = {
+    sl_pacing_callback_done};
+
+// Commits |host| to the host compositor. If its frames are paced or timed,
+// also asks the host to tell us when it is ready for the next one.
+static void sl_host_surface_commit_to_host(struct sl_host_surface* host) {
+  if (host->paced && (host->ctx->frame_pacing || host->ctx->timing)) {
+    if (host->pacing_callback) {
+      // The host was not ready for the previous frame yet; if it had a new
+      // buffer, it is unlikely to ever be presented.
+      wl_callback_destroy(host->pacing_callback);
+      if (host->ctx->timing != NULL && host->committed_buffer_attached) {
+        host->ctx->timing->UpdateFrameDropped(
+            try_wl_resource_get_id(host->resource));
       }
     }
+    host->pacing_callback = wl_surface_frame(host->proxy);
+    wl_callback_add_listener(host->pacing_callback,
+                             &sl_pacing_callback_listener, host);
+    host->presented_commit_time = host->commit_time;
   }
+  wl_surface_commit(host->proxy);
 }
 
 static void sl_host_surface_commit(struct wl_client* client,
@@ -614,68 +626,128 @@ static void sl_host_surface_commit(struct wl_client* client,
   if (host->ctx->timing != NULL) {
     host->ctx->timing->UpdateLastCommit(resource_id);
   }
+  clock_gettime(CLOCK_MONOTONIC, &host->commit_time);
   struct sl_viewport* viewport = NULL;
 
   if (!wl_list_empty(&host->contents_viewport))
     viewport = wl_container_of(host->contents_viewport.next, viewport, link);
 
-  if (host->contents_shm_mmap) {
-    double contents_scale_x, contents_scale_y;
-    wl_fixed_t contents_offset_x, contents_offset_y;
-    compute_buffer_scale_and_offset(host, viewport, &contents_scale_x,
-                                    &contents_scale_y, &contents_offset_x,
-                                    &contents_offset_y);
-
-    if (host->current_buffer->mmap->begin_write)
-      host->current_buffer->mmap->begin_write(host->current_buffer->mmap->fd,
-                                              host->ctx);
-
-    // Copy damaged regions (surface-relative coordinates).
-    int n;
-    pixman_box32_t* rect =
-        pixman_region32_rectangles(&host->current_buffer->surface_damage, &n);
-    while (n--) {
-      TRACE_EVENT("surface",
-                  "sl_host_surface_commit: memcpy_loop (surface damage)");
-      copy_damaged_rect(host, rect, contents_scale_x, contents_scale_y,
-                        wl_fixed_to_double(contents_offset_x),
-                        wl_fixed_to_double(contents_offset_y));
-      ++rect;
+  // Record the damage of this commit in buffer coordinates, so that pixels
+  // damaged through both wl_surface::damage and wl_surface::damage_buffer, or
+  // by overlapping rects, are only copied once.
+  double contents_scale_x, contents_scale_y;
+  wl_fixed_t contents_offset_x, contents_offset_y;
+  compute_buffer_scale_and_offset(host, viewport, &contents_scale_x,
+                                  &contents_scale_y, &contents_offset_x,
+                                  &contents_offset_y);
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  int n;
+  pixman_box32_t* rect =
+      pixman_region32_rectangles(&host->pending_surface_damage, &n);
+  while (n--) {
+    add_damaged_rect(host, &damage, rect, contents_scale_x, contents_scale_y,
+                     wl_fixed_to_double(contents_offset_x),
+                     wl_fixed_to_double(contents_offset_y));
+    ++rect;
+  }
+  pixman_region32_union(&damage, &damage, &host->pending_buffer_damage);
+  pixman_region32_clear(&host->pending_surface_damage);
+  pixman_region32_clear(&host->pending_buffer_damage);
+  sl_damage_history_add(&host->damage_history, &damage);
+  pixman_region32_fini(&damage);
+
+  // A commit still held back is merged into this one.
+  if (host->commit_pending && host->ctx->timing != NULL)
+    host->ctx->timing->UpdateFrameCoalesced(resource_id);
+
+  // Latch the buffer attached since the last commit. The contents of a
+  // commit still held back are replaced before being copied: the client can
+  // have its buffer back, unless it is the one being committed again.
+  if (host->buffer_attached) {
+    if (host->committed_shm_mmap) {
+      struct wl_resource* committed_resource =
+          host->committed_shm_mmap->buffer_resource;
+      if (committed_resource &&
+          (!host->contents_shm_mmap ||
+           host->contents_shm_mmap->buffer_resource != committed_resource)) {
+        wl_buffer_send_release(committed_resource);
+      }
+      sl_mmap_unref(host->committed_shm_mmap);
     }
+    host->committed_shm_mmap = host->contents_shm_mmap;
+    host->contents_shm_mmap = NULL;
+    host->committed_buffer = host->current_buffer;
+    host->committed_width = host->contents_width;
+    host->committed_height = host->contents_height;
+    host->committed_buffer_attached = true;
+    host->buffer_attached = false;
+  }
+  if (host->attach_deferred) {
+    wl_surface_attach(host->proxy, host->deferred_attach_proxy,
+                      host->deferred_attach_x, host->deferred_attach_y);
+    host->attach_deferred = false;
+  }
 
-    // Copy damaged regions (buffer-relative coordinates).
-    //
-    // In theory, if we've accumulated both surface damage and buffer damage,
-    // it might be more efficient to first transform and union the regions, so
-    // that we won't ever copy the same pixel twice.
-    // In practice, wl_surface::damage_buffer obsoletes wl_surface::damage, and
-    // it doesn't seem worthwhile to optimize for the edge case in which an app
-    // uses both in the same frame.
-    rect = pixman_region32_rectangles(&host->current_buffer->buffer_damage, &n);
-    while (n--) {
-      TRACE_EVENT("surface",
-                  "sl_host_surface_commit: memcpy_loop (buffer damage)");
-      copy_damaged_rect(host, rect, 1.0, 1.0, 0.0, 0.0);
-      ++rect;
-    }
+  // Hold back shm frames until the host is ready for them, rather than
+  // copying and sending frames that will never be presented. The state of
+  // the host surface is only updated once the commit is flushed.
+  if (host->ctx->frame_pacing && host->paced && host->pacing_callback &&
+      host->committed_shm_mmap) {
+    TRACE_EVENT("surface", "sl_host_surface_commit: hold", "resource_id",
+                resource_id);
+    host->commit_pending = true;
+    return;
+  }
+
+  sl_host_surface_flush_commit(host);
+}
 
-    if (host->current_buffer->mmap->end_write)
-      host->current_buffer->mmap->end_write(host->current_buffer->mmap->fd,
-                                            host->ctx);
+// Applies the last commit of |host|, which may have been held back, to the
+// host surface.
+static void sl_host_surface_flush_commit(struct sl_host_surface* host) {
+  auto resource_id = try_wl_resource_get_id(host->resource);
+  struct sl_viewport* viewport = NULL;
 
-    pixman_region32_clear(&host->current_buffer->surface_damage);
-    pixman_region32_clear(&host->current_buffer->buffer_damage);
+  host->commit_pending = false;
+  if (!wl_list_empty(&host->contents_viewport))
+    viewport = wl_container_of(host->contents_viewport.next, viewport, link);
 
-    wl_list_remove(&host->current_buffer->link);
-    wl_list_insert(&host->busy_buffers, &host->current_buffer->link);
+  if (host->committed_shm_mmap) {
+    struct sl_output_buffer* buffer = host->committed_buffer;
+    if (buffer->mmap->begin_write)
+      buffer->mmap->begin_write(buffer->mmap->fd, host->ctx);
+
+    // Only copy the pixels that changed since the buffer was last written
+    // to, or all of them if that was too long ago.
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if (!sl_damage_history_get_stale(&host->damage_history, buffer->frame,
+                                     &damage)) {
+      pixman_region32_union_rect(&damage, &damage, 0, 0,
+                                 host->committed_width,
+                                 host->committed_height);
+    }
+    struct sl_damage_copy_stats stats;
+    sl_damage_copy(host->committed_shm_mmap, buffer->mmap,
+                   host->committed_width, host->committed_height, &damage,
+                   &stats);
+    pixman_region32_fini(&damage);
+    buffer->frame = host->damage_history.last_frame;
+
+    if (buffer->mmap->end_write)
+      buffer->mmap->end_write(buffer->mmap->fd, host->ctx);
+
+    wl_list_remove(&buffer->link);
+    wl_list_insert(&host->busy_buffers, &buffer->link);
   }
 
-  if (host->contents_width && host->contents_height) {
+  if (host->committed_width && host->committed_height) {
     double scale = host->ctx->scale * host->contents_scale;
 
     if (host->viewport) {
-      int width = host->contents_width;
-      int height = host->contents_height;
+      int width = host->committed_width;
+      int height = host->committed_height;
 
       // We need to take the client's viewport into account while still
       // making sure our scale is accounted for.
@@ -712,7 +784,7 @@ static void sl_host_surface_commit(struct wl_client* client,
   if (host->has_role) {
     TRACE_EVENT("surface", "sl_host_surface_commit: wl_surface_commit",
                 "resource_id", resource_id, "has_role", host->has_role);
-    wl_surface_commit(host->proxy);
+    sl_host_surface_commit_to_host(host);
 
     // GTK determines the scale based on the output the surface has entered.
     // If the surface has not entered any output, then have it enter the
@@ -736,10 +808,10 @@ static void sl_host_surface_commit(struct wl_client* client,
     // commit until window is created.
     struct sl_window* window;
     wl_list_for_each(window, &host->ctx->windows, link) {
-      if (window->host_surface_id == try_wl_resource_get_id(resource)) {
+      if (window->host_surface_id == resource_id) {
         if (window->xdg_surface) {
-          wl_surface_commit(host->proxy);
-          if (host->contents_width && host->contents_height)
+          sl_host_surface_commit_to_host(host);
+          if (host->committed_width && host->committed_height)
             window->realized = 1;
         }
         break;
@@ -747,12 +819,26 @@ static void sl_host_surface_commit(struct wl_client* client,
     }
   }
 
-  if (host->contents_shm_mmap) {
-    if (host->contents_shm_mmap->buffer_resource) {
-      wl_buffer_send_release(host->contents_shm_mmap->buffer_resource);
+  // The client can have its buffer back, unless it attached it again since.
+  if (host->committed_shm_mmap) {
+    struct wl_resource* committed_resource =
+        host->committed_shm_mmap->buffer_resource;
+    if (committed_resource &&
+        (!host->contents_shm_mmap ||
+         host->contents_shm_mmap->buffer_resource != committed_resource)) {
+      wl_buffer_send_release(committed_resource);
     }
-    sl_mmap_unref(host->contents_shm_mmap);
-    host->contents_shm_mmap = NULL;
+    sl_mmap_unref(host->committed_shm_mmap);
+    host->committed_shm_mmap = NULL;
+    host->committed_buffer = NULL;
+  }
+  host->committed_buffer_attached = false;
+
+  // An attach made while the commit was held back can go to the host now.
+  if (host->attach_deferred) {
+    wl_surface_attach(host->proxy, host->deferred_attach_proxy,
+                      host->deferred_attach_x, host->deferred_attach_y);
+    host->attach_deferred = false;
   }
 }
 
@@ -808,6 +894,8 @@ static void sl_destroy_host_surface(struct wl_resource* resource) {
 
   if (host->contents_shm_mmap)
     sl_mmap_unref(host->contents_shm_mmap);
+  if (host->committed_shm_mmap)
+    sl_mmap_unref(host->committed_shm_mmap);
 
   while (!wl_list_empty(&host->released_buffers)) {
     buffer = wl_container_of(host->released_buffers.next, buffer, link);
@@ -819,6 +907,11 @@ static void sl_destroy_host_surface(struct wl_resource* resource) {
   }
   while (!wl_list_empty(&host->contents_viewport))
     wl_list_remove(host->contents_viewport.next);
+  pixman_region32_fini(&host->pending_surface_damage);
+  pixman_region32_fini(&host->pending_buffer_damage);
+  sl_damage_history_fini(&host->damage_history);
+  if (host->pacing_callback)
+    wl_callback_destroy(host->pacing_callback);
 
   if (host->viewport)
     wp_viewport_destroy(host->viewport);
@@ -937,6 +1030,22 @@ static void sl_compositor_create_host_surface(struct wl_client* client,
   host_surface->current_buffer = NULL;
   wl_list_init(&host_surface->released_buffers);
   wl_list_init(&host_surface->busy_buffers);
+  pixman_region32_init(&host_surface->pending_surface_damage);
+  pixman_region32_init(&host_surface->pending_buffer_damage);
+  sl_damage_history_init(&host_surface->damage_history);
+  host_surface->paced = true;
+  host_surface->pacing_callback = NULL;
+  host_surface->commit_pending = false;
+  host_surface->committed_shm_mmap = NULL;
+  host_surface->committed_buffer = NULL;
+  host_surface->committed_width = 0;
+  host_surface->committed_height = 0;
+  host_surface->buffer_attached = false;
+  host_surface->committed_buffer_attached = false;
+  host_surface->attach_deferred = false;
+  host_surface->deferred_attach_proxy = NULL;
+  host_surface->deferred_attach_x = 0;
+  host_surface->deferred_attach_y = 0;
   host_surface->resource = wl_resource_create(
       client, &wl_surface_interface, wl_resource_get_version(resource), id);
   wl_resource_set_implementation(host_surface->resource,
@@ -18,6 +18,10 @@
 // TODO(b/173147612): Use container_token rather than this name.
 #define DEFAULT_VM_NAME "termina"
 
+// Maximum number of reads from the virtwl socket per event, so that a chatty
+// client can't starve the other event sources.
+#define MAX_VIRTWL_SOCKET_READS 16
+
 // Returns the string mapped to the given ATOM_ enum value.
 //
 // Note this is NOT the atom value sent via the X protocol, despite both being
@@ -174,6 +178,7 @@ void sl_context_init_default(struct sl_context* ctx) {
     ctx->atoms[i].name = name;
   }
   ctx->timing = NULL;
+  ctx->frame_pacing = false;
   ctx->trace_filename = NULL;
   ctx->trace_system = false;
 
@@ -290,9 +295,9 @@ static int sl_handle_wayland_channel_event(int fd, uint32_t mask, void* data) {
   return 1;
 }
 
-static int sl_handle_virtwl_socket_event(int fd, uint32_t mask, void* data) {
-  TRACE_EVENT("surface", "sl_handle_virtwl_socket_event");
-  struct sl_context* ctx = (struct sl_context*)data;
+// Forwards one read worth of data, and the fds that come with it, from the
+// virtwl socket to the channel. Returns false if there was nothing to read.
+static bool sl_forward_virtwl_socket_data(struct sl_context* ctx, int flags) {
   struct WaylandSendReceive send = {0};
   char fd_buffer[CMSG_LEN(sizeof(int) * WAYLAND_MAX_FDs)];
   uint8_t data_buffer[DEFAULT_BUFFER_SIZE];
@@ -303,14 +308,6 @@ static int sl_handle_virtwl_socket_event(int fd, uint32_t mask, void* data) {
   ssize_t bytes;
   int rv;
 
-  if (!(mask & WL_EVENT_READABLE)) {
-    fprintf(stderr,
-            "Got error or hangup on virtwl socket"
-            " (mask %d), exiting\n",
-            mask);
-    exit(EXIT_SUCCESS);
-  }
-
   buffer_iov.iov_base = data_buffer;
   buffer_iov.iov_len = ctx->channel->max_send_size();
 
@@ -319,7 +316,9 @@ static int sl_handle_virtwl_socket_event(int fd, uint32_t mask, void* data) {
   msg.msg_control = fd_buffer;
   msg.msg_controllen = sizeof(fd_buffer);
 
-  bytes = recvmsg(ctx->virtwl_socket_fd, &msg, 0);
+  bytes = recvmsg(ctx->virtwl_socket_fd, &msg, flags);
+  if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return false;
   errno_assert(bytes > 0);
 
   // If there were any FDs recv'd by recvmsg, there will be some data in the
@@ -351,6 +350,29 @@ static int sl_handle_virtwl_socket_event(int fd, uint32_t mask, void* data) {
   while (send.num_fds--)
     close(send.fds[send.num_fds]);
 
+  return true;
+}
+
+static int sl_handle_virtwl_socket_event(int fd, uint32_t mask, void* data) {
+  TRACE_EVENT("surface", "sl_handle_virtwl_socket_event");
+  struct sl_context* ctx = (struct sl_context*)data;
+
+  if (!(mask & WL_EVENT_READABLE)) {
+    fprintf(stderr,
+            "Got error or hangup on virtwl socket"
+            " (mask %d), exiting\n",
+            mask);
+    exit(EXIT_SUCCESS);
+  }
+
+  // Read everything the client side has written so far, up to a limit, so
+  // that the channel can batch it into a single submission to the host.
+  sl_forward_virtwl_socket_data(ctx, 0);
+  for (int i = 1; i < MAX_VIRTWL_SOCKET_READS; i++) {
+    if (!sl_forward_virtwl_socket_data(ctx, MSG_DONTWAIT))
+      break;
+  }
+
   return 1;
 }
 
@@ -160,6 +160,8 @@ struct sl_context {
   xcb_visualid_t visual_ids[256];
   xcb_colormap_t colormaps[256];
   Timing* timing;
+  // Hold back shm frames until the host is ready to present them.
+  bool frame_pacing;
   const char* trace_filename;
   bool trace_system;
   bool use_explicit_fence;
@@ -0,0 +1,173 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Benchmark of the pixels copied into the host buffers of a shm surface.
+// Replays the damage of synthetic clients on a 1920x1080 surface through the
+// damage history and copy engine used by sl_host_surface_commit(), with a
+// host that holds on to the last two buffers committed to it, and reports for
+// each client the bytes damaged by the client, the bytes actually copied and
+// the time spent copying, per frame.
+//
+// Usage: sommelier_damage_benchmark [frames]
+
+#include <pixman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <memory>
+#include <vector>
+
+#include "sommelier-damage-copy.h"  // NOLINT(build/include_directory)
+#include "sommelier-mmap.h"         // NOLINT(build/include_directory)
+
+namespace {
+
+constexpr int32_t kWidth = 1920;
+constexpr int32_t kHeight = 1080;
+constexpr size_t kBpp = 4;
+constexpr int kDefaultFrames = 600;
+// Commits after which the host releases a buffer committed to it.
+constexpr int kReleaseDelay = 3;
+
+// Adds to |damage| the damage of the |frame|-th frame of a terminal printing
+// a line each frame for one second, then idling with the user typing for one
+// second. Returns false if the client does not commit this frame.
+bool TerminalDamage(int frame, pixman_region32_t* damage) {
+  if ((frame / 60) % 2 == 0) {
+    // Scrolling redraws the whole view, scrollbar included.
+    pixman_region32_union_rect(damage, damage, 0, 0, kWidth, kHeight);
+    return true;
+  }
+  if (frame % 8 != 0)
+    return false;
+  // A character cell of the prompt line.
+  pixman_region32_union_rect(damage, damage, 10 * (frame % 60), kHeight - 20,
+                             10, 20);
+  return true;
+}
+
+// Adds to |damage| the damage of the |frame|-th frame of a 30 fps video
+// playing in a 60 Hz window, with its controls shown for the first 3 seconds.
+bool VideoDamage(int frame, pixman_region32_t* damage) {
+  if (frame % 2 != 0)
+    return false;
+  const int32_t x = (kWidth - 1280) / 2;
+  const int32_t y = (kHeight - 720) / 2;
+  pixman_region32_union_rect(damage, damage, x, y, 1280, 720);
+  if (frame <= 180) {
+    // Controls, including the progress bar, below the video.
+    pixman_region32_union_rect(damage, damage, x, y + 720, 1280, 48);
+  }
+  return true;
+}
+
+struct Buffer {
+  std::vector<uint8_t> pixels;
+  sl_mmap map;
+  uint64_t frame = 0;
+  int release_at = 0;
+};
+
+sl_mmap Map(std::vector<uint8_t>* pixels) {
+  pixels->resize(kWidth * kHeight * kBpp);
+  sl_mmap map = {};
+  map.addr = pixels->data();
+  map.size = pixels->size();
+  map.bpp = kBpp;
+  map.num_planes = 1;
+  map.stride[0] = kWidth * kBpp;
+  map.y_ss[0] = 1;
+  return map;
+}
+
+size_t RegionBytes(pixman_region32_t* region) {
+  int n;
+  pixman_box32_t* rects = pixman_region32_rectangles(region, &n);
+  size_t bytes = 0;
+  for (int i = 0; i < n; ++i)
+    bytes += (rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1) * kBpp;
+  return bytes;
+}
+
+double NowMs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void Run(const char* name,
+         bool (*client_damage)(int, pixman_region32_t*),
+         int frames) {
+  std::vector<uint8_t> contents;
+  sl_mmap src = Map(&contents);
+  std::vector<std::unique_ptr<Buffer>> buffers;
+  sl_damage_history history;
+  sl_damage_history_init(&history);
+
+  int commits = 0;
+  size_t damaged_bytes = 0, copied_bytes = 0;
+  double copy_ms = 0;
+  for (int i = 1; i <= frames; ++i) {
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if (!client_damage(i, &damage)) {
+      pixman_region32_fini(&damage);
+      continue;
+    }
+    commits++;
+    damaged_bytes += RegionBytes(&damage);
+    uint64_t frame = sl_damage_history_add(&history, &damage);
+
+    // Same choice as sl_host_surface_attach(): the released buffer with the
+    // most recent contents, or a new one.
+    Buffer* buffer = nullptr;
+    for (const auto& candidate : buffers) {
+      if (candidate->release_at <= commits &&
+          (!buffer || candidate->frame > buffer->frame)) {
+        buffer = candidate.get();
+      }
+    }
+    if (!buffer) {
+      buffers.push_back(std::make_unique<Buffer>());
+      buffer = buffers.back().get();
+      buffer->map = Map(&buffer->pixels);
+    }
+
+    if (!sl_damage_history_get_stale(&history, buffer->frame, &damage))
+      pixman_region32_union_rect(&damage, &damage, 0, 0, kWidth, kHeight);
+    sl_damage_copy_stats stats;
+    double start = NowMs();
+    sl_damage_copy(&src, &buffer->map, kWidth, kHeight, &damage, &stats);
+    copy_ms += NowMs() - start;
+    copied_bytes += stats.bytes;
+    buffer->frame = frame;
+    buffer->release_at = commits + kReleaseDelay;
+    pixman_region32_fini(&damage);
+  }
+  sl_damage_history_fini(&history);
+
+  if (!commits)
+    return;
+  printf("%-10s %7d %8zu %14zu %14zu %14zu %10.3f\n", name, commits,
+         buffers.size(), static_cast<size_t>(kWidth * kHeight * kBpp),
+         damaged_bytes / commits, copied_bytes / commits, copy_ms / commits);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : kDefaultFrames;
+  if (frames <= 0) {
+    fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("%-10s %7s %8s %14s %14s %14s %10s\n", "client", "commits",
+         "buffers", "frame bytes", "damaged/frame", "copied/frame",
+         "ms/frame");
+  Run("terminal", TerminalDamage, frames);
+  Run("video", VideoDamage, frames);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,342 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sommelier-damage-copy.h"  // NOLINT(build/include_directory)
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "sommelier-mmap.h"     // NOLINT(build/include_directory)
+#include "sommelier-tracing.h"  // NOLINT(build/include_directory)
+
+namespace {
+
+// Rectangles of a band that are at most this many bytes apart are copied as
+// one span: copying a few undamaged pixels is cheaper than another row loop.
+constexpr size_t kMergeGapBytes = 64;
+
+// Copies of at least this size are unlikely to be read back from the cache
+// before it is flushed, so they are written with non-temporal stores.
+constexpr size_t kStreamingMinBytes = 1024 * 1024;
+
+// Copies of at least this size are split into tasks of about kTaskBytes and
+// spread over the worker pool.
+constexpr size_t kParallelMinBytes = 2 * 1024 * 1024;
+constexpr size_t kTaskBytes = 256 * 1024;
+constexpr unsigned kMaxWorkers = 3;
+
+// A run of |rows| rows of |bytes| bytes each.
+struct sl_copy_span {
+  uint8_t* dst;
+  const uint8_t* src;
+  size_t dst_stride;
+  size_t src_stride;
+  size_t bytes;
+  size_t rows;
+};
+
+#if defined(__SSE2__)
+void copy_row_streaming(uint8_t* dst, const uint8_t* src, size_t bytes) {
+  // Non-temporal stores require a 16-byte aligned destination.
+  size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+  head = std::min(head, bytes);
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  bytes -= head;
+
+  __m128i* d = reinterpret_cast<__m128i*>(dst);
+  const __m128i* s = reinterpret_cast<const __m128i*>(src);
+  for (; bytes >= 64; bytes -= 64, d += 4, s += 4) {
+    __m128i v0 = _mm_loadu_si128(s);
+    __m128i v1 = _mm_loadu_si128(s + 1);
+    __m128i v2 = _mm_loadu_si128(s + 2);
+    __m128i v3 = _mm_loadu_si128(s + 3);
+    _mm_stream_si128(d, v0);
+    _mm_stream_si128(d + 1, v1);
+    _mm_stream_si128(d + 2, v2);
+    _mm_stream_si128(d + 3, v3);
+  }
+  for (; bytes >= 16; bytes -= 16, ++d, ++s)
+    _mm_stream_si128(d, _mm_loadu_si128(s));
+  memcpy(d, s, bytes);
+}
+#endif
+
+void copy_span(const sl_copy_span& span, bool streaming) {
+  uint8_t* dst = span.dst;
+  const uint8_t* src = span.src;
+
+#if defined(__SSE2__)
+  if (streaming) {
+    for (size_t i = 0; i < span.rows; ++i) {
+      copy_row_streaming(dst, src, span.bytes);
+      dst += span.dst_stride;
+      src += span.src_stride;
+    }
+    // Make the non-temporal stores visible before the copy is reported as
+    // done.
+    _mm_sfence();
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < span.rows; ++i) {
+    memcpy(dst, src, span.bytes);
+    dst += span.dst_stride;
+    src += span.src_stride;
+  }
+}
+
+// Appends a span to |spans|, extending the last one instead when the new
+// span continues it.
+void add_span(std::vector<sl_copy_span>* spans, const sl_copy_span& span) {
+  if (!spans->empty()) {
+    sl_copy_span& last = spans->back();
+    if (last.bytes == span.bytes && last.dst_stride == span.dst_stride &&
+        last.src_stride == span.src_stride &&
+        last.dst + last.rows * last.dst_stride == span.dst &&
+        last.src + last.rows * last.src_stride == span.src) {
+      last.rows += span.rows;
+      return;
+    }
+  }
+  spans->push_back(span);
+}
+
+// Threads waiting to help with large copies. Run() uses the calling thread
+// as well and only returns once every task is done.
+class DamageCopyPool {
+ public:
+  explicit DamageCopyPool(unsigned num_workers) {
+    for (unsigned i = 0; i < num_workers; ++i)
+      workers_.emplace_back(&DamageCopyPool::WorkerLoop, this);
+  }
+  DamageCopyPool(const DamageCopyPool&) = delete;
+  DamageCopyPool& operator=(const DamageCopyPool&) = delete;
+
+  size_t num_workers() const { return workers_.size(); }
+
+  void Run(const std::vector<sl_copy_span>& tasks, bool streaming) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_ = &tasks;
+      streaming_ = streaming;
+      next_task_ = 0;
+      busy_workers_ = workers_.size();
+      ++generation_;
+    }
+    work_cv_.notify_all();
+
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return busy_workers_ == 0; });
+    tasks_ = nullptr;
+  }
+
+ private:
+  void WorkerLoop() {
+    uint64_t generation = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [&] { return generation_ != generation; });
+        generation = generation_;
+      }
+
+      RunTasks();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--busy_workers_ == 0)
+        done_cv_.notify_one();
+    }
+  }
+
+  void RunTasks() {
+    for (size_t i = next_task_.fetch_add(1); i < tasks_->size();
+         i = next_task_.fetch_add(1)) {
+      copy_span((*tasks_)[i], streaming_);
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  // Written under |mutex_| before the workers are woken up.
+  const std::vector<sl_copy_span>* tasks_ = nullptr;
+  bool streaming_ = false;
+  std::atomic<size_t> next_task_{0};
+  size_t busy_workers_ = 0;
+  uint64_t generation_ = 0;
+  std::vector<std::thread> workers_;
+};
+
+// Returns the process-wide pool, or nullptr on single core machines. The pool
+// is created on first use and never destroyed: its threads only ever block
+// waiting for work.
+DamageCopyPool* get_pool() {
+  static DamageCopyPool* pool = []() -> DamageCopyPool* {
+    unsigned cpus = std::thread::hardware_concurrency();
+    if (cpus < 2)
+      return nullptr;
+    return new DamageCopyPool(std::min(cpus - 1, kMaxWorkers));
+  }();
+  return pool;
+}
+
+}  // namespace
+
+void sl_damage_history_init(struct sl_damage_history* history) {
+  history->last_frame = 0;
+  for (pixman_region32_t& frame : history->frames)
+    pixman_region32_init(&frame);
+}
+
+void sl_damage_history_fini(struct sl_damage_history* history) {
+  for (pixman_region32_t& frame : history->frames)
+    pixman_region32_fini(&frame);
+}
+
+uint64_t sl_damage_history_add(struct sl_damage_history* history,
+                               pixman_region32_t* damage) {
+  uint64_t frame = ++history->last_frame;
+  pixman_region32_copy(&history->frames[frame % SL_DAMAGE_HISTORY_LENGTH],
+                       damage);
+  return frame;
+}
+
+bool sl_damage_history_get_stale(const struct sl_damage_history* history,
+                                 uint64_t frame,
+                                 pixman_region32_t* stale) {
+  if (frame == 0 || frame > history->last_frame ||
+      history->last_frame - frame > SL_DAMAGE_HISTORY_LENGTH) {
+    return false;
+  }
+
+  pixman_region32_clear(stale);
+  for (uint64_t i = frame + 1; i <= history->last_frame; ++i) {
+    pixman_region32_union(
+        stale, stale,
+        const_cast<pixman_region32_t*>(
+            &history->frames[i % SL_DAMAGE_HISTORY_LENGTH]));
+  }
+  return true;
+}
+
+void sl_damage_copy(struct sl_mmap* src,
+                    struct sl_mmap* dst,
+                    int32_t width,
+                    int32_t height,
+                    pixman_region32_t* damage,
+                    struct sl_damage_copy_stats* stats) {
+  uint8_t* src_addr = static_cast<uint8_t*>(src->addr);
+  uint8_t* dst_addr = static_cast<uint8_t*>(dst->addr);
+  size_t bpp = src->bpp;
+  size_t merge_gap = kMergeGapBytes / bpp;
+
+  *stats = {};
+  pixman_region32_intersect_rect(damage, damage, 0, 0, width, height);
+
+  // Pixman regions are made of bands of rectangles sharing the same rows,
+  // sorted left to right. Overlapping and touching rectangles have already
+  // been merged; merge close ones as well.
+  int n;
+  pixman_box32_t* rects = pixman_region32_rectangles(damage, &n);
+  std::vector<pixman_box32_t> merged;
+  merged.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    if (!merged.empty()) {
+      pixman_box32_t& last = merged.back();
+      if (last.y1 == rects[i].y1 && last.y2 == rects[i].y2 &&
+          static_cast<size_t>(rects[i].x1 - last.x2) <= merge_gap) {
+        last.x2 = rects[i].x2;
+        continue;
+      }
+    }
+    merged.push_back(rects[i]);
+  }
+
+  std::vector<sl_copy_span> spans;
+  for (size_t i = 0; i < src->num_planes; ++i) {
+    uint8_t* src_base = src_addr + src->offset[i];
+    uint8_t* dst_base = dst_addr + dst->offset[i];
+
+    for (const pixman_box32_t& rect : merged) {
+      sl_copy_span span;
+      span.src = src_base + rect.y1 * src->stride[i] + rect.x1 * bpp;
+      span.dst = dst_base + rect.y1 * dst->stride[i] + rect.x1 * bpp;
+      span.src_stride = src->stride[i];
+      span.dst_stride = dst->stride[i];
+      span.bytes = (rect.x2 - rect.x1) * bpp;
+      span.rows = (rect.y2 - rect.y1) / src->y_ss[i];
+      if (!span.rows)
+        continue;
+      stats->bytes += span.bytes * span.rows;
+
+      // Rows that fill the whole stride on both sides are contiguous.
+      if (span.bytes == span.src_stride && span.bytes == span.dst_stride) {
+        span.bytes *= span.rows;
+        span.src_stride = span.dst_stride = span.bytes;
+        span.rows = 1;
+      }
+      add_span(&spans, span);
+    }
+  }
+  stats->spans = spans.size();
+  stats->threads = 1;
+#if defined(__SSE2__)
+  stats->streaming = stats->bytes >= kStreamingMinBytes;
+#endif
+
+  DamageCopyPool* pool =
+      stats->bytes >= kParallelMinBytes ? get_pool() : nullptr;
+  if (pool) {
+    stats->threads += pool->num_workers();
+  }
+
+  TRACE_EVENT("surface", "sl_damage_copy", [&](perfetto::EventContext p) {
+    perfetto_annotate_damage_copy(p, *stats);
+  });
+
+  if (!pool) {
+    for (const sl_copy_span& span : spans)
+      copy_span(span, stats->streaming);
+    return;
+  }
+
+  // Split the spans into tasks of about kTaskBytes, cutting between rows or,
+  // for contiguous spans, anywhere.
+  std::vector<sl_copy_span> tasks;
+  for (const sl_copy_span& span : spans) {
+    if (span.rows == 1) {
+      for (size_t offset = 0; offset < span.bytes; offset += kTaskBytes) {
+        sl_copy_span task = span;
+        task.src += offset;
+        task.dst += offset;
+        task.bytes = std::min(kTaskBytes, span.bytes - offset);
+        tasks.push_back(task);
+      }
+      continue;
+    }
+    size_t rows_per_task = std::max<size_t>(1, kTaskBytes / span.bytes);
+    for (size_t row = 0; row < span.rows; row += rows_per_task) {
+      sl_copy_span task = span;
+      task.src += row * span.src_stride;
+      task.dst += row * span.dst_stride;
+      task.rows = std::min(rows_per_task, span.rows - row);
+      tasks.push_back(task);
+    }
+  }
+  pool->Run(tasks, stats->streaming);
+}
@@ -0,0 +1,68 @@
+// Copyright 2022 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef VM_TOOLS_SOMMELIER_SOMMELIER_DAMAGE_COPY_H_
+#define VM_TOOLS_SOMMELIER_SOMMELIER_DAMAGE_COPY_H_
+
+#include <pixman.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct sl_mmap;
+
+// Number of frames of damage remembered by a sl_damage_history. Buffers
+// holding older contents are copied in full.
+#define SL_DAMAGE_HISTORY_LENGTH 4
+
+// Damage of the last frames of a surface, in buffer coordinates. Like EGL's
+// buffer age, it lets a buffer that held the contents of an earlier frame be
+// brought up to date by copying only the pixels damaged since that frame.
+//
+// Frames are numbered from 1; 0 stands for unknown contents.
+struct sl_damage_history {
+  uint64_t last_frame;
+  pixman_region32_t frames[SL_DAMAGE_HISTORY_LENGTH];
+};
+
+void sl_damage_history_init(struct sl_damage_history* history);
+void sl_damage_history_fini(struct sl_damage_history* history);
+
+// Records |damage| as the damage of a new frame and returns its number.
+uint64_t sl_damage_history_add(struct sl_damage_history* history,
+                               pixman_region32_t* damage);
+
+// Sets |stale| to the pixels damaged after frame |frame|, that is the pixels
+// a buffer holding the contents of |frame| needs to be updated with to hold
+// those of the last frame. Returns false, leaving |stale| unchanged, if the
+// history does not go back that far.
+bool sl_damage_history_get_stale(const struct sl_damage_history* history,
+                                 uint64_t frame,
+                                 pixman_region32_t* stale);
+
+// Summary of a damage copy, reported through tracing.
+struct sl_damage_copy_stats {
+  // Number of row spans copied, after merging, over all planes.
+  size_t spans;
+  size_t bytes;
+  // Number of threads, including the calling one, that took part.
+  size_t threads;
+  bool streaming;
+};
+
+// Copies the pixels of |damage|, in buffer coordinates, from |src| to |dst|.
+// Both mappings must share the same format and be at least |width| by
+// |height| pixels large; |damage| is clamped to that size.
+//
+// Rectangles of |damage| are merged with their neighbors when that saves
+// row copies. Large copies bypass the CPU caches where supported and are
+// split across a small pool of worker threads. All writes to |dst| have
+// completed when this returns.
+void sl_damage_copy(struct sl_mmap* src,
+                    struct sl_mmap* dst,
+                    int32_t width,
+                    int32_t height,
+                    pixman_region32_t* damage,
+                    struct sl_damage_copy_stats* stats);
+
+#endif  // VM_TOOLS_SOMMELIER_SOMMELIER_DAMAGE_COPY_H_
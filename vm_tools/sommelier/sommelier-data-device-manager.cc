@@ -378,6 +378,7 @@ static void sl_data_device_start_drag(struct wl_client* client,
                           wl_resource_get_user_data(icon_resource))
                     : NULL;
   host_icon->has_role = 1;
+  host_icon->paced = false;
 
   wl_data_device_start_drag(host->proxy,
                             host_source ? host_source->proxy : NULL,
@@ -55,6 +55,7 @@ static void sl_host_pointer_set_cursor(struct wl_client* client,
     host_surface = static_cast<sl_host_surface*>(
         wl_resource_get_user_data(surface_resource));
     host_surface->has_role = 1;
+    host_surface->paced = false;
     if (host_surface->contents_width && host_surface->contents_height)
       wl_surface_commit(host_surface->proxy);
   }
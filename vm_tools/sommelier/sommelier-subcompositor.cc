@@ -119,6 +119,7 @@ static void sl_subcompositor_get_subsurface(
       host->proxy, host_surface->proxy, host_parent->proxy);
   wl_subsurface_set_user_data(host_subsurface->proxy, host_subsurface);
   host_surface->has_role = 1;
+  host_surface->paced = false;
 }  // NOLINT(whitespace/indent)
 
 static const struct wl_subcompositor_interface sl_subcompositor_implementation =
@@ -4,6 +4,8 @@
 
 #include "sommelier-timing.h"  // NOLINT(build/include_directory)
 
+#include <stdint.h>
+
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -16,25 +18,55 @@ static timespec GetTime() {
   return tp;
 }
 
+void Timing::AddAction(const BufferAction& action) {
+  actions[actions_idx] = action;
+  actions_idx = ((actions_idx + 1) % kMaxNumActions);
+}
+
 // Create a new action, add info gained from attach call.
 void Timing::UpdateLastAttach(int surface_id, int buffer_id) {
-  actions[actions_idx] =
-      BufferAction(GetTime(), surface_id, buffer_id, BufferAction::ATTACH);
-  actions_idx = ((actions_idx + 1) % kMaxNumActions);
+  AddAction(
+      BufferAction(GetTime(), surface_id, buffer_id, BufferAction::ATTACH));
 }
 
 // Create a new action, add info gained from commit call.
 void Timing::UpdateLastCommit(int surface_id) {
-  actions[actions_idx] = BufferAction(GetTime(), surface_id, kUnknownBufferId,
-                                      BufferAction::COMMIT);
-  actions_idx = ((actions_idx + 1) % kMaxNumActions);
+  AddAction(BufferAction(GetTime(), surface_id, kUnknownBufferId,
+                         BufferAction::COMMIT));
 }
 
 // Add a release action with release timing info.
 void Timing::UpdateLastRelease(int buffer_id) {
-  actions[actions_idx] = BufferAction(GetTime(), kUnknownSurfaceId, buffer_id,
-                                      BufferAction::RELEASE);
-  actions_idx = ((actions_idx + 1) % kMaxNumActions);
+  AddAction(BufferAction(GetTime(), kUnknownSurfaceId, buffer_id,
+                         BufferAction::RELEASE));
+}
+
+void Timing::UpdateFrameCoalesced(int surface_id) {
+  AddAction(BufferAction(GetTime(), surface_id, kUnknownBufferId,
+                         BufferAction::COALESCED));
+  ++coalesced_frames;
+}
+
+void Timing::UpdateFrameDropped(int surface_id) {
+  AddAction(BufferAction(GetTime(), surface_id, kUnknownBufferId,
+                         BufferAction::DROPPED));
+  ++dropped_frames;
+}
+
+void Timing::UpdateFramePresented(int surface_id,
+                                  const timespec& commit_time) {
+  AddAction(BufferAction(GetTime(), surface_id, kUnknownBufferId,
+                         BufferAction::PRESENTED));
+  ++presented_frames;
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t latency_ms = (now.tv_sec - commit_time.tv_sec) * 1000 +
+                       (now.tv_nsec - commit_time.tv_nsec) / 1000000;
+  int bucket = 0;
+  while (bucket < kNumLatencyBuckets - 1 && latency_ms >= (1 << bucket))
+    ++bucket;
+  ++latency_histogram[bucket];
 }
 
 // Output the recorded actions to the timing log file.
@@ -62,6 +94,12 @@ void Timing::OutputLog() {
       type = "commit";
     } else if (actions[i].action_type == BufferAction::RELEASE) {
       type = "release";
+    } else if (actions[i].action_type == BufferAction::COALESCED) {
+      type = "coalesced";
+    } else if (actions[i].action_type == BufferAction::DROPPED) {
+      type = "dropped";
+    } else if (actions[i].action_type == BufferAction::PRESENTED) {
+      type = "presented";
     }
     outfile << i << " ";  // Event #
     outfile << type << " ";
@@ -72,6 +110,23 @@ void Timing::OutputLog() {
     outfile << actions[i].time.tv_sec << "." << nsec.str() << std::endl;
   }
   outfile.close();
+
+  // Frame counts and present latencies since sommelier started, in a
+  // separate file to keep the event log easy to parse.
+  std::ofstream frames_file(output_filename + "_frames");
+  frames_file << "Presented, Coalesced, Dropped" << std::endl;
+  frames_file << presented_frames << " " << coalesced_frames << " "
+              << dropped_frames << std::endl;
+  frames_file << "Present_Latency_ms, Frames" << std::endl;
+  for (int i = 0; i < kNumLatencyBuckets; ++i) {
+    if (i == kNumLatencyBuckets - 1) {
+      frames_file << ">=" << (1 << (i - 1));
+    } else {
+      frames_file << "<" << (1 << i);
+    }
+    frames_file << " " << latency_histogram[i] << std::endl;
+  }
+  frames_file.close();
   std::cout << "Finished writing " << output_filename << std::endl;
   ++saves;
 }
@@ -16,14 +16,36 @@ class Timing {
   void UpdateLastAttach(int surface_id, int buffer_id);
   void UpdateLastCommit(int surface_id);
   void UpdateLastRelease(int buffer_id);
+  // A commit of the surface was merged into a later one before reaching the
+  // host.
+  void UpdateFrameCoalesced(int surface_id);
+  // A commit of the surface reached the host but was replaced by a newer one
+  // before the host was ready for it to be presented.
+  void UpdateFrameDropped(int surface_id);
+  // The host is ready for the next frame of the surface, whose last commit
+  // was made by the client at |commit_time| (CLOCK_MONOTONIC).
+  void UpdateFramePresented(int surface_id, const timespec& commit_time);
   void OutputLog();
 
  private:
   // 10 min * 60 sec/min * 60 frames/sec * 3 actions/frame = 108000 actions
   static const int kMaxNumActions = 10 * 60 * 60 * 3;
 
+  // Present latency histogram: bucket i counts latencies below 2^i ms, and
+  // above the previous bucket's, except for the last bucket which counts all
+  // the latencies above.
+  static const int kNumLatencyBuckets = 10;
+
   struct BufferAction {
-    enum Type { UNKNOWN, ATTACH, COMMIT, RELEASE };
+    enum Type {
+      UNKNOWN,
+      ATTACH,
+      COMMIT,
+      RELEASE,
+      COALESCED,
+      DROPPED,
+      PRESENTED
+    };
     timespec time;
     int surface_id;
     int buffer_id;
@@ -39,8 +61,14 @@ class Timing {
         : time(t), surface_id(sid), buffer_id(bid), action_type(type) {}
   };
 
+  void AddAction(const BufferAction& action);
+
   BufferAction actions[kMaxNumActions];
   int actions_idx = 0;
+  int coalesced_frames = 0;
+  int dropped_frames = 0;
+  int presented_frames = 0;
+  int latency_histogram[kNumLatencyBuckets] = {};
   int saves = 0;
   const char* filename;
 };      // class Timing
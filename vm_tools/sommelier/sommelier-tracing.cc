@@ -15,8 +15,9 @@
 #include <vector>
 #include <xcb/xproto.h>
 
-#include "sommelier.h"      // NOLINT(build/include_directory)
-#include "sommelier-ctx.h"  // NOLINT(build/include_directory)
+#include "sommelier.h"              // NOLINT(build/include_directory)
+#include "sommelier-ctx.h"          // NOLINT(build/include_directory)
+#include "sommelier-damage-copy.h"  // NOLINT(build/include_directory)
 
 #if defined(_M_IA64) || defined(_M_IX86) || defined(__ia64__) ||      \
     defined(__i386__) || defined(__amd64__) || defined(__x86_64__) || \
@@ -471,6 +472,23 @@ void perfetto_annotate_time_sync(const perfetto::EventContext& perfetto) {
   dbg->set_uint_value(cpu_time);
 }
 
+// The time spent copying is the duration of the annotated event.
+void perfetto_annotate_damage_copy(const perfetto::EventContext& perfetto,
+                                   const sl_damage_copy_stats& stats) {
+  auto* dbg = perfetto.event()->add_debug_annotations();
+  dbg->set_name("bytes");
+  dbg->set_uint_value(stats.bytes);
+  dbg = perfetto.event()->add_debug_annotations();
+  dbg->set_name("spans");
+  dbg->set_uint_value(stats.spans);
+  dbg = perfetto.event()->add_debug_annotations();
+  dbg->set_name("threads");
+  dbg->set_uint_value(stats.threads);
+  dbg = perfetto.event()->add_debug_annotations();
+  dbg->set_name("streaming");
+  dbg->set_bool_value(stats.streaming);
+}
+
 #else
 
 // Stubs.
@@ -42,6 +42,8 @@ void perfetto_annotate_cardinal_list(const perfetto::EventContext& perfetto,
                                      const char* event_name,
                                      xcb_get_property_reply_t* reply);
 void perfetto_annotate_time_sync(const perfetto::EventContext& perfetto);
+void perfetto_annotate_damage_copy(const perfetto::EventContext& perfetto,
+                                   const struct sl_damage_copy_stats& stats);
 
 #else
 #define TRACE_EVENT(category, name, ...)
@@ -3047,7 +3047,9 @@ static void sl_print_usage() {
       "  --virtwl-device=DEVICE\tVirtWL device to use\n"
       "  --drm-device=DEVICE\t\tDRM device to use\n"
       "  --glamor\t\t\tUse glamor to accelerate X11 clients\n"
-      "  --timing-filename=PATH\tPath to timing output log\n"
+      "  --timing-filename=PATH\tPath to timing output log (requests a host\n"
+      "\t\t\t\tframe callback for every commit)\n"
+      "  --frame-pacing\t\tHold back frames the host cannot present yet\n"
 #ifdef PERFETTO_TRACING
       "  --trace-filename=PATH\t\tPath to Perfetto trace filename\n"
       "  --trace-system\t\tPerfetto trace to system daemon\n"
@@ -3175,6 +3177,8 @@ int real_main(int argc, char** argv) {
       xfont_path = sl_arg_value(arg);
     } else if (strstr(arg, "--timing-filename") == arg) {
       ctx.timing = new Timing(sl_arg_value(arg));
+    } else if (strstr(arg, "--frame-pacing") == arg) {
+      ctx.frame_pacing = true;
     } else if (strstr(arg, "--explicit-fence") == arg) {
       ctx.use_explicit_fence = true;
     } else if (strstr(arg, "--virtgpu-channel") == arg) {
@@ -3674,6 +3678,8 @@ int real_main(int argc, char** argv) {
     }
     if (wl_display_flush(ctx.display) < 0)
       return EXIT_FAILURE;
+    if (ctx.channel->flush() < 0)
+      return EXIT_FAILURE;
 
     if (wl_event_loop_dispatch(event_loop, -1) == -1) {
       // Ignore EINTR or sommelier will exit when attached by strace or gdb.
@@ -7,16 +7,18 @@
 
 #include <linux/types.h>
 #include <sys/types.h>
+#include <time.h>
 #include <wayland-server.h>
 #include <wayland-util.h>
 #include <xcb/xcb.h>
 #include <xkbcommon/xkbcommon.h>
 
-#include "sommelier-ctx.h"     // NOLINT(build/include_directory)
-#include "sommelier-global.h"  // NOLINT(build/include_directory)
-#include "sommelier-mmap.h"    // NOLINT(build/include_directory)
-#include "sommelier-util.h"    // NOLINT(build/include_directory)
-#include "sommelier-window.h"  // NOLINT(build/include_directory)
+#include "sommelier-ctx.h"          // NOLINT(build/include_directory)
+#include "sommelier-damage-copy.h"  // NOLINT(build/include_directory)
+#include "sommelier-global.h"       // NOLINT(build/include_directory)
+#include "sommelier-mmap.h"         // NOLINT(build/include_directory)
+#include "sommelier-util.h"         // NOLINT(build/include_directory)
+#include "sommelier-window.h"       // NOLINT(build/include_directory)
 
 #define SOMMELIER_VERSION "0.20"
 
@@ -145,6 +147,39 @@ struct sl_host_surface {
   struct zwp_linux_surface_synchronization_v1* surface_sync;
   struct wl_list released_buffers;
   struct wl_list busy_buffers;
+  // Damage of the next commit, in surface and buffer coordinates.
+  pixman_region32_t pending_surface_damage;
+  pixman_region32_t pending_buffer_damage;
+  struct sl_damage_history damage_history;
+  // Frame pacing, see sl_host_surface_commit(). Surfaces whose commits are
+  // tied to another surface's, or that need the lowest latency, such as
+  // subsurfaces and cursors, are not paced.
+  bool paced;
+  // Frame callback of the last commit sent to the host, if not done yet.
+  struct wl_callback* pacing_callback;
+  // Whether the last commit of the client is held back.
+  bool commit_pending;
+  // Contents of the last commit of the client until they are copied, kept
+  // apart from |contents_shm_mmap| and |current_buffer|, which a new attach
+  // replaces before the client commits it.
+  struct sl_mmap* committed_shm_mmap;
+  struct sl_output_buffer* committed_buffer;
+  uint32_t committed_width;
+  uint32_t committed_height;
+  // Whether a buffer was attached since the last commit of the client, and
+  // since the last commit sent to the host.
+  bool buffer_attached;
+  bool committed_buffer_attached;
+  // Attach of the client while a commit is held back, sent to the host along
+  // with the next commit.
+  bool attach_deferred;
+  struct wl_buffer* deferred_attach_proxy;
+  int32_t deferred_attach_x;
+  int32_t deferred_attach_y;
+  // Time of the last commit of the client, and of the last one sent to the
+  // host (CLOCK_MONOTONIC).
+  struct timespec commit_time;
+  struct timespec presented_commit_time;
 };
 
 struct sl_host_region {
@@ -3,19 +3,30 @@
 // found in the LICENSE file.
 
 #include <ctype.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <unistd.h>
 #include <wayland-client.h>
 #include <wayland-util.h>
 
-#include "sommelier.h"  // NOLINT(build/include_directory)
+#include "sommelier.h"                       // NOLINT(build/include_directory)
+#include "sommelier-damage-copy.h"           // NOLINT(build/include_directory)
+#include "sommelier-mmap.h"                  // NOLINT(build/include_directory)
 #include "virtualization/wayland_channel.h"  // NOLINT(build/include_directory)
 
 #include "aura-shell-client-protocol.h"      // NOLINT(build/include_directory)
+#include "drm-client-protocol.h"             // NOLINT(build/include_directory)
 #include "xdg-shell-client-protocol.h"       // NOLINT(build/include_directory)
 
 // Help gtest print Wayland message streams on expectation failure.
@@ -266,6 +277,21 @@ TEST_F(WaylandTest, CanCommitToEmptySurface) {
   wl_surface_commit(surface);
 }
 
+TEST_F(WaylandTest, ForwardsAllPendingRequestsInOneEvent) {
+  Pump();  // exclude pending messages from EXPECT_CALL()s below
+  ON_CALL(mock_wayland_channel_, max_send_size()).WillByDefault(Return(8));
+
+  // Act: Send 44 bytes of requests, which take 6 reads of 8 bytes.
+  wl_surface* surface = wl_compositor_create_surface(ctx.compositor->internal);
+  for (int i = 0; i < 4; i++)
+    wl_surface_commit(surface);
+
+  // Assert: They are all forwarded to the channel by a single dispatch, so
+  // that it can submit them to the host together.
+  EXPECT_CALL(mock_wayland_channel_, send(_)).Times(6);
+  Pump();
+}
+
 TEST_F(X11Test, TogglesFullscreenOnWmStateFullscreen) {
   // Arrange: Create an xdg_toplevel surface. Initially it's not fullscreen.
   sl_window* window = CreateToplevelWindow();
@@ -531,6 +557,497 @@ TEST_F(X11Test, IconifySuppressesStateChanges) {
 }
 #endif
 
+namespace {
+// Name and version of a global advertised to the client.
+struct Global {
+  uint32_t name;
+  uint32_t version;
+};
+
+void RegistryGlobal(void* data,
+                    wl_registry* registry,
+                    uint32_t name,
+                    const char* interface,
+                    uint32_t version) {
+  (*static_cast<std::map<std::string, Global>*>(data))[interface] = {name,
+                                                                      version};
+}
+
+void RegistryGlobalRemove(void* data, wl_registry* registry, uint32_t name) {}
+
+const wl_registry_listener kRegistryListener = {RegistryGlobal,
+                                                RegistryGlobalRemove};
+
+void BufferRelease(void* data, wl_buffer* buffer) {
+  ++*static_cast<int*>(data);
+}
+
+const wl_buffer_listener kBufferListener = {BufferRelease};
+}  // namespace
+
+// Fixture for frame pacing tests, which drive Sommelier from a real Wayland
+// client connected to it, as the host is mocked.
+class FramePacingTest : public WaylandTest {
+ public:
+  void SetUp() override {
+    WaylandTest::SetUp();
+
+    // Back the buffers Sommelier copies shm contents to with memory.
+    ON_CALL(mock_wayland_channel_, allocate(_, _))
+        .WillByDefault([](const WaylandBufferCreateInfo& create_info,
+                          WaylandBufferCreateOutput& create_output) {
+          create_output.fd = memfd_create("sommelier_test", MFD_CLOEXEC);
+          EXPECT_EQ(ftruncate(create_output.fd, create_info.size), 0);
+          create_output.host_size = create_info.size;
+          return 0;
+        });
+    ON_CALL(mock_wayland_channel_, send(_))
+        .WillByDefault([this](const WaylandSendReceive& send) {
+          RecordMessages(send);
+          return 0;
+        });
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+    ctx.client = wl_client_create(ctx.host_display, fds[0]);
+    sl_set_display_implementation(&ctx);
+    client_display_ = wl_display_connect_to_fd(fds[1]);
+    registry_ = wl_display_get_registry(client_display_);
+    wl_registry_add_listener(registry_, &kRegistryListener, &globals_);
+    PumpClient();
+
+    compositor_ = static_cast<wl_compositor*>(Bind(&wl_compositor_interface));
+    shm_ = static_cast<wl_shm*>(Bind(&wl_shm_interface));
+    xdg_wm_base_ = static_cast<xdg_wm_base*>(Bind(&xdg_wm_base_interface));
+    PumpClient();
+  }
+
+  void TearDown() override {
+    WaylandTest::TearDown();
+    wl_display_disconnect(client_display_);
+  }
+
+ protected:
+  static constexpr int32_t kWidth = 16;
+  static constexpr int32_t kHeight = 16;
+  static constexpr int32_t kStride = kWidth * 4;
+
+  void InitContext() override {
+    WaylandTest::InitContext();
+    ctx.frame_pacing = true;
+  }
+
+  void Connect() override {
+    WaylandTest::Connect();
+    wl_registry* registry = wl_display_get_registry(ctx.display);
+
+    uint32_t id = 3;
+    sl_registry_handler(&ctx, registry, id++, "wl_shm", 1);
+    sl_registry_handler(&ctx, registry, id++, "wl_subcompositor", 1);
+    sl_registry_handler(&ctx, registry, id++, "wl_seat", 5);
+    sl_registry_handler(&ctx, registry, id++, "zwp_linux_dmabuf_v1", 2);
+  }
+
+  // Exchanges the pending requests and events of the client with Sommelier,
+  // and those of Sommelier with the mock host.
+  void PumpClient() {
+    wl_display_flush(client_display_);
+    Pump();
+    Pump();
+    wl_display_flush_clients(ctx.host_display);
+
+    while (wl_display_prepare_read(client_display_) != 0)
+      wl_display_dispatch_pending(client_display_);
+    pollfd fd = {wl_display_get_fd(client_display_), POLLIN, 0};
+    if (poll(&fd, 1, 0) > 0) {
+      wl_display_read_events(client_display_);
+    } else {
+      wl_display_cancel_read(client_display_);
+    }
+    wl_display_dispatch_pending(client_display_);
+  }
+
+  void* Bind(const wl_interface* interface) {
+    auto it = globals_.find(interface->name);
+    EXPECT_TRUE(it != globals_.end()) << interface->name;
+    return wl_registry_bind(
+        registry_, it->second.name, interface,
+        std::min(it->second.version,
+                 static_cast<uint32_t>(interface->version)));
+  }
+
+  wl_surface* CreateToplevelSurface() {
+    wl_surface* surface = wl_compositor_create_surface(compositor_);
+    xdg_surface* toplevel_surface =
+        xdg_wm_base_get_xdg_surface(xdg_wm_base_, surface);
+    xdg_surface_get_toplevel(toplevel_surface);
+    PumpClient();
+    return surface;
+  }
+
+  // Creates a buffer whose bytes are all |value|.
+  wl_buffer* CreateShmBuffer(uint8_t value = 0) {
+    int fd = memfd_create("sommelier_test", MFD_CLOEXEC);
+    EXPECT_EQ(ftruncate(fd, kStride * kHeight), 0);
+    void* data = mmap(nullptr, kStride * kHeight, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    EXPECT_NE(data, MAP_FAILED);
+    memset(data, value, kStride * kHeight);
+    munmap(data, kStride * kHeight);
+    wl_shm_pool* pool = wl_shm_create_pool(shm_, fd, kStride * kHeight);
+    wl_buffer* buffer = wl_shm_pool_create_buffer(
+        pool, 0, kWidth, kHeight, kStride, WL_SHM_FORMAT_ARGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    wl_buffer_add_listener(buffer, &kBufferListener, &releases_[buffer]);
+    return buffer;
+  }
+
+  // Attaches |buffer| to |surface|, damages and commits it.
+  void Commit(wl_surface* surface, wl_buffer* buffer) {
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, kWidth, kHeight);
+    wl_surface_commit(surface);
+    PumpClient();
+  }
+
+  sl_host_surface* HostSurface(wl_surface* surface) {
+    wl_resource* resource = wl_client_get_object(
+        ctx.client, wl_proxy_get_id(reinterpret_cast<wl_proxy*>(surface)));
+    return static_cast<sl_host_surface*>(wl_resource_get_user_data(resource));
+  }
+
+  // First byte of the buffer last sent to the host for |host|.
+  uint8_t HostContents(sl_host_surface* host) {
+    EXPECT_FALSE(wl_list_empty(&host->busy_buffers));
+    sl_output_buffer* buffer =
+        wl_container_of(host->busy_buffers.next, buffer, link);
+    return static_cast<uint8_t*>(buffer->mmap->addr)[buffer->mmap->offset[0]];
+  }
+
+  // Number of commits of |host| sent to the host.
+  int HostCommits(sl_host_surface* host) {
+    auto commit = std::make_pair(
+        wl_proxy_get_id(reinterpret_cast<wl_proxy*>(host->proxy)),
+        static_cast<uint16_t>(WL_SURFACE_COMMIT));
+    return std::count(sent_messages_.begin(), sent_messages_.end(), commit);
+  }
+
+  // Pretends the host is ready for the next frame of |host|.
+  void FramePacingCallbackDone(sl_host_surface* host) {
+    ASSERT_NE(host->pacing_callback, nullptr);
+    wl_proxy* callback = reinterpret_cast<wl_proxy*>(host->pacing_callback);
+    const wl_callback_listener* listener =
+        static_cast<const wl_callback_listener*>(
+            wl_proxy_get_listener(callback));
+    listener->done(wl_proxy_get_user_data(callback), host->pacing_callback, 0);
+    PumpClient();
+  }
+
+  void RecordMessages(const WaylandSendReceive& send) {
+    size_t i = 0;
+    while (i + sizeof(uint32_t) * 2 <= send.data_size) {
+      uint32_t object_id = *reinterpret_cast<uint32_t*>(send.data + i);
+      uint32_t second_word = *reinterpret_cast<uint32_t*>(send.data + i + 4);
+      uint16_t message_size_in_bytes = second_word >> 16;
+      sent_messages_.emplace_back(object_id, second_word & 0xffff);
+      if (message_size_in_bytes < sizeof(uint32_t) * 2)
+        break;
+      i += message_size_in_bytes;
+    }
+  }
+
+  wl_display* client_display_ = nullptr;
+  wl_registry* registry_ = nullptr;
+  std::map<std::string, Global> globals_;
+  wl_compositor* compositor_ = nullptr;
+  wl_shm* shm_ = nullptr;
+  xdg_wm_base* xdg_wm_base_ = nullptr;
+  // Number of wl_buffer::release events received for each buffer.
+  std::map<wl_buffer*, int> releases_;
+  // Object ID and opcode of the messages sent to the host.
+  std::vector<std::pair<uint32_t, uint16_t>> sent_messages_;
+};
+
+TEST_F(FramePacingTest, HoldsShmCommitsUntilHostIsReady) {
+  // Arrange: The first frame is sent to the host right away.
+  wl_surface* surface = CreateToplevelSurface();
+  sl_host_surface* host = HostSurface(surface);
+  Commit(surface, CreateShmBuffer());
+  EXPECT_EQ(HostCommits(host), 1);
+
+  // Act: Commit two more frames before the host is ready for them.
+  Commit(surface, CreateShmBuffer());
+  Commit(surface, CreateShmBuffer());
+
+  // Assert: They are held back.
+  EXPECT_EQ(HostCommits(host), 1);
+  EXPECT_TRUE(host->commit_pending);
+
+  // Act: The host is ready for the next frame.
+  FramePacingCallbackDone(host);
+
+  // Assert: Only the last frame is sent, and paced in turn.
+  EXPECT_EQ(HostCommits(host), 2);
+  EXPECT_FALSE(host->commit_pending);
+  EXPECT_NE(host->pacing_callback, nullptr);
+}
+
+TEST_F(FramePacingTest, ReleasesBufferOfReplacedHeldCommit) {
+  // Arrange: Buffer A is copied and released right away, buffer B is held.
+  wl_surface* surface = CreateToplevelSurface();
+  sl_host_surface* host = HostSurface(surface);
+  wl_buffer* a = CreateShmBuffer();
+  wl_buffer* b = CreateShmBuffer();
+  wl_buffer* c = CreateShmBuffer();
+  Commit(surface, a);
+  Commit(surface, b);
+  EXPECT_EQ(releases_[a], 1);
+  EXPECT_EQ(releases_[b], 0);
+
+  // Act: Commit buffer C while B is still held.
+  Commit(surface, c);
+
+  // Assert: B will never be copied, so the client can have it back.
+  EXPECT_EQ(releases_[b], 1);
+  EXPECT_EQ(releases_[c], 0);
+
+  // Act: The host is ready for the next frame.
+  FramePacingCallbackDone(host);
+
+  // Assert: C is released once copied.
+  EXPECT_EQ(releases_[b], 1);
+  EXPECT_EQ(releases_[c], 1);
+}
+
+TEST_F(FramePacingTest, AttachDoesNotReplaceHeldCommit) {
+  // Arrange: Buffer A is sent to the host right away, buffer B is held.
+  wl_surface* surface = CreateToplevelSurface();
+  sl_host_surface* host = HostSurface(surface);
+  wl_buffer* b = CreateShmBuffer(0xbb);
+  wl_buffer* c = CreateShmBuffer(0xcc);
+  Commit(surface, CreateShmBuffer(0xaa));
+  Commit(surface, b);
+  EXPECT_TRUE(host->commit_pending);
+
+  // Act: Attach buffer C without committing it yet, then the host is ready
+  // for the next frame.
+  wl_surface_attach(surface, c, 0, 0);
+  wl_surface_damage(surface, 0, 0, kWidth, kHeight);
+  PumpClient();
+  FramePacingCallbackDone(host);
+
+  // Assert: B is the one copied and sent, then released. C is not.
+  EXPECT_EQ(HostCommits(host), 2);
+  EXPECT_EQ(HostContents(host), 0xbb);
+  EXPECT_EQ(releases_[b], 1);
+  EXPECT_EQ(releases_[c], 0);
+
+  // Act: Commit C, then the host is ready for the next frame.
+  wl_surface_commit(surface);
+  PumpClient();
+  EXPECT_TRUE(host->commit_pending);
+  FramePacingCallbackDone(host);
+
+  // Assert: C is copied and sent, then released.
+  EXPECT_EQ(HostCommits(host), 3);
+  EXPECT_EQ(HostContents(host), 0xcc);
+  EXPECT_EQ(releases_[c], 1);
+}
+
+TEST_F(FramePacingTest, DoesNotHoldSubsurfaceCommits) {
+  wl_surface* parent = CreateToplevelSurface();
+  wl_surface* surface = wl_compositor_create_surface(compositor_);
+  auto* subcompositor =
+      static_cast<wl_subcompositor*>(Bind(&wl_subcompositor_interface));
+  wl_subcompositor_get_subsurface(subcompositor, surface, parent);
+  PumpClient();
+  sl_host_surface* host = HostSurface(surface);
+
+  Commit(surface, CreateShmBuffer());
+  Commit(surface, CreateShmBuffer());
+
+  EXPECT_EQ(HostCommits(host), 2);
+  EXPECT_FALSE(host->commit_pending);
+  EXPECT_EQ(host->pacing_callback, nullptr);
+}
+
+TEST_F(FramePacingTest, DoesNotHoldCursorCommits) {
+  wl_surface* surface = wl_compositor_create_surface(compositor_);
+  auto* seat = static_cast<wl_seat*>(Bind(&wl_seat_interface));
+  wl_pointer* pointer = wl_seat_get_pointer(seat);
+  wl_pointer_set_cursor(pointer, 0, surface, 0, 0);
+  PumpClient();
+  sl_host_surface* host = HostSurface(surface);
+
+  Commit(surface, CreateShmBuffer());
+  Commit(surface, CreateShmBuffer());
+
+  EXPECT_EQ(HostCommits(host), 2);
+  EXPECT_FALSE(host->commit_pending);
+  EXPECT_EQ(host->pacing_callback, nullptr);
+}
+
+TEST_F(FramePacingTest, DoesNotHoldDmabufCommits) {
+  wl_surface* surface = CreateToplevelSurface();
+  sl_host_surface* host = HostSurface(surface);
+  auto* drm = static_cast<wl_drm*>(Bind(&wl_drm_interface));
+  wl_buffer* buffers[2];
+  for (wl_buffer*& buffer : buffers) {
+    int fd = memfd_create("sommelier_test", MFD_CLOEXEC);
+    buffer = wl_drm_create_prime_buffer(drm, fd, kWidth, kHeight,
+                                        WL_DRM_FORMAT_ARGB8888, 0, kStride, 0,
+                                        0, 0, 0);
+    close(fd);
+  }
+
+  // dma-bufs are not copied, so there is nothing to save by holding back
+  // their frames, which are still paced.
+  Commit(surface, buffers[0]);
+  Commit(surface, buffers[1]);
+
+  EXPECT_EQ(HostCommits(host), 2);
+  EXPECT_FALSE(host->commit_pending);
+  EXPECT_NE(host->pacing_callback, nullptr);
+}
+
+// Fixture for tests of the copy of damaged pixels between shm buffers.
+class DamageCopyTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kBpp = 4;
+
+  // Maps |width| by |height| pixels of |pixels|, with rows |stride| bytes
+  // apart.
+  static sl_mmap Map(std::vector<uint8_t>* pixels,
+                     int32_t width,
+                     int32_t height,
+                     size_t stride) {
+    pixels->resize(stride * height);
+    sl_mmap map = {};
+    map.addr = pixels->data();
+    map.size = pixels->size();
+    map.bpp = kBpp;
+    map.num_planes = 1;
+    map.stride[0] = stride;
+    map.y_ss[0] = 1;
+    return map;
+  }
+
+  static bool InRect(int32_t x, int32_t y, const pixman_box32_t& box) {
+    return x >= box.x1 && x < box.x2 && y >= box.y1 && y < box.y2;
+  }
+};
+
+TEST_F(DamageCopyTest, CopiesOnlyDamagedPixels) {
+  const int32_t width = 256, height = 64;
+  std::vector<uint8_t> src_pixels, dst_pixels;
+  sl_mmap src = Map(&src_pixels, width, height, width * kBpp + 32);
+  sl_mmap dst = Map(&dst_pixels, width, height, width * kBpp);
+  for (size_t i = 0; i < src_pixels.size(); ++i)
+    src_pixels[i] = i % 251 + 1;
+
+  // Two overlapping rects, one more far enough not to be merged with them,
+  // and one clamped to the buffer size.
+  const pixman_box32_t boxes[] = {{10, 10, 50, 20},
+                                   {40, 15, 60, 30},
+                                   {100, 10, 120, 20},
+                                   {250, 60, 300, 80}};
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  for (const pixman_box32_t& box : boxes) {
+    pixman_region32_union_rect(&damage, &damage, box.x1, box.y1,
+                               box.x2 - box.x1, box.y2 - box.y1);
+  }
+
+  sl_damage_copy_stats stats;
+  sl_damage_copy(&src, &dst, width, height, &damage, &stats);
+  pixman_region32_fini(&damage);
+
+  size_t expected_bytes = 0;
+  for (int32_t y = 0; y < height; ++y) {
+    for (int32_t x = 0; x < width; ++x) {
+      bool damaged = false;
+      for (const pixman_box32_t& box : boxes)
+        damaged |= InRect(x, y, box);
+      expected_bytes += damaged ? kBpp : 0;
+      const uint8_t* s = &src_pixels[y * src.stride[0] + x * kBpp];
+      const uint8_t* d = &dst_pixels[y * dst.stride[0] + x * kBpp];
+      for (size_t i = 0; i < kBpp; ++i)
+        ASSERT_EQ(damaged ? s[i] : 0, d[i]) << "x=" << x << " y=" << y;
+    }
+  }
+  // Overlapping pixels are copied once.
+  EXPECT_EQ(stats.bytes, expected_bytes);
+  EXPECT_EQ(stats.threads, 1);
+  EXPECT_FALSE(stats.streaming);
+}
+
+TEST_F(DamageCopyTest, CopiesLargeDamage) {
+  const int32_t width = 1920, height = 1080;
+  std::vector<uint8_t> src_pixels, dst_pixels;
+  sl_mmap src = Map(&src_pixels, width, height, width * kBpp);
+  sl_mmap dst = Map(&dst_pixels, width, height, width * kBpp);
+  for (size_t i = 0; i < src_pixels.size(); ++i)
+    src_pixels[i] = i % 251 + 1;
+
+  // Adjacent rects covering the whole buffer.
+  pixman_region32_t damage;
+  pixman_region32_init_rect(&damage, 0, 0, width, 333);
+  pixman_region32_union_rect(&damage, &damage, 0, 333, 1, height - 333);
+  pixman_region32_union_rect(&damage, &damage, 1, 333, width - 1,
+                             height - 333);
+
+  sl_damage_copy_stats stats;
+  sl_damage_copy(&src, &dst, width, height, &damage, &stats);
+  pixman_region32_fini(&damage);
+
+  EXPECT_EQ(src_pixels, dst_pixels);
+  EXPECT_EQ(stats.bytes, src_pixels.size());
+  // Full-width rows are contiguous and copied as a single span.
+  EXPECT_EQ(stats.spans, 1);
+}
+
+TEST(DamageHistoryTest, ReturnsDamageSinceFrame) {
+  sl_damage_history history;
+  sl_damage_history_init(&history);
+  pixman_region32_t damage, stale;
+  pixman_region32_init(&stale);
+
+  uint64_t frames[SL_DAMAGE_HISTORY_LENGTH + 1];
+  for (int i = 0; i <= SL_DAMAGE_HISTORY_LENGTH; ++i) {
+    pixman_region32_init_rect(&damage, 10 * i, 0, 10, 10);
+    frames[i] = sl_damage_history_add(&history, &damage);
+    pixman_region32_fini(&damage);
+  }
+
+  // Unknown contents.
+  EXPECT_FALSE(sl_damage_history_get_stale(&history, 0, &stale));
+  // Up to date.
+  ASSERT_TRUE(sl_damage_history_get_stale(
+      &history, frames[SL_DAMAGE_HISTORY_LENGTH], &stale));
+  EXPECT_FALSE(pixman_region32_not_empty(&stale));
+  // The damage of the last two frames.
+  ASSERT_TRUE(sl_damage_history_get_stale(
+      &history, frames[SL_DAMAGE_HISTORY_LENGTH - 2], &stale));
+  pixman_box32_t* extents = pixman_region32_extents(&stale);
+  EXPECT_EQ(extents->x1, 10 * (SL_DAMAGE_HISTORY_LENGTH - 1));
+  EXPECT_EQ(extents->x2, 10 * (SL_DAMAGE_HISTORY_LENGTH + 1));
+  // As far back as the history goes.
+  EXPECT_TRUE(sl_damage_history_get_stale(&history, frames[0], &stale));
+  EXPECT_EQ(pixman_region32_extents(&stale)->x1, 10);
+  // Too old once another frame is added.
+  pixman_region32_init_rect(&damage, 10 * (SL_DAMAGE_HISTORY_LENGTH + 1), 0,
+                            10, 10);
+  sl_damage_history_add(&history, &damage);
+  pixman_region32_fini(&damage);
+  EXPECT_FALSE(sl_damage_history_get_stale(&history, frames[0], &stale));
+  EXPECT_TRUE(sl_damage_history_get_stale(&history, frames[1], &stale));
+  EXPECT_EQ(pixman_region32_extents(&stale)->x1, 20);
+
+  pixman_region32_fini(&stale);
+  sl_damage_history_fini(&history);
+}
+
 }  // namespace sommelier
 }  // namespace vm_tools
 
@@ -40,6 +40,11 @@
 #define MAX_WRITE_SIZE \
   (DEFAULT_BUFFER_SIZE - sizeof(struct CrossDomainReadWrite))
 
+// The host walks a command buffer command by command, using the size given in
+// each header.  Queued commands are padded to keep every header aligned.
+#define MAX_BATCH_SIZE (16 * DEFAULT_BUFFER_SIZE)
+#define BATCH_ALIGNMENT (sizeof(struct CrossDomainHeader))
+
 struct virtgpu_param {
   uint64_t param;
   const char* name;
@@ -324,8 +329,7 @@ int32_t VirtGpuChannel::send(const struct WaylandSendReceive& send) {
     cmd_send->num_identifiers++;
   }
 
-  ret = submit_cmd((uint32_t*)cmd_send, cmd_send->hdr.cmd_size,
-                   CROSS_DOMAIN_RING_NONE, false);
+  ret = queue_cmd((uint32_t*)cmd_send, cmd_send->hdr.cmd_size);
   if (ret < 0)
     return ret;
 
@@ -436,8 +440,7 @@ int32_t VirtGpuChannel::handle_pipe(int read_fd, bool readable, bool& hang_up) {
       sizeof(struct CrossDomainReadWrite) + cmd_write->opaque_data_size;
   cmd_write->hang_up = hang_up;
 
-  ret = submit_cmd((uint32_t*)cmd_write, cmd_write->hdr.cmd_size,
-                   CROSS_DOMAIN_RING_NONE, false);
+  ret = queue_cmd((uint32_t*)cmd_write, cmd_write->hdr.cmd_size);
   if (ret < 0)
     return ret;
 
@@ -450,6 +453,46 @@ int32_t VirtGpuChannel::handle_pipe(int read_fd, bool readable, bool& hang_up) {
   return 0;
 }
 
+int32_t VirtGpuChannel::flush(void) {
+  int32_t ret;
+
+  if (batch_.empty())
+    return 0;
+
+  ret = submit_cmd((uint32_t*)batch_.data(), batch_.size(),
+                   CROSS_DOMAIN_RING_NONE, false);
+  batch_.clear();
+  if (ret < 0)
+    return ret;
+
+  return 0;
+}
+
+int32_t VirtGpuChannel::queue_cmd(const uint32_t* cmd, uint32_t size) {
+  int32_t ret;
+  struct CrossDomainHeader* hdr;
+  size_t offset;
+  uint32_t padded_size = (size + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1);
+
+  if (batch_.size() + padded_size > MAX_BATCH_SIZE) {
+    ret = flush();
+    if (ret < 0)
+      return ret;
+  }
+
+  if (batch_.capacity() < MAX_BATCH_SIZE)
+    batch_.reserve(MAX_BATCH_SIZE);
+
+  offset = batch_.size();
+  batch_.resize(offset + padded_size);
+  memcpy(&batch_[offset], cmd, size);
+
+  // The padding is part of the command as far as the host is concerned.
+  hdr = (struct CrossDomainHeader*)&batch_[offset];
+  hdr->cmd_size = padded_size;
+  return 0;
+}
+
 int32_t VirtGpuChannel::submit_cmd(uint32_t* cmd,
                                    uint32_t size,
                                    uint32_t ring_idx,
@@ -524,6 +567,11 @@ int32_t VirtGpuChannel::image_query(const struct WaylandBufferCreateInfo& input,
   // Assumes a gbm-like API on the host
   cmd_get_reqs.flags = GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT;
 
+  // We are about to wait on the host; don't keep it waiting on us.
+  ret = flush();
+  if (ret < 0)
+    return ret;
+
   ret = submit_cmd((uint32_t*)&cmd_get_reqs, cmd_get_reqs.hdr.cmd_size,
                    CROSS_DOMAIN_QUERY_RING, true);
   if (ret < 0)
@@ -160,6 +160,13 @@ class WaylandChannel {
   // Returns the maximum size of opaque data that the channel is able to handle
   // in the `send` function.  Must be less than or equal to DEFAULT_BUFFER_SIZE.
   virtual size_t max_send_size(void) = 0;
+
+  // Submits to the host any data that `send` or `handle_pipe` queued up
+  // instead of forwarding right away.  Must be called before waiting for
+  // events, as the host may be waiting for that data to reply.
+  //
+  // Returns 0 on success.  Returns -errno on failure.
+  virtual int32_t flush(void) { return 0; }
 };
 
 class VirtWaylandChannel : public WaylandChannel {
@@ -214,6 +221,7 @@ class VirtGpuChannel : public WaylandChannel {
   int32_t sync(int dmabuf_fd, uint64_t flags) override;
   int32_t handle_pipe(int read_fd, bool readable, bool& hang_up) override;
   size_t max_send_size(void) override;
+  int32_t flush(void) override;
 
  private:
   /*
@@ -246,6 +254,7 @@ class VirtGpuChannel : public WaylandChannel {
                      uint32_t size,
                      uint32_t ring_idx,
                      bool wait);
+  int32_t queue_cmd(const uint32_t* cmd, uint32_t size);
   int32_t channel_poll(void);
   int32_t close_gem_handle(uint32_t gem_handle);
   int32_t create_host_blob(uint64_t blob_id, uint64_t size, int& out_fd);
@@ -281,6 +290,9 @@ class VirtGpuChannel : public WaylandChannel {
 
   std::vector<BufferDescription> description_cache_;
   std::vector<PipeDescription> pipe_cache_;
+  // Commands queued by `queue_cmd` and submitted together by `flush`, so
+  // that a burst of Wayland messages costs a single trip to the host.
+  std::vector<uint8_t> batch_;
 };
 
 int open_virtgpu(char** drm_device);